@@ -559,6 +559,13 @@ typedef struct VkParserAv1PictureData {
     VkParserAv1GlobalMotionParameters ref_global_motion[7];
 } VkParserAv1PictureData;
 
+// A slice of a picture, start code prefix included, in memory owned by the
+// parser (bScatterGatherSlices)
+typedef struct VkParserSliceSegment {
+    const uint8_t* pData;
+    size_t nDataLen;
+} VkParserSliceSegment;
+
 typedef struct VkParserPictureData {
     int32_t PicWidthInMbs; // Coded Frame Size
     int32_t FrameHeightInMbs; // Coded Frame Height
@@ -596,6 +603,12 @@ typedef struct VkParserPictureData {
     } CodecSpecific;
     // Dpb Id for the setup (current picture to be reference) slot
     int8_t current_dpb_id;
+
+    // With bScatterGatherSlices, nNumSlices segments to be gathered in
+    // order, only valid until DecodePicture() returns. pBitstreamData is
+    // NULL then, while nBitstreamDataLen and pSliceDataOffsets describe the
+    // gathered data. NULL otherwise.
+    const VkParserSliceSegment* pSliceSegments;
 } VkParserPictureData;
 
 // Packet input for parsing
@@ -661,7 +674,17 @@ typedef struct VkParserSequenceInfo {
     uint32_t codecProfile;
 } VkParserSequenceInfo;
 
-struct VkParserSliceInfo;
+// Reference picture lists of a slice, as given by DecodeSliceInfo()
+typedef struct VkParserSliceInfo {
+    int32_t slice_type; // as coded, modulo 5 for H.264
+    uint32_t first_mb_in_slice; // or slice_segment_address for H.265
+    int32_t num_ref_idx_active[2]; // entries in each RefPicList
+    // Indexes into the references of the picture data, dpb[] for H.264 and
+    // RefPics[] for H.265, or -1 if missing
+    int8_t RefPicList[2][32];
+    // H.264 field pictures: bit i set if RefPicList[l][i] is a bottom field
+    uint32_t RefPicBottomFieldMask[2];
+} VkParserSliceInfo;
 
 enum {
     VK_PARSER_CAPS_MVC = 0x01,
@@ -696,6 +719,11 @@ typedef struct VkPictureParameters {
         const StdVideoH265PictureParameterSet*  pH265Pps;
     };
     uint32_t updateSequenceCount;
+    // Of the parameter sets with the same id, starting at 1, and the same
+    // for those with the same content: when a stream switches back to a
+    // parameter set it had before, the client can reuse what it built for
+    // it. A PPS converted against a different SPS gets a new one.
+    uint32_t contentGeneration;
 } VkPictureParameters;
 
 // Interface to allow decoder to communicate with the client
@@ -735,6 +763,27 @@ protected:
     virtual ~VkParserVideoDecodeClient() { }
 };
 
+// Optional extension of VkParserVideoDecodeClient, set in
+// VkParserInitDecodeParameters::pBitstreamStorage: the client provides the
+// memory the slices of every picture are written into, which is then
+// handed to DecodePicture() as pBitstreamData.
+class VkParserBitstreamStorage {
+public:
+    // Returns memory for at least nMinSize bytes of pPic's bitstream, and
+    // its actual size in pSize, or NULL on failure. pBuffer, if not NULL,
+    // is the memory previously returned for the same picture: its first
+    // nUsedSize bytes have to be at the beginning of the new one.
+    virtual uint8_t* GetBitstreamBuffer(VkPicIf* pPic, uint8_t* pBuffer,
+        size_t nUsedSize, size_t nMinSize, size_t* pSize)
+        = 0;
+
+    // The parser is done with pBuffer: DecodePicture() has returned, or
+    // the picture was dropped.
+    virtual void ReleaseBitstreamBuffer(VkPicIf* pPic, uint8_t* pBuffer) = 0;
+
+    virtual ~VkParserBitstreamStorage() { }
+};
+
 // Initialization parameters for decoder class
 typedef struct VkParserInitDecodeParameters {
     uint32_t                   interfaceVersion;
@@ -746,8 +795,60 @@ typedef struct VkParserInitDecodeParameters {
     VkParserSequenceInfo* pExternalSeqInfo; // optional external sequence header
         // data from system layer
 
-    // If set, Picture Parameters are going to be provided via UpdatePictureParameters callback
+    // Ignored: Picture Parameters are always provided via the
+    // UpdatePictureParameters callback as they arrive, and every picture
+    // also points to those it uses.
     bool     bOutOfBandPictureParameters;
+
+    // If set, ParseByteStream() doesn't copy pByteStream: the packet data is
+    // only borrowed until ParseByteStream() returns, and just the bytes the
+    // parser has to keep after that are copied.
+    bool     bZeroCopyByteStream;
+
+    // If set, the byte stream is split in access units by the parser
+    // itself and fed straight to the decoder, without a GStreamer pipeline.
+    bool     bDirectDrive;
+
+    // If set, slices are handed to DecodePicture() as pSliceSegments,
+    // pointing into the parsed byte stream, instead of being copied into
+    // pBitstreamData.
+    bool     bScatterGatherSlices;
+
+    // If not zero, pBitstreamData is aligned to nBitstreamOffsetAlignment,
+    // a power of two, and zero padded so nBitstreamDataLen is a multiple of
+    // nBitstreamSizeAlignment, ie. minBitstreamBufferOffsetAlignment and
+    // minBitstreamBufferSizeAlignment of VkVideoCapabilitiesKHR.
+    uint32_t nBitstreamOffsetAlignment;
+    uint32_t nBitstreamSizeAlignment;
+
+    // If set, slices are written into memory provided by it, instead of
+    // the parser's. nBitstreamOffsetAlignment is up to it then.
+    VkParserBitstreamStorage* pBitstreamStorage;
+
+    // If not zero, ParseByteStream() copies the packet into a queue and
+    // returns, while a thread of the parser parses the queued packets in
+    // order and calls the client callbacks. It only blocks while
+    // nAsyncQueueDepth packets are waiting, or for all of them to be parsed
+    // if bEOS is set. A parsing failure is returned by the next call.
+    uint32_t nAsyncQueueDepth;
+
+    // If set, the queued packets are parsed by the threads of a scheduler
+    // shared by all the parsers of the process, instead of one of the
+    // parser's own, with a queue of 4 packets if nAsyncQueueDepth is zero.
+    // Parsers with ready packets and a higher nSchedulerPriority go first,
+    // then those whose packets have been ready for longer, from
+    // nSchedulerLatency microseconds before, which defaults to zero.
+    bool     bSharedScheduler;
+    int32_t  nSchedulerPriority;
+    uint32_t nSchedulerLatency;
+
+    // If set, the NAL units and slice headers of an access unit are parsed
+    // while the previous one is still going through reference marking and
+    // the client callbacks, which are then called from a thread of the
+    // decoder. ParseByteStream() returns before the callbacks of the last
+    // access unit are done, unless bEOS is set. Only H.264, and ignored
+    // with bZeroCopyByteStream.
+    bool     bPipelinedParsing;
 } VkParserInitDecodeParameters;
 
 // High-level interface to video decoder (Note that parsing and decoding
@@ -757,6 +858,9 @@ public:
     virtual VkResult Initialize(VkParserInitDecodeParameters* pParserPictureData) = 0;
     virtual bool Deinitialize() = 0;
     virtual bool DecodePicture(VkParserPictureData* pParserPictureData) = 0;
+    // Fails when the client fails decoding pictures: up to 10 pictures in
+    // a row whose DecodePicture() returns false are tolerated, and the
+    // packet decoding the next one fails.
     virtual bool ParseByteStream(const VkParserBitstreamPacket* pck,
         int32_t* pParsedBytes = NULL)
         = 0;
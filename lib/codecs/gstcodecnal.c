@@ -0,0 +1,395 @@
+/* GStreamer
+ * Copyright (C) 2022 Igalia, S.L.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "gstcodecnal.h"
+
+/* SIMD kernels are only built with GCC and clang, which provide the
+ * target attribute and the cpu builtins used to pick them at runtime */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#elif defined(__GNUC__) && (defined(__aarch64__) || defined(__ARM_NEON))
+#define HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+static gboolean
+gst_codec_nal_meta_init (GstMeta * meta, gpointer params, GstBuffer * buffer)
+{
+  GstCodecNalMeta *nmeta = (GstCodecNalMeta *) meta;
+
+  nmeta->nals = NULL;
+  nmeta->n_nals = 0;
+
+  return TRUE;
+}
+
+static void
+gst_codec_nal_meta_free (GstMeta * meta, GstBuffer * buffer)
+{
+  GstCodecNalMeta *nmeta = (GstCodecNalMeta *) meta;
+
+  g_free (nmeta->nals);
+}
+
+static gboolean
+gst_codec_nal_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstCodecNalMeta *nmeta = (GstCodecNalMeta *) meta;
+
+  if (!GST_META_TRANSFORM_IS_COPY (type))
+    return FALSE;
+
+  /* offsets are only valid for a copy of the whole buffer */
+  if (((GstMetaTransformCopy *) data)->region)
+    return FALSE;
+
+  return gst_buffer_add_codec_nal_meta (dest, nmeta->nals,
+      nmeta->n_nals) != NULL;
+}
+
+GType
+gst_codec_nal_meta_api_get_type (void)
+{
+  static GType type = 0;
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("GstCodecNalMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+
+  return type;
+}
+
+const GstMetaInfo *
+gst_codec_nal_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) & meta_info)) {
+    const GstMetaInfo *mi = gst_meta_register (GST_CODEC_NAL_META_API_TYPE,
+        "GstCodecNalMeta", sizeof (GstCodecNalMeta), gst_codec_nal_meta_init,
+        gst_codec_nal_meta_free, gst_codec_nal_meta_transform);
+    g_once_init_leave ((GstMetaInfo **) & meta_info, (GstMetaInfo *) mi);
+  }
+
+  return meta_info;
+}
+
+/**
+ * gst_buffer_add_codec_nal_meta:
+ * @buffer: a byte-stream #GstBuffer
+ * @nals: (array length=n_nals): the NAL units of @buffer
+ * @n_nals: number of entries in @nals
+ *
+ * Attaches a copy of @nals to @buffer.
+ *
+ * Returns: (transfer none): the #GstCodecNalMeta on @buffer
+ */
+GstCodecNalMeta *
+gst_buffer_add_codec_nal_meta (GstBuffer * buffer, const GstCodecNal * nals,
+    guint n_nals)
+{
+  GstCodecNalMeta *meta;
+
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+  g_return_val_if_fail (nals != NULL || n_nals == 0, NULL);
+
+  meta = (GstCodecNalMeta *) gst_buffer_add_meta (buffer,
+      GST_CODEC_NAL_META_INFO, NULL);
+  if (!meta)
+    return NULL;
+
+  if (n_nals > 0) {
+    meta->nals = g_new (GstCodecNal, n_nals);
+    memcpy (meta->nals, nals, n_nals * sizeof (GstCodecNal));
+  }
+  meta->n_nals = n_nals;
+
+  return meta;
+}
+
+typedef gsize (*GstCodecNalFindFunc) (const guint8 * data, gsize size);
+
+static gsize
+find_start_code_scalar (const guint8 * data, gsize size)
+{
+  gsize i;
+
+  for (i = 0; i + 2 < size; i++) {
+    /* no start code begins at i, i + 1 nor i + 2 */
+    if (data[i + 2] > 1)
+      i += 2;
+    else if (data[i + 2] == 1 && data[i + 1] == 0 && data[i] == 0)
+      return i;
+  }
+
+  return size;
+}
+
+#if HAVE_X86_SIMD
+__attribute__ ((target ("sse2")))
+static inline __m128i
+start_code_mask_sse (const guint8 * data)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  __m128i b0 = _mm_loadu_si128 ((const __m128i *) data);
+  __m128i b1 = _mm_loadu_si128 ((const __m128i *) (data + 1));
+  __m128i b2 = _mm_loadu_si128 ((const __m128i *) (data + 2));
+
+  return _mm_and_si128 (_mm_cmpeq_epi8 (b2, _mm_set1_epi8 (1)),
+      _mm_and_si128 (_mm_cmpeq_epi8 (b0, zero), _mm_cmpeq_epi8 (b1, zero)));
+}
+
+__attribute__ ((target ("sse2")))
+static gsize
+find_start_code_sse2 (const guint8 * data, gsize size)
+{
+  gsize i = 0;
+
+  /* each block looks two bytes past its end */
+  for (; i + 18 <= size; i += 16) {
+    guint mask = (guint) _mm_movemask_epi8 (start_code_mask_sse (data + i));
+
+    if (mask)
+      return i + __builtin_ctz (mask);
+  }
+
+  return i + find_start_code_scalar (data + i, size - i);
+}
+
+__attribute__ ((target ("avx2")))
+static gsize
+find_start_code_avx2 (const guint8 * data, gsize size)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  const __m256i one = _mm256_set1_epi8 (1);
+  gsize i = 0;
+
+  for (; i + 34 <= size; i += 32) {
+    __m256i b0 = _mm256_loadu_si256 ((const __m256i *) (data + i));
+    __m256i b1 = _mm256_loadu_si256 ((const __m256i *) (data + i + 1));
+    __m256i b2 = _mm256_loadu_si256 ((const __m256i *) (data + i + 2));
+    __m256i sc = _mm256_and_si256 (_mm256_cmpeq_epi8 (b2, one),
+        _mm256_and_si256 (_mm256_cmpeq_epi8 (b0, zero),
+            _mm256_cmpeq_epi8 (b1, zero)));
+    guint mask = (guint) _mm256_movemask_epi8 (sc);
+
+    if (mask)
+      return i + __builtin_ctz (mask);
+  }
+
+  return i + find_start_code_sse2 (data + i, size - i);
+}
+
+/* Like the SSE2 version, but 64 bytes at a time, checking for matches
+ * with a single ptest. */
+__attribute__ ((target ("sse4.2")))
+static gsize
+find_start_code_sse42 (const guint8 * data, gsize size)
+{
+  gsize i = 0;
+
+  for (; i + 66 <= size; i += 64) {
+    __m128i sc0 = start_code_mask_sse (data + i);
+    __m128i sc1 = start_code_mask_sse (data + i + 16);
+    __m128i sc2 = start_code_mask_sse (data + i + 32);
+    __m128i sc3 = start_code_mask_sse (data + i + 48);
+    __m128i any = _mm_or_si128 (_mm_or_si128 (sc0, sc1), _mm_or_si128 (sc2,
+            sc3));
+    guint64 mask;
+
+    if (_mm_testz_si128 (any, any))
+      continue;
+
+    mask = (guint64) (guint) _mm_movemask_epi8 (sc0)
+        | (guint64) (guint) _mm_movemask_epi8 (sc1) << 16
+        | (guint64) (guint) _mm_movemask_epi8 (sc2) << 32
+        | (guint64) (guint) _mm_movemask_epi8 (sc3) << 48;
+
+    return i + __builtin_ctzll (mask);
+  }
+
+  return i + find_start_code_sse2 (data + i, size - i);
+}
+#endif
+
+#if HAVE_NEON
+static gsize
+find_start_code_neon (const guint8 * data, gsize size)
+{
+  const uint8x16_t zero = vdupq_n_u8 (0);
+  const uint8x16_t one = vdupq_n_u8 (1);
+  gsize i = 0;
+
+  for (; i + 18 <= size; i += 16) {
+    uint8x16_t b0 = vld1q_u8 (data + i);
+    uint8x16_t b1 = vld1q_u8 (data + i + 1);
+    uint8x16_t b2 = vld1q_u8 (data + i + 2);
+    uint8x16_t sc = vandq_u8 (vceqq_u8 (b2, one),
+        vandq_u8 (vceqq_u8 (b0, zero), vceqq_u8 (b1, zero)));
+    /* narrow to a nibble per byte */
+    guint64 mask = vget_lane_u64 (vreinterpret_u64_u8 (vshrn_n_u16
+            (vreinterpretq_u16_u8 (sc), 4)), 0);
+
+    if (mask)
+      return i + (__builtin_ctzll (mask) >> 2);
+  }
+
+  return i + find_start_code_scalar (data + i, size - i);
+}
+#endif
+
+typedef struct
+{
+  const gchar *name;
+  GstCodecNalFindFunc find;
+} GstCodecNalImpl;
+
+/* from the fastest, as measured by benchnal; the pcmpestri-free SSE4.2
+ * kernel doesn't beat the SSE2 one, being bound by memory bandwidth */
+static const GstCodecNalImpl impls[] = {
+#if HAVE_X86_SIMD
+  {"avx2", find_start_code_avx2},
+  {"sse2", find_start_code_sse2},
+  {"sse4.2", find_start_code_sse42},
+#elif HAVE_NEON
+  {"neon", find_start_code_neon},
+#endif
+  {"scalar", find_start_code_scalar},
+};
+
+static gboolean
+gst_codec_nal_impl_is_supported (const GstCodecNalImpl * impl)
+{
+#if HAVE_X86_SIMD
+  __builtin_cpu_init ();
+
+  if (impl->find == find_start_code_avx2)
+    return __builtin_cpu_supports ("avx2");
+  if (impl->find == find_start_code_sse42)
+    return __builtin_cpu_supports ("sse4.2");
+  if (impl->find == find_start_code_sse2)
+    return __builtin_cpu_supports ("sse2");
+#endif
+
+  return TRUE;
+}
+
+/* The GST_CODEC_NAL_IMPL environment variable forces an implementation,
+ * mostly to compare them. */
+static const GstCodecNalImpl *
+gst_codec_nal_get_impl (void)
+{
+  static gsize impl = 0;
+
+  if (g_once_init_enter (&impl)) {
+    const gchar *env = g_getenv ("GST_CODEC_NAL_IMPL");
+    const GstCodecNalImpl *best = NULL;
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS (impls); i++) {
+      if (!gst_codec_nal_impl_is_supported (&impls[i]))
+        continue;
+      if (!best)
+        best = &impls[i];
+      if (env && g_strcmp0 (env, impls[i].name) == 0) {
+        best = &impls[i];
+        break;
+      }
+    }
+
+    g_once_init_leave (&impl, (gsize) best);
+  }
+
+  return (const GstCodecNalImpl *) impl;
+}
+
+/**
+ * gst_codec_nal_get_impl_name:
+ *
+ * Returns: the name of the start code scanning implementation in use
+ */
+const gchar *
+gst_codec_nal_get_impl_name (void)
+{
+  return gst_codec_nal_get_impl ()->name;
+}
+
+/**
+ * gst_codec_nal_find_start_code:
+ * @data: the data to scan
+ * @size: size of @data
+ *
+ * Looks for the first 0x000001 start code prefix in @data, using the
+ * fastest implementation the CPU supports.
+ *
+ * Returns: the offset of the start code prefix, or @size if there's none
+ */
+gsize
+gst_codec_nal_find_start_code (const guint8 * data, gsize size)
+{
+  return gst_codec_nal_get_impl ()->find (data, size);
+}
+
+/**
+ * gst_codec_nal_table_fill:
+ * @table: a #GArray of #GstCodecNal
+ * @data: Annex-B byte-stream data
+ * @size: size of @data
+ *
+ * Replaces the contents of @table with the NAL units in @data, found in a
+ * single pass. Bytes before the first start code are skipped.
+ *
+ * Returns: the number of NAL units
+ */
+guint
+gst_codec_nal_table_fill (GArray * table, const guint8 * data, gsize size)
+{
+  GstCodecNalFindFunc find = gst_codec_nal_get_impl ()->find;
+  gsize pos;
+
+  g_return_val_if_fail (table != NULL, 0);
+  g_return_val_if_fail (size <= G_MAXUINT32, 0);
+
+  g_array_set_size (table, 0);
+
+  pos = find (data, size);
+  while (pos < size) {
+    gsize next = pos + 3 + find (data + pos + 3, size - pos - 3);
+    GstCodecNal nal = { (guint32) pos, (guint32) next };
+
+    /* trailing_zero_8bits and the zero_byte of the next start code */
+    while (nal.end > pos + 3 && data[nal.end - 1] == 0)
+      nal.end--;
+
+    g_array_append_val (table, nal);
+    pos = next;
+  }
+
+  return table->len;
+}
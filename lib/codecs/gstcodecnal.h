@@ -0,0 +1,85 @@
+/* GStreamer
+ * Copyright (C) 2022 Igalia, S.L.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_CODEC_NAL_H__
+#define __GST_CODEC_NAL_H__
+
+#include "codecs-prelude.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GstCodecNal GstCodecNal;
+typedef struct _GstCodecNalMeta GstCodecNalMeta;
+
+/**
+ * GstCodecNal:
+ * @sc_offset: offset of the 0x000001 start code prefix
+ * @end: offset right after the last byte of the NAL unit, trailing zero
+ *   bytes excluded
+ *
+ * Location of an Annex-B NAL unit inside a buffer.
+ */
+struct _GstCodecNal
+{
+  guint32 sc_offset;
+  guint32 end;
+};
+
+/**
+ * GstCodecNalMeta:
+ * @meta: parent #GstMeta
+ * @nals: the NAL units of the buffer, in order
+ * @n_nals: number of entries in @nals
+ *
+ * Byte-stream buffers carrying this meta are split in NAL units by the
+ * h264/h265 decoder base classes without scanning for start codes again.
+ */
+struct _GstCodecNalMeta
+{
+  GstMeta meta;
+
+  GstCodecNal *nals;
+  guint n_nals;
+};
+
+GType gst_codec_nal_meta_api_get_type (void);
+#define GST_CODEC_NAL_META_API_TYPE (gst_codec_nal_meta_api_get_type())
+
+const GstMetaInfo *gst_codec_nal_meta_get_info (void);
+#define GST_CODEC_NAL_META_INFO (gst_codec_nal_meta_get_info())
+
+#define gst_buffer_get_codec_nal_meta(b) \
+    ((GstCodecNalMeta *) gst_buffer_get_meta ((b), GST_CODEC_NAL_META_API_TYPE))
+
+GstCodecNalMeta * gst_buffer_add_codec_nal_meta (GstBuffer * buffer,
+                                                 const GstCodecNal * nals,
+                                                 guint n_nals);
+
+gsize gst_codec_nal_find_start_code (const guint8 * data,
+                                     gsize size);
+
+guint gst_codec_nal_table_fill (GArray * table,
+                                const guint8 * data,
+                                gsize size);
+
+const gchar * gst_codec_nal_get_impl_name (void);
+
+G_END_DECLS
+
+#endif /* __GST_CODEC_NAL_H__ */
@@ -60,6 +60,7 @@
 
 #include <gst/base/base.h>
 #include "gsth264decoder.h"
+#include "gstcodecnal.h"
 
 GST_DEBUG_CATEGORY (gst_h264_decoder_debug);
 #define GST_CAT_DEFAULT gst_h264_decoder_debug
@@ -78,9 +79,31 @@ typedef enum
   GST_H264_DECODER_ALIGN_AU
 } GstH264DecoderAlign;
 
+/* access units staged by handle_frame() and not decoded yet, at most */
+#define GST_H264_DECODER_PIPELINE_DEPTH 2
+
+typedef struct
+{
+  /* the header only of slices, parsed when staged */
+  GstH264Slice slice;
+  gboolean is_slice;
+} GstH264DecoderUnit;
+
+typedef struct
+{
+  /* Holds ref, mapped into map until decoded */
+  GstVideoCodecFrame *frame;
+  GstMapInfo map;
+  /* GstH264DecoderUnit of the NAL units not decoded yet, in order */
+  GArray *units;
+  /* of staging them, applied after decoding those staged before */
+  GstFlowReturn ret;
+} GstH264DecoderJob;
+
 struct _GstH264DecoderPrivate
 {
   GstH264DecoderCompliance compliance;
+  gboolean pipelined;
 
   guint8 profile_idc;
   gint width, height;
@@ -135,6 +158,7 @@ struct _GstH264DecoderPrivate
   guint preferred_output_delay;
 
   /* Reference picture lists, constructed for each frame */
+  gboolean ref_pic_lists_prepared;
   GArray *ref_pic_list_p0;
   GArray *ref_pic_list_b0;
   GArray *ref_pic_list_b1;
@@ -150,8 +174,31 @@ struct _GstH264DecoderPrivate
   GArray *ref_pic_list0;
   GArray *ref_pic_list1;
 
+  /* NAL units of the current byte-stream buffer */
+  GArray *nal_table;
+
+  /* Recycles the pictures, non-existing ones included */
+  GstH264PicturePool *picture_pool;
+
   /* For delayed output */
   GstQueueArray *output_queue;
+
+  /* Pipelined mode: handle_frame() parses the slice headers of an access
+   * unit, without the stream lock, while decode_thread does the rest for
+   * the previous ones, with it. The jobs are a ring whose indexes are
+   * only written under pipeline_lock. */
+  GThread *decode_thread;
+  GstH264DecoderJob jobs[GST_H264_DECODER_PIPELINE_DEPTH];
+  /* counts of jobs queued and decoded, the slot of a job being its count
+   * modulo the depth */
+  guint64 jobs_queued;
+  guint64 jobs_decoded;
+  gboolean pipeline_stop;
+  /* first failure of decode_thread, reported by the next handle_frame(),
+   * or by drain() and finish() */
+  GstFlowReturn pipeline_ret;
+  GMutex pipeline_lock;
+  GCond pipeline_cond;
 };
 
 typedef struct
@@ -193,6 +240,11 @@ static GstFlowReturn gst_h264_decoder_process_sps (GstH264Decoder * self,
 static GstFlowReturn gst_h264_decoder_decode_slice (GstH264Decoder * self);
 static GstFlowReturn gst_h264_decoder_decode_nal (GstH264Decoder * self,
     GstH264NalUnit * nalu);
+static GstFlowReturn gst_h264_decoder_process_slice (GstH264Decoder * self);
+static GstFlowReturn gst_h264_decoder_stage_nal (GstH264Decoder * self,
+    GstH264DecoderJob * job, GstH264NalUnit * nalu,
+    const GstH264SliceHdrMeta * hdr_meta, guint index);
+static gpointer gst_h264_decoder_decode_thread (GstH264Decoder * self);
 static gboolean gst_h264_decoder_fill_picture_from_slice (GstH264Decoder * self,
     const GstH264Slice * slice, GstH264Picture * picture);
 static gboolean gst_h264_decoder_calculate_poc (GstH264Decoder * self,
@@ -207,7 +259,8 @@ static void gst_h264_decoder_finish_picture (GstH264Decoder * self,
 static void gst_h264_decoder_prepare_ref_pic_lists (GstH264Decoder * self,
     GstH264Picture * current_picture);
 static void gst_h264_decoder_clear_ref_pic_lists (GstH264Decoder * self);
-static gboolean gst_h264_decoder_modify_ref_pic_lists (GstH264Decoder * self);
+static gboolean gst_h264_decoder_modify_ref_pic_lists (GstH264Decoder * self,
+    const GstH264SliceHdr * slice_hdr);
 static gboolean
 gst_h264_decoder_sliding_window_picture_marking (GstH264Decoder * self,
     GstH264Picture * picture);
@@ -222,6 +275,7 @@ enum
 {
   PROP_0,
   PROP_COMPLIANCE,
+  PROP_PIPELINED,
 };
 
 /**
@@ -271,6 +325,11 @@ gst_h264_decoder_get_property (GObject * object, guint property_id,
       g_value_set_enum (value, priv->compliance);
       GST_OBJECT_UNLOCK (self);
       break;
+    case PROP_PIPELINED:
+      GST_OBJECT_LOCK (self);
+      g_value_set_boolean (value, priv->pipelined);
+      GST_OBJECT_UNLOCK (self);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -290,6 +349,11 @@ gst_h264_decoder_set_property (GObject * object, guint property_id,
       priv->compliance = g_value_get_enum (value);
       GST_OBJECT_UNLOCK (self);
       break;
+    case PROP_PIPELINED:
+      GST_OBJECT_LOCK (self);
+      priv->pipelined = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (self);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -330,12 +394,25 @@ gst_h264_decoder_class_init (GstH264DecoderClass * klass)
           "The decoder's behavior in compliance with the h264 spec.",
           GST_TYPE_H264_DECODER_COMPLIANCE, GST_H264_DECODER_COMPLIANCE_AUTO,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT));
+
+  /**
+   * GstH264Decoder:pipelined:
+   *
+   * Parses the slice headers of an access unit while the previous one is
+   * still being decoded, on a thread of the decoder, which then calls the
+   * virtual methods of the subclass. Only read when the decoder starts.
+   */
+  g_object_class_install_property (object_class, PROP_PIPELINED,
+      g_param_spec_boolean ("pipelined", "Pipelined",
+          "Parse slice headers ahead of decoding, on another thread",
+          FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
 gst_h264_decoder_init (GstH264Decoder * self)
 {
   GstH264DecoderPrivate *priv;
+  guint i;
 
   gst_video_decoder_set_packetized (GST_VIDEO_DECODER (self), TRUE);
 
@@ -378,10 +455,21 @@ gst_h264_decoder_init (GstH264Decoder * self)
   priv->ref_pic_list1 = g_array_sized_new (FALSE, TRUE,
       sizeof (GstH264Picture *), 32);
 
+  priv->nal_table = g_array_sized_new (FALSE, FALSE, sizeof (GstCodecNal), 16);
+  priv->picture_pool =
+      gst_h264_picture_pool_new (GST_H264_PICTURE_POOL_DEFAULT_MAX_FREE);
+
   priv->output_queue =
       gst_queue_array_new_for_struct (sizeof (GstH264DecoderOutputFrame), 1);
   gst_queue_array_set_clear_func (priv->output_queue,
       (GDestroyNotify) gst_h264_decoder_clear_output_frame);
+
+  for (i = 0; i < GST_H264_DECODER_PIPELINE_DEPTH; i++) {
+    priv->jobs[i].units = g_array_sized_new (FALSE, FALSE,
+        sizeof (GstH264DecoderUnit), 8);
+  }
+  g_mutex_init (&priv->pipeline_lock);
+  g_cond_init (&priv->pipeline_cond);
 }
 
 static void
@@ -389,6 +477,7 @@ gst_h264_decoder_finalize (GObject * object)
 {
   GstH264Decoder *self = GST_H264_DECODER (object);
   GstH264DecoderPrivate *priv = self->priv;
+  guint i;
 
   g_array_unref (priv->ref_pic_list_p0);
   g_array_unref (priv->ref_pic_list_b0);
@@ -398,8 +487,15 @@ gst_h264_decoder_finalize (GObject * object)
   g_array_unref (priv->ref_frame_list_long_term);
   g_array_unref (priv->ref_pic_list0);
   g_array_unref (priv->ref_pic_list1);
+  g_array_unref (priv->nal_table);
+  gst_h264_picture_pool_unref (priv->picture_pool);
   gst_queue_array_free (priv->output_queue);
 
+  for (i = 0; i < GST_H264_DECODER_PIPELINE_DEPTH; i++)
+    g_array_unref (priv->jobs[i].units);
+  g_mutex_clear (&priv->pipeline_lock);
+  g_cond_clear (&priv->pipeline_cond);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -431,13 +527,71 @@ gst_h264_decoder_start (GstVideoDecoder * decoder)
   priv->parser = gst_h264_nal_parser_new ();
   priv->dpb = gst_h264_dpb_new ();
 
+  GST_OBJECT_LOCK (self);
+  if (priv->pipelined) {
+    priv->jobs_queued = priv->jobs_decoded = 0;
+    priv->pipeline_stop = FALSE;
+    priv->pipeline_ret = GST_FLOW_OK;
+    priv->decode_thread = g_thread_new ("h264decode",
+        (GThreadFunc) gst_h264_decoder_decode_thread, self);
+  }
+  GST_OBJECT_UNLOCK (self);
+
   return TRUE;
 }
 
+/* Waits until at most pending jobs are left to decode. */
+static void
+gst_h264_decoder_wait_jobs (GstH264Decoder * self, guint64 pending)
+{
+  GstH264DecoderPrivate *priv = self->priv;
+
+  g_mutex_lock (&priv->pipeline_lock);
+  while (priv->jobs_queued - priv->jobs_decoded > pending)
+    g_cond_wait (&priv->pipeline_cond, &priv->pipeline_lock);
+  g_mutex_unlock (&priv->pipeline_lock);
+}
+
+/* For the virtual methods called with the stream lock held, once, before
+ * touching anything decode_thread does. Returns the failure of
+ * decode_thread not reported yet, if any, which is then forgotten. */
+static GstFlowReturn
+gst_h264_decoder_wait_pipeline (GstH264Decoder * self)
+{
+  GstH264DecoderPrivate *priv = self->priv;
+  GstFlowReturn ret;
+
+  if (!priv->decode_thread)
+    return GST_FLOW_OK;
+
+  GST_VIDEO_DECODER_STREAM_UNLOCK (self);
+  gst_h264_decoder_wait_jobs (self, 0);
+
+  g_mutex_lock (&priv->pipeline_lock);
+  ret = priv->pipeline_ret;
+  priv->pipeline_ret = GST_FLOW_OK;
+  g_mutex_unlock (&priv->pipeline_lock);
+  GST_VIDEO_DECODER_STREAM_LOCK (self);
+
+  return ret;
+}
+
 static gboolean
 gst_h264_decoder_stop (GstVideoDecoder * decoder)
 {
   GstH264Decoder *self = GST_H264_DECODER (decoder);
+  GstH264DecoderPrivate *priv = self->priv;
+
+  /* without the stream lock, and after streaming stopped */
+  if (priv->decode_thread) {
+    g_mutex_lock (&priv->pipeline_lock);
+    priv->pipeline_stop = TRUE;
+    g_cond_broadcast (&priv->pipeline_cond);
+    g_mutex_unlock (&priv->pipeline_lock);
+
+    g_thread_join (priv->decode_thread);
+    priv->decode_thread = NULL;
+  }
 
   gst_h264_decoder_reset (self);
 
@@ -491,6 +645,8 @@ gst_h264_decoder_flush (GstVideoDecoder * decoder)
 {
   GstH264Decoder *self = GST_H264_DECODER (decoder);
 
+  /* a failure of the frames flushed is of no use after them */
+  gst_h264_decoder_wait_pipeline (self);
   gst_h264_decoder_clear_dpb (self, TRUE);
 
   return TRUE;
@@ -500,9 +656,16 @@ static GstFlowReturn
 gst_h264_decoder_drain (GstVideoDecoder * decoder)
 {
   GstH264Decoder *self = GST_H264_DECODER (decoder);
+  GstFlowReturn ret, drain_ret;
+
+  /* the last frames might have failed after handle_frame() returned */
+  ret = gst_h264_decoder_wait_pipeline (self);
 
   /* dpb will be cleared by this method */
-  return gst_h264_decoder_drain_internal (self);
+  drain_ret = gst_h264_decoder_drain_internal (self);
+  UPDATE_FLOW_RETURN (&ret, drain_ret);
+
+  return ret;
 }
 
 static GstFlowReturn
@@ -511,56 +674,135 @@ gst_h264_decoder_finish (GstVideoDecoder * decoder)
   return gst_h264_decoder_drain (decoder);
 }
 
+static gboolean
+gst_h264_decoder_nal_is_slice (GstH264NalUnitType type)
+{
+  switch (type) {
+    case GST_H264_NAL_SLICE:
+    case GST_H264_NAL_SLICE_DPA:
+    case GST_H264_NAL_SLICE_DPB:
+    case GST_H264_NAL_SLICE_DPC:
+    case GST_H264_NAL_SLICE_IDR:
+    case GST_H264_NAL_SLICE_EXT:
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+/* Fills slice with the header of the index-th slice of hdr_meta, bound to
+ * the PPS of our parser with its id. Returns FALSE if there is none. */
+static gboolean
+gst_h264_decoder_fill_slice (GstH264Decoder * self, GstH264NalUnit * nalu,
+    const GstH264SliceHdrMeta * hdr_meta, guint index, GstH264Slice * slice)
+{
+  GstH264PPS *pps;
+
+  if (!hdr_meta || index >= hdr_meta->n_headers)
+    return FALSE;
+
+  pps = &self->priv->parser->pps[hdr_meta->pps_ids[index]];
+  if (!pps->valid)
+    return FALSE;
+
+  memset (slice, 0, sizeof (GstH264Slice));
+  slice->header = hdr_meta->headers[index];
+  slice->header.pps = pps;
+  slice->nalu = *nalu;
+
+  return TRUE;
+}
+
+/* As gst_h264_decoder_decode_nal() for a slice, but with its header from
+ * hdr_meta if there. */
 static GstFlowReturn
-gst_h264_decoder_handle_frame (GstVideoDecoder * decoder,
-    GstVideoCodecFrame * frame)
+gst_h264_decoder_decode_slice_nal (GstH264Decoder * self,
+    GstH264NalUnit * nalu, const GstH264SliceHdrMeta * hdr_meta, guint index)
+{
+  if (!gst_h264_decoder_fill_slice (self, nalu, hdr_meta, index,
+          &self->priv->current_slice))
+    return gst_h264_decoder_decode_nal (self, nalu);
+
+  return gst_h264_decoder_process_slice (self);
+}
+
+/* Decodes the NAL units of the mapped input buffer of the current frame
+ * or, with job, stages them, until one fails. */
+static GstFlowReturn
+gst_h264_decoder_handle_nals (GstH264Decoder * self, GstBuffer * in_buf,
+    GstMapInfo * map, GstH264DecoderJob * job)
 {
-  GstH264Decoder *self = GST_H264_DECODER (decoder);
   GstH264DecoderPrivate *priv = self->priv;
-  GstBuffer *in_buf = frame->input_buffer;
   GstH264NalUnit nalu;
   GstH264ParserResult pres;
-  GstMapInfo map;
   GstFlowReturn decode_ret = GST_FLOW_OK;
+  GstCodecNalMeta *nal_meta;
+  guint i;
 
-  GST_LOG_OBJECT (self,
-      "handle frame, PTS: %" GST_TIME_FORMAT ", DTS: %"
-      GST_TIME_FORMAT, GST_TIME_ARGS (GST_BUFFER_PTS (in_buf)),
-      GST_TIME_ARGS (GST_BUFFER_DTS (in_buf)));
-
-  priv->current_frame = frame;
-
-  gst_buffer_map (in_buf, &map, GST_MAP_READ);
   if (priv->in_format == GST_H264_DECODER_FORMAT_AVC) {
     pres = gst_h264_parser_identify_nalu_avc (priv->parser,
-        map.data, 0, map.size, priv->nal_length_size, &nalu);
+        map->data, 0, map->size, priv->nal_length_size, &nalu);
 
     while (pres == GST_H264_PARSER_OK && decode_ret == GST_FLOW_OK) {
-      decode_ret = gst_h264_decoder_decode_nal (self, &nalu);
+      if (job)
+        decode_ret = gst_h264_decoder_stage_nal (self, job, &nalu, NULL, 0);
+      else
+        decode_ret = gst_h264_decoder_decode_nal (self, &nalu);
 
       pres = gst_h264_parser_identify_nalu_avc (priv->parser,
-          map.data, nalu.offset + nalu.size, map.size, priv->nal_length_size,
+          map->data, nalu.offset + nalu.size, map->size, priv->nal_length_size,
           &nalu);
     }
   } else {
-    pres = gst_h264_parser_identify_nalu (priv->parser,
-        map.data, 0, map.size, &nalu);
+    const GstCodecNal *nals;
+    guint n_nals;
+    GstH264SliceHdrMeta *hdr_meta;
+    guint n_slices = 0;
+
+    nal_meta = gst_buffer_get_codec_nal_meta (in_buf);
+    if (nal_meta) {
+      /* already split by upstream */
+      nals = nal_meta->nals;
+      n_nals = nal_meta->n_nals;
+    } else {
+      n_nals = gst_codec_nal_table_fill (priv->nal_table, map->data, map->size);
+      nals = (const GstCodecNal *) priv->nal_table->data;
+    }
 
-    if (pres == GST_H264_PARSER_NO_NAL_END)
-      pres = GST_H264_PARSER_OK;
+    hdr_meta = gst_buffer_get_h264_slice_hdr_meta (in_buf);
 
-    while (pres == GST_H264_PARSER_OK && decode_ret == GST_FLOW_OK) {
-      decode_ret = gst_h264_decoder_decode_nal (self, &nalu);
+    for (i = 0; i < n_nals && decode_ret == GST_FLOW_OK; i++) {
+      pres = gst_h264_parser_identify_nalu_unchecked (priv->parser,
+          map->data, nals[i].sc_offset, nals[i].end, &nalu);
+      if (pres != GST_H264_PARSER_OK)
+        break;
 
-      pres = gst_h264_parser_identify_nalu (priv->parser,
-          map.data, nalu.offset + nalu.size, map.size, &nalu);
+      if (job) {
+        decode_ret = gst_h264_decoder_stage_nal (self, job, &nalu, hdr_meta,
+            n_slices);
+      } else if (gst_h264_decoder_nal_is_slice (nalu.type)) {
+        decode_ret = gst_h264_decoder_decode_slice_nal (self, &nalu, hdr_meta,
+            n_slices);
+      } else {
+        decode_ret = gst_h264_decoder_decode_nal (self, &nalu);
+      }
 
-      if (pres == GST_H264_PARSER_NO_NAL_END)
-        pres = GST_H264_PARSER_OK;
+      if (gst_h264_decoder_nal_is_slice (nalu.type))
+        n_slices++;
     }
   }
 
-  gst_buffer_unmap (in_buf, &map);
+  return decode_ret;
+}
+
+/* Once every NAL unit of frame is decoded, or one failed with decode_ret.
+ * The input buffer is still mapped, since the subclass might keep pointers
+ * into it up to end_picture(). */
+static GstFlowReturn
+gst_h264_decoder_end_frame (GstH264Decoder * self, GstVideoCodecFrame * frame,
+    GstFlowReturn decode_ret)
+{
+  GstH264DecoderPrivate *priv = self->priv;
 
   if (decode_ret != GST_FLOW_OK) {
     if (decode_ret == GST_FLOW_ERROR) {
@@ -568,7 +810,7 @@ gst_h264_decoder_handle_frame (GstVideoDecoder * decoder,
           ("Failed to decode data"), (NULL), decode_ret);
     }
 
-    gst_video_decoder_drop_frame (decoder, frame);
+    gst_video_decoder_drop_frame (GST_VIDEO_DECODER (self), frame);
     gst_clear_h264_picture (&priv->current_picture);
     priv->current_frame = NULL;
 
@@ -587,6 +829,193 @@ gst_h264_decoder_handle_frame (GstVideoDecoder * decoder,
   return decode_ret;
 }
 
+/* With the stream lock, decodes the NAL units staged in job so far, for
+ * the current frame. */
+static GstFlowReturn
+gst_h264_decoder_decode_units (GstH264Decoder * self, GstH264DecoderJob * job)
+{
+  GstH264DecoderPrivate *priv = self->priv;
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint i;
+
+  for (i = 0; i < job->units->len && ret == GST_FLOW_OK; i++) {
+    GstH264DecoderUnit *unit =
+        &g_array_index (job->units, GstH264DecoderUnit, i);
+
+    if (unit->is_slice) {
+      priv->current_slice = unit->slice;
+      ret = gst_h264_decoder_process_slice (self);
+    } else {
+      ret = gst_h264_decoder_decode_nal (self, &unit->slice.nalu);
+    }
+  }
+
+  g_array_set_size (job->units, 0);
+
+  return ret;
+}
+
+/* Without the stream lock, keeps the NAL unit in job, along with the
+ * header of slices, for decode_thread. A slice takes the index-th header
+ * of hdr_meta, if there. */
+static GstFlowReturn
+gst_h264_decoder_stage_nal (GstH264Decoder * self, GstH264DecoderJob * job,
+    GstH264NalUnit * nalu, const GstH264SliceHdrMeta * hdr_meta, guint index)
+{
+  GstH264DecoderPrivate *priv = self->priv;
+  GstH264DecoderUnit *unit;
+  GstH264ParserResult pres;
+  GstFlowReturn ret;
+
+  switch (nalu->type) {
+    case GST_H264_NAL_SPS:
+    case GST_H264_NAL_PPS:
+      /* They replace the ones the staged slice headers point to, and go to
+       * the subclass, so they are decoded right here, after the NAL units
+       * before them, while decode_thread has nothing else to do. */
+      gst_h264_decoder_wait_jobs (self, 0);
+
+      GST_VIDEO_DECODER_STREAM_LOCK (self);
+      priv->current_frame = job->frame;
+      ret = gst_h264_decoder_decode_units (self, job);
+      if (ret == GST_FLOW_OK)
+        ret = gst_h264_decoder_decode_nal (self, nalu);
+      GST_VIDEO_DECODER_STREAM_UNLOCK (self);
+
+      return ret;
+    default:
+      break;
+  }
+
+  g_array_set_size (job->units, job->units->len + 1);
+  unit = &g_array_index (job->units, GstH264DecoderUnit, job->units->len - 1);
+  memset (&unit->slice, 0, sizeof (GstH264Slice));
+  unit->slice.nalu = *nalu;
+  unit->is_slice = FALSE;
+
+  if (!gst_h264_decoder_nal_is_slice (nalu->type))
+    return GST_FLOW_OK;
+
+  if (!gst_h264_decoder_fill_slice (self, nalu, hdr_meta, index,
+          &unit->slice)) {
+    pres = gst_h264_parser_parse_slice_hdr (priv->parser, nalu,
+        &unit->slice.header, TRUE, TRUE);
+    if (pres != GST_H264_PARSER_OK) {
+      GST_ERROR_OBJECT (self, "Failed to parse slice header, ret %d", pres);
+      g_array_set_size (job->units, job->units->len - 1);
+
+      return GST_FLOW_ERROR;
+    }
+  }
+  unit->is_slice = TRUE;
+
+  return GST_FLOW_OK;
+}
+
+static gpointer
+gst_h264_decoder_decode_thread (GstH264Decoder * self)
+{
+  GstH264DecoderPrivate *priv = self->priv;
+  GstH264DecoderJob *job;
+  GstBuffer *in_buf;
+  GstFlowReturn ret;
+
+  g_mutex_lock (&priv->pipeline_lock);
+  for (;;) {
+    while (priv->jobs_decoded == priv->jobs_queued && !priv->pipeline_stop)
+      g_cond_wait (&priv->pipeline_cond, &priv->pipeline_lock);
+    if (priv->jobs_decoded == priv->jobs_queued)
+      break;
+
+    job = &priv->jobs[priv->jobs_decoded % GST_H264_DECODER_PIPELINE_DEPTH];
+    g_mutex_unlock (&priv->pipeline_lock);
+
+    GST_VIDEO_DECODER_STREAM_LOCK (self);
+    priv->current_frame = job->frame;
+    in_buf = gst_buffer_ref (job->frame->input_buffer);
+    ret = gst_h264_decoder_decode_units (self, job);
+    if (ret == GST_FLOW_OK)
+      ret = job->ret;
+    ret = gst_h264_decoder_end_frame (self, job->frame, ret);
+    job->frame = NULL;
+    GST_VIDEO_DECODER_STREAM_UNLOCK (self);
+
+    gst_buffer_unmap (in_buf, &job->map);
+    gst_buffer_unref (in_buf);
+
+    g_mutex_lock (&priv->pipeline_lock);
+    UPDATE_FLOW_RETURN (&priv->pipeline_ret, ret);
+    priv->jobs_decoded++;
+    g_cond_broadcast (&priv->pipeline_cond);
+  }
+  g_mutex_unlock (&priv->pipeline_lock);
+
+  return NULL;
+}
+
+/* Stages the NAL units of frame without the stream lock, so decode_thread
+ * can decode those of the previous frames meanwhile, and queues them. */
+static GstFlowReturn
+gst_h264_decoder_queue_frame (GstH264Decoder * self, GstVideoCodecFrame * frame)
+{
+  GstH264DecoderPrivate *priv = self->priv;
+  GstH264DecoderJob *job;
+  GstFlowReturn ret;
+
+  GST_VIDEO_DECODER_STREAM_UNLOCK (self);
+
+  /* only queued from here, so the count can be read without the lock */
+  gst_h264_decoder_wait_jobs (self, GST_H264_DECODER_PIPELINE_DEPTH - 1);
+  job = &priv->jobs[priv->jobs_queued % GST_H264_DECODER_PIPELINE_DEPTH];
+
+  job->frame = frame;
+  gst_buffer_map (frame->input_buffer, &job->map, GST_MAP_READ);
+  job->ret = gst_h264_decoder_handle_nals (self, frame->input_buffer,
+      &job->map, job);
+
+  g_mutex_lock (&priv->pipeline_lock);
+  priv->jobs_queued++;
+  g_cond_broadcast (&priv->pipeline_cond);
+  ret = priv->pipeline_ret;
+  priv->pipeline_ret = GST_FLOW_OK;
+  g_mutex_unlock (&priv->pipeline_lock);
+
+  GST_VIDEO_DECODER_STREAM_LOCK (self);
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_h264_decoder_handle_frame (GstVideoDecoder * decoder,
+    GstVideoCodecFrame * frame)
+{
+  GstH264Decoder *self = GST_H264_DECODER (decoder);
+  GstH264DecoderPrivate *priv = self->priv;
+  GstBuffer *in_buf = frame->input_buffer;
+  GstMapInfo map;
+  GstFlowReturn decode_ret;
+
+  GST_LOG_OBJECT (self,
+      "handle frame, PTS: %" GST_TIME_FORMAT ", DTS: %"
+      GST_TIME_FORMAT, GST_TIME_ARGS (GST_BUFFER_PTS (in_buf)),
+      GST_TIME_ARGS (GST_BUFFER_DTS (in_buf)));
+
+  if (priv->decode_thread)
+    return gst_h264_decoder_queue_frame (self, frame);
+
+  priv->current_frame = frame;
+
+  /* kept past the frame, which end_frame() may release */
+  gst_buffer_ref (in_buf);
+  gst_buffer_map (in_buf, &map, GST_MAP_READ);
+  decode_ret = gst_h264_decoder_handle_nals (self, in_buf, &map, NULL);
+  decode_ret = gst_h264_decoder_end_frame (self, frame, decode_ret);
+  gst_buffer_unmap (in_buf, &map);
+  gst_buffer_unref (in_buf);
+
+  return decode_ret;
+}
+
 static GstFlowReturn
 gst_h264_decoder_parse_sps (GstH264Decoder * self, GstH264NalUnit * nalu)
 {
@@ -605,7 +1034,7 @@ gst_h264_decoder_parse_sps (GstH264Decoder * self, GstH264NalUnit * nalu)
   GST_LOG_OBJECT (self, "SPS parsed");
 
   if (klass->update_picture_parameters)
-    klass->update_picture_parameters (self, GST_H264_NAL_SPS, &sps);
+    klass->update_picture_parameters (self, GST_H264_NAL_SPS, &sps, nalu);
 
   ret = gst_h264_decoder_process_sps (self, &sps);
   if (ret != GST_FLOW_OK) {
@@ -639,13 +1068,11 @@ gst_h264_decoder_parse_pps (GstH264Decoder * self, GstH264NalUnit * nalu)
   GST_LOG_OBJECT (self, "PPS parsed");
 
   if (klass->update_picture_parameters)
-      klass->update_picture_parameters (self, GST_H264_NAL_PPS, &pps);
+      klass->update_picture_parameters (self, GST_H264_NAL_PPS, &pps, nalu);
 
-  if (pps.num_slice_groups_minus1 > 0) {
-    GST_FIXME_OBJECT (self, "FMO is not supported");
-    ret = GST_FLOW_ERROR;
-  } else if (gst_h264_parser_update_pps (priv->parser, &pps)
-      != GST_H264_PARSER_OK) {
+  /* slice groups (FMO) don't change how pictures are managed: the
+   * subclass provides the map */
+  if (gst_h264_parser_update_pps (priv->parser, &pps) != GST_H264_PARSER_OK) {
     GST_WARNING_OBJECT (self, "Failed to update PPS");
     ret = GST_FLOW_ERROR;
   }
@@ -988,7 +1415,8 @@ gst_h264_decoder_handle_frame_num_gap (GstH264Decoder * self, gint frame_num)
   unused_short_term_frame_num =
       (priv->prev_ref_frame_num + 1) % priv->max_frame_num;
   while (unused_short_term_frame_num != frame_num) {
-    GstH264Picture *picture = gst_h264_picture_new ();
+    GstH264Picture *picture =
+        gst_h264_picture_pool_acquire (priv->picture_pool);
     GstFlowReturn ret = GST_FLOW_OK;
 
     if (!gst_h264_decoder_init_gap_picture (self, picture,
@@ -1134,7 +1562,7 @@ gst_h264_decoder_new_field_picture (GstH264Decoder * self,
     return NULL;
   }
 
-  new_picture = gst_h264_picture_new ();
+  new_picture = gst_h264_picture_pool_acquire (self->priv->picture_pool);
   /* don't confuse subclass by non-existing picture */
   if (!picture->nonexisting) {
     GstFlowReturn ret;
@@ -1238,7 +1666,6 @@ gst_h264_decoder_parse_slice (GstH264Decoder * self, GstH264NalUnit * nalu)
 {
   GstH264DecoderPrivate *priv = self->priv;
   GstH264ParserResult pres = GST_H264_PARSER_OK;
-  GstFlowReturn ret = GST_FLOW_OK;
 
   memset (&priv->current_slice, 0, sizeof (GstH264Slice));
 
@@ -1254,6 +1681,16 @@ gst_h264_decoder_parse_slice (GstH264Decoder * self, GstH264NalUnit * nalu)
 
   priv->current_slice.nalu = *nalu;
 
+  return gst_h264_decoder_process_slice (self);
+}
+
+/* Decodes current_slice, whose header is parsed already. */
+static GstFlowReturn
+gst_h264_decoder_process_slice (GstH264Decoder * self)
+{
+  GstH264DecoderPrivate *priv = self->priv;
+  GstFlowReturn ret = GST_FLOW_OK;
+
   if (!gst_h264_decoder_preprocess_slice (self, &priv->current_slice))
     return GST_FLOW_ERROR;
 
@@ -1304,7 +1741,7 @@ gst_h264_decoder_parse_slice (GstH264Decoder * self, GstH264NalUnit * nalu)
         GST_ERROR_OBJECT (self, "Couldn't duplicate the first field picture");
       }
     } else {
-      picture = gst_h264_picture_new ();
+      picture = gst_h264_picture_pool_acquire (priv->picture_pool);
 
       if (klass->new_picture)
         ret = klass->new_picture (self, priv->current_frame, picture);
@@ -1420,6 +1857,9 @@ gst_h264_decoder_set_format (GstVideoDecoder * decoder,
 
   GST_DEBUG_OBJECT (decoder, "Set format");
 
+  /* the next handle_frame() reports failures of the frames after it */
+  gst_h264_decoder_wait_pipeline (self);
+
   if (self->input_state)
     gst_video_codec_state_unref (self->input_state);
 
@@ -2564,7 +3004,7 @@ gst_h264_decoder_decode_slice (GstH264Decoder * self)
   priv->max_pic_num = slice->header.max_pic_num;
 
   if (priv->process_ref_pic_lists) {
-    if (!gst_h264_decoder_modify_ref_pic_lists (self)) {
+    if (!gst_h264_decoder_modify_ref_pic_lists (self, &slice->header)) {
       ret = GST_FLOW_ERROR;
       goto beach;
     }
@@ -3060,16 +3500,15 @@ gst_h264_decoder_prepare_ref_pic_lists (GstH264Decoder * self,
 
   if (!construct_list) {
     gst_h264_decoder_clear_ref_pic_lists (self);
-    return;
-  }
-
-  if (GST_H264_PICTURE_IS_FRAME (current_picture)) {
+  } else if (GST_H264_PICTURE_IS_FRAME (current_picture)) {
     construct_ref_pic_lists_p (self, current_picture);
     construct_ref_pic_lists_b (self, current_picture);
   } else {
     construct_ref_field_pic_lists_p (self, current_picture);
     construct_ref_field_pic_lists_b (self, current_picture);
   }
+
+  priv->ref_pic_lists_prepared = TRUE;
 }
 
 static void
@@ -3080,6 +3519,7 @@ gst_h264_decoder_clear_ref_pic_lists (GstH264Decoder * self)
   g_array_set_size (priv->ref_pic_list_p0, 0);
   g_array_set_size (priv->ref_pic_list_b0, 0);
   g_array_set_size (priv->ref_pic_list_b1, 0);
+  priv->ref_pic_lists_prepared = FALSE;
 }
 
 static gint
@@ -3115,12 +3555,12 @@ shift_right_and_insert (GArray * array, gint from, gint to,
  * on the list argument. Set up pointers to proper list to be
  * processed here. */
 static gboolean
-modify_ref_pic_list (GstH264Decoder * self, int list)
+modify_ref_pic_list (GstH264Decoder * self, const GstH264SliceHdr * slice_hdr,
+    int list)
 {
   GstH264DecoderPrivate *priv = self->priv;
   GstH264Picture *picture = priv->current_picture;
   GArray *ref_pic_listx;
-  const GstH264SliceHdr *slice_hdr = &priv->current_slice.header;
   const GstH264RefPicListModification *list_mod;
   gboolean ref_pic_list_modification_flag_lX;
   gint num_ref_idx_lX_active_minus1;
@@ -3282,10 +3722,10 @@ copy_pic_list_into (GArray * dest, GArray * src)
 }
 
 static gboolean
-gst_h264_decoder_modify_ref_pic_lists (GstH264Decoder * self)
+gst_h264_decoder_modify_ref_pic_lists (GstH264Decoder * self,
+    const GstH264SliceHdr * slice_hdr)
 {
   GstH264DecoderPrivate *priv = self->priv;
-  GstH264SliceHdr *slice_hdr = &priv->current_slice.header;
 
   g_array_set_size (priv->ref_pic_list0, 0);
   g_array_set_size (priv->ref_pic_list1, 0);
@@ -3293,13 +3733,13 @@ gst_h264_decoder_modify_ref_pic_lists (GstH264Decoder * self)
   if (GST_H264_IS_P_SLICE (slice_hdr) || GST_H264_IS_SP_SLICE (slice_hdr)) {
     /* 8.2.4 fill reference picture list RefPicList0 for P or SP slice */
     copy_pic_list_into (priv->ref_pic_list0, priv->ref_pic_list_p0);
-    return modify_ref_pic_list (self, 0);
+    return modify_ref_pic_list (self, slice_hdr, 0);
   } else if (GST_H264_IS_B_SLICE (slice_hdr)) {
     /* 8.2.4 fill reference picture list RefPicList0 and RefPicList1 for B slice */
     copy_pic_list_into (priv->ref_pic_list0, priv->ref_pic_list_b0);
     copy_pic_list_into (priv->ref_pic_list1, priv->ref_pic_list_b1);
-    return modify_ref_pic_list (self, 0)
-        && modify_ref_pic_list (self, 1);
+    return modify_ref_pic_list (self, slice_hdr, 0)
+        && modify_ref_pic_list (self, slice_hdr, 1);
   }
 
   return TRUE;
@@ -3321,6 +3761,89 @@ gst_h264_decoder_set_process_ref_pic_lists (GstH264Decoder * decoder,
   decoder->priv->process_ref_pic_lists = process;
 }
 
+/**
+ * gst_h264_decoder_reparse_slice:
+ * @decoder: a #GstH264Decoder
+ * @data: a slice NAL unit, start code prefix included
+ * @size: the size of @data
+ * @slice: (out): the parsed slice
+ *
+ * Parses again a slice of the current picture, as handed to
+ * #GstH264DecoderClass.decode_slice(), for
+ * gst_h264_decoder_build_ref_pic_lists(). @slice points to @data.
+ *
+ * Returns: %TRUE if @data is a slice which could be parsed
+ */
+gboolean
+gst_h264_decoder_reparse_slice (GstH264Decoder * decoder, const guint8 * data,
+    gsize size, GstH264Slice * slice)
+{
+  GstH264DecoderPrivate *priv = decoder->priv;
+  GstH264ParserResult pres;
+
+  memset (slice, 0, sizeof (GstH264Slice));
+
+  pres = gst_h264_parser_identify_nalu (priv->parser, data, 0, size,
+      &slice->nalu);
+  if (pres != GST_H264_PARSER_OK && pres != GST_H264_PARSER_NO_NAL_END)
+    return FALSE;
+
+  if (slice->nalu.type != GST_H264_NAL_SLICE
+      && slice->nalu.type != GST_H264_NAL_SLICE_IDR)
+    return FALSE;
+
+  pres = gst_h264_parser_parse_slice_hdr (priv->parser, &slice->nalu,
+      &slice->header, TRUE, TRUE);
+  if (pres != GST_H264_PARSER_OK) {
+    GST_WARNING_OBJECT (decoder, "Failed to parse slice header, ret %d", pres);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+ * gst_h264_decoder_build_ref_pic_lists:
+ * @decoder: a #GstH264Decoder
+ * @slice: a slice of the current picture
+ * @ref_pic_list0: (out) (transfer none): the RefPicList0 of @slice, an array
+ *    of #GstH264Picture pointers
+ * @ref_pic_list1: (out) (transfer none): the RefPicList1 of @slice, an array
+ *    of #GstH264Picture pointers
+ *
+ * Builds the reference picture lists of @slice as they would be given to
+ * #GstH264DecoderClass.decode_slice() had the process been enabled with
+ * gst_h264_decoder_set_process_ref_pic_lists(), for subclasses needing them
+ * only for some slices. Only to be called from
+ * #GstH264DecoderClass.start_picture() to #GstH264DecoderClass.end_picture()
+ * of the picture @slice belongs to. The lists are valid until the next call
+ * or the end of the picture.
+ *
+ * Returns: %TRUE if the lists could be built
+ */
+gboolean
+gst_h264_decoder_build_ref_pic_lists (GstH264Decoder * decoder,
+    const GstH264Slice * slice, GArray ** ref_pic_list0,
+    GArray ** ref_pic_list1)
+{
+  GstH264DecoderPrivate *priv = decoder->priv;
+
+  g_return_val_if_fail (priv->current_picture != NULL, FALSE);
+
+  /* the initial lists are those of the whole picture */
+  if (!priv->ref_pic_lists_prepared)
+    gst_h264_decoder_prepare_ref_pic_lists (decoder, priv->current_picture);
+
+  priv->max_pic_num = slice->header.max_pic_num;
+  if (!gst_h264_decoder_modify_ref_pic_lists (decoder, &slice->header))
+    return FALSE;
+
+  *ref_pic_list0 = priv->ref_pic_list0;
+  *ref_pic_list1 = priv->ref_pic_list1;
+
+  return TRUE;
+}
+
 /**
  * gst_h264_decoder_get_picture:
  * @decoder: a #GstH264Decoder
@@ -3339,3 +3862,131 @@ gst_h264_decoder_get_picture (GstH264Decoder * decoder,
 {
   return gst_h264_dpb_get_picture (decoder->priv->dpb, system_frame_number);
 }
+
+static gboolean
+gst_h264_slice_hdr_meta_init (GstMeta * meta, gpointer params,
+    GstBuffer * buffer)
+{
+  GstH264SliceHdrMeta *hmeta = (GstH264SliceHdrMeta *) meta;
+
+  hmeta->headers = NULL;
+  hmeta->pps_ids = NULL;
+  hmeta->n_headers = 0;
+
+  return TRUE;
+}
+
+static void
+gst_h264_slice_hdr_meta_free (GstMeta * meta, GstBuffer * buffer)
+{
+  GstH264SliceHdrMeta *hmeta = (GstH264SliceHdrMeta *) meta;
+
+  g_free (hmeta->headers);
+  g_free (hmeta->pps_ids);
+}
+
+static gboolean
+gst_h264_slice_hdr_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstH264SliceHdrMeta *hmeta = (GstH264SliceHdrMeta *) meta;
+  GstH264SliceHdrMeta *dmeta;
+
+  if (!GST_META_TRANSFORM_IS_COPY (type))
+    return FALSE;
+
+  /* the slices are only all there in a copy of the whole buffer */
+  if (((GstMetaTransformCopy *) data)->region)
+    return FALSE;
+
+  dmeta = (GstH264SliceHdrMeta *) gst_buffer_add_meta (dest,
+      GST_H264_SLICE_HDR_META_INFO, NULL);
+  if (!dmeta)
+    return FALSE;
+
+  if (hmeta->n_headers > 0) {
+    dmeta->headers = g_new (GstH264SliceHdr, hmeta->n_headers);
+    memcpy (dmeta->headers, hmeta->headers,
+        hmeta->n_headers * sizeof (GstH264SliceHdr));
+    dmeta->pps_ids = g_new (guint8, hmeta->n_headers);
+    memcpy (dmeta->pps_ids, hmeta->pps_ids, hmeta->n_headers);
+  }
+  dmeta->n_headers = hmeta->n_headers;
+
+  return TRUE;
+}
+
+GType
+gst_h264_slice_hdr_meta_api_get_type (void)
+{
+  static GType type = 0;
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("GstH264SliceHdrMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+
+  return type;
+}
+
+const GstMetaInfo *
+gst_h264_slice_hdr_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) & meta_info)) {
+    const GstMetaInfo *mi =
+        gst_meta_register (GST_H264_SLICE_HDR_META_API_TYPE,
+        "GstH264SliceHdrMeta", sizeof (GstH264SliceHdrMeta),
+        gst_h264_slice_hdr_meta_init, gst_h264_slice_hdr_meta_free,
+        gst_h264_slice_hdr_meta_transform);
+    g_once_init_leave ((GstMetaInfo **) & meta_info, (GstMetaInfo *) mi);
+  }
+
+  return meta_info;
+}
+
+/**
+ * gst_buffer_add_h264_slice_hdr_meta:
+ * @buffer: a byte-stream #GstBuffer
+ * @headers: (array length=n_headers): the headers of the first slices of
+ *   @buffer
+ * @n_headers: number of entries in @headers
+ *
+ * Attaches a copy of @headers to @buffer, keeping only the id of their PPS,
+ * so the parser which parsed them may go as soon as this returns.
+ *
+ * Returns: (transfer none): the #GstH264SliceHdrMeta on @buffer
+ */
+GstH264SliceHdrMeta *
+gst_buffer_add_h264_slice_hdr_meta (GstBuffer * buffer,
+    const GstH264SliceHdr * headers, guint n_headers)
+{
+  GstH264SliceHdrMeta *meta;
+  guint i;
+
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+  g_return_val_if_fail (headers != NULL || n_headers == 0, NULL);
+
+  for (i = 0; i < n_headers; i++)
+    g_return_val_if_fail (headers[i].pps != NULL, NULL);
+
+  meta = (GstH264SliceHdrMeta *) gst_buffer_add_meta (buffer,
+      GST_H264_SLICE_HDR_META_INFO, NULL);
+  if (!meta)
+    return NULL;
+
+  if (n_headers > 0) {
+    meta->headers = g_new (GstH264SliceHdr, n_headers);
+    meta->pps_ids = g_new (guint8, n_headers);
+    for (i = 0; i < n_headers; i++) {
+      meta->headers[i] = headers[i];
+      meta->headers[i].pps = NULL;
+      meta->pps_ids[i] = headers[i].pps->id;
+    }
+  }
+  meta->n_headers = n_headers;
+
+  return meta;
+}
@@ -238,9 +238,20 @@ struct _GstH264DecoderClass
                                          const guint8 * data,
                                          guint32 len);
 
+  /**
+   * GstH264DecoderClass::update_picture_parameters:
+   * @decoder: a #GstH264Decoder
+   * @type: the type of the parameter set
+   * @nalu: the parsed #GstH264SPS or #GstH264PPS
+   * @unit: the #GstH264NalUnit it was parsed from
+   *
+   * Optional. Called by baseclass for every parameter set parsed, repeated
+   * or not.
+   */
   void (*update_picture_parameters)     (GstH264Decoder* decoder,
                                          GstH264NalUnitType type,
-                                         const gpointer nalu);
+                                         const gpointer nalu,
+                                         const GstH264NalUnit * unit);
 
   /*< private >*/
   gpointer padding[GST_PADDING_LARGE];
@@ -248,6 +259,42 @@ struct _GstH264DecoderClass
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(GstH264Decoder, gst_object_unref)
 
+typedef struct _GstH264SliceHdrMeta GstH264SliceHdrMeta;
+
+/**
+ * GstH264SliceHdrMeta:
+ * @meta: parent #GstMeta
+ * @headers: the headers of the first slices of the buffer, in order, with
+ *   @pps cleared
+ * @pps_ids: id of the PPS of every header
+ * @n_headers: number of entries in @headers and @pps_ids
+ *
+ * Slice headers parsed ahead, by a parser whose parameter sets matched
+ * those of the decoder at every slice, so the decoder doesn't parse them
+ * again. Slices past @n_headers are parsed as usual.
+ */
+struct _GstH264SliceHdrMeta
+{
+  GstMeta meta;
+
+  GstH264SliceHdr *headers;
+  guint8 *pps_ids;
+  guint n_headers;
+};
+
+GType gst_h264_slice_hdr_meta_api_get_type (void);
+#define GST_H264_SLICE_HDR_META_API_TYPE (gst_h264_slice_hdr_meta_api_get_type())
+
+const GstMetaInfo *gst_h264_slice_hdr_meta_get_info (void);
+#define GST_H264_SLICE_HDR_META_INFO (gst_h264_slice_hdr_meta_get_info())
+
+#define gst_buffer_get_h264_slice_hdr_meta(b) \
+    ((GstH264SliceHdrMeta *) gst_buffer_get_meta ((b), GST_H264_SLICE_HDR_META_API_TYPE))
+
+GstH264SliceHdrMeta * gst_buffer_add_h264_slice_hdr_meta (GstBuffer * buffer,
+                                                         const GstH264SliceHdr * headers,
+                                                         guint n_headers);
+
 
 GType gst_h264_decoder_get_type (void);
 
@@ -255,6 +302,16 @@ GType gst_h264_decoder_get_type (void);
 void gst_h264_decoder_set_process_ref_pic_lists (GstH264Decoder * decoder,
                                                  gboolean process);
 
+gboolean gst_h264_decoder_reparse_slice         (GstH264Decoder * decoder,
+                                                 const guint8 * data,
+                                                 gsize size,
+                                                 GstH264Slice * slice);
+
+gboolean gst_h264_decoder_build_ref_pic_lists   (GstH264Decoder * decoder,
+                                                 const GstH264Slice * slice,
+                                                 GArray ** ref_pic_list0,
+                                                 GArray ** ref_pic_list1);
+
 
 GstH264Picture * gst_h264_decoder_get_picture   (GstH264Decoder * decoder,
                                                  guint32 system_frame_number);
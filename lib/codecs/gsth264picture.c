@@ -23,12 +23,23 @@
 
 #include "gsth264picture.h"
 #include <stdlib.h>
+#include <string.h>
 
 GST_DEBUG_CATEGORY_EXTERN (gst_h264_decoder_debug);
 #define GST_CAT_DEFAULT gst_h264_decoder_debug
 
 GST_DEFINE_MINI_OBJECT_TYPE (GstH264Picture, gst_h264_picture);
 
+struct _GstH264PicturePool
+{
+  gint ref_count;
+  guint max_free;
+
+  GMutex lock;
+  /* reset pictures, each holding a reference kept by the pool */
+  GPtrArray *free;
+};
+
 static void
 _gst_h264_picture_free (GstH264Picture * picture)
 {
@@ -38,6 +49,56 @@ _gst_h264_picture_free (GstH264Picture * picture)
   g_free (picture);
 }
 
+static void
+gst_h264_picture_init (GstH264Picture * picture)
+{
+  picture->top_field_order_cnt = G_MAXINT32;
+  picture->bottom_field_order_cnt = G_MAXINT32;
+  picture->field = GST_H264_PICTURE_FIELD_FRAME;
+  picture->dpb_slot = -1;
+}
+
+/* Drops the user data of picture and sets it as gst_h264_picture_new() does,
+ * but for its #GstMiniObject */
+static void
+gst_h264_picture_reset (GstH264Picture * picture)
+{
+  if (picture->notify)
+    picture->notify (picture->user_data);
+
+  memset ((guint8 *) picture + sizeof (GstMiniObject), 0,
+      sizeof (GstH264Picture) - sizeof (GstMiniObject));
+  GST_MINI_OBJECT_FLAGS (picture) = 0;
+  gst_h264_picture_init (picture);
+}
+
+/* Pooled pictures are reset and kept by the pool when their last reference
+ * goes, if it isn't full */
+static gboolean
+_gst_h264_picture_dispose (GstH264Picture * picture)
+{
+  GstH264PicturePool *pool = picture->pool;
+  gboolean recycled = FALSE;
+
+  if (!pool)
+    return TRUE;
+
+  gst_h264_picture_reset (picture);
+
+  g_mutex_lock (&pool->lock);
+  if (pool->free->len < pool->max_free) {
+    gst_mini_object_ref (GST_MINI_OBJECT_CAST (picture));
+    g_ptr_array_add (pool->free, picture);
+    recycled = TRUE;
+  }
+  g_mutex_unlock (&pool->lock);
+
+  /* might free picture, if it was the last one holding the pool */
+  gst_h264_picture_pool_unref (pool);
+
+  return !recycled;
+}
+
 /**
  * gst_h264_picture_new:
  *
@@ -52,12 +113,11 @@ gst_h264_picture_new (void)
 
   pic = g_new0 (GstH264Picture, 1);
 
-  pic->top_field_order_cnt = G_MAXINT32;
-  pic->bottom_field_order_cnt = G_MAXINT32;
-  pic->field = GST_H264_PICTURE_FIELD_FRAME;
+  gst_h264_picture_init (pic);
 
   gst_mini_object_init (GST_MINI_OBJECT_CAST (pic), 0,
-      GST_TYPE_H264_PICTURE, NULL, NULL,
+      GST_TYPE_H264_PICTURE, NULL,
+      (GstMiniObjectDisposeFunction) _gst_h264_picture_dispose,
       (GstMiniObjectFreeFunction) _gst_h264_picture_free);
 
   return pic;
@@ -103,8 +163,105 @@ gst_h264_picture_get_user_data (GstH264Picture * picture)
   return picture->user_data;
 }
 
+/**
+ * gst_h264_picture_pool_new:
+ * @max_free: the number of unused pictures to keep
+ *
+ * Create a new #GstH264PicturePool, which recycles the #GstH264Picture
+ * acquired from it once they aren't referenced anymore, up to @max_free of
+ * them. Each acquired picture keeps a reference to the pool.
+ *
+ * Returns: a new #GstH264PicturePool
+ */
+GstH264PicturePool *
+gst_h264_picture_pool_new (guint max_free)
+{
+  GstH264PicturePool *pool = g_new0 (GstH264PicturePool, 1);
+
+  pool->ref_count = 1;
+  pool->max_free = max_free;
+  g_mutex_init (&pool->lock);
+  pool->free = g_ptr_array_sized_new (max_free);
+
+  return pool;
+}
+
+/**
+ * gst_h264_picture_pool_ref:
+ * @pool: a #GstH264PicturePool
+ *
+ * Returns: @pool
+ */
+GstH264PicturePool *
+gst_h264_picture_pool_ref (GstH264PicturePool * pool)
+{
+  g_return_val_if_fail (pool != NULL, NULL);
+
+  g_atomic_int_inc (&pool->ref_count);
+  return pool;
+}
+
+/**
+ * gst_h264_picture_pool_unref:
+ * @pool: a #GstH264PicturePool
+ *
+ * Frees @pool and the pictures kept by it when the last reference goes.
+ */
+void
+gst_h264_picture_pool_unref (GstH264PicturePool * pool)
+{
+  guint i;
+
+  g_return_if_fail (pool != NULL);
+
+  if (!g_atomic_int_dec_and_test (&pool->ref_count))
+    return;
+
+  for (i = 0; i < pool->free->len; i++)
+    gst_h264_picture_unref (g_ptr_array_index (pool->free, i));
+  g_ptr_array_unref (pool->free);
+  g_mutex_clear (&pool->lock);
+  g_free (pool);
+}
+
+/**
+ * gst_h264_picture_pool_acquire:
+ * @pool: a #GstH264PicturePool
+ *
+ * Like gst_h264_picture_new(), but reusing a #GstH264Picture released to
+ * @pool, if any.
+ *
+ * Returns: (transfer full): a #GstH264Picture
+ */
+GstH264Picture *
+gst_h264_picture_pool_acquire (GstH264PicturePool * pool)
+{
+  GstH264Picture *picture = NULL;
+
+  g_return_val_if_fail (pool != NULL, NULL);
+
+  g_mutex_lock (&pool->lock);
+  if (pool->free->len > 0)
+    picture = g_ptr_array_remove_index_fast (pool->free, pool->free->len - 1);
+  g_mutex_unlock (&pool->lock);
+
+  if (!picture)
+    picture = gst_h264_picture_new ();
+
+  picture->pool = gst_h264_picture_pool_ref (pool);
+
+  return picture;
+}
+
+/* Fields are stored as pictures of their own, so an interlaced DPB takes
+ * twice as many, plus those of the picture about to be bumped or added */
+#define GST_H264_DPB_MAX_SLOTS (2 * (GST_H264_DPB_MAX_SIZE + 1))
+
+#define SLOT_BIT(slot) (G_GUINT64_CONSTANT (1) << (slot))
+
 struct _GstH264Dpb
 {
+  /* the pictures in order of insertion */
   GArray *pic_list;
   gint max_num_frames;
   gint num_output_needed;
@@ -113,8 +270,173 @@ struct _GstH264Dpb
   gboolean last_output_non_ref;
 
   gboolean interlaced;
+
+  /* The same pictures by slot, and their state as masks of slots, so the
+   * queries done per picture don't have to walk pic_list. Kept in sync by
+   * gst_h264_dpb_update_slot() */
+  GstH264Picture *slots[GST_H264_DPB_MAX_SLOTS];
+  guint64 insertion[GST_H264_DPB_MAX_SLOTS];
+  guint64 next_insertion;
+  guint64 used_mask;
+  guint64 short_term_mask;
+  guint64 long_term_mask;
+  guint64 output_needed_mask;
+  guint64 second_field_mask;
+  /* frames and first fields with their pair: the frame buffers in use */
+  guint64 frame_buffer_mask;
+
+  /* the slots of the pictures which can be bumped, by POC, then by
+   * insertion */
+  guint8 bump_queue[GST_H264_DPB_MAX_SLOTS];
+  guint bump_queue_len;
+  guint64 bump_mask;
 };
 
+G_STATIC_ASSERT (GST_H264_DPB_MAX_SLOTS <= 64);
+
+static inline gint
+mask_first_slot (guint64 mask)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll (mask);
+#else
+  gint slot = 0;
+
+  for (; !(mask & 1); mask >>= 1)
+    slot++;
+
+  return slot;
+#endif
+}
+
+static inline gint
+mask_count (guint64 mask)
+{
+#if defined(__GNUC__)
+  return __builtin_popcountll (mask);
+#else
+  gint count = 0;
+
+  for (; mask; mask &= mask - 1)
+    count++;
+
+  return count;
+#endif
+}
+
+/* Whether the picture in slot a was inserted before that in slot b */
+static inline gboolean
+slot_precedes (GstH264Dpb * dpb, gint a, gint b)
+{
+  return dpb->insertion[a] < dpb->insertion[b];
+}
+
+static void
+bump_queue_insert (GstH264Dpb * dpb, gint slot)
+{
+  gint poc = dpb->slots[slot]->pic_order_cnt;
+  guint i;
+
+  for (i = dpb->bump_queue_len; i > 0; i--) {
+    gint other = dpb->bump_queue[i - 1];
+
+    if (dpb->slots[other]->pic_order_cnt < poc ||
+        (dpb->slots[other]->pic_order_cnt == poc
+            && slot_precedes (dpb, other, slot)))
+      break;
+
+    dpb->bump_queue[i] = other;
+  }
+
+  dpb->bump_queue[i] = slot;
+  dpb->bump_queue_len++;
+  dpb->bump_mask |= SLOT_BIT (slot);
+}
+
+static void
+bump_queue_remove (GstH264Dpb * dpb, gint slot)
+{
+  guint i;
+
+  for (i = 0; dpb->bump_queue[i] != slot; i++);
+
+  memmove (&dpb->bump_queue[i], &dpb->bump_queue[i + 1],
+      dpb->bump_queue_len - i - 1);
+  dpb->bump_queue_len--;
+  dpb->bump_mask &= ~SLOT_BIT (slot);
+}
+
+/* Refreshes the masks from the state of picture, stored in dpb */
+static void
+gst_h264_dpb_update_slot (GstH264Dpb * dpb, GstH264Picture * picture)
+{
+  gint slot = picture->dpb_slot;
+  guint64 bit = SLOT_BIT (slot);
+  gboolean frame = GST_H264_PICTURE_IS_FRAME (picture);
+  gboolean bumpable;
+
+#define UPDATE_MASK(mask, cond) \
+  dpb->mask = (cond) ? dpb->mask | bit : dpb->mask & ~bit
+
+  UPDATE_MASK (short_term_mask, GST_H264_PICTURE_IS_SHORT_TERM_REF (picture));
+  UPDATE_MASK (long_term_mask, GST_H264_PICTURE_IS_LONG_TERM_REF (picture));
+  UPDATE_MASK (output_needed_mask, picture->needed_for_output);
+  UPDATE_MASK (second_field_mask, picture->second_field);
+  UPDATE_MASK (frame_buffer_mask, !picture->second_field &&
+      (frame || picture->other_field));
+
+#undef UPDATE_MASK
+
+  /* the fields are output as a pair, with the first one */
+  bumpable = picture->needed_for_output &&
+      (frame || (picture->other_field && !picture->second_field));
+
+  if (bumpable && !(dpb->bump_mask & bit))
+    bump_queue_insert (dpb, slot);
+  else if (!bumpable && (dpb->bump_mask & bit))
+    bump_queue_remove (dpb, slot);
+}
+
+/* Takes picture out of its slot, leaving it in pic_list */
+static void
+gst_h264_dpb_release_slot (GstH264Dpb * dpb, GstH264Picture * picture)
+{
+  gint slot = picture->dpb_slot;
+  guint64 bit = SLOT_BIT (slot);
+
+  if (dpb->bump_mask & bit)
+    bump_queue_remove (dpb, slot);
+
+  dpb->used_mask &= ~bit;
+  dpb->short_term_mask &= ~bit;
+  dpb->long_term_mask &= ~bit;
+  dpb->output_needed_mask &= ~bit;
+  dpb->second_field_mask &= ~bit;
+  dpb->frame_buffer_mask &= ~bit;
+  dpb->slots[slot] = NULL;
+
+  picture->dpb = NULL;
+  picture->dpb_slot = -1;
+}
+
+static void
+gst_h264_dpb_remove (GstH264Dpb * dpb, GstH264Picture * picture)
+{
+  guint i;
+
+  for (i = 0; i < dpb->pic_list->len; i++) {
+    if (g_array_index (dpb->pic_list, GstH264Picture *, i) == picture)
+      break;
+  }
+
+  g_assert (i < dpb->pic_list->len);
+
+  gst_h264_dpb_release_slot (dpb, picture);
+  /* NOTE: don't use g_array_remove_index_fast here since the last picture
+   * need to be referenced for bumping decision */
+  g_array_remove_index (dpb->pic_list, i);
+}
+
 static void
 gst_h264_dpb_init (GstH264Dpb * dpb)
 {
@@ -236,9 +558,18 @@ gst_h264_dpb_free (GstH264Dpb * dpb)
 void
 gst_h264_dpb_clear (GstH264Dpb * dpb)
 {
+  guint i;
+
   g_return_if_fail (dpb != NULL);
 
+  for (i = 0; i < dpb->pic_list->len; i++) {
+    gst_h264_dpb_release_slot (dpb,
+        g_array_index (dpb->pic_list, GstH264Picture *, i));
+  }
+  g_assert (dpb->used_mask == 0 && dpb->bump_queue_len == 0);
+
   g_array_set_size (dpb->pic_list, 0);
+  dpb->next_insertion = 0;
   gst_h264_dpb_init (dpb);
 }
 
@@ -270,8 +601,18 @@ gst_h264_dpb_set_max_num_reorder_frames (GstH264Dpb * dpb,
 void
 gst_h264_dpb_add (GstH264Dpb * dpb, GstH264Picture * picture)
 {
+  gint slot;
+
   g_return_if_fail (dpb != NULL);
   g_return_if_fail (GST_IS_H264_PICTURE (picture));
+  g_return_if_fail (picture->dpb == NULL);
+
+  if (dpb->used_mask == (SLOT_BIT (GST_H264_DPB_MAX_SLOTS - 1) << 1) - 1) {
+    GST_ERROR ("DPB is full, dropping picture %p (poc %d)", picture,
+        picture->pic_order_cnt);
+    gst_h264_picture_unref (picture);
+    return;
+  }
 
   /* C.4.2 Decoding of gaps in frame_num and storage of "non-existing" pictures
    *
@@ -292,12 +633,23 @@ gst_h264_dpb_add (GstH264Dpb * dpb, GstH264Picture * picture)
     picture->needed_for_output = FALSE;
   }
 
+  slot = mask_first_slot (~dpb->used_mask);
+  dpb->used_mask |= SLOT_BIT (slot);
+  dpb->slots[slot] = picture;
+  dpb->insertion[slot] = dpb->next_insertion++;
+  picture->dpb = dpb;
+  picture->dpb_slot = slot;
+
   /* Link each field */
   if (picture->second_field && picture->other_field) {
     picture->other_field->other_field = picture;
+    /* the first field can be bumped now */
+    if (picture->other_field->dpb == dpb)
+      gst_h264_dpb_update_slot (dpb, picture->other_field);
   }
 
   g_array_append_val (dpb->pic_list, picture);
+  gst_h264_dpb_update_slot (dpb, picture);
 
   if (dpb->pic_list->len > dpb->max_num_frames * (dpb->interlaced + 1))
     GST_ERROR ("DPB size is %d, exceed the max size %d",
@@ -320,23 +672,20 @@ gst_h264_dpb_add (GstH264Dpb * dpb, GstH264Picture * picture)
 void
 gst_h264_dpb_delete_unused (GstH264Dpb * dpb)
 {
-  gint i;
+  guint64 unused;
 
   g_return_if_fail (dpb != NULL);
 
-  for (i = 0; i < dpb->pic_list->len; i++) {
-    GstH264Picture *picture =
-        g_array_index (dpb->pic_list, GstH264Picture *, i);
+  unused = dpb->used_mask & ~(dpb->output_needed_mask |
+      dpb->short_term_mask | dpb->long_term_mask);
 
-    /* NOTE: don't use g_array_remove_index_fast here since the last picture
-     * need to be referenced for bumping decision */
-    if (!picture->needed_for_output && !GST_H264_PICTURE_IS_REF (picture)) {
-      GST_TRACE
-          ("remove picture %p (frame num: %d, poc: %d, field: %d) from dpb",
-          picture, picture->frame_num, picture->pic_order_cnt, picture->field);
-      g_array_remove_index (dpb->pic_list, i);
-      i--;
-    }
+  for (; unused; unused &= unused - 1) {
+    GstH264Picture *picture = dpb->slots[mask_first_slot (unused)];
+
+    GST_TRACE
+        ("remove picture %p (frame num: %d, poc: %d, field: %d) from dpb",
+        picture, picture->frame_num, picture->pic_order_cnt, picture->field);
+    gst_h264_dpb_remove (dpb, picture);
   }
 }
 
@@ -351,24 +700,11 @@ gst_h264_dpb_delete_unused (GstH264Dpb * dpb)
 gint
 gst_h264_dpb_num_ref_frames (GstH264Dpb * dpb)
 {
-  gint i;
-  gint ret = 0;
-
   g_return_val_if_fail (dpb != NULL, -1);
 
-  for (i = 0; i < dpb->pic_list->len; i++) {
-    GstH264Picture *picture =
-        g_array_index (dpb->pic_list, GstH264Picture *, i);
-
-    /* Count frame, not field picture */
-    if (picture->second_field)
-      continue;
-
-    if (GST_H264_PICTURE_IS_REF (picture))
-      ret++;
-  }
-
-  return ret;
+  /* Count frame, not field picture */
+  return mask_count ((dpb->short_term_mask | dpb->long_term_mask) &
+      ~dpb->second_field_mask);
 }
 
 /**
@@ -380,15 +716,14 @@ gst_h264_dpb_num_ref_frames (GstH264Dpb * dpb)
 void
 gst_h264_dpb_mark_all_non_ref (GstH264Dpb * dpb)
 {
-  gint i;
+  guint64 refs;
 
   g_return_if_fail (dpb != NULL);
 
-  for (i = 0; i < dpb->pic_list->len; i++) {
-    GstH264Picture *picture =
-        g_array_index (dpb->pic_list, GstH264Picture *, i);
-
-    gst_h264_picture_set_reference (picture, GST_H264_PICTURE_REF_NONE, FALSE);
+  refs = dpb->short_term_mask | dpb->long_term_mask;
+  for (; refs; refs &= refs - 1) {
+    gst_h264_picture_set_reference (dpb->slots[mask_first_slot (refs)],
+        GST_H264_PICTURE_REF_NONE, FALSE);
   }
 }
 
@@ -404,19 +739,23 @@ gst_h264_dpb_mark_all_non_ref (GstH264Dpb * dpb)
 GstH264Picture *
 gst_h264_dpb_get_short_ref_by_pic_num (GstH264Dpb * dpb, gint pic_num)
 {
-  gint i;
+  GstH264Picture *ret = NULL;
+  guint64 refs;
 
   g_return_val_if_fail (dpb != NULL, NULL);
 
-  for (i = 0; i < dpb->pic_list->len; i++) {
-    GstH264Picture *picture =
-        g_array_index (dpb->pic_list, GstH264Picture *, i);
+  /* the first one inserted, as both fields of a frame share it */
+  for (refs = dpb->short_term_mask; refs; refs &= refs - 1) {
+    gint slot = mask_first_slot (refs);
 
-    if (GST_H264_PICTURE_IS_SHORT_TERM_REF (picture)
-        && picture->pic_num == pic_num)
-      return picture;
+    if (dpb->slots[slot]->pic_num == pic_num &&
+        (!ret || slot_precedes (dpb, slot, ret->dpb_slot)))
+      ret = dpb->slots[slot];
   }
 
+  if (ret)
+    return ret;
+
   GST_WARNING ("No short term reference picture for %d", pic_num);
 
   return NULL;
@@ -437,19 +776,22 @@ GstH264Picture *
 gst_h264_dpb_get_long_ref_by_long_term_pic_num (GstH264Dpb * dpb,
     gint long_term_pic_num)
 {
-  gint i;
+  GstH264Picture *ret = NULL;
+  guint64 refs;
 
   g_return_val_if_fail (dpb != NULL, NULL);
 
-  for (i = 0; i < dpb->pic_list->len; i++) {
-    GstH264Picture *picture =
-        g_array_index (dpb->pic_list, GstH264Picture *, i);
+  for (refs = dpb->long_term_mask; refs; refs &= refs - 1) {
+    gint slot = mask_first_slot (refs);
 
-    if (GST_H264_PICTURE_IS_LONG_TERM_REF (picture) &&
-        picture->long_term_pic_num == long_term_pic_num)
-      return picture;
+    if (dpb->slots[slot]->long_term_pic_num == long_term_pic_num &&
+        (!ret || slot_precedes (dpb, slot, ret->dpb_slot)))
+      ret = dpb->slots[slot];
   }
 
+  if (ret)
+    return ret;
+
   GST_WARNING ("No long term reference picture for %d", long_term_pic_num);
 
   return NULL;
@@ -466,17 +808,17 @@ gst_h264_dpb_get_long_ref_by_long_term_pic_num (GstH264Dpb * dpb,
 GstH264Picture *
 gst_h264_dpb_get_lowest_frame_num_short_ref (GstH264Dpb * dpb)
 {
-  gint i;
   GstH264Picture *ret = NULL;
+  guint64 refs;
 
   g_return_val_if_fail (dpb != NULL, NULL);
 
-  for (i = 0; i < dpb->pic_list->len; i++) {
-    GstH264Picture *picture =
-        g_array_index (dpb->pic_list, GstH264Picture *, i);
+  for (refs = dpb->short_term_mask; refs; refs &= refs - 1) {
+    GstH264Picture *picture = dpb->slots[mask_first_slot (refs)];
 
-    if (GST_H264_PICTURE_IS_SHORT_TERM_REF (picture) &&
-        (!ret || picture->frame_num_wrap < ret->frame_num_wrap))
+    if (!ret || picture->frame_num_wrap < ret->frame_num_wrap ||
+        (picture->frame_num_wrap == ret->frame_num_wrap &&
+            slot_precedes (dpb, picture->dpb_slot, ret->dpb_slot)))
       ret = picture;
   }
 
@@ -559,6 +901,72 @@ gst_h264_dpb_get_pictures_long_term_ref (GstH264Dpb * dpb,
   }
 }
 
+/**
+ * gst_h264_dpb_ref_iter_init:
+ * @iter: an uninitialized #GstH264DpbRefIter
+ * @dpb: a #GstH264Dpb
+ * @include_non_existing: %TRUE if non-existing pictures need to be included
+ * @include_second_field: %TRUE if the second field pictures need to be included
+ *
+ * Prepares @iter to walk the short-term reference pictures of @dpb, then
+ * its long-term ones, in the order gst_h264_dpb_get_pictures_short_term_ref()
+ * and gst_h264_dpb_get_pictures_long_term_ref() would retrieve them.
+ */
+void
+gst_h264_dpb_ref_iter_init (GstH264DpbRefIter * iter, GstH264Dpb * dpb,
+    gboolean include_non_existing, gboolean include_second_field)
+{
+  g_return_if_fail (iter != NULL);
+  g_return_if_fail (dpb != NULL);
+
+  iter->dpb = dpb;
+  iter->index = 0;
+  iter->long_term = FALSE;
+  iter->include_non_existing = include_non_existing;
+  iter->include_second_field = include_second_field;
+}
+
+/**
+ * gst_h264_dpb_ref_iter_next:
+ * @iter: an initialized #GstH264DpbRefIter
+ *
+ * Returns: (transfer none) (nullable): the next reference picture, or %NULL
+ *   once all were walked
+ */
+GstH264Picture *
+gst_h264_dpb_ref_iter_next (GstH264DpbRefIter * iter)
+{
+  GArray *pic_list;
+
+  g_return_val_if_fail (iter != NULL, NULL);
+
+  pic_list = iter->dpb->pic_list;
+
+  while (TRUE) {
+    while (iter->index < pic_list->len) {
+      GstH264Picture *picture =
+          g_array_index (pic_list, GstH264Picture *, iter->index++);
+
+      if (!iter->include_second_field && picture->second_field)
+        continue;
+
+      if (iter->long_term) {
+        if (GST_H264_PICTURE_IS_LONG_TERM_REF (picture))
+          return picture;
+      } else if (GST_H264_PICTURE_IS_SHORT_TERM_REF (picture) &&
+          (iter->include_non_existing || !picture->nonexisting)) {
+        return picture;
+      }
+    }
+
+    if (iter->long_term)
+      return NULL;
+
+    iter->long_term = TRUE;
+    iter->index = 0;
+  }
+}
+
 /**
  * gst_h264_dpb_get_pictures_all:
  * @dpb: a #GstH264Dpb
@@ -634,64 +1042,22 @@ gst_h264_dpb_has_empty_frame_buffer (GstH264Dpb * dpb)
     if (dpb->pic_list->len < dpb->max_num_frames)
       return TRUE;
   } else {
-    gint i;
-    gint count = 0;
     /* Count the number of complementary field pairs */
-    for (i = 0; i < dpb->pic_list->len; i++) {
-      GstH264Picture *picture =
-          g_array_index (dpb->pic_list, GstH264Picture *, i);
-
-      if (picture->second_field)
-        continue;
-
-      if (GST_H264_PICTURE_IS_FRAME (picture) || picture->other_field)
-        count++;
-    }
-
-    if (count < dpb->max_num_frames)
+    if (mask_count (dpb->frame_buffer_mask) < dpb->max_num_frames)
       return TRUE;
   }
 
   return FALSE;
 }
 
-static gint
-gst_h264_dpb_get_lowest_output_needed_picture (GstH264Dpb * dpb,
-    GstH264Picture ** picture)
+/* (transfer none) */
+static GstH264Picture *
+gst_h264_dpb_get_lowest_output_needed_picture (GstH264Dpb * dpb)
 {
-  gint i;
-  GstH264Picture *lowest = NULL;
-  gint index = -1;
-
-  *picture = NULL;
-
-  for (i = 0; i < dpb->pic_list->len; i++) {
-    GstH264Picture *picture =
-        g_array_index (dpb->pic_list, GstH264Picture *, i);
-
-    if (!picture->needed_for_output)
-      continue;
-
-    if (!GST_H264_PICTURE_IS_FRAME (picture) &&
-        (!picture->other_field || picture->second_field))
-      continue;
-
-    if (!lowest) {
-      lowest = picture;
-      index = i;
-      continue;
-    }
-
-    if (picture->pic_order_cnt < lowest->pic_order_cnt) {
-      lowest = picture;
-      index = i;
-    }
-  }
-
-  if (lowest)
-    *picture = gst_h264_picture_ref (lowest);
+  if (dpb->bump_queue_len == 0)
+    return NULL;
 
-  return index;
+  return dpb->slots[dpb->bump_queue[0]];
 }
 
 /**
@@ -708,21 +1074,19 @@ gboolean
 gst_h264_dpb_needs_bump (GstH264Dpb * dpb, GstH264Picture * to_insert,
     GstH264DpbBumpMode latency_mode)
 {
-  GstH264Picture *picture = NULL;
+  GstH264Picture *picture;
   gint32 lowest_poc;
   gboolean is_ref_picture;
-  gint lowest_index;
 
   g_return_val_if_fail (dpb != NULL, FALSE);
   g_assert (dpb->num_output_needed >= 0);
 
   lowest_poc = G_MAXINT32;
   is_ref_picture = FALSE;
-  lowest_index = gst_h264_dpb_get_lowest_output_needed_picture (dpb, &picture);
-  if (lowest_index >= 0) {
+  picture = gst_h264_dpb_get_lowest_output_needed_picture (dpb);
+  if (picture) {
     lowest_poc = picture->pic_order_cnt;
     is_ref_picture = picture->ref_pic;
-    gst_h264_picture_unref (picture);
   } else {
     goto normal_bump;
   }
@@ -753,17 +1117,22 @@ gst_h264_dpb_needs_bump (GstH264Dpb * dpb, GstH264Picture * to_insert,
     /* num_reorder_frames indicates the maximum number of frames, that
        precede any frame in the coded video sequence in decoding order
        and follow it in output order. Safe. */
-    if (lowest_index >= dpb->max_num_reorder_frames) {
-      guint i, need_output;
-
-      need_output = 0;
-      for (i = 0; i < lowest_index; i++) {
-        GstH264Picture *p = g_array_index (dpb->pic_list, GstH264Picture *, i);
-        if (p->needed_for_output)
-          need_output++;
+    {
+      guint64 preceding = 0, used;
+      guint lowest_index, need_output;
+
+      for (used = dpb->used_mask; used; used &= used - 1) {
+        gint slot = mask_first_slot (used);
+
+        if (slot_precedes (dpb, slot, picture->dpb_slot))
+          preceding |= SLOT_BIT (slot);
       }
 
-      if (need_output >= dpb->max_num_reorder_frames) {
+      lowest_index = mask_count (preceding);
+      need_output = mask_count (preceding & dpb->output_needed_mask);
+
+      if (lowest_index >= dpb->max_num_reorder_frames &&
+          need_output >= dpb->max_num_reorder_frames) {
         GST_TRACE ("frame with lowest poc %d has %d precede frame, already"
             " satisfy num_reorder_frames %d, bumping for low-latency.",
             dpb->last_output_poc, lowest_index, dpb->max_num_reorder_frames);
@@ -882,29 +1251,30 @@ gst_h264_dpb_bump (GstH264Dpb * dpb, gboolean drain)
 {
   GstH264Picture *picture;
   GstH264Picture *other_picture;
-  gint i;
-  gint index;
 
   g_return_val_if_fail (dpb != NULL, NULL);
 
-  index = gst_h264_dpb_get_lowest_output_needed_picture (dpb, &picture);
+  picture = gst_h264_dpb_get_lowest_output_needed_picture (dpb);
 
-  if (!picture || index < 0)
+  if (!picture)
     return NULL;
 
+  gst_h264_picture_ref (picture);
   picture->needed_for_output = FALSE;
 
   dpb->num_output_needed--;
   g_assert (dpb->num_output_needed >= 0);
 
-  /* NOTE: don't use g_array_remove_index_fast here since the last picture
-   * need to be referenced for bumping decision */
   if (!GST_H264_PICTURE_IS_REF (picture) || drain)
-    g_array_remove_index (dpb->pic_list, index);
+    gst_h264_dpb_remove (dpb, picture);
+  else
+    gst_h264_dpb_update_slot (dpb, picture);
 
   other_picture = picture->other_field;
   if (other_picture) {
     other_picture->needed_for_output = FALSE;
+    if (other_picture->dpb == dpb)
+      gst_h264_dpb_update_slot (dpb, other_picture);
 
     /* At this moment, this picture should be interlaced */
     picture->buffer_flags |= GST_VIDEO_BUFFER_FLAG_INTERLACED;
@@ -914,17 +1284,8 @@ gst_h264_dpb_bump (GstH264Dpb * dpb, gboolean drain)
     if (picture->pic_order_cnt < other_picture->pic_order_cnt)
       picture->buffer_flags |= GST_VIDEO_BUFFER_FLAG_TFF;
 
-    if (!other_picture->ref) {
-      for (i = 0; i < dpb->pic_list->len; i++) {
-        GstH264Picture *tmp =
-            g_array_index (dpb->pic_list, GstH264Picture *, i);
-
-        if (tmp == other_picture) {
-          g_array_remove_index (dpb->pic_list, i);
-          break;
-        }
-      }
-    }
+    if (!other_picture->ref && other_picture->dpb == dpb)
+      gst_h264_dpb_remove (dpb, other_picture);
     /* Now other field may or may not exist */
   }
 
@@ -961,6 +1322,26 @@ get_picNumX (GstH264Picture * picture, GstH264RefPicMarking * ref_pic_marking)
       (ref_pic_marking->difference_of_pic_nums_minus1 + 1);
 }
 
+/* The first long-term reference picture inserted with long_term_frame_idx,
+ * if any */
+static GstH264Picture *
+gst_h264_dpb_get_long_ref_by_frame_idx (GstH264Dpb * dpb,
+    gint long_term_frame_idx)
+{
+  GstH264Picture *ret = NULL;
+  guint64 refs;
+
+  for (refs = dpb->long_term_mask; refs; refs &= refs - 1) {
+    gint slot = mask_first_slot (refs);
+
+    if (dpb->slots[slot]->long_term_frame_idx == long_term_frame_idx &&
+        (!ret || slot_precedes (dpb, slot, ret->dpb_slot)))
+      ret = dpb->slots[slot];
+  }
+
+  return ret;
+}
+
 /**
  * gst_h264_dpb_perform_memory_management_control_operation:
  * @dpb: a #GstH265Dpb
@@ -980,8 +1361,8 @@ gst_h264_dpb_perform_memory_management_control_operation (GstH264Dpb * dpb,
   guint8 type;
   gint pic_num_x;
   gint max_long_term_frame_idx;
-  GstH264Picture *other;
-  gint i;
+  GstH264Picture *other, *tmp;
+  guint64 refs;
 
   g_return_val_if_fail (dpb != NULL, FALSE);
   g_return_val_if_fail (ref_pic_marking != NULL, FALSE);
@@ -1037,59 +1418,54 @@ gst_h264_dpb_perform_memory_management_control_operation (GstH264Dpb * dpb,
 
       /* If we have long-term ref picture for LongTermFrameIdx,
        * mark the picture as non-reference */
-      for (i = 0; i < dpb->pic_list->len; i++) {
-        GstH264Picture *tmp =
-            g_array_index (dpb->pic_list, GstH264Picture *, i);
-
-        if (GST_H264_PICTURE_IS_LONG_TERM_REF (tmp)
-            && tmp->long_term_frame_idx == ref_pic_marking->long_term_frame_idx) {
-          if (GST_H264_PICTURE_IS_FRAME (tmp)) {
-            /* When long_term_frame_idx is already assigned to a long-term
-             * reference frame, that frame is marked as "unused for reference"
-             */
+      tmp = gst_h264_dpb_get_long_ref_by_frame_idx (dpb,
+          ref_pic_marking->long_term_frame_idx);
+      if (tmp) {
+        if (GST_H264_PICTURE_IS_FRAME (tmp)) {
+          /* When long_term_frame_idx is already assigned to a long-term
+           * reference frame, that frame is marked as "unused for reference"
+           */
+          gst_h264_picture_set_reference (tmp,
+              GST_H264_PICTURE_REF_NONE, TRUE);
+          GST_TRACE ("MMCO-3: unmark old long-term frame %p (poc %d)",
+              tmp, tmp->pic_order_cnt);
+        } else if (tmp->other_field &&
+            GST_H264_PICTURE_IS_LONG_TERM_REF (tmp->other_field) &&
+            tmp->other_field->long_term_frame_idx ==
+            ref_pic_marking->long_term_frame_idx) {
+          /* When long_term_frame_idx is already assigned to a long-term
+           * reference field pair, that complementary field pair and both of
+           * its fields are marked as "unused for reference"
+           */
+          gst_h264_picture_set_reference (tmp,
+              GST_H264_PICTURE_REF_NONE, TRUE);
+          GST_TRACE ("MMCO-3: unmark old long-term field-pair %p (poc %d)",
+              tmp, tmp->pic_order_cnt);
+        } else {
+          /* When long_term_frame_idx is already assigned to a reference field,
+           * and that reference field is not part of a complementary field
+           * pair that includes the picture specified by picNumX,
+           * that field is marked as "unused for reference"
+           */
+
+          /* Check "tmp" (a long-term ref pic) is part of
+           * "other" (a picture to be updated from short-term to long-term)
+           * complementary field pair */
+
+          /* NOTE: "other" here is short-ref, so "other" and "tmp" must not be
+           * identical picture */
+          if (!tmp->other_field) {
             gst_h264_picture_set_reference (tmp,
-                GST_H264_PICTURE_REF_NONE, TRUE);
-            GST_TRACE ("MMCO-3: unmark old long-term frame %p (poc %d)",
+                GST_H264_PICTURE_REF_NONE, FALSE);
+            GST_TRACE ("MMCO-3: unmark old long-term field %p (poc %d)",
                 tmp, tmp->pic_order_cnt);
-          } else if (tmp->other_field &&
-              GST_H264_PICTURE_IS_LONG_TERM_REF (tmp->other_field) &&
-              tmp->other_field->long_term_frame_idx ==
-              ref_pic_marking->long_term_frame_idx) {
-            /* When long_term_frame_idx is already assigned to a long-term
-             * reference field pair, that complementary field pair and both of
-             * its fields are marked as "unused for reference"
-             */
+          } else if (tmp->other_field != other &&
+              (!other->other_field || other->other_field != tmp)) {
             gst_h264_picture_set_reference (tmp,
-                GST_H264_PICTURE_REF_NONE, TRUE);
-            GST_TRACE ("MMCO-3: unmark old long-term field-pair %p (poc %d)",
+                GST_H264_PICTURE_REF_NONE, FALSE);
+            GST_TRACE ("MMCO-3: unmark old long-term field %p (poc %d)",
                 tmp, tmp->pic_order_cnt);
-          } else {
-            /* When long_term_frame_idx is already assigned to a reference field,
-             * and that reference field is not part of a complementary field
-             * pair that includes the picture specified by picNumX,
-             * that field is marked as "unused for reference"
-             */
-
-            /* Check "tmp" (a long-term ref pic) is part of
-             * "other" (a picture to be updated from short-term to long-term)
-             * complementary field pair */
-
-            /* NOTE: "other" here is short-ref, so "other" and "tmp" must not be
-             * identical picture */
-            if (!tmp->other_field) {
-              gst_h264_picture_set_reference (tmp,
-                  GST_H264_PICTURE_REF_NONE, FALSE);
-              GST_TRACE ("MMCO-3: unmark old long-term field %p (poc %d)",
-                  tmp, tmp->pic_order_cnt);
-            } else if (tmp->other_field != other &&
-                (!other->other_field || other->other_field != tmp)) {
-              gst_h264_picture_set_reference (tmp,
-                  GST_H264_PICTURE_REF_NONE, FALSE);
-              GST_TRACE ("MMCO-3: unmark old long-term field %p (poc %d)",
-                  tmp, tmp->pic_order_cnt);
-            }
           }
-          break;
         }
       }
 
@@ -1115,11 +1491,10 @@ gst_h264_dpb_perform_memory_management_control_operation (GstH264Dpb * dpb,
 
       GST_TRACE ("MMCO-4: max_long_term_frame_idx %d", max_long_term_frame_idx);
 
-      for (i = 0; i < dpb->pic_list->len; i++) {
-        other = g_array_index (dpb->pic_list, GstH264Picture *, i);
+      for (refs = dpb->long_term_mask; refs; refs &= refs - 1) {
+        other = dpb->slots[mask_first_slot (refs)];
 
-        if (GST_H264_PICTURE_IS_LONG_TERM_REF (other) &&
-            other->long_term_frame_idx > max_long_term_frame_idx) {
+        if (other->long_term_frame_idx > max_long_term_frame_idx) {
           gst_h264_picture_set_reference (other,
               GST_H264_PICTURE_REF_NONE, FALSE);
           GST_TRACE ("MMCO-4: unmark long-term ref pic %p, index %d, (poc %d)",
@@ -1129,11 +1504,7 @@ gst_h264_dpb_perform_memory_management_control_operation (GstH264Dpb * dpb,
       break;
     case 5:
       /* 8.2.5.4.5 Unmark all reference pictures */
-      for (i = 0; i < dpb->pic_list->len; i++) {
-        other = g_array_index (dpb->pic_list, GstH264Picture *, i);
-        gst_h264_picture_set_reference (other,
-            GST_H264_PICTURE_REF_NONE, FALSE);
-      }
+      gst_h264_dpb_mark_all_non_ref (dpb);
       picture->mem_mgmt_5 = TRUE;
       picture->frame_num = 0;
       /* When the current picture includes a memory management control operation
@@ -1159,18 +1530,13 @@ gst_h264_dpb_perform_memory_management_control_operation (GstH264Dpb * dpb,
 
       /* If we have long-term ref picture for LongTermFrameIdx,
        * mark the picture as non-reference */
-      for (i = 0; i < dpb->pic_list->len; i++) {
-        other = g_array_index (dpb->pic_list, GstH264Picture *, i);
-
-        if (GST_H264_PICTURE_IS_LONG_TERM_REF (other) &&
-            other->long_term_frame_idx ==
-            ref_pic_marking->long_term_frame_idx) {
-          GST_TRACE ("MMCO-6: unmark old long-term ref pic %p (poc %d)",
-              other, other->pic_order_cnt);
-          gst_h264_picture_set_reference (other,
-              GST_H264_PICTURE_REF_NONE, TRUE);
-          break;
-        }
+      other = gst_h264_dpb_get_long_ref_by_frame_idx (dpb,
+          ref_pic_marking->long_term_frame_idx);
+      if (other) {
+        GST_TRACE ("MMCO-6: unmark old long-term ref pic %p (poc %d)",
+            other, other->pic_order_cnt);
+        gst_h264_picture_set_reference (other,
+            GST_H264_PICTURE_REF_NONE, TRUE);
       }
 
       gst_h264_picture_set_reference (picture,
@@ -1210,11 +1576,16 @@ gst_h264_picture_set_reference (GstH264Picture * picture,
   picture->ref = reference;
   if (reference > GST_H264_PICTURE_REF_NONE)
     picture->ref_pic = TRUE;
+  if (picture->dpb)
+    gst_h264_dpb_update_slot (picture->dpb, picture);
 
   if (other_field && picture->other_field) {
     picture->other_field->ref = reference;
 
     if (reference > GST_H264_PICTURE_REF_NONE)
       picture->other_field->ref_pic = TRUE;
+    if (picture->other_field->dpb)
+      gst_h264_dpb_update_slot (picture->other_field->dpb,
+          picture->other_field);
   }
 }
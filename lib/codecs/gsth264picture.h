@@ -33,6 +33,8 @@ G_BEGIN_DECLS
 
 typedef struct _GstH264Slice GstH264Slice;
 typedef struct _GstH264Picture GstH264Picture;
+typedef struct _GstH264PicturePool GstH264PicturePool;
+typedef struct _GstH264Dpb GstH264Dpb;
 
 /* As specified in A.3.1 h) and A.3.2 f) */
 #define GST_H264_DPB_MAX_SIZE 16
@@ -163,6 +165,14 @@ struct _GstH264Picture
 
   gpointer user_data;
   GDestroyNotify notify;
+
+  /* The #GstH264Dpb holding it and its slot there, so reference marking
+   * changes reach the DPB's state */
+  GstH264Dpb *dpb;
+  gint dpb_slot;
+
+  /* The #GstH264PicturePool it goes back to, if any */
+  GstH264PicturePool *pool;
 };
 
 /**
@@ -223,10 +233,41 @@ void gst_h264_picture_set_user_data (GstH264Picture * picture,
 
 gpointer gst_h264_picture_get_user_data (GstH264Picture * picture);
 
+/* a whole interlaced DPB, plus the pictures being decoded and output */
+#define GST_H264_PICTURE_POOL_DEFAULT_MAX_FREE (2 * (GST_H264_DPB_MAX_SIZE + 1) + 4)
+
+
+GstH264PicturePool * gst_h264_picture_pool_new     (guint max_free);
+
+
+GstH264PicturePool * gst_h264_picture_pool_ref     (GstH264PicturePool * pool);
+
+
+void                 gst_h264_picture_pool_unref   (GstH264PicturePool * pool);
+
+
+GstH264Picture *     gst_h264_picture_pool_acquire (GstH264PicturePool * pool);
+
 /*******************
  * GstH264Dpb *
  *******************/
-typedef struct _GstH264Dpb GstH264Dpb;
+
+/**
+ * GstH264DpbRefIter:
+ *
+ * Walks the reference pictures of a #GstH264Dpb without taking references
+ * to them. Must be initialized with gst_h264_dpb_ref_iter_init(), and the
+ * #GstH264Dpb not modified while walking it.
+ */
+typedef struct _GstH264DpbRefIter
+{
+  /*< private >*/
+  GstH264Dpb *dpb;
+  guint index;
+  gboolean long_term;
+  gboolean include_non_existing;
+  gboolean include_second_field;
+} GstH264DpbRefIter;
 
 
 GstH264Dpb * gst_h264_dpb_new (void);
@@ -291,6 +332,15 @@ void  gst_h264_dpb_get_pictures_long_term_ref  (GstH264Dpb * dpb,
                                                 GArray * out);
 
 
+void  gst_h264_dpb_ref_iter_init               (GstH264DpbRefIter * iter,
+                                                GstH264Dpb * dpb,
+                                                gboolean include_non_existing,
+                                                gboolean include_second_field);
+
+
+GstH264Picture * gst_h264_dpb_ref_iter_next    (GstH264DpbRefIter * iter);
+
+
 GArray * gst_h264_dpb_get_pictures_all         (GstH264Dpb * dpb);
 
 
@@ -32,6 +32,7 @@
 
 #include <gst/base/base.h>
 #include "gsth265decoder.h"
+#include "gstcodecnal.h"
 
 GST_DEBUG_CATEGORY (gst_h265_decoder_debug);
 #define GST_CAT_DEFAULT gst_h265_decoder_debug
@@ -96,10 +97,10 @@ struct _GstH265DecoderPrivate
   GstH265Picture *current_picture;
   GstVideoCodecFrame *current_frame;
 
-  /* Slice (slice header + nalu) currently being processed/decoded */
+  /* Slice (slice header + nalu) currently being processed/decoded. For a
+   * dependent slice segment, most of the header is still the one of the
+   * independent slice segment before. */
   GstH265Slice current_slice;
-  GstH265Slice prev_slice;
-  GstH265Slice prev_independent_slice;
 
   gint32 poc;                   // PicOrderCntVal
   gint32 poc_msb;               // PicOrderCntMsb
@@ -128,6 +129,11 @@ struct _GstH265DecoderPrivate
   GArray *ref_pic_list1;
 
   GArray *nalu;
+  /* NAL units of the current byte-stream buffer */
+  GArray *nal_table;
+
+  /* Recycles the pictures, non-existing ones included */
+  GstH265PicturePool *picture_pool;
 
   /* For delayed output */
   guint preferred_output_delay;
@@ -135,14 +141,19 @@ struct _GstH265DecoderPrivate
   GstQueueArray *output_queue;
 };
 
+/* A NAL unit of the current buffer, staged until all of them are parsed.
+ * Only a handle: slices are parsed when decoded, and SPSs are taken from
+ * the parser table. */
 typedef struct
 {
-  union
-  {
-    GstH265SPS sps;
-    GstH265Slice slice;
-  } unit;
+  /* points to the mapped input buffer */
+  GstH265NalUnit unit;
   gboolean is_slice;
+  /* of an SPS */
+  guint sps_id;
+  /* of a slice, as the NAL units preceding it leave them */
+  gboolean no_rasl_output_flag;
+  gboolean clear_dpb;
 } GstH265DecoderNalUnit;
 
 typedef struct
@@ -159,6 +170,9 @@ typedef struct
     *(ret) = new_ret; \
 } G_STMT_END
 
+/* a NAL unit couldn't be decoded, and neither will those after it */
+#define GST_H265_DECODER_FLOW_SKIP GST_FLOW_CUSTOM_SUCCESS
+
 #define parent_class gst_h265_decoder_parent_class
 G_DEFINE_ABSTRACT_TYPE_WITH_CODE (GstH265Decoder, gst_h265_decoder,
     GST_TYPE_VIDEO_DECODER,
@@ -185,7 +199,6 @@ static void gst_h265_decoder_clear_dpb (GstH265Decoder * self, gboolean flush);
 static GstFlowReturn gst_h265_decoder_drain_internal (GstH265Decoder * self);
 static GstFlowReturn
 gst_h265_decoder_start_current_picture (GstH265Decoder * self);
-static void gst_h265_decoder_clear_nalu (GstH265DecoderNalUnit * nalu);
 static void
 gst_h265_decoder_clear_output_frame (GstH265DecoderOutputFrame * output_frame);
 
@@ -224,10 +237,11 @@ gst_h265_decoder_init (GstH265Decoder * self)
       sizeof (GstH265Picture *), 32);
   priv->ref_pic_list1 = g_array_sized_new (FALSE, TRUE,
       sizeof (GstH265Picture *), 32);
-  priv->nalu = g_array_sized_new (FALSE, TRUE, sizeof (GstH265DecoderNalUnit),
-      8);
-  g_array_set_clear_func (priv->nalu,
-      (GDestroyNotify) gst_h265_decoder_clear_nalu);
+  priv->nalu = g_array_sized_new (FALSE, FALSE,
+      sizeof (GstH265DecoderNalUnit), 8);
+  priv->nal_table = g_array_sized_new (FALSE, FALSE, sizeof (GstCodecNal), 16);
+  priv->picture_pool =
+      gst_h265_picture_pool_new (GST_H265_PICTURE_POOL_DEFAULT_MAX_FREE);
   priv->output_queue =
       gst_queue_array_new_for_struct (sizeof (GstH265DecoderOutputFrame), 1);
   gst_queue_array_set_clear_func (priv->output_queue,
@@ -244,6 +258,8 @@ gst_h265_decoder_finalize (GObject * object)
   g_array_unref (priv->ref_pic_list0);
   g_array_unref (priv->ref_pic_list1);
   g_array_unref (priv->nalu);
+  g_array_unref (priv->nal_table);
+  gst_h265_picture_pool_unref (priv->picture_pool);
   gst_queue_array_free (priv->output_queue);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
@@ -492,13 +508,13 @@ gst_h265_decoder_parse_sei (GstH265Decoder * self, GstH265NalUnit * nalu)
 
 static void
 gst_h265_decoder_process_ref_pic_lists (GstH265Decoder * self,
-    GstH265Picture * curr_pic, GstH265Slice * slice,
+    GstH265Picture * curr_pic, const GstH265Slice * slice,
     GArray ** ref_pic_list0, GArray ** ref_pic_list1)
 {
   GstH265DecoderPrivate *priv = self->priv;
-  GstH265RefPicListModification *ref_mod =
+  const GstH265RefPicListModification *ref_mod =
       &slice->header.ref_pic_list_modification;
-  GstH265PPSSccExtensionParams *scc_ext =
+  const GstH265PPSSccExtensionParams *scc_ext =
       &slice->header.pps->pps_scc_extension_params;
   GArray *tmp_refs;
   gint num_tmp_refs, i;
@@ -661,25 +677,11 @@ gst_h265_decoder_preprocess_slice (GstH265Decoder * self, GstH265Slice * slice)
 }
 
 static GstFlowReturn
-gst_h265_decoder_process_slice (GstH265Decoder * self, GstH265Slice * slice)
+gst_h265_decoder_process_slice (GstH265Decoder * self)
 {
   GstH265DecoderPrivate *priv = self->priv;
   GstFlowReturn ret = GST_FLOW_OK;
 
-  priv->current_slice = *slice;
-
-  if (priv->current_slice.header.dependent_slice_segment_flag) {
-    GstH265SliceHdr *slice_hdr = &priv->current_slice.header;
-    GstH265SliceHdr *indep_slice_hdr = &priv->prev_independent_slice.header;
-
-    memcpy (&slice_hdr->type, &indep_slice_hdr->type,
-        G_STRUCT_OFFSET (GstH265SliceHdr, num_entry_point_offsets) -
-        G_STRUCT_OFFSET (GstH265SliceHdr, type));
-  } else {
-    priv->prev_independent_slice = priv->current_slice;
-    memset (&priv->prev_independent_slice.nalu, 0, sizeof (GstH265NalUnit));
-  }
-
   ret = gst_h265_decoder_preprocess_slice (self, &priv->current_slice);
   if (ret != GST_FLOW_OK)
     return ret;
@@ -694,7 +696,7 @@ gst_h265_decoder_process_slice (GstH265Decoder * self, GstH265Slice * slice)
 
     g_assert (priv->current_frame);
 
-    picture = gst_h265_picture_new ();
+    picture = gst_h265_picture_pool_acquire (priv->picture_pool);
     /* This allows accessing the frame from the picture. */
     picture->system_frame_number = priv->current_frame->system_frame_number;
 
@@ -724,31 +726,16 @@ gst_h265_decoder_process_slice (GstH265Decoder * self, GstH265Slice * slice)
   return gst_h265_decoder_decode_slice (self);
 }
 
+/* The header of a slice is only parsed when decoded, but process_sps()
+ * needs to know before whether prior pictures are output. */
 static GstH265ParserResult
-gst_h265_decoder_parse_slice (GstH265Decoder * self, GstH265NalUnit * nalu)
+gst_h265_decoder_stage_slice (GstH265Decoder * self, GstH265NalUnit * nalu)
 {
   GstH265DecoderPrivate *priv = self->priv;
-  GstH265ParserResult pres;
-  GstH265Slice slice;
-  GstH265DecoderNalUnit decoder_nalu;
-
-  memset (&slice, 0, sizeof (GstH265Slice));
-
-  pres = gst_h265_parser_parse_slice_hdr (priv->parser, nalu, &slice.header);
-  if (pres != GST_H265_PARSER_OK)
-    return pres;
-
-  /* NOTE: gst_h265_parser_parse_slice_hdr() allocates array
-   * GstH265SliceHdr::entry_point_offset_minus1 but we don't use it
-   * in this h265decoder baseclass at the moment
-   */
-  gst_h265_slice_hdr_free (&priv->current_slice.header);
-  slice.nalu = *nalu;
+  GstH265DecoderNalUnit decoder_nalu = { 0, };
 
-  if (nalu->type >= GST_H265_NAL_SLICE_BLA_W_LP &&
-      nalu->type <= GST_H265_NAL_SLICE_CRA_NUT) {
-    slice.rap_pic_flag = TRUE;
-  }
+  decoder_nalu.unit = *nalu;
+  decoder_nalu.is_slice = TRUE;
 
   /* NoRaslOutputFlag == 1 if the current picture is
    * 1) an IDR picture
@@ -761,34 +748,79 @@ gst_h265_decoder_parse_slice (GstH265Decoder * self, GstH265NalUnit * nalu)
       GST_H265_IS_NAL_TYPE_BLA (nalu->type) ||
       (GST_H265_IS_NAL_TYPE_CRA (nalu->type) && priv->new_bitstream) ||
       priv->prev_nal_is_eos) {
-    slice.no_rasl_output_flag = TRUE;
+    decoder_nalu.no_rasl_output_flag = TRUE;
   }
 
-  if (GST_H265_IS_NAL_TYPE_IRAP (nalu->type)) {
-    slice.intra_pic_flag = TRUE;
+  if (GST_H265_IS_NAL_TYPE_IRAP (nalu->type) &&
+      decoder_nalu.no_rasl_output_flag && !priv->new_bitstream) {
+    /* C 3.2 */
+    decoder_nalu.clear_dpb = TRUE;
 
-    if (slice.no_rasl_output_flag && !priv->new_bitstream) {
-      /* C 3.2 */
-      slice.clear_dpb = TRUE;
-      if (nalu->type == GST_H265_NAL_SLICE_CRA_NUT) {
-        slice.no_output_of_prior_pics_flag = TRUE;
-      } else {
-        slice.no_output_of_prior_pics_flag =
-            slice.header.no_output_of_prior_pics_flag;
-      }
+    /* no_output_of_prior_pics_flag follows first_slice_segment_in_pic_flag,
+     * right after the NAL unit header */
+    if (nalu->type == GST_H265_NAL_SLICE_CRA_NUT ||
+        (nalu->size > nalu->header_bytes &&
+            (nalu->data[nalu->offset + nalu->header_bytes] & 0x40))) {
+      priv->no_output_of_prior_pics_flag = TRUE;
     }
   }
 
-  if (slice.no_output_of_prior_pics_flag)
-    priv->no_output_of_prior_pics_flag = TRUE;
-
-  decoder_nalu.unit.slice = slice;
-  decoder_nalu.is_slice = TRUE;
   g_array_append_val (priv->nalu, decoder_nalu);
 
   return GST_H265_PARSER_OK;
 }
 
+/* Parses the staged slice into current_slice. */
+static GstH265ParserResult
+gst_h265_decoder_parse_slice (GstH265Decoder * self,
+    GstH265DecoderNalUnit * decoder_nalu)
+{
+  GstH265DecoderPrivate *priv = self->priv;
+  GstH265Slice *slice = &priv->current_slice;
+  GstH265NalUnit *nalu = &decoder_nalu->unit;
+  GstH265SliceHdr header;
+  GstH265ParserResult pres;
+
+  memset (&header, 0, sizeof (GstH265SliceHdr));
+
+  pres = gst_h265_parser_parse_slice_hdr (priv->parser, nalu, &header);
+  if (pres != GST_H265_PARSER_OK)
+    return pres;
+
+  /* NOTE: gst_h265_parser_parse_slice_hdr() allocates array
+   * GstH265SliceHdr::entry_point_offset_minus1 but we don't use it
+   * in this h265decoder baseclass at the moment
+   */
+  gst_h265_slice_hdr_free (&header);
+
+  if (header.dependent_slice_segment_flag) {
+    /* what goes from type to num_entry_point_offsets is taken from the
+     * independent slice segment, still in current_slice */
+    gsize type_offset = G_STRUCT_OFFSET (GstH265SliceHdr, type);
+    gsize entry_offset =
+        G_STRUCT_OFFSET (GstH265SliceHdr, num_entry_point_offsets);
+
+    memcpy (&slice->header, &header, type_offset);
+    memcpy ((guint8 *) & slice->header + entry_offset,
+        (guint8 *) & header + entry_offset,
+        sizeof (GstH265SliceHdr) - entry_offset);
+  } else {
+    slice->header = header;
+  }
+
+  slice->nalu = *nalu;
+  slice->rap_pic_flag = nalu->type >= GST_H265_NAL_SLICE_BLA_W_LP &&
+      nalu->type <= GST_H265_NAL_SLICE_CRA_NUT;
+  slice->no_rasl_output_flag = decoder_nalu->no_rasl_output_flag;
+  slice->intra_pic_flag = GST_H265_IS_NAL_TYPE_IRAP (nalu->type);
+  slice->clear_dpb = decoder_nalu->clear_dpb;
+  slice->no_output_of_prior_pics_flag = slice->clear_dpb &&
+      (nalu->type == GST_H265_NAL_SLICE_CRA_NUT ||
+      slice->header.no_output_of_prior_pics_flag);
+
+  return GST_H265_PARSER_OK;
+}
+
 static GstH265ParserResult
 gst_h265_decoder_parse_nalu (GstH265Decoder * self, GstH265NalUnit * nalu)
 {
@@ -797,7 +829,7 @@ gst_h265_decoder_parse_nalu (GstH265Decoder * self, GstH265NalUnit * nalu)
   GstH265SPS sps;
   GstH265PPS pps;
   GstH265ParserResult ret = GST_H265_PARSER_OK;
-  GstH265DecoderNalUnit decoder_nalu;
+  GstH265DecoderNalUnit decoder_nalu = { 0, };
   GstH265DecoderClass* klass = GST_H265_DECODER_GET_CLASS (self);
 
   GST_LOG_OBJECT (self, "Parsed nal type: %d, offset %d, size %d",
@@ -807,7 +839,7 @@ gst_h265_decoder_parse_nalu (GstH265Decoder * self, GstH265NalUnit * nalu)
     case GST_H265_NAL_VPS:
       ret = gst_h265_parser_parse_vps (priv->parser, nalu, &vps);
       if (klass->update_picture_parameters)
-        klass->update_picture_parameters (self, GST_H265_NAL_VPS, &vps);
+        klass->update_picture_parameters (self, GST_H265_NAL_VPS, &vps, nalu);
       break;
     case GST_H265_NAL_SPS:
       ret = gst_h265_parser_parse_sps (priv->parser, nalu, &sps, TRUE);
@@ -815,16 +847,17 @@ gst_h265_decoder_parse_nalu (GstH265Decoder * self, GstH265NalUnit * nalu)
         break;
 
       if (klass->update_picture_parameters)
-        klass->update_picture_parameters (self, GST_H265_NAL_SPS, &sps);
+        klass->update_picture_parameters (self, GST_H265_NAL_SPS, &sps, nalu);
 
-      memset (&decoder_nalu, 0, sizeof (GstH265DecoderNalUnit));
-      decoder_nalu.unit.sps = sps;
+      /* processed from the parser table, where it was just stored */
+      decoder_nalu.unit = *nalu;
+      decoder_nalu.sps_id = sps.id;
       g_array_append_val (priv->nalu, decoder_nalu);
       break;
     case GST_H265_NAL_PPS:
       ret = gst_h265_parser_parse_pps (priv->parser, nalu, &pps);
       if (klass->update_picture_parameters)
-        klass->update_picture_parameters (self, GST_H265_NAL_PPS, &pps);
+        klass->update_picture_parameters (self, GST_H265_NAL_PPS, &pps, nalu);
       break;
     case GST_H265_NAL_PREFIX_SEI:
     case GST_H265_NAL_SUFFIX_SEI:
@@ -846,7 +879,7 @@ gst_h265_decoder_parse_nalu (GstH265Decoder * self, GstH265NalUnit * nalu)
     case GST_H265_NAL_SLICE_IDR_W_RADL:
     case GST_H265_NAL_SLICE_IDR_N_LP:
     case GST_H265_NAL_SLICE_CRA_NUT:
-      ret = gst_h265_decoder_parse_slice (self, nalu);
+      ret = gst_h265_decoder_stage_slice (self, nalu);
       priv->new_bitstream = FALSE;
       priv->prev_nal_is_eos = FALSE;
       break;
@@ -871,10 +904,19 @@ static GstFlowReturn
 gst_h265_decoder_decode_nalu (GstH265Decoder * self,
     GstH265DecoderNalUnit * nalu)
 {
+  GstH265ParserResult pres;
+
   if (!nalu->is_slice)
-    return gst_h265_decoder_process_sps (self, &nalu->unit.sps);
+    return gst_h265_decoder_process_sps (self,
+        &self->priv->parser->sps[nalu->sps_id]);
+
+  pres = gst_h265_decoder_parse_slice (self, nalu);
+  if (pres != GST_H265_PARSER_OK) {
+    GST_WARNING_OBJECT (self, "Failed to parse slice header, ret %d", pres);
+    return GST_H265_DECODER_FLOW_SKIP;
+  }
 
-  return gst_h265_decoder_process_slice (self, &nalu->unit.slice);
+  return gst_h265_decoder_process_slice (self);
 }
 
 static void
@@ -978,7 +1020,8 @@ gst_h265_decoder_parse_codec_data (GstH265Decoder * self, const guint8 * data,
             return GST_FLOW_ERROR;
           }
           if (klass->update_picture_parameters)
-            klass->update_picture_parameters (self, GST_H265_NAL_VPS, &vps);
+            klass->update_picture_parameters (self, GST_H265_NAL_VPS, &vps,
+                &nalu);
           break;
         case GST_H265_NAL_SPS:
           pres = gst_h265_parser_parse_sps (priv->parser, &nalu, &sps, TRUE);
@@ -987,7 +1030,8 @@ gst_h265_decoder_parse_codec_data (GstH265Decoder * self, const guint8 * data,
             return GST_FLOW_ERROR;
           }
           if (klass->update_picture_parameters)
-            klass->update_picture_parameters (self, GST_H265_NAL_SPS, &sps);
+            klass->update_picture_parameters (self, GST_H265_NAL_SPS, &sps,
+                &nalu);
 
           ret = gst_h265_decoder_process_sps (self, &sps);
           if (ret != GST_FLOW_OK) {
@@ -1869,6 +1913,7 @@ gst_h265_decoder_handle_frame (GstVideoDecoder * decoder,
   GstH265ParserResult pres;
   GstMapInfo map;
   GstFlowReturn decode_ret = GST_FLOW_OK;
+  GstCodecNalMeta *nal_meta;
   guint i;
 
   GST_LOG_OBJECT (self,
@@ -1901,21 +1946,28 @@ gst_h265_decoder_handle_frame (GstVideoDecoder * decoder,
           &nalu);
     }
   } else {
-    pres = gst_h265_parser_identify_nalu (priv->parser,
-        map.data, 0, map.size, &nalu);
+    const GstCodecNal *nals;
+    guint n_nals;
+
+    nal_meta = gst_buffer_get_codec_nal_meta (in_buf);
+    if (nal_meta) {
+      /* already split by upstream */
+      nals = nal_meta->nals;
+      n_nals = nal_meta->n_nals;
+    } else {
+      n_nals = gst_codec_nal_table_fill (priv->nal_table, map.data, map.size);
+      nals = (const GstCodecNal *) priv->nal_table->data;
+    }
 
-    if (pres == GST_H265_PARSER_NO_NAL_END)
-      pres = GST_H265_PARSER_OK;
+    for (i = 0; i < n_nals; i++) {
+      pres = gst_h265_parser_identify_nalu_unchecked (priv->parser,
+          map.data, nals[i].sc_offset, nals[i].end, &nalu);
+      if (pres != GST_H265_PARSER_OK)
+        break;
 
-    while (pres == GST_H265_PARSER_OK) {
       pres = gst_h265_decoder_parse_nalu (self, &nalu);
       if (pres != GST_H265_PARSER_OK)
         break;
-
-      pres = gst_h265_parser_identify_nalu (priv->parser,
-          map.data, nalu.offset + nalu.size, map.size, &nalu);
-      if (pres == GST_H265_PARSER_NO_NAL_END)
-        pres = GST_H265_PARSER_OK;
     }
   }
 
@@ -1925,9 +1977,16 @@ gst_h265_decoder_handle_frame (GstVideoDecoder * decoder,
     decode_ret = gst_h265_decoder_decode_nalu (self, decoder_nalu);
   }
 
-  gst_buffer_unmap (in_buf, &map);
+  /* as if the buffer ended before the slice which couldn't be parsed */
+  if (decode_ret == GST_H265_DECODER_FLOW_SKIP)
+    decode_ret = GST_FLOW_OK;
+
   gst_h265_decoder_reset_frame_state (self);
 
+  /* The subclass might keep pointers into the mapped buffer up to
+   * end_picture(), and the frame might be released before unmapping. */
+  gst_buffer_ref (in_buf);
+
   if (decode_ret != GST_FLOW_OK) {
     if (decode_ret == GST_FLOW_ERROR) {
       GST_VIDEO_DECODER_ERROR (self, 1, STREAM, DECODE,
@@ -1936,33 +1995,25 @@ gst_h265_decoder_handle_frame (GstVideoDecoder * decoder,
 
     gst_video_decoder_drop_frame (decoder, frame);
     gst_clear_h265_picture (&priv->current_picture);
-
-    return decode_ret;
-  }
-
-  if (priv->current_picture) {
-    gst_h265_decoder_finish_current_picture (self, &decode_ret);
-    gst_video_codec_frame_unref (frame);
   } else {
-    /* This picture was dropped */
-    gst_video_decoder_release_frame (decoder, frame);
-  }
+    if (priv->current_picture) {
+      gst_h265_decoder_finish_current_picture (self, &decode_ret);
+      gst_video_codec_frame_unref (frame);
+    } else {
+      /* This picture was dropped */
+      gst_video_decoder_release_frame (decoder, frame);
+    }
 
-  if (decode_ret == GST_FLOW_ERROR) {
-    GST_VIDEO_DECODER_ERROR (self, 1, STREAM, DECODE,
-        ("Failed to decode data"), (NULL), decode_ret);
+    if (decode_ret == GST_FLOW_ERROR) {
+      GST_VIDEO_DECODER_ERROR (self, 1, STREAM, DECODE,
+          ("Failed to decode data"), (NULL), decode_ret);
+    }
   }
 
-  return decode_ret;
-}
-
-static void
-gst_h265_decoder_clear_nalu (GstH265DecoderNalUnit * nalu)
-{
-  if (!nalu)
-    return;
+  gst_buffer_unmap (in_buf, &map);
+  gst_buffer_unref (in_buf);
 
-  memset (nalu, 0, sizeof (GstH265DecoderNalUnit));
+  return decode_ret;
 }
 
 /**
@@ -1981,6 +2032,88 @@ gst_h265_decoder_set_process_ref_pic_lists (GstH265Decoder * decoder,
   decoder->priv->process_ref_pic_lists = process;
 }
 
+/**
+ * gst_h265_decoder_reparse_slice:
+ * @decoder: a #GstH265Decoder
+ * @data: a slice segment NAL unit, start code prefix included
+ * @size: the size of @data
+ * @slice: (out): the parsed slice
+ *
+ * Parses again a slice segment of the current picture, as handed to
+ * #GstH265DecoderClass.decode_slice(), for
+ * gst_h265_decoder_build_ref_pic_lists(). Unlike there, the header of a
+ * dependent slice segment isn't completed with the one of its independent
+ * slice segment. @slice points to @data, its entry points aren't kept.
+ *
+ * Returns: %TRUE if @data is a slice segment which could be parsed
+ */
+gboolean
+gst_h265_decoder_reparse_slice (GstH265Decoder * decoder, const guint8 * data,
+    gsize size, GstH265Slice * slice)
+{
+  GstH265DecoderPrivate *priv = decoder->priv;
+  GstH265ParserResult pres;
+
+  memset (slice, 0, sizeof (GstH265Slice));
+
+  pres = gst_h265_parser_identify_nalu (priv->parser, data, 0, size,
+      &slice->nalu);
+  if (pres != GST_H265_PARSER_OK && pres != GST_H265_PARSER_NO_NAL_END)
+    return FALSE;
+
+  if (slice->nalu.type > GST_H265_NAL_SLICE_CRA_NUT)
+    return FALSE;
+
+  pres = gst_h265_parser_parse_slice_hdr (priv->parser, &slice->nalu,
+      &slice->header);
+  if (pres != GST_H265_PARSER_OK) {
+    GST_WARNING_OBJECT (decoder, "Failed to parse slice header, ret %d", pres);
+    return FALSE;
+  }
+
+  gst_h265_slice_hdr_free (&slice->header);
+
+  return TRUE;
+}
+
+/**
+ * gst_h265_decoder_build_ref_pic_lists:
+ * @decoder: a #GstH265Decoder
+ * @slice: an independent slice segment of the current picture
+ * @ref_pic_list0: (out) (transfer none): the RefPicList0 of @slice, an array
+ *    of #GstH265Picture pointers
+ * @ref_pic_list1: (out) (transfer none): the RefPicList1 of @slice, an array
+ *    of #GstH265Picture pointers
+ *
+ * Builds the reference picture lists of @slice as they would be given to
+ * #GstH265DecoderClass.decode_slice() had the process been enabled with
+ * gst_h265_decoder_set_process_ref_pic_lists(), for subclasses needing them
+ * only for some slices. Dependent slice segments have those of the
+ * independent one preceding them. Only to be called from
+ * #GstH265DecoderClass.start_picture() to #GstH265DecoderClass.end_picture()
+ * of the picture @slice belongs to. The lists are valid until the next call
+ * or the end of the picture.
+ *
+ * Returns: %TRUE if the lists could be built
+ */
+gboolean
+gst_h265_decoder_build_ref_pic_lists (GstH265Decoder * decoder,
+    const GstH265Slice * slice, GArray ** ref_pic_list0,
+    GArray ** ref_pic_list1)
+{
+  GstH265DecoderPrivate *priv = decoder->priv;
+
+  g_return_val_if_fail (priv->current_picture != NULL, FALSE);
+  g_return_val_if_fail (!slice->header.dependent_slice_segment_flag, FALSE);
+
+  g_array_set_size (priv->ref_pic_list0, 0);
+  g_array_set_size (priv->ref_pic_list1, 0);
+  gst_h265_decoder_process_ref_pic_lists (decoder, priv->current_picture,
+      slice, ref_pic_list0, ref_pic_list1);
+
+  return TRUE;
+}
+
 /**
  * gst_h265_decoder_get_picture:
  * @decoder: a #GstH265Decoder
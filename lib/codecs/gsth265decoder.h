@@ -186,9 +186,20 @@ struct _GstH265DecoderClass
                                          const guint8 * data,
                                          guint32 len);
 
+  /**
+   * GstH265DecoderClass::update_picture_parameters:
+   * @decoder: a #GstH265Decoder
+   * @type: the type of the parameter set
+   * @nalu: the parsed #GstH265VPS, #GstH265SPS or #GstH265PPS
+   * @unit: the #GstH265NalUnit it was parsed from
+   *
+   * Optional. Called by baseclass for every parameter set parsed, repeated
+   * or not.
+   */
   void (*update_picture_parameters)     (GstH265Decoder* decoder,
                                          GstH265NalUnitType type,
-                                         const gpointer nalu);
+                                         const gpointer nalu,
+                                         const GstH265NalUnit * unit);
 
 
   /*< private >*/
@@ -204,6 +215,16 @@ GType gst_h265_decoder_get_type (void);
 void gst_h265_decoder_set_process_ref_pic_lists (GstH265Decoder * decoder,
                                                  gboolean process);
 
+gboolean gst_h265_decoder_reparse_slice         (GstH265Decoder * decoder,
+                                                 const guint8 * data,
+                                                 gsize size,
+                                                 GstH265Slice * slice);
+
+gboolean gst_h265_decoder_build_ref_pic_lists   (GstH265Decoder * decoder,
+                                                 const GstH265Slice * slice,
+                                                 GArray ** ref_pic_list0,
+                                                 GArray ** ref_pic_list1);
+
 
 GstH265Picture * gst_h265_decoder_get_picture   (GstH265Decoder * decoder,
                                                  guint32 system_frame_number);
@@ -22,12 +22,23 @@
 #endif
 
 #include "gsth265picture.h"
+#include <string.h>
 
 GST_DEBUG_CATEGORY_EXTERN (gst_h265_decoder_debug);
 #define GST_CAT_DEFAULT gst_h265_decoder_debug
 
 GST_DEFINE_MINI_OBJECT_TYPE (GstH265Picture, gst_h265_picture);
 
+struct _GstH265PicturePool
+{
+  gint ref_count;
+  guint max_free;
+
+  GMutex lock;
+  /* reset pictures, each holding a reference kept by the pool */
+  GPtrArray *free;
+};
+
 static void
 _gst_h265_picture_free (GstH265Picture * picture)
 {
@@ -37,6 +48,57 @@ _gst_h265_picture_free (GstH265Picture * picture)
   g_free (picture);
 }
 
+static void
+gst_h265_picture_init (GstH265Picture * picture)
+{
+  picture->pic_struct = GST_H265_SEI_PIC_STRUCT_FRAME;
+  /* 0: interlaced, 1: progressive, 2: unspecified, 3: reserved, can be
+   * interpreted as 2 */
+  picture->source_scan_type = 2;
+  picture->duplicate_flag = 0;
+}
+
+/* Drops the user data of picture and sets it as gst_h265_picture_new() does,
+ * but for its #GstMiniObject */
+static void
+gst_h265_picture_reset (GstH265Picture * picture)
+{
+  if (picture->notify)
+    picture->notify (picture->user_data);
+
+  memset ((guint8 *) picture + sizeof (GstMiniObject), 0,
+      sizeof (GstH265Picture) - sizeof (GstMiniObject));
+  GST_MINI_OBJECT_FLAGS (picture) = 0;
+  gst_h265_picture_init (picture);
+}
+
+/* Pooled pictures are reset and kept by the pool when their last reference
+ * goes, if it isn't full */
+static gboolean
+_gst_h265_picture_dispose (GstH265Picture * picture)
+{
+  GstH265PicturePool *pool = picture->pool;
+  gboolean recycled = FALSE;
+
+  if (!pool)
+    return TRUE;
+
+  gst_h265_picture_reset (picture);
+
+  g_mutex_lock (&pool->lock);
+  if (pool->free->len < pool->max_free) {
+    gst_mini_object_ref (GST_MINI_OBJECT_CAST (picture));
+    g_ptr_array_add (pool->free, picture);
+    recycled = TRUE;
+  }
+  g_mutex_unlock (&pool->lock);
+
+  /* might free picture, if it was the last one holding the pool */
+  gst_h265_picture_pool_unref (pool);
+
+  return !recycled;
+}
+
 /**
  * gst_h265_picture_new:
  *
@@ -51,14 +113,11 @@ gst_h265_picture_new (void)
 
   pic = g_new0 (GstH265Picture, 1);
 
-  pic->pic_struct = GST_H265_SEI_PIC_STRUCT_FRAME;
-  /* 0: interlaced, 1: progressive, 2: unspecified, 3: reserved, can be
-   * interpreted as 2 */
-  pic->source_scan_type = 2;
-  pic->duplicate_flag = 0;
+  gst_h265_picture_init (pic);
 
   gst_mini_object_init (GST_MINI_OBJECT_CAST (pic), 0,
-      GST_TYPE_H265_PICTURE, NULL, NULL,
+      GST_TYPE_H265_PICTURE, NULL,
+      (GstMiniObjectDisposeFunction) _gst_h265_picture_dispose,
       (GstMiniObjectFreeFunction) _gst_h265_picture_free);
 
   return pic;
@@ -104,6 +163,96 @@ gst_h265_picture_get_user_data (GstH265Picture * picture)
   return picture->user_data;
 }
 
+/**
+ * gst_h265_picture_pool_new:
+ * @max_free: the number of unused pictures to keep
+ *
+ * Create a new #GstH265PicturePool, which recycles the #GstH265Picture
+ * acquired from it once they aren't referenced anymore, up to @max_free of
+ * them. Each acquired picture keeps a reference to the pool.
+ *
+ * Returns: a new #GstH265PicturePool
+ */
+GstH265PicturePool *
+gst_h265_picture_pool_new (guint max_free)
+{
+  GstH265PicturePool *pool = g_new0 (GstH265PicturePool, 1);
+
+  pool->ref_count = 1;
+  pool->max_free = max_free;
+  g_mutex_init (&pool->lock);
+  pool->free = g_ptr_array_sized_new (max_free);
+
+  return pool;
+}
+
+/**
+ * gst_h265_picture_pool_ref:
+ * @pool: a #GstH265PicturePool
+ *
+ * Returns: @pool
+ */
+GstH265PicturePool *
+gst_h265_picture_pool_ref (GstH265PicturePool * pool)
+{
+  g_return_val_if_fail (pool != NULL, NULL);
+
+  g_atomic_int_inc (&pool->ref_count);
+  return pool;
+}
+
+/**
+ * gst_h265_picture_pool_unref:
+ * @pool: a #GstH265PicturePool
+ *
+ * Frees @pool and the pictures kept by it when the last reference goes.
+ */
+void
+gst_h265_picture_pool_unref (GstH265PicturePool * pool)
+{
+  guint i;
+
+  g_return_if_fail (pool != NULL);
+
+  if (!g_atomic_int_dec_and_test (&pool->ref_count))
+    return;
+
+  for (i = 0; i < pool->free->len; i++)
+    gst_h265_picture_unref (g_ptr_array_index (pool->free, i));
+  g_ptr_array_unref (pool->free);
+  g_mutex_clear (&pool->lock);
+  g_free (pool);
+}
+
+/**
+ * gst_h265_picture_pool_acquire:
+ * @pool: a #GstH265PicturePool
+ *
+ * Like gst_h265_picture_new(), but reusing a #GstH265Picture released to
+ * @pool, if any.
+ *
+ * Returns: (transfer full): a #GstH265Picture
+ */
+GstH265Picture *
+gst_h265_picture_pool_acquire (GstH265PicturePool * pool)
+{
+  GstH265Picture *picture = NULL;
+
+  g_return_val_if_fail (pool != NULL, NULL);
+
+  g_mutex_lock (&pool->lock);
+  if (pool->free->len > 0)
+    picture = g_ptr_array_remove_index_fast (pool->free, pool->free->len - 1);
+  g_mutex_unlock (&pool->lock);
+
+  if (!picture)
+    picture = gst_h265_picture_new ();
+
+  picture->pool = gst_h265_picture_pool_ref (pool);
+
+  return picture;
+}
+
 struct _GstH265Dpb
 {
   GArray *pic_list;
@@ -190,6 +339,8 @@ gst_h265_dpb_clear (GstH265Dpb * dpb)
 {
   g_return_if_fail (dpb != NULL);
 
+  /* not references anymore for those still holding them */
+  gst_h265_dpb_mark_all_non_ref (dpb);
   g_array_set_size (dpb->pic_list, 0);
   dpb->num_output_needed = 0;
 }
@@ -620,8 +771,10 @@ gst_h265_dpb_bump (GstH265Dpb * dpb, gboolean drain)
   dpb->num_output_needed--;
   g_assert (dpb->num_output_needed >= 0);
 
-  if (!picture->ref || drain)
+  if (!picture->ref || drain) {
+    picture->ref = FALSE;
     g_array_remove_index_fast (dpb->pic_list, index);
+  }
 
   return picture;
 }
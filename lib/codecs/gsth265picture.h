@@ -40,6 +40,7 @@ G_BEGIN_DECLS
 
 typedef struct _GstH265Slice GstH265Slice;
 typedef struct _GstH265Picture GstH265Picture;
+typedef struct _GstH265PicturePool GstH265PicturePool;
 
 #define GST_H265_DPB_MAX_SIZE 16
 
@@ -93,6 +94,9 @@ struct _GstH265Picture
 
   gpointer user_data;
   GDestroyNotify notify;
+
+  /* The #GstH265PicturePool it goes back to, if any */
+  GstH265PicturePool *pool;
 };
 
 
@@ -138,6 +142,21 @@ void gst_h265_picture_set_user_data (GstH265Picture * picture,
 
 gpointer gst_h265_picture_get_user_data (GstH265Picture * picture);
 
+/* a whole DPB, plus the pictures being decoded and output */
+#define GST_H265_PICTURE_POOL_DEFAULT_MAX_FREE (GST_H265_DPB_MAX_SIZE + 4)
+
+
+GstH265PicturePool * gst_h265_picture_pool_new     (guint max_free);
+
+
+GstH265PicturePool * gst_h265_picture_pool_ref     (GstH265PicturePool * pool);
+
+
+void                 gst_h265_picture_pool_unref   (GstH265PicturePool * pool);
+
+
+GstH265Picture *     gst_h265_picture_pool_acquire (GstH265PicturePool * pool);
+
 /*******************
  * GstH265Dpb *
  *******************/
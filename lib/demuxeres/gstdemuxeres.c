@@ -56,8 +56,6 @@ struct _GstDemuxerESPrivate
   GCond ready_cond;
   GMutex ready_mutex;
 
-  GThread *bus_thread;
-  gboolean bus_exit;
   GstSample *pending_sample;
 };
 
@@ -90,6 +88,19 @@ set_demuxer_state (GstDemuxerES * demuxer, GstDemuxerESState state)
   g_mutex_unlock (&priv->ready_mutex);
 }
 
+static inline GstDemuxerESState
+get_demuxer_state (GstDemuxerES * demuxer)
+{
+  GstDemuxerESPrivate *priv = demuxer->priv;
+  GstDemuxerESState state;
+
+  g_mutex_lock (&priv->ready_mutex);
+  state = priv->state;
+  g_mutex_unlock (&priv->ready_mutex);
+
+  return state;
+}
+
 static GstDemuxerEStream *
 find_stream (GstDemuxerES * demuxer, const gchar * stream_id)
 {
@@ -479,32 +490,20 @@ uridecodebin_autoplug_query_cb (GstElement * uridecodebin, GstPad * pad,
   }
 }
 
-static gboolean
+/* Called by the thread posting the message, so the demuxer state changes
+ * right away without any thread waiting on the bus. It must not block. */
+static GstBusSyncReply
 handle_bus_message (GstBus * bus, GstMessage * message, GstDemuxerES * demuxer)
 {
-  GstDemuxerESPrivate *priv = demuxer->priv;
   switch (GST_MESSAGE_TYPE (message)) {
     case GST_MESSAGE_ERROR:
     {
-      set_demuxer_state (demuxer, DEMUXER_ES_STATE_ERROR);;
+      set_demuxer_state (demuxer, DEMUXER_ES_STATE_ERROR);
       break;
     }
     case GST_MESSAGE_EOS:
     {
-      set_demuxer_state (demuxer, DEMUXER_ES_STATE_EOS);;
-      break;
-    }
-    case GST_MESSAGE_ELEMENT:
-    {
-      const GstStructure *s;
-      const char *sname;
-      s = gst_message_get_structure (message);
-      sname = gst_structure_get_name (s);
-      if ((GST_MESSAGE_SRC (message) == GST_OBJECT (priv->pipeline)) &&
-          (!g_strcmp0 (sname, "exit"))) {
-        GST_DEBUG ("`exit` message received");
-        priv->bus_exit = TRUE;
-      }
+      set_demuxer_state (demuxer, DEMUXER_ES_STATE_EOS);
       break;
     }
     default:
@@ -512,37 +511,7 @@ handle_bus_message (GstBus * bus, GstMessage * message, GstDemuxerES * demuxer)
       break;
   }
 
-  return TRUE;
-}
-
-static gboolean
-check_for_bus_message (GstDemuxerES * demuxer)
-{
-  GstDemuxerESPrivate *priv = demuxer->priv;
-  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (priv->pipeline));
-  gboolean check_message = TRUE;
-  while (check_message) {
-    GstMessage *message = gst_bus_timed_pop (bus, 1);
-    if (G_LIKELY (message)) {
-      handle_bus_message (bus, message, demuxer);
-      gst_message_unref (message);
-    } else
-      check_message = FALSE;
-  }
-  gst_object_unref (bus);
-
-  return TRUE;
-}
-
-static gpointer
-check_for_bus_message_cb (gpointer data)
-{
-  GstDemuxerES *demuxer = (GstDemuxerES *) data;
-  GstDemuxerESPrivate *priv = demuxer->priv;
-  while (!priv->bus_exit) {
-    check_for_bus_message (demuxer);
-  }
-  return NULL;
+  return GST_BUS_DROP;
 }
 
 GstDemuxerES *
@@ -552,6 +521,7 @@ gst_demuxer_es_new (const gchar * uri)
   GstDemuxerESPrivate *priv;
   GstElement *uridecodebin;
   GstStateChangeReturn sret;
+  GstBus *bus;
   gchar *current_uri;
 
   if (!gst_init_check (NULL, NULL, NULL))
@@ -595,8 +565,10 @@ gst_demuxer_es_new (const gchar * uri)
 
   gst_element_link_many (priv->funnel, priv->appsink, NULL);
 
-  priv->bus_thread =
-      g_thread_new ("gst_bus_thread", check_for_bus_message_cb, demuxer);
+  bus = gst_pipeline_get_bus (GST_PIPELINE (priv->pipeline));
+  gst_bus_set_sync_handler (bus, (GstBusSyncHandler) handle_bus_message,
+      demuxer, NULL);
+  gst_object_unref (bus);
 
   sret = gst_element_set_state (priv->pipeline, GST_STATE_PLAYING);
   switch (sret) {
@@ -644,8 +616,7 @@ gst_demuxer_es_read_packet (GstDemuxerES * demuxer,
   GstDemuxerESPrivate *priv = demuxer->priv;
   GstDemuxerESResult result = DEMUXER_ES_RESULT_NO_PACKET;
 
-  check_for_bus_message (demuxer);
-  if (priv->state == DEMUXER_ES_STATE_ERROR) {
+  if (get_demuxer_state (demuxer) == DEMUXER_ES_STATE_ERROR) {
     return DEMUXER_ES_RESULT_ERROR;
   }
 
@@ -654,7 +625,7 @@ gst_demuxer_es_read_packet (GstDemuxerES * demuxer,
   if (queued_packet) {
     *packet = queued_packet;
     result = DEMUXER_ES_RESULT_NEW_PACKET;
-    if (priv->state == DEMUXER_ES_STATE_EOS) {
+    if (get_demuxer_state (demuxer) == DEMUXER_ES_STATE_EOS) {
       result = DEMUXER_ES_RESULT_LAST_PACKET;
       GST_LOG ("A %s packet of type %d stream_id %d with size %lu.",
           (result == DEMUXER_ES_RESULT_LAST_PACKET) ? "last" : "new",
@@ -698,28 +669,20 @@ static void
 _gst_demuxer_es_cleanup_bus_watch (GstDemuxerES * demuxer)
 {
   g_assert (demuxer != NULL);
-  GstDemuxerESPrivate *priv = demuxer->priv;
   GstBus *bus = gst_element_get_bus (demuxer->priv->pipeline);
-  GThread *bus_thread = priv->bus_thread;
-  if (G_LIKELY (bus) && priv->bus_thread) {
-    gst_bus_post (bus,
-        gst_message_new_element (GST_OBJECT (priv->pipeline),
-            gst_structure_new_empty ("exit")));
-    GST_LOG ("waiting for message bus thread");
-    priv->bus_thread = NULL;
+  if (G_LIKELY (bus)) {
+    gst_bus_set_sync_handler (bus, NULL, NULL, NULL);
     gst_object_unref (bus);
-
-    g_thread_join (bus_thread);
   }
-  priv->bus_exit = TRUE;
 }
 
 void
 gst_demuxer_es_teardown (GstDemuxerES * demuxer)
 {
   GstDemuxerESPrivate *priv = demuxer->priv;
-  _gst_demuxer_es_cleanup_bus_watch (demuxer);
+  /* stop the streaming threads before their messages stop being handled */
   gst_element_set_state (priv->pipeline, GST_STATE_NULL);
+  _gst_demuxer_es_cleanup_bus_watch (demuxer);
 
   g_list_free_full (priv->streams, (GDestroyNotify) gst_parse_stream_teardown);
   gst_object_unref (priv->pipeline);
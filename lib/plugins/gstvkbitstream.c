@@ -0,0 +1,370 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "gstvkbitstream.h"
+
+#include <string.h>
+
+struct _GstVkBitstreamArena
+{
+  gint ref_count;
+
+  /* of data, and of its size once padded */
+  gsize offset_alignment;
+  gsize size_alignment;
+
+  /* client provided storage, instead of storage */
+  GstVkBitstreamStorageGetFunc storage_get;
+  GstVkBitstreamStorageReleaseFunc storage_release;
+  gpointer storage_data;
+
+  GMutex lock;
+  /* released bitstreams, keeping their storage */
+  GPtrArray *free;
+  /* heap (re)allocations done so far */
+  guint64 allocations;
+  /* of the largest storage allocated so far */
+  gsize max_capacity;
+};
+
+GstVkBitstreamArena *
+gst_vk_bitstream_arena_new (void)
+{
+  GstVkBitstreamArena *arena = g_new0 (GstVkBitstreamArena, 1);
+
+  arena->ref_count = 1;
+  arena->offset_alignment = 1;
+  arena->size_alignment = 1;
+  g_mutex_init (&arena->lock);
+  arena->free = g_ptr_array_new ();
+
+  return arena;
+}
+
+GstVkBitstreamArena *
+gst_vk_bitstream_arena_ref (GstVkBitstreamArena * arena)
+{
+  g_atomic_int_inc (&arena->ref_count);
+  return arena;
+}
+
+static void
+gst_vk_bitstream_free (GstVkBitstream * bitstream)
+{
+  g_free (bitstream->storage);
+  g_free (bitstream->offsets);
+  g_free (bitstream->segments);
+  g_free (bitstream);
+}
+
+void
+gst_vk_bitstream_arena_unref (GstVkBitstreamArena * arena)
+{
+  guint i;
+
+  if (!g_atomic_int_dec_and_test (&arena->ref_count))
+    return;
+
+  for (i = 0; i < arena->free->len; i++)
+    gst_vk_bitstream_free ((GstVkBitstream *) g_ptr_array_index (arena->free, i));
+  g_ptr_array_unref (arena->free);
+  g_mutex_clear (&arena->lock);
+  g_free (arena);
+}
+
+/* The offset alignment has to be a power of two. Only to be called before
+ * acquiring any bitstream. */
+void
+gst_vk_bitstream_arena_set_alignment (GstVkBitstreamArena * arena,
+    guint offset_alignment, guint size_alignment)
+{
+  g_return_if_fail (offset_alignment > 0
+      && (offset_alignment & (offset_alignment - 1)) == 0);
+  g_return_if_fail (size_alignment > 0);
+
+  arena->offset_alignment = offset_alignment;
+  arena->size_alignment = size_alignment;
+}
+
+/* Slice data is written into memory got from get, instead of the arena's.
+ * That memory isn't recycled: it's given back through release once the
+ * picture is decoded. Only to be called before acquiring any bitstream. */
+void
+gst_vk_bitstream_arena_set_storage (GstVkBitstreamArena * arena,
+    GstVkBitstreamStorageGetFunc get,
+    GstVkBitstreamStorageReleaseFunc release, gpointer user_data)
+{
+  arena->storage_get = get;
+  arena->storage_release = release;
+  arena->storage_data = user_data;
+}
+
+guint64
+gst_vk_bitstream_arena_get_allocations (GstVkBitstreamArena * arena)
+{
+  guint64 allocations;
+
+  g_mutex_lock (&arena->lock);
+  allocations = arena->allocations;
+  g_mutex_unlock (&arena->lock);
+
+  return allocations;
+}
+
+static void
+gst_vk_bitstream_reserve_offsets (GstVkBitstream * bitstream, guint n)
+{
+  if (n <= bitstream->offsets_capacity)
+    return;
+
+  bitstream->offsets_capacity = MAX (n, bitstream->offsets_capacity * 2);
+  bitstream->offsets = g_renew (guint32, bitstream->offsets,
+      bitstream->offsets_capacity);
+
+  g_mutex_lock (&bitstream->arena->lock);
+  bitstream->arena->allocations++;
+  g_mutex_unlock (&bitstream->arena->lock);
+}
+
+GstVkBitstream *
+gst_vk_bitstream_arena_acquire (GstVkBitstreamArena * arena)
+{
+  GstVkBitstream *bitstream = NULL;
+
+  g_mutex_lock (&arena->lock);
+  if (arena->free->len > 0) {
+    bitstream = (GstVkBitstream *) g_ptr_array_remove_index_fast (arena->free,
+        arena->free->len - 1);
+  } else {
+    bitstream = g_new0 (GstVkBitstream, 1);
+    arena->allocations++;
+  }
+  g_mutex_unlock (&arena->lock);
+
+  bitstream->arena = gst_vk_bitstream_arena_ref (arena);
+  bitstream->size = 0;
+  bitstream->n_slices = 0;
+  bitstream->owner = NULL;
+
+  gst_vk_bitstream_reserve_offsets (bitstream, 16);
+  bitstream->offsets[0] = 0;
+
+  return bitstream;
+}
+
+/* The storage is kept for the next picture. */
+void
+gst_vk_bitstream_release (GstVkBitstream * bitstream)
+{
+  GstVkBitstreamArena *arena = bitstream->arena;
+
+  gst_vk_bitstream_release_storage (bitstream);
+  bitstream->arena = NULL;
+
+  g_mutex_lock (&arena->lock);
+  g_ptr_array_add (arena->free, bitstream);
+  g_mutex_unlock (&arena->lock);
+
+  gst_vk_bitstream_arena_unref (arena);
+}
+
+/* nvidia parser adds 000001 NAL unit identifier at every slice */
+static const guint8 nal[] = { 0, 0, 1 };
+
+/* Gives client provided storage back, if any. */
+void
+gst_vk_bitstream_release_storage (GstVkBitstream * bitstream)
+{
+  GstVkBitstreamArena *arena = bitstream->arena;
+
+  if (!arena->storage_release || !bitstream->data)
+    return;
+
+  arena->storage_release (bitstream, arena->storage_data);
+  bitstream->data = NULL;
+  bitstream->capacity = 0;
+}
+
+static gboolean
+gst_vk_bitstream_reserve (GstVkBitstream * bitstream, gsize needed)
+{
+  GstVkBitstreamArena *arena = bitstream->arena;
+  gsize alignment = arena->offset_alignment;
+  guint8 *storage, *data;
+
+  if (needed <= bitstream->capacity)
+    return TRUE;
+
+  if (arena->storage_get) {
+    gsize capacity = 0;
+
+    data = arena->storage_get (bitstream, needed, &capacity,
+        arena->storage_data);
+    if (!data)
+      return FALSE;
+
+    /* kept even if too small, to be released */
+    bitstream->data = data;
+    bitstream->capacity = capacity;
+    return capacity >= needed;
+  }
+
+  /* at least as large as the largest one so far, so bitstreams only grow
+   * for access units larger than all before, whichever they get */
+  g_mutex_lock (&arena->lock);
+  bitstream->capacity = MAX (MAX (needed, bitstream->capacity * 2),
+      arena->max_capacity);
+  arena->max_capacity = bitstream->capacity;
+  arena->allocations++;
+  g_mutex_unlock (&arena->lock);
+
+  /* data starts at the first aligned byte of the storage */
+  storage = (guint8 *) g_malloc (bitstream->capacity + alignment - 1);
+  data = (guint8 *) GSIZE_TO_POINTER ((GPOINTER_TO_SIZE (storage) +
+          alignment - 1) & ~(alignment - 1));
+  if (bitstream->size > 0)
+    memcpy (data, bitstream->data, bitstream->size);
+
+  g_free (bitstream->storage);
+  bitstream->storage = storage;
+  bitstream->data = data;
+
+  return TRUE;
+}
+
+static gboolean
+gst_vk_bitstream_copy_slice (GstVkBitstream * bitstream,
+    const guint8 * data, gsize size)
+{
+  gsize needed = bitstream->size + sizeof (nal) + size;
+
+  if (!gst_vk_bitstream_reserve (bitstream, needed))
+    return FALSE;
+
+  memcpy (bitstream->data + bitstream->size, nal, sizeof (nal));
+  memcpy (bitstream->data + bitstream->size + sizeof (nal), data, size);
+  bitstream->size = needed;
+
+  return TRUE;
+}
+
+gboolean
+gst_vk_bitstream_append_slice (GstVkBitstream * bitstream,
+    const guint8 * data, gsize size)
+{
+  if (!gst_vk_bitstream_copy_slice (bitstream, data, size))
+    return FALSE;
+
+  gst_vk_bitstream_reserve_offsets (bitstream, bitstream->n_slices + 2);
+  bitstream->offsets[++bitstream->n_slices] = (guint32) bitstream->size;
+
+  return TRUE;
+}
+
+/* Records the slice NAL unit at data + offset without copying it when it
+ * comes right after a start code, as in byte-stream input, so the segment
+ * can point there. Otherwise it's copied into the bitstream data, the
+ * segment being resolved by gst_vk_bitstream_get_segments(). */
+gboolean
+gst_vk_bitstream_add_slice_segment (GstVkBitstream * bitstream,
+    const guint8 * data, guint offset, gsize size)
+{
+  GstVkBitstreamSegment *segment;
+  guint n = bitstream->n_slices;
+
+  if (n + 1 > bitstream->segments_capacity) {
+    bitstream->segments_capacity = MAX (16, bitstream->segments_capacity * 2);
+    bitstream->segments = g_renew (GstVkBitstreamSegment, bitstream->segments,
+        bitstream->segments_capacity);
+
+    g_mutex_lock (&bitstream->arena->lock);
+    bitstream->arena->allocations++;
+    g_mutex_unlock (&bitstream->arena->lock);
+  }
+
+  segment = &bitstream->segments[n];
+  segment->size = sizeof (nal) + size;
+
+  if (offset >= sizeof (nal)
+      && memcmp (data + offset - sizeof (nal), nal, sizeof (nal)) == 0) {
+    segment->data = data + offset - sizeof (nal);
+  } else {
+    /* the data might still be reallocated */
+    segment->data = NULL;
+    if (!gst_vk_bitstream_copy_slice (bitstream, data + offset, size))
+      return FALSE;
+  }
+
+  gst_vk_bitstream_reserve_offsets (bitstream, n + 2);
+  bitstream->offsets[n + 1] = bitstream->offsets[n] + (guint32) segment->size;
+  bitstream->n_slices++;
+
+  return TRUE;
+}
+
+/* The n_slices segments added, valid as long as the memory they borrow. */
+const GstVkBitstreamSegment *
+gst_vk_bitstream_get_segments (GstVkBitstream * bitstream)
+{
+  gsize copied = 0;
+  guint i;
+
+  for (i = 0; i < bitstream->n_slices; i++) {
+    GstVkBitstreamSegment *segment = &bitstream->segments[i];
+
+    if (segment->data)
+      continue;
+
+    segment->data = bitstream->data + copied;
+    copied += segment->size;
+  }
+
+  return bitstream->segments;
+}
+
+/* Slice i, start code included, as handed to DecodePicture(): segments
+ * have to be resolved with gst_vk_bitstream_get_segments() first, if
+ * assembled with gst_vk_bitstream_add_slice_segment(). Valid as long as
+ * they are. */
+const guint8 *
+gst_vk_bitstream_get_slice (GstVkBitstream * bitstream, guint i, gsize * size)
+{
+  g_return_val_if_fail (i < bitstream->n_slices, NULL);
+
+  *size = bitstream->offsets[i + 1] - bitstream->offsets[i];
+  if (bitstream->segments)
+    return bitstream->segments[i].data;
+  return bitstream->data + bitstream->offsets[i];
+}
+
+/* Fills data with zeros up to a multiple of the size alignment, returning
+ * that padded size. */
+gboolean
+gst_vk_bitstream_pad (GstVkBitstream * bitstream, gsize * padded)
+{
+  gsize alignment = bitstream->arena->size_alignment;
+
+  *padded = (bitstream->size + alignment - 1) / alignment * alignment;
+
+  if (*padded > bitstream->size) {
+    if (!gst_vk_bitstream_reserve (bitstream, *padded))
+      return FALSE;
+    memset (bitstream->data + bitstream->size, 0, *padded - bitstream->size);
+  }
+
+  return TRUE;
+}
@@ -0,0 +1,116 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstVkBitstreamArena GstVkBitstreamArena;
+typedef struct _GstVkBitstream GstVkBitstream;
+typedef struct _GstVkBitstreamSegment GstVkBitstreamSegment;
+
+/* Returns memory for at least needed bytes, its actual size in capacity,
+ * keeping the current bitstream->size bytes of bitstream->data, if any, at
+ * its beginning. NULL on failure. */
+typedef guint8 * (*GstVkBitstreamStorageGetFunc) (GstVkBitstream * bitstream,
+                                                  gsize needed,
+                                                  gsize * capacity,
+                                                  gpointer user_data);
+
+/* bitstream->data isn't used anymore. */
+typedef void (*GstVkBitstreamStorageReleaseFunc) (GstVkBitstream * bitstream,
+                                                  gpointer user_data);
+
+/* A start code and slice NAL unit, somewhere in memory. Laid out as
+ * VkParserSliceSegment. */
+struct _GstVkBitstreamSegment
+{
+  const guint8 *data;
+  gsize size;
+};
+
+/* The slice data of a picture, as handed to DecodePicture(): every slice
+ * prefixed with a start code, and offsets[i] being where slice i begins,
+ * offsets[n_slices] being the total size. When assembled with
+ * gst_vk_bitstream_add_slice_segment(), data only holds the slices that
+ * couldn't be borrowed, and offsets are those of the gathered segments. */
+struct _GstVkBitstream
+{
+  guint8 *data;
+  gsize size;
+  guint32 *offsets;
+  guint n_slices;
+  /* for the storage functions */
+  gpointer owner;
+
+  /*< private >*/
+  guint8 *storage;
+  gsize capacity;
+  guint offsets_capacity;
+  GstVkBitstreamSegment *segments;
+  guint segments_capacity;
+  GstVkBitstreamArena *arena;
+};
+
+/* Recycles the storage of released bitstreams, so once it has grown to the
+ * largest access unit of the stream, assembling pictures doesn't allocate.
+ * Bitstreams keep a reference to their arena. */
+GstVkBitstreamArena *   gst_vk_bitstream_arena_new      (void);
+
+GstVkBitstreamArena *   gst_vk_bitstream_arena_ref      (GstVkBitstreamArena * arena);
+
+void                    gst_vk_bitstream_arena_unref    (GstVkBitstreamArena * arena);
+
+void                    gst_vk_bitstream_arena_set_alignment (GstVkBitstreamArena * arena,
+                                                         guint offset_alignment,
+                                                         guint size_alignment);
+
+void                    gst_vk_bitstream_arena_set_storage (GstVkBitstreamArena * arena,
+                                                         GstVkBitstreamStorageGetFunc get,
+                                                         GstVkBitstreamStorageReleaseFunc release,
+                                                         gpointer user_data);
+
+GstVkBitstream *        gst_vk_bitstream_arena_acquire  (GstVkBitstreamArena * arena);
+
+guint64                 gst_vk_bitstream_arena_get_allocations (GstVkBitstreamArena * arena);
+
+void                    gst_vk_bitstream_release        (GstVkBitstream * bitstream);
+
+void                    gst_vk_bitstream_release_storage (GstVkBitstream * bitstream);
+
+gboolean                gst_vk_bitstream_append_slice   (GstVkBitstream * bitstream,
+                                                         const guint8 * data,
+                                                         gsize size);
+
+gboolean                gst_vk_bitstream_add_slice_segment (GstVkBitstream * bitstream,
+                                                         const guint8 * data,
+                                                         guint offset,
+                                                         gsize size);
+
+const GstVkBitstreamSegment * gst_vk_bitstream_get_segments (GstVkBitstream * bitstream);
+
+const guint8 *          gst_vk_bitstream_get_slice      (GstVkBitstream * bitstream,
+                                                         guint i,
+                                                         gsize * size);
+
+gboolean                gst_vk_bitstream_pad            (GstVkBitstream * bitstream,
+                                                         gsize * padded);
+
+G_END_DECLS
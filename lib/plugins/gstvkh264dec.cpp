@@ -18,6 +18,10 @@
 #include "gstvkh264dec.h"
 #include "gstvkelements.h"
 #include "glib_compat.h"
+#include "gstvkbitstream.h"
+#include "gstvkpicpool.h"
+#include "gstvkparamset.h"
+#include "gstvkslicegroupmap.h"
 
 
 #include "videoutils.h"
@@ -30,6 +34,10 @@
 
 #define GST_CAT_DEFAULT gst_vk_parser_debug
 
+/* the bytes of the NAL unit a parameter set is converted from, if any */
+#define NALU_DATA(unit) ((unit) ? (unit)->data + (unit)->offset : NULL)
+#define NALU_SIZE(unit) ((unit) ? (unit)->size : 0)
+
 static GstStaticPadTemplate sink_factory =
 GST_STATIC_PAD_TEMPLATE ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
     GST_STATIC_CAPS ("video/x-h264"));
@@ -38,28 +46,48 @@ static GstStaticPadTemplate src_factory =
 GST_STATIC_PAD_TEMPLATE ("src", GST_PAD_SRC, GST_PAD_ALWAYS,
     GST_STATIC_CAPS ("video/x-raw, format=(string)NV12"));
 
-typedef struct _VkH264Picture VkH264Picture;
-struct _VkH264Picture
+/* converted parameter sets, pointed from the pictures using them */
+typedef struct _VkH264SPS VkH264SPS;
+struct _VkH264SPS
 {
   StdVideoH264HrdParameters hrd;
   StdVideoH264SequenceParameterSetVui vui;
   StdVideoH264SequenceParameterSet sps;
-  StdVideoH264PictureParameterSet pps;
-  StdVideoH264ScalingLists scaling_lists_sps, scaling_lists_pps;
+  StdVideoH264ScalingLists scaling_lists;
   int32_t offset_for_ref_frame[255];
 };
 
+typedef struct _VkH264PPS VkH264PPS;
+struct _VkH264PPS
+{
+  StdVideoH264PictureParameterSet pps;
+  StdVideoH264ScalingLists scaling_lists;
+  /* for the dimensions of the parent SPS */
+  GstVkSliceGroupMaps *slice_group_maps;
+};
+
 typedef struct _GstVkH264Dec GstVkH264Dec;
 struct _GstVkH264Dec
 {
   GstH264Decoder parent;
   VkParserVideoDecodeClient *client;
-  gboolean oob_pic_params;
+  gboolean scatter_gather;
+  guint offset_alignment;
+  guint size_alignment;
+  VkParserBitstreamStorage *storage;
+  guint64 clock_rate;
 
   gint max_dpb_size;
 
-  VkH264Picture vkp;
-  GArray *refs;
+  GstVkBitstreamArena *arena;
+  GstVkPicPool *pic_pool;
+
+  GstVkParamSetCache *sps_cache;
+  GstVkParamSetCache *pps_cache;
+  /* the parameter sets of the last picture */
+  GstVkParamSnapshot *params;
+  /* the picture given to DecodePicture(), while it runs */
+  VkPic *decoding;
 
   VkSharedBaseObj<VkParserVideoRefCountBase> spsclient, ppsclient;
 
@@ -69,20 +97,33 @@ struct _GstVkH264Dec
 
 struct VkPic
 {
+  GstVkPicPool *pool;
   VkPicIf *pic;
   VkParserPictureData data;
-  GByteArray *bitstream;
-  VkH264Picture vkp;
-  uint8_t *slice_group_map;
-  GArray *slice_offsets;
+  GstVkBitstream *bitstream;
+  GstVkParamSnapshot *params;
+  GBytes *slice_group_map;
 };
 
 enum
 {
   PROP_USER_DATA = 1,
-  PROP_OOB_PIC_PARAMS,
+  PROP_SCATTER_GATHER_SLICES,
+  PROP_BITSTREAM_OFFSET_ALIGNMENT,
+  PROP_BITSTREAM_SIZE_ALIGNMENT,
+  PROP_BITSTREAM_STORAGE,
+  PROP_CLOCK_RATE,
+  PROP_PIC_POOL_HITS,
+  PROP_PIC_POOL_MISSES,
+  PROP_BITSTREAM_ALLOCATIONS,
+  PROP_PICTURE_BYTES,
+  PROP_PARAM_SET_BYTES,
 };
 
+G_STATIC_ASSERT (sizeof (GstVkBitstreamSegment) == sizeof (VkParserSliceSegment));
+G_STATIC_ASSERT (G_STRUCT_OFFSET (GstVkBitstreamSegment, size) ==
+    G_STRUCT_OFFSET (VkParserSliceSegment, nDataLen));
+
 G_DEFINE_TYPE(GstVkH264Dec, gst_vk_h264_dec, GST_TYPE_H264_DECODER)
 GST_ELEMENT_REGISTER_DEFINE_WITH_CODE (vkh264parse, "vkh264parse", GST_RANK_PRIMARY, GST_TYPE_VK_H264_DEC, vk_element_init(plugin));
 
@@ -185,41 +226,106 @@ get_h264_weighted_bipred_idc (guint8 weighted_bipred_idc)
   return STD_VIDEO_H264_WEIGHTED_BIPRED_IDC_INVALID;
 }
 
-static VkPic *vk_pic_new (VkPicIf * pic)
+static VkPic *
+vk_pic_new (GstVkH264Dec * self, VkPicIf * pic)
 {
-  VkPic *vkpic = g_new0 (struct VkPic, 1);
-  uint32_t zero = 0;
+  VkPic *vkpic =
+      static_cast<VkPic *>(gst_vk_pic_pool_acquire (self->pic_pool));
 
+  /* a recycled VkPic keeps its previous contents: data is rewritten in
+   * start_picture(), so only reset what is used before */
+  vkpic->pool = self->pic_pool;
   vkpic->pic = pic;
-  vkpic->bitstream = g_byte_array_new ();
-  vkpic->slice_offsets = g_array_new (FALSE, FALSE, sizeof (uint32_t));
-  g_array_append_val (vkpic->slice_offsets, zero);
+  vkpic->bitstream = gst_vk_bitstream_arena_acquire (self->arena);
+  vkpic->bitstream->owner = pic;
+  vkpic->params = NULL;
+  vkpic->slice_group_map = NULL;
+  vkpic->data.nNumSlices = 0;
   return vkpic;
 }
 
+static guint8 *
+vk_bitstream_storage_get (GstVkBitstream * bitstream, gsize needed,
+    gsize * capacity, gpointer user_data)
+{
+  VkParserBitstreamStorage *storage =
+      static_cast<VkParserBitstreamStorage *>(user_data);
+  size_t size = 0;
+  uint8_t *data;
+
+  data = storage->GetBitstreamBuffer (static_cast<VkPicIf *>(bitstream->owner),
+      bitstream->data, bitstream->size, needed, &size);
+  *capacity = size;
+  return data;
+}
+
+static void
+vk_bitstream_storage_release (GstVkBitstream * bitstream, gpointer user_data)
+{
+  VkParserBitstreamStorage *storage =
+      static_cast<VkParserBitstreamStorage *>(user_data);
+
+  storage->ReleaseBitstreamBuffer (static_cast<VkPicIf *>(bitstream->owner),
+      bitstream->data);
+}
+
 static void
 vk_pic_free (gpointer data)
 {
   VkPic *vkpic = static_cast<VkPic *>(data);
+  /* storage release callbacks get the VkPicIf */
+  gst_vk_bitstream_release (vkpic->bitstream);
   if (vkpic->pic)
     vkpic->pic->Release ();
-  g_byte_array_unref (vkpic->bitstream);
-  g_free ((uint32_t *)vkpic->data.pSliceDataOffsets);
-  g_free (vkpic->data.pBitstreamData);
-  g_array_unref (vkpic->slice_offsets);
-  g_free (vkpic->slice_group_map);
-  g_free (vkpic);
+  g_clear_pointer (&vkpic->params, gst_vk_param_snapshot_unref);
+  g_clear_pointer (&vkpic->slice_group_map, g_bytes_unref);
+  gst_vk_pic_pool_release (vkpic->pool, vkpic);
 }
 
 static bool
-profile_is_svc (GstCaps * caps)
+profile_is_svc (GstCaps * caps, const GstH264SPS * sps)
 {
   const GstStructure *structure = gst_caps_get_structure (caps, 0);
   const gchar *profile = gst_structure_get_string (structure, "profile");
 
+  /* without h264parse upstream the caps have no profile */
+  if (!profile)
+    return sps->profile_idc == GST_H264_PROFILE_SCALABLE_BASELINE
+        || sps->profile_idc == GST_H264_PROFILE_SCALABLE_HIGH;
+
   return g_str_has_prefix (profile, "scalable");
 }
 
+/* Falls back to the VUI when the caps don't provide them, as happens when
+ * the decoder is driven directly. */
+static void
+get_framerate_and_par (GstVideoCodecState * state, const GstH264SPS * sps,
+    gint * fps_n, gint * fps_d, gint * par_n, gint * par_d)
+{
+  const GstStructure *structure = gst_caps_get_structure (state->caps, 0);
+
+  *fps_n = GST_VIDEO_INFO_FPS_N (&state->info);
+  *fps_d = GST_VIDEO_INFO_FPS_D (&state->info);
+  *par_n = GST_VIDEO_INFO_PAR_N (&state->info);
+  *par_d = GST_VIDEO_INFO_PAR_D (&state->info);
+
+  if (!sps->vui_parameters_present_flag)
+    return;
+
+  if (*fps_n == 0 && sps->vui_parameters.timing_info_present_flag
+      && sps->vui_parameters.num_units_in_tick > 0) {
+    *fps_n = sps->vui_parameters.time_scale;
+    *fps_d = 2 * sps->vui_parameters.num_units_in_tick;
+  }
+
+  if (!gst_structure_has_field (structure, "pixel-aspect-ratio")
+      && sps->vui_parameters.aspect_ratio_info_present_flag
+      && sps->vui_parameters.par_n > 0 && sps->vui_parameters.par_d > 0) {
+    *par_n = sps->vui_parameters.par_n;
+    *par_d = sps->vui_parameters.par_d;
+  }
+}
+
 static GstFlowReturn
 gst_vk_h264_dec_new_sequence (GstH264Decoder * decoder, const GstH264SPS * sps,
     gint max_dpb_size)
@@ -229,11 +335,15 @@ gst_vk_h264_dec_new_sequence (GstH264Decoder * decoder, const GstH264SPS * sps,
   GstVideoCodecState *state;
   VkParserSequenceInfo seqInfo;
   guint dar_n = 0, dar_d = 0;
+  gint fps_n, fps_d, par_n, par_d;
+
+  get_framerate_and_par (decoder->input_state, sps, &fps_n, &fps_d, &par_n,
+      &par_d);
 
   seqInfo = VkParserSequenceInfo {
     .eCodec = VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_EXT,
-    .isSVC = profile_is_svc(decoder->input_state->caps),
-    .frameRate = pack_framerate(GST_VIDEO_INFO_FPS_N(&decoder->input_state->info), GST_VIDEO_INFO_FPS_D(&decoder->input_state->info)) * 1000,
+    .isSVC = profile_is_svc(decoder->input_state->caps, sps),
+    .frameRate = pack_framerate(fps_n, fps_d) * 1000,
     .bProgSeq = sps->frame_mbs_only_flag,
     .nCodedWidth = sps->width,
     .nCodedHeight = sps->height,
@@ -273,8 +383,7 @@ gst_vk_h264_dec_new_sequence (GstH264Decoder * decoder, const GstH264SPS * sps,
 
   if (gst_video_calculate_display_ratio (&dar_n, &dar_d,
           seqInfo.nDisplayWidth, seqInfo.nDisplayHeight,
-          GST_VIDEO_INFO_PAR_N (&decoder->input_state->info),
-          GST_VIDEO_INFO_PAR_D (&decoder->input_state->info), 1, 1)) {
+          par_n, par_d, 1, 1)) {
     seqInfo.lDARWidth = dar_n;
     seqInfo.lDARHeight = dar_d;
   }
@@ -296,20 +405,25 @@ static GstFlowReturn
 gst_vk_h264_dec_decode_slice (GstH264Decoder * decoder, GstH264Picture * picture,
     GstH264Slice * slice, GArray * ref_pic_list0, GArray * ref_pic_list1)
 {
+  GstVkH264Dec *self = GST_VK_H264_DEC (decoder);
   VkPic *vkpic = static_cast<VkPic *>(gst_h264_picture_get_user_data(picture));
-  static const uint8_t nal[] = { 0, 0, 1 };
-  uint32_t offset;
+
+  gboolean ret;
 
   vkpic->data.nNumSlices++;
-  // nvidia parser adds 000001 NAL unit identifier at every slice
-  g_byte_array_append (vkpic->bitstream, nal, sizeof (nal));
-  g_byte_array_append (vkpic->bitstream, slice->nalu.data + slice->nalu.offset,
-      slice->nalu.size);
+  if (self->scatter_gather) {
+    /* the input buffer stays mapped until end_picture() returns */
+    ret = gst_vk_bitstream_add_slice_segment (vkpic->bitstream,
+        slice->nalu.data, slice->nalu.offset, slice->nalu.size);
+  } else {
+    ret = gst_vk_bitstream_append_slice (vkpic->bitstream,
+        slice->nalu.data + slice->nalu.offset, slice->nalu.size);
+  }
+  if (!ret) {
+    GST_ERROR_OBJECT (self, "Failed to get bitstream storage");
+    return GST_FLOW_ERROR;
+  }
   // GST_MEMDUMP_OBJECT(decoder, "SLICE :", slice->nalu.data + slice->nalu.offset, slice->nalu.size);
-  offset =
-      g_array_index (vkpic->slice_offsets, uint32_t,
-      vkpic->slice_offsets->len - 1) + slice->nalu.size + sizeof (nal);
-  g_array_append_val (vkpic->slice_offsets, offset);
 
   return GST_FLOW_OK;
 }
@@ -327,10 +441,12 @@ gst_vk_h264_dec_new_picture (GstH264Decoder * decoder, GstVideoCodecFrame * fram
       return GST_FLOW_ERROR;
   }
 
-  vkpic = vk_pic_new (pic);
+  vkpic = vk_pic_new (self, pic);
   gst_h264_picture_set_user_data (picture, vkpic, vk_pic_free);
 
-  frame->output_buffer = gst_buffer_new ();
+  /* nothing downstream when driven directly */
+  if (gst_pad_is_linked (GST_VIDEO_DECODER_SRC_PAD (decoder)))
+    frame->output_buffer = gst_buffer_new ();
 
   return GST_FLOW_OK;
 }
@@ -348,12 +464,29 @@ gst_vk_h264_dec_new_field_picture (GstH264Decoder * decoder,
       return GST_FLOW_ERROR;
   }
 
-  vkpic = vk_pic_new (pic);
+  vkpic = vk_pic_new (self, pic);
   gst_h264_picture_set_user_data (second_field, vkpic, vk_pic_free);
 
   return GST_FLOW_OK;
 }
 
+/* The PTS of the frame, or one made up from its number, in clock-rate
+ * ticks. */
+static int64_t
+get_timestamp (GstVkH264Dec * self, GstVideoCodecFrame * frame,
+    GstH264Picture * picture)
+{
+  GstClockTime ts = frame->pts;
+
+  if (!GST_CLOCK_TIME_IS_VALID (ts)
+      && GST_CLOCK_TIME_IS_VALID (frame->duration))
+    ts = picture->system_frame_number * frame->duration;
+  if (!GST_CLOCK_TIME_IS_VALID (ts))
+    return 0;
+
+  return gst_util_uint64_scale_round (ts, self->clock_rate, GST_SECOND);
+}
+
 static GstFlowReturn
 gst_vk_h264_dec_output_picture (GstH264Decoder * decoder,
     GstVideoCodecFrame * frame, GstH264Picture * picture)
@@ -363,13 +496,19 @@ gst_vk_h264_dec_output_picture (GstH264Decoder * decoder,
 
   if (self->client) {
     if (!self->client->DisplayPicture (vkpic->pic,
-            picture->system_frame_number * frame->duration / 100)) {
+            get_timestamp (self, frame, picture))) {
       gst_h264_picture_unref (picture);
       return GST_FLOW_ERROR;
     }
   }
 
   gst_h264_picture_unref (picture);
+
+  if (!gst_pad_is_linked (GST_VIDEO_DECODER_SRC_PAD (decoder))) {
+    gst_video_decoder_release_frame (GST_VIDEO_DECODER (decoder), frame);
+    return GST_FLOW_OK;
+  }
+
   return gst_video_decoder_finish_frame (GST_VIDEO_DECODER (decoder), frame);
 }
 
@@ -378,105 +517,130 @@ gst_vk_h264_dec_end_picture (GstH264Decoder * decoder, GstH264Picture * picture)
 {
   GstVkH264Dec *self = GST_VK_H264_DEC (decoder);
   VkPic *vkpic = reinterpret_cast<VkPic *>(gst_h264_picture_get_user_data(picture));
-  gsize len;
   GstFlowReturn ret = GST_FLOW_OK;
 
-  vkpic->data.pBitstreamData = g_byte_array_steal (vkpic->bitstream, &len);
-  vkpic->data.nBitstreamDataLen = static_cast<int32_t>(len);
-  vkpic->data.pSliceDataOffsets =
-      static_cast <uint32_t *>(g_array_steal (vkpic->slice_offsets, NULL));
+  if (self->scatter_gather) {
+    vkpic->data.pSliceSegments = reinterpret_cast<const VkParserSliceSegment *>
+        (gst_vk_bitstream_get_segments (vkpic->bitstream));
+    vkpic->data.nBitstreamDataLen =
+        vkpic->bitstream->offsets[vkpic->bitstream->n_slices];
+  } else {
+    gsize padded;
+
+    /* padding might move the data */
+    if (!gst_vk_bitstream_pad (vkpic->bitstream, &padded)) {
+      GST_ERROR_OBJECT (self, "Failed to get bitstream storage");
+      return GST_FLOW_ERROR;
+    }
+    vkpic->data.nBitstreamDataLen = static_cast<uint32_t>(padded);
+    vkpic->data.pBitstreamData = vkpic->bitstream->data;
+  }
+  vkpic->data.pSliceDataOffsets = vkpic->bitstream->offsets;
 
   if (self->client) {
+    self->decoding = vkpic;
     if (!self->client->DecodePicture (&vkpic->data))
       ret = GST_FLOW_ERROR;
+    self->decoding = NULL;
   }
 
+  /* client provided memory isn't kept past decoding */
+  gst_vk_bitstream_release_storage (vkpic->bitstream);
+
   return ret;
 }
 
-static uint8_t *
-get_slice_group_map (GstH264PPS * pps)
+/* The index of the entry of picture in dpb, or -1. */
+static int8_t
+find_dpb_entry (const VkParserH264DpbEntry * dpb, GstH264Picture * picture)
 {
-  uint8_t *ret, i, j, k;
+  VkPic *vkpic, *other = NULL;
+  int8_t i;
+
+  if (!picture)
+    return -1;
+
+  vkpic = static_cast<VkPic *>(gst_h264_picture_get_user_data (picture));
+  if (picture->other_field)
+    other = static_cast<VkPic *>
+        (gst_h264_picture_get_user_data (picture->other_field));
+
+  for (i = 0; i < 16 + 1; i++) {
+    if (!dpb[i].pPicBuf)
+      continue;
+    if ((vkpic && dpb[i].pPicBuf == vkpic->pic)
+        || (other && dpb[i].pPicBuf == other->pic))
+      return i;
+  }
 
-  ret = g_new0 (uint8_t, pps->pic_size_in_map_units_minus1 + 1);
+  return -1;
+}
 
-  if (pps->num_slice_groups_minus1 == 0)
-    return ret;
+static void
+fill_ref_pic_list (VkParserSliceInfo * info, guint list,
+    const VkParserH264DpbEntry * dpb, GArray * ref_pic_list)
+{
+  guint i;
 
-  switch (pps->slice_group_map_type) {
-    case 0:{
-      i = 0;
-      do {
-        for (j = 0;
-            j <= pps->num_slice_groups_minus1
-            && i <= pps->pic_size_in_map_units_minus1;
-            i += pps->run_length_minus1[j++] + 1) {
-          for (k = 0; k <= pps->run_length_minus1[j]
-              && i + k <= pps->pic_size_in_map_units_minus1; k++)
-            ret[i + k] = j;
-        }
-      } while (i <= pps->pic_size_in_map_units_minus1);
-      break;
-    }
-    case 1:{
-      for (i = 0; i <= pps->pic_size_in_map_units_minus1; i++) {
-        ret[i] = ((i % (pps->sequence->pic_width_in_mbs_minus1 + 1)) +
-            (((i / (pps->sequence->pic_width_in_mbs_minus1 + 1)) *
-                    (pps->num_slice_groups_minus1 + 1)) / 2)) %
-            (pps->num_slice_groups_minus1 + 1);
-      }
-      break;
-    }
-    case 2:{
-      uint32_t ytl, xtl, ybr, xbr;
-
-      for (i = 0; i <= pps->pic_size_in_map_units_minus1; i++)
-        ret[i] = pps->num_slice_groups_minus1;
-      for (i = pps->num_slice_groups_minus1 - 1; i >= 0; i--) {
-        ytl = pps->top_left[i] / (pps->sequence->pic_width_in_mbs_minus1 + 1);
-        xtl = pps->top_left[i] % (pps->sequence->pic_width_in_mbs_minus1 + 1);
-        ybr =
-            pps->bottom_right[i] / (pps->sequence->pic_width_in_mbs_minus1 + 1);
-        xbr =
-            pps->bottom_right[i] % (pps->sequence->pic_width_in_mbs_minus1 + 1);
-
-        for (j = ytl; j < ybr; j++)
-          for (k = xtl; k < xbr; k++)
-            ret[j * (pps->sequence->pic_width_in_mbs_minus1 + 1) + k] = i;
-      }
-      break;
-    }
-    case 3:
-    case 4:
-    case 5:
-      /* @TODO */
-      break;
-    case 6:
-      for (i = 0; i <= pps->pic_size_in_map_units_minus1; i++)
-        ret[i] = pps->slice_group_id[i];
-      break;
-    default:
-      break;
+  info->num_ref_idx_active[list] = MIN (ref_pic_list->len, 32);
+  for (i = 0; i < (guint) info->num_ref_idx_active[list]; i++) {
+    GstH264Picture *picture =
+        g_array_index (ref_pic_list, GstH264Picture *, i);
+
+    info->RefPicList[list][i] = find_dpb_entry (dpb, picture);
+    if (picture && picture->field == GST_H264_PICTURE_FIELD_BOTTOM_FIELD)
+      info->RefPicBottomFieldMask[list] |= 1u << i;
+  }
+}
+
+/* The reference picture lists are only built for the slices the client asks
+ * about, from its DecodePicture(), parsing them again. */
+static gboolean
+gst_vk_h264_dec_decode_slice_info (GstVkH264Dec * self,
+    VkParserSliceInfo * info, const VkParserPictureData * data, gint index)
+{
+  GstH264Decoder *decoder = GST_H264_DECODER (self);
+  VkPic *vkpic = self->decoding;
+  const guint8 *slice_data;
+  gsize size;
+  GstH264Slice slice;
+  GArray *ref_pic_list0, *ref_pic_list1;
+
+  if (!vkpic || data != &vkpic->data || index < 0
+      || static_cast<guint>(index) >= vkpic->bitstream->n_slices)
+    return FALSE;
+
+  slice_data = gst_vk_bitstream_get_slice (vkpic->bitstream, index, &size);
+  if (!gst_h264_decoder_reparse_slice (decoder, slice_data, size, &slice)
+      || !gst_h264_decoder_build_ref_pic_lists (decoder, &slice,
+          &ref_pic_list0, &ref_pic_list1))
+    return FALSE;
+
+  *info = VkParserSliceInfo {
+    .slice_type = slice.header.type % 5,
+    .first_mb_in_slice = slice.header.first_mb_in_slice,
   };
+  memset (info->RefPicList, -1, sizeof (info->RefPicList));
+  fill_ref_pic_list (info, 0, data->CodecSpecific.h264.dpb, ref_pic_list0);
+  fill_ref_pic_list (info, 1, data->CodecSpecific.h264.dpb, ref_pic_list1);
 
-  return ret;
+  return TRUE;
 }
 
 static void
-fill_sps (GstH264SPS * sps, VkH264Picture * vkp)
+fill_sps (GstH264SPS * sps, VkH264SPS * vkp)
 {
   GstH264VUIParams *vui = &sps->vui_parameters;
   GstH264HRDParams *hrd = NULL;
 
   if (sps->scaling_matrix_present_flag) {
-    vkp->scaling_lists_sps.scaling_list_present_mask = 1;
-    vkp->scaling_lists_sps.use_default_scaling_matrix_mask = 0;
+    vkp->scaling_lists.scaling_list_present_mask = 1;
+    vkp->scaling_lists.use_default_scaling_matrix_mask = 0;
 
-    memcpy (&vkp->scaling_lists_sps.ScalingList4x4, &sps->scaling_lists_4x4,
-        sizeof (vkp->scaling_lists_sps.ScalingList4x4));
-    memcpy (&vkp->scaling_lists_sps.ScalingList8x8, &sps->scaling_lists_8x8,
-        sizeof (vkp->scaling_lists_sps.ScalingList8x8));
+    memcpy (&vkp->scaling_lists.ScalingList4x4, &sps->scaling_lists_4x4,
+        sizeof (vkp->scaling_lists.ScalingList4x4));
+    memcpy (&vkp->scaling_lists.ScalingList8x8, &sps->scaling_lists_8x8,
+        sizeof (vkp->scaling_lists.ScalingList8x8));
   }
 
   if (sps->num_ref_frames_in_pic_order_cnt_cycle > 0) {
@@ -583,23 +747,23 @@ fill_sps (GstH264SPS * sps, VkH264Picture * vkp)
     .pOffsetForRefFrame = (sps->num_ref_frames_in_pic_order_cnt_cycle > 0) ?
         vkp->offset_for_ref_frame : nullptr,
     .pScalingLists = sps->scaling_matrix_present_flag ?
-        &vkp->scaling_lists_sps : nullptr,
+        &vkp->scaling_lists : nullptr,
     .pSequenceParameterSetVui = sps->vui_parameters_present_flag ?
         &vkp->vui : nullptr,
   };
 }
 
 static void
-fill_pps (GstH264PPS * pps, VkH264Picture * vkp)
+fill_pps (GstH264PPS * pps, VkH264PPS * vkp)
 {
   if (pps->pic_scaling_matrix_present_flag) {
-    vkp->scaling_lists_pps.scaling_list_present_mask = 1;
-    vkp->scaling_lists_pps.use_default_scaling_matrix_mask = 0;
+    vkp->scaling_lists.scaling_list_present_mask = 1;
+    vkp->scaling_lists.use_default_scaling_matrix_mask = 0;
 
-    memcpy (&vkp->scaling_lists_pps.ScalingList4x4, &pps->scaling_lists_4x4,
-        sizeof (vkp->scaling_lists_pps.ScalingList4x4));
-    memcpy (&vkp->scaling_lists_pps.ScalingList8x8, &pps->scaling_lists_8x8,
-        sizeof (vkp->scaling_lists_pps.ScalingList8x8));
+    memcpy (&vkp->scaling_lists.ScalingList4x4, &pps->scaling_lists_4x4,
+        sizeof (vkp->scaling_lists.ScalingList4x4));
+    memcpy (&vkp->scaling_lists.ScalingList8x8, &pps->scaling_lists_8x8,
+        sizeof (vkp->scaling_lists.ScalingList8x8));
   }
 
   vkp->pps = StdVideoH264PictureParameterSet {
@@ -625,10 +789,71 @@ fill_pps (GstH264PPS * pps, VkH264Picture * vkp)
     .second_chroma_qp_index_offset =
         static_cast<int8_t>(pps->second_chroma_qp_index_offset),
     .pScalingLists = pps->pic_scaling_matrix_present_flag ?
-        &vkp->scaling_lists_pps : NULL,
+        &vkp->scaling_lists : NULL,
   };
 }
 
+static GstVkParamSet *
+convert_sps (GstVkH264Dec * self, GstH264SPS * sps,
+    const GstH264NalUnit * unit)
+{
+  GstVkParamSet *ps = gst_vk_param_set_cache_insert (self->sps_cache,
+      sps->id, sizeof (VkH264SPS), NALU_DATA (unit), NALU_SIZE (unit));
+
+  fill_sps (sps, GST_VK_PARAM_SET_DATA (ps, VkH264SPS));
+  GST_DEBUG_OBJECT (self, "SPS %u generation %u", ps->id, ps->generation);
+
+  return ps;
+}
+
+static void
+vk_h264_pps_clear (gpointer data)
+{
+  VkH264PPS *vkp = static_cast<VkH264PPS *>(data);
+
+  gst_vk_slice_group_maps_free (vkp->slice_group_maps);
+}
+
+/* The slice group maps depend on the picture size, so the PPS is converted
+ * against the SPS, which becomes its parent. */
+static GstVkParamSet *
+convert_pps (GstVkH264Dec * self, GstH264PPS * pps, GstVkParamSet * sps_ps,
+    const GstH264NalUnit * unit)
+{
+  GstVkParamSet *ps = gst_vk_param_set_cache_insert (self->pps_cache,
+      pps->id, sizeof (VkH264PPS), NALU_DATA (unit), NALU_SIZE (unit));
+  VkH264PPS *vkp = GST_VK_PARAM_SET_DATA (ps, VkH264PPS);
+
+  gst_vk_param_set_set_parent (ps, sps_ps);
+  fill_pps (pps, vkp);
+  vkp->slice_group_maps = gst_vk_slice_group_maps_new (pps);
+  gst_vk_param_set_set_clear_func (ps, vk_h264_pps_clear);
+
+  GST_DEBUG_OBJECT (self, "PPS %u generation %u, on SPS %u generation %u",
+      ps->id, ps->generation, sps_ps->id, sps_ps->generation);
+
+  return ps;
+}
+
+/* Parameter sets are converted as they arrive, in
+ * update_picture_parameters(); this only converts those missed. */
+static GstVkParamSet *
+get_sps (GstVkH264Dec * self, GstH264SPS * sps)
+{
+  GstVkParamSet *ps = gst_vk_param_set_cache_lookup (self->sps_cache, sps->id);
+
+  return ps ? ps : convert_sps (self, sps, NULL);
+}
+
+static GstVkParamSet *
+get_pps (GstVkH264Dec * self, GstH264PPS * pps, GstVkParamSet * sps_ps)
+{
+  GstVkParamSet *ps = gst_vk_param_set_cache_lookup (self->pps_cache, pps->id);
+
+  return ps && ps->parent == sps_ps ? ps :
+      convert_pps (self, pps, sps_ps, NULL);
+}
+
 static void
 fill_dbp_entry (VkParserH264DpbEntry * entry, GstH264Picture * picture)
 {
@@ -686,16 +911,16 @@ gst_vk_h264_dec_start_picture (GstH264Decoder * decoder, GstH264Picture * pictur
   GstVkH264Dec *self = GST_VK_H264_DEC (decoder);
   VkPic *vkpic =
       reinterpret_cast <VkPic *>(gst_h264_picture_get_user_data (picture));
-  VkH264Picture *vkp = &self->vkp;
   GstH264PPS *pps = slice->header.pps;
   GstH264SPS *sps = pps->sequence;
+  GstVkParamSet *sps_ps = get_sps (self, sps);
+  VkH264PPS *vkpps;
 
-  if (!self->oob_pic_params
-      || (self->sps_update_count == 0 && self->sps_update_count == 0)) {
-    vkp = &vkpic->vkp;
-    fill_sps (sps, vkp);
-    fill_pps (pps, vkp);
-  }
+  vkpic->params = gst_vk_param_snapshot_ref (gst_vk_param_snapshot_update
+      (&self->params, NULL, sps_ps, get_pps (self, pps, sps_ps)));
+  vkpps = GST_VK_PARAM_SET_DATA (vkpic->params->pps, VkH264PPS);
+  vkpic->slice_group_map = g_bytes_ref (gst_vk_slice_group_maps_get
+      (vkpps->slice_group_maps, slice->header.slice_group_change_cycle));
 
   vkpic->data = VkParserPictureData {
     .PicWidthInMbs = sps->width / 16, // Coded Frame Size
@@ -728,9 +953,9 @@ gst_vk_h264_dec_start_picture (GstH264Decoder * decoder, GstH264Picture * pictur
 
   VkParserH264PictureData *h264 = &vkpic->data.CodecSpecific.h264;
   *h264 = VkParserH264PictureData {
-    .pStdSps = &vkp->sps,
+    .pStdSps = &GST_VK_PARAM_SET_DATA (vkpic->params->sps, VkH264SPS)->sps,
     .pSpsClientObject = self->spsclient,
-    .pStdPps = &vkp->pps,
+    .pStdPps = &vkpps->pps,
     .pPpsClientObject = self->ppsclient,
     .pic_parameter_set_id = static_cast<uint8_t>(pps->id),          // PPS ID
     .seq_parameter_set_id = static_cast<uint8_t>(pps->sequence->id),          // SPS ID
@@ -760,30 +985,22 @@ gst_vk_h264_dec_start_picture (GstH264Decoder * decoder, GstH264Picture * pictur
     .slice_group_map_type = pps->slice_group_map_type,
     .pic_init_qs_minus26 = pps->pic_init_qp_minus26,
     .slice_group_change_rate_minus1 = pps->slice_group_change_rate_minus1,
-    .pMb2SliceGroupMap =
-        (vkpic->slice_group_map = get_slice_group_map (pps),
-         vkpic->slice_group_map),
+    .pMb2SliceGroupMap = static_cast<const uint8_t *>
+        (g_bytes_get_data (vkpic->slice_group_map, NULL)),
     // // DPB
     // VkParserH264DpbEntry dpb[16 + 1]; // List of reference frames within the DPB
   };
 
   /* reference frames */
   {
-    guint i, ref_frame_idx = 0;
-
-    gst_h264_dpb_get_pictures_short_term_ref (dpb, FALSE, FALSE, self->refs);
-    for (i = 0; ref_frame_idx < 16 + 1 && i < self->refs->len; i++) {
-      GstH264Picture *pic = g_array_index (self->refs, GstH264Picture *, i);
-      fill_dbp_entry (&h264->dpb[ref_frame_idx++], pic);
-    }
-    g_array_set_size (self->refs, 0);
+    GstH264DpbRefIter iter;
+    GstH264Picture *pic;
+    guint ref_frame_idx = 0;
 
-    gst_h264_dpb_get_pictures_long_term_ref (dpb, FALSE, self->refs);
-    for (; ref_frame_idx < 16 + 1 && i < self->refs->len; i++) {
-      GstH264Picture *pic = g_array_index (self->refs, GstH264Picture *, i);
+    /* short-term ones first, then long-term ones */
+    gst_h264_dpb_ref_iter_init (&iter, dpb, FALSE, FALSE);
+    while (ref_frame_idx < 16 + 1 && (pic = gst_h264_dpb_ref_iter_next (&iter)))
       fill_dbp_entry (&h264->dpb[ref_frame_idx++], pic);
-    }
-    g_array_set_size (self->refs, 0);
 
     for (; ref_frame_idx < 16 + 1; ref_frame_idx++)
       h264->dpb[ref_frame_idx] = { 0, };
@@ -804,19 +1021,31 @@ gst_vk_h264_dec_unhandled_nalu (GstH264Decoder * decoder, const guint8 * data,
 
 static void
 gst_vk_h264_dec_update_picture_parameters (GstH264Decoder * decoder,
-    GstH264NalUnitType type, const gpointer nalu)
+    GstH264NalUnitType type, const gpointer nalu, const GstH264NalUnit * unit)
 {
   GstVkH264Dec *self = GST_VK_H264_DEC (decoder);
   VkPictureParameters params;
 
+  /* Streams usually repeat their parameter sets before every IDR: the
+   * client is only told about those which changed, so it doesn't rebuild
+   * its session parameters for nothing. */
   switch (type) {
     case GST_H264_NAL_SPS:{
       GstH264SPS *sps = static_cast < GstH264SPS * >(nalu);
-      fill_sps (sps, &self->vkp);
+      GstVkParamSet *ps;
+
+      if (gst_vk_param_set_cache_lookup_content (self->sps_cache, sps->id,
+              NALU_DATA (unit), NALU_SIZE (unit))) {
+        GST_LOG_OBJECT (self, "SPS %u repeated", sps->id);
+        break;
+      }
+
+      ps = convert_sps (self, sps, unit);
       params = VkPictureParameters {
         .updateType = VK_PICTURE_PARAMETERS_UPDATE_H264_SPS,
-        .pH264Sps = &self->vkp.sps,
+        .pH264Sps = &GST_VK_PARAM_SET_DATA (ps, VkH264SPS)->sps,
         .updateSequenceCount = self->sps_update_count++,
+        .contentGeneration = ps->generation,
       };
       if (self->client) {
         if (!self->client->UpdatePictureParameters (&params, self->spsclient,
@@ -827,11 +1056,23 @@ gst_vk_h264_dec_update_picture_parameters (GstH264Decoder * decoder,
     }
     case GST_H264_NAL_PPS:{
       GstH264PPS *pps = static_cast < GstH264PPS * >(nalu);
-      fill_pps (pps, &self->vkp);
+      GstVkParamSet *sps_ps = get_sps (self, pps->sequence);
+      GstVkParamSet *ps;
+
+      /* its conversion might change with the SPS */
+      ps = gst_vk_param_set_cache_lookup_content (self->pps_cache, pps->id,
+          NALU_DATA (unit), NALU_SIZE (unit));
+      if (ps && ps->parent == sps_ps) {
+        GST_LOG_OBJECT (self, "PPS %u repeated", pps->id);
+        break;
+      }
+
+      ps = convert_pps (self, pps, sps_ps, unit);
       params = VkPictureParameters {
         .updateType = VK_PICTURE_PARAMETERS_UPDATE_H264_PPS,
-        .pH264Pps = &self->vkp.pps,
+        .pH264Pps = &GST_VK_PARAM_SET_DATA (ps, VkH264PPS)->pps,
         .updateSequenceCount = self->pps_update_count++,
+        .contentGeneration = ps->generation,
       };
       if (self->client) {
         if (!self->client->UpdatePictureParameters (&params, self->ppsclient,
@@ -855,7 +1096,11 @@ gst_vk_h264_dec_dispose (GObject * object)
   if (self->ppsclient)
     self->ppsclient->Release ();
 
-  g_clear_pointer (&self->refs, g_array_unref);
+  g_clear_pointer (&self->params, gst_vk_param_snapshot_unref);
+  g_clear_pointer (&self->sps_cache, gst_vk_param_set_cache_free);
+  g_clear_pointer (&self->pps_cache, gst_vk_param_set_cache_free);
+  g_clear_pointer (&self->arena, gst_vk_bitstream_arena_unref);
+  g_clear_pointer (&self->pic_pool, gst_vk_pic_pool_unref);
 
   G_OBJECT_CLASS (parent_class)->dispose (object);
 }
@@ -871,8 +1116,63 @@ gst_vk_h264_dec_set_property (GObject * object, guint property_id,
       self->client =
           reinterpret_cast <VkParserVideoDecodeClient *>(g_value_get_pointer (value));
       break;
-    case PROP_OOB_PIC_PARAMS:
-      self->oob_pic_params = g_value_get_boolean (value);
+    case PROP_SCATTER_GATHER_SLICES:
+      self->scatter_gather = g_value_get_boolean (value);
+      break;
+    case PROP_BITSTREAM_OFFSET_ALIGNMENT:
+      self->offset_alignment = g_value_get_uint (value);
+      gst_vk_bitstream_arena_set_alignment (self->arena,
+          self->offset_alignment, self->size_alignment);
+      break;
+    case PROP_BITSTREAM_SIZE_ALIGNMENT:
+      self->size_alignment = g_value_get_uint (value);
+      gst_vk_bitstream_arena_set_alignment (self->arena,
+          self->offset_alignment, self->size_alignment);
+      break;
+    case PROP_CLOCK_RATE:
+      self->clock_rate = g_value_get_uint64 (value);
+      break;
+    case PROP_BITSTREAM_STORAGE:
+      self->storage =
+          reinterpret_cast <VkParserBitstreamStorage *>(g_value_get_pointer (value));
+      if (self->storage) {
+        gst_vk_bitstream_arena_set_storage (self->arena,
+            vk_bitstream_storage_get, vk_bitstream_storage_release,
+            self->storage);
+      }
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_vk_h264_dec_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstVkH264Dec *self = GST_VK_H264_DEC (object);
+  guint64 hits, misses;
+
+  switch (property_id) {
+    case PROP_PIC_POOL_HITS:
+      gst_vk_pic_pool_get_stats (self->pic_pool, &hits, NULL);
+      g_value_set_uint64 (value, hits);
+      break;
+    case PROP_PIC_POOL_MISSES:
+      gst_vk_pic_pool_get_stats (self->pic_pool, NULL, &misses);
+      g_value_set_uint64 (value, misses);
+      break;
+    case PROP_BITSTREAM_ALLOCATIONS:
+      g_value_set_uint64 (value,
+          gst_vk_bitstream_arena_get_allocations (self->arena));
+      break;
+    case PROP_PICTURE_BYTES:
+      g_value_set_uint64 (value, gst_vk_pic_pool_get_size (self->pic_pool));
+      break;
+    case PROP_PARAM_SET_BYTES:
+      g_value_set_uint64 (value, gst_vk_param_set_cache_get_size (self->sps_cache)
+          + gst_vk_param_set_cache_get_size (self->pps_cache));
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -901,6 +1201,7 @@ gst_vk_h264_dec_class_init (GstVkH264DecClass * klass)
 
   gobject_class->dispose = gst_vk_h264_dec_dispose;
   gobject_class->set_property = gst_vk_h264_dec_set_property;
+  gobject_class->get_property = gst_vk_h264_dec_get_property;
 
   h264decoder_class->new_sequence = gst_vk_h264_dec_new_sequence;
   h264decoder_class->decode_slice = gst_vk_h264_dec_decode_slice;
@@ -917,10 +1218,71 @@ gst_vk_h264_dec_class_init (GstVkH264DecClass * klass)
       g_param_spec_pointer ("user-data", "user-data", "user-data",
           GParamFlags (G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY)));
 
-  g_object_class_install_property (gobject_class, PROP_OOB_PIC_PARAMS,
-      g_param_spec_boolean ("oob-pic-params", "oob-pic-params",
-          "oop-pic-params", FALSE,
+  g_object_class_install_property (gobject_class, PROP_SCATTER_GATHER_SLICES,
+      g_param_spec_boolean ("scatter-gather-slices", "scatter-gather-slices",
+          "Hand slices as segments of the input instead of copying them",
+          FALSE, GParamFlags (G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_BITSTREAM_OFFSET_ALIGNMENT,
+      g_param_spec_uint ("bitstream-offset-alignment",
+          "bitstream-offset-alignment",
+          "Alignment of the picture bitstream data, a power of two", 1,
+          G_MAXUINT, 1,
           GParamFlags (G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_BITSTREAM_SIZE_ALIGNMENT,
+      g_param_spec_uint ("bitstream-size-alignment",
+          "bitstream-size-alignment",
+          "Picture bitstream data is zero padded to a multiple of this", 1,
+          G_MAXUINT, 1,
+          GParamFlags (G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY)));
+
+  g_object_class_install_property (gobject_class, PROP_BITSTREAM_STORAGE,
+      g_param_spec_pointer ("bitstream-storage", "bitstream-storage",
+          "VkParserBitstreamStorage providing the picture bitstream memory",
+          GParamFlags (G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY)));
+
+  g_object_class_install_property (gobject_class, PROP_CLOCK_RATE,
+      g_param_spec_uint64 ("clock-rate", "clock-rate",
+          "Ticks per second of the timestamps given to DisplayPicture()", 1,
+          G_MAXUINT64, 10000000,
+          GParamFlags (G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY)));
+
+  g_object_class_install_property (gobject_class, PROP_PIC_POOL_HITS,
+      g_param_spec_uint64 ("pic-pool-hits", "pic-pool-hits",
+          "Pictures reused from the pool", 0, G_MAXUINT64, 0,
+          GParamFlags (G_PARAM_READABLE)));
+
+  g_object_class_install_property (gobject_class, PROP_PIC_POOL_MISSES,
+      g_param_spec_uint64 ("pic-pool-misses", "pic-pool-misses",
+          "Pictures allocated because the pool was empty", 0, G_MAXUINT64, 0,
+          GParamFlags (G_PARAM_READABLE)));
+
+  g_object_class_install_property (gobject_class, PROP_BITSTREAM_ALLOCATIONS,
+      g_param_spec_uint64 ("bitstream-allocations", "bitstream-allocations",
+          "Heap allocations done to store picture slice data", 0,
+          G_MAXUINT64, 0,
+          GParamFlags (G_PARAM_READABLE)));
+
+  g_object_class_install_property (gobject_class, PROP_PICTURE_BYTES,
+      g_param_spec_uint64 ("picture-bytes", "picture-bytes",
+          "Memory taken by the picture structures, in use or pooled", 0,
+          G_MAXUINT64, 0,
+          GParamFlags (G_PARAM_READABLE)));
+
+  g_object_class_install_property (gobject_class, PROP_PARAM_SET_BYTES,
+      g_param_spec_uint64 ("param-set-bytes", "param-set-bytes",
+          "Memory taken by the converted parameter sets", 0,
+          G_MAXUINT64, 0,
+          GParamFlags (G_PARAM_READABLE)));
+
+  /* gboolean (VkParserSliceInfo *, const VkParserPictureData *, gint) */
+  g_signal_new_class_handler ("decode-slice-info", G_TYPE_FROM_CLASS (klass),
+      GSignalFlags (G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION),
+      G_CALLBACK (gst_vk_h264_dec_decode_slice_info), NULL, NULL, NULL,
+      G_TYPE_BOOLEAN, 3, G_TYPE_POINTER, G_TYPE_POINTER, G_TYPE_INT);
 }
 
 static void
@@ -928,6 +1290,13 @@ gst_vk_h264_dec_init (GstVkH264Dec * self)
 {
   gst_h264_decoder_set_process_ref_pic_lists (GST_H264_DECODER (self), FALSE);
 
-  self->refs = g_array_sized_new (FALSE, TRUE, sizeof (GstH264Decoder *), 16);
-  g_array_set_clear_func (self->refs, (GDestroyNotify) gst_clear_h264_picture);
+
+  self->arena = gst_vk_bitstream_arena_new ();
+  self->sps_cache = gst_vk_param_set_cache_new (GST_H264_MAX_SPS_COUNT);
+  self->pps_cache = gst_vk_param_set_cache_new (GST_H264_MAX_PPS_COUNT);
+  self->offset_alignment = 1;
+  self->size_alignment = 1;
+  self->clock_rate = 10000000;
+  self->pic_pool =
+      gst_vk_pic_pool_new (sizeof (VkPic), GST_VK_PIC_POOL_DEFAULT_MAX_FREE);
 }
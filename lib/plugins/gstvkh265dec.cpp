@@ -17,6 +17,9 @@
 
 #include "gstvkelements.h"
 #include "glib_compat.h"
+#include "gstvkbitstream.h"
+#include "gstvkpicpool.h"
+#include "gstvkparamset.h"
 
 #include <atomic>
 
@@ -31,6 +34,10 @@
 
 #define GST_CAT_DEFAULT gst_vk_parser_debug
 
+/* the bytes of the NAL unit a parameter set is converted from, if any */
+#define NALU_DATA(unit) ((unit) ? (unit)->data + (unit)->offset : NULL)
+#define NALU_SIZE(unit) ((unit) ? (unit)->size : 0)
+
 static GstStaticPadTemplate sink_factory =
 GST_STATIC_PAD_TEMPLATE ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
     GST_STATIC_CAPS ("video/x-h265"));
@@ -39,17 +46,32 @@ static GstStaticPadTemplate src_factory =
 GST_STATIC_PAD_TEMPLATE ("src", GST_PAD_SRC, GST_PAD_ALWAYS,
     GST_STATIC_CAPS ("video/x-raw, format=(string)NV12"));
 
-typedef struct _VkH265Picture VkH265Picture;
-struct _VkH265Picture
+/* converted parameter sets, pointed from the pictures using them */
+typedef struct _VkH265VPS VkH265VPS;
+struct _VkH265VPS
+{
+  StdVideoH265VideoParameterSet vps;
+  StdVideoH265DecPicBufMgr pic_buf_mgr;
+};
+
+typedef struct _VkH265SPS VkH265SPS;
+struct _VkH265SPS
 {
   StdVideoH265HrdParameters hrd;
   StdVideoH265SequenceParameterSetVui vui;
   StdVideoH265ProfileTierLevel profileTierLevel;
   StdVideoH265SequenceParameterSet sps;
-  StdVideoH265PictureParameterSet pps;
-  StdVideoH265VideoParameterSet vps;
   StdVideoH265DecPicBufMgr pic_buf_mgr;
-  StdVideoH265ScalingLists scaling_lists_sps, scaling_lists_pps;
+  StdVideoH265ScalingLists scaling_lists;
+};
+
+typedef struct _VkH265PPS VkH265PPS;
+struct _VkH265PPS
+{
+  StdVideoH265PictureParameterSet pps;
+  StdVideoH265ScalingLists scaling_lists;
+  /* the one of the parent SPS, with these scaling lists if they apply */
+  StdVideoH265SequenceParameterSet sps;
 };
 
 typedef struct _GstVkH265Dec GstVkH265Dec;
@@ -57,12 +79,28 @@ struct _GstVkH265Dec
 {
   GstH265Decoder parent;
   VkParserVideoDecodeClient *client;
-  gboolean oob_pic_params;
+  gboolean scatter_gather;
+  guint offset_alignment;
+  guint size_alignment;
+  VkParserBitstreamStorage *storage;
+  guint64 clock_rate;
 
   gint max_dpb_size;
 
-  VkH265Picture vkp;
-  GArray *refs;
+  GstVkBitstreamArena *arena;
+  GstVkPicPool *pic_pool;
+
+  GstVkParamSetCache *vps_cache;
+  GstVkParamSetCache *sps_cache;
+  GstVkParamSetCache *pps_cache;
+  /* the parameter sets of the last picture */
+  GstVkParamSnapshot *params;
+  /* the pictures which might still be referenced, by their RefPics index.
+   * Borrowed: a picture takes a slot when it starts and gives it back once
+   * it's not a reference anymore, or freed. */
+  GstH265Picture *dpb_slots[16];
+  /* the picture given to DecodePicture(), while it runs */
+  VkPic *decoding;
 
   VkSharedBaseObj<VkParserVideoRefCountBase> spsclient, ppsclient, vpsclient;
 
@@ -72,61 +110,142 @@ struct _GstVkH265Dec
 
 struct VkPic
 {
+  GstVkPicPool *pool;
   VkPicIf *pic;
   VkParserPictureData data;
-  GByteArray *bitstream;
-  VkH265Picture vkp;
-  uint8_t *slice_group_map;
-  GArray *slice_offsets;
+  GstVkBitstream *bitstream;
+  GstVkParamSnapshot *params;
+  /* in GstVkH265Dec::dpb_slots, if any */
+  GstH265Picture **dpb_slot;
 };
 
 enum
 {
   PROP_USER_DATA = 1,
-  PROP_OOB_PIC_PARAMS,
+  PROP_SCATTER_GATHER_SLICES,
+  PROP_BITSTREAM_OFFSET_ALIGNMENT,
+  PROP_BITSTREAM_SIZE_ALIGNMENT,
+  PROP_BITSTREAM_STORAGE,
+  PROP_CLOCK_RATE,
+  PROP_PIC_POOL_HITS,
+  PROP_PIC_POOL_MISSES,
+  PROP_BITSTREAM_ALLOCATIONS,
+  PROP_PICTURE_BYTES,
+  PROP_PARAM_SET_BYTES,
 };
 
+G_STATIC_ASSERT (sizeof (GstVkBitstreamSegment) == sizeof (VkParserSliceSegment));
+G_STATIC_ASSERT (G_STRUCT_OFFSET (GstVkBitstreamSegment, size) ==
+    G_STRUCT_OFFSET (VkParserSliceSegment, nDataLen));
+G_STATIC_ASSERT (G_N_ELEMENTS (((GstVkH265Dec *) 0)->dpb_slots) ==
+    G_N_ELEMENTS (((VkParserHevcPictureData *) 0)->RefPics));
+
 G_DEFINE_TYPE(GstVkH265Dec, gst_vk_h265_dec, GST_TYPE_H265_DECODER)
 GST_ELEMENT_REGISTER_DEFINE_WITH_CODE (vkh265parse, "vkh265parse", GST_RANK_PRIMARY, GST_TYPE_VK_H265_DEC, vk_element_init(plugin));
 
 static gpointer parent_class = NULL;
 
-static VkPic
-*vk_pic_new (VkPicIf * pic)
+static VkPic *
+vk_pic_new (GstVkH265Dec * self, VkPicIf * pic)
 {
-  VkPic *vkpic = g_new0 (struct VkPic, 1);
-  uint32_t zero = 0;
+  VkPic *vkpic =
+      static_cast<VkPic *>(gst_vk_pic_pool_acquire (self->pic_pool));
 
+  /* a recycled VkPic keeps its previous contents: data is rewritten in
+   * start_picture(), so only reset what is used before */
+  vkpic->pool = self->pic_pool;
   vkpic->pic = pic;
-  vkpic->bitstream = g_byte_array_new ();
-  vkpic->slice_offsets = g_array_new (FALSE, FALSE, sizeof (uint32_t));
-  g_array_append_val (vkpic->slice_offsets, zero);
+  vkpic->bitstream = gst_vk_bitstream_arena_acquire (self->arena);
+  vkpic->bitstream->owner = pic;
+  vkpic->params = NULL;
+  vkpic->dpb_slot = NULL;
+  vkpic->data.nNumSlices = 0;
   return vkpic;
 }
 
+static guint8 *
+vk_bitstream_storage_get (GstVkBitstream * bitstream, gsize needed,
+    gsize * capacity, gpointer user_data)
+{
+  VkParserBitstreamStorage *storage =
+      static_cast<VkParserBitstreamStorage *>(user_data);
+  size_t size = 0;
+  uint8_t *data;
+
+  data = storage->GetBitstreamBuffer (static_cast<VkPicIf *>(bitstream->owner),
+      bitstream->data, bitstream->size, needed, &size);
+  *capacity = size;
+  return data;
+}
+
+static void
+vk_bitstream_storage_release (GstVkBitstream * bitstream, gpointer user_data)
+{
+  VkParserBitstreamStorage *storage =
+      static_cast<VkParserBitstreamStorage *>(user_data);
+
+  storage->ReleaseBitstreamBuffer (static_cast<VkPicIf *>(bitstream->owner),
+      bitstream->data);
+}
+
 static void
 vk_pic_free (gpointer data)
 {
   VkPic *vkpic = static_cast<VkPic *>(data);
+  /* storage release callbacks get the VkPicIf */
+  gst_vk_bitstream_release (vkpic->bitstream);
   if (vkpic->pic)
     vkpic->pic->Release ();
-  g_byte_array_unref (vkpic->bitstream);
-  g_free ((uint32_t *)vkpic->data.pSliceDataOffsets);
-  g_free (vkpic->data.pBitstreamData);
-  g_array_unref (vkpic->slice_offsets);
-  g_free (vkpic->slice_group_map);
-  g_free (vkpic);
+  g_clear_pointer (&vkpic->params, gst_vk_param_snapshot_unref);
+  if (vkpic->dpb_slot)
+    *vkpic->dpb_slot = NULL;
+  gst_vk_pic_pool_release (vkpic->pool, vkpic);
 }
 
 static bool
-profile_is_svc (GstCaps * caps)
+profile_is_svc (GstCaps * caps, const GstH265SPS * sps)
 {
   const GstStructure *structure = gst_caps_get_structure (caps, 0);
   const gchar *profile = gst_structure_get_string (structure, "profile");
 
+  /* without h265parse upstream the caps have no profile */
+  if (!profile)
+    return sps->profile_tier_level.profile_idc == GST_H265_PROFILE_IDC_SCALABLE_MAIN
+        || sps->profile_tier_level.profile_idc == GST_H265_PROFILE_IDC_SCALABLE_FORMAT_RANGE_EXTENSION;
+
   return g_str_has_prefix (profile, "scalable");
 }
 
+/* Falls back to the VUI when the caps don't provide them, as happens when
+ * the decoder is driven directly. */
+static void
+get_framerate_and_par (GstVideoCodecState * state, const GstH265SPS * sps,
+    gint * fps_n, gint * fps_d, gint * par_n, gint * par_d)
+{
+  const GstStructure *structure = gst_caps_get_structure (state->caps, 0);
+
+  *fps_n = GST_VIDEO_INFO_FPS_N (&state->info);
+  *fps_d = GST_VIDEO_INFO_FPS_D (&state->info);
+  *par_n = GST_VIDEO_INFO_PAR_N (&state->info);
+  *par_d = GST_VIDEO_INFO_PAR_D (&state->info);
+
+  if (!sps->vui_parameters_present_flag)
+    return;
+
+  if (*fps_n == 0 && sps->vui_params.timing_info_present_flag
+      && sps->vui_params.num_units_in_tick > 0) {
+    *fps_n = sps->vui_params.time_scale;
+    *fps_d = sps->vui_params.num_units_in_tick;
+  }
+
+  if (!gst_structure_has_field (structure, "pixel-aspect-ratio")
+      && sps->vui_params.aspect_ratio_info_present_flag
+      && sps->vui_params.par_n > 0 && sps->vui_params.par_d > 0) {
+    *par_n = sps->vui_params.par_n;
+    *par_d = sps->vui_params.par_d;
+  }
+}
+
 static StdVideoH265ProfileIdc
 get_profile_idc (GstH265ProfileIDC profile_idc)
 {
@@ -169,11 +288,15 @@ gst_vk_h265_dec_new_sequence (GstH265Decoder * decoder, const GstH265SPS * sps,
   GstVideoCodecState *state;
   VkParserSequenceInfo seqInfo;
   guint dar_n = 0, dar_d = 0;
+  gint fps_n, fps_d, par_n, par_d;
+
+  get_framerate_and_par (decoder->input_state, sps, &fps_n, &fps_d, &par_n,
+      &par_d);
 
   seqInfo = VkParserSequenceInfo {
     .eCodec = VK_VIDEO_CODEC_OPERATION_DECODE_H265_BIT_EXT,
-    .isSVC = profile_is_svc(decoder->input_state->caps),
-    .frameRate = pack_framerate(GST_VIDEO_INFO_FPS_N(&decoder->input_state->info), GST_VIDEO_INFO_FPS_D(&decoder->input_state->info)),
+    .isSVC = profile_is_svc(decoder->input_state->caps, sps),
+    .frameRate = pack_framerate(fps_n, fps_d),
     .bProgSeq = true, // Progressive by default
     .nCodedWidth = sps->width,
     .nCodedHeight = sps->height,
@@ -223,8 +346,7 @@ gst_vk_h265_dec_new_sequence (GstH265Decoder * decoder, const GstH265SPS * sps,
 
   if (gst_video_calculate_display_ratio (&dar_n, &dar_d,
           seqInfo.nDisplayWidth, seqInfo.nDisplayHeight,
-          GST_VIDEO_INFO_PAR_N (&decoder->input_state->info),
-          GST_VIDEO_INFO_PAR_D (&decoder->input_state->info), 1, 1)) {
+          par_n, par_d, 1, 1)) {
     seqInfo.lDARWidth = dar_n;
     seqInfo.lDARHeight = dar_d;
   }
@@ -246,21 +368,25 @@ static GstFlowReturn
 gst_vk_h265_dec_decode_slice (GstH265Decoder * decoder, GstH265Picture * picture,
     GstH265Slice * slice, GArray * ref_pic_list0, GArray * ref_pic_list1)
 {
+  GstVkH265Dec *self = GST_VK_H265_DEC (decoder);
   VkPic *vkpic = static_cast<VkPic *>(gst_h265_picture_get_user_data(picture));
-  static const uint8_t nal[] = { 0, 0, 1 };
-  const size_t start_code_size = sizeof(nal);
-  uint32_t offset;
+
+  gboolean ret;
 
   vkpic->data.nNumSlices++;
-  // nvidia parser adds 000001 NAL unit identifier at every slice
-  g_byte_array_append (vkpic->bitstream, nal, start_code_size);
-  g_byte_array_append (vkpic->bitstream, slice->nalu.data + slice->nalu.offset,
-      slice->nalu.size);
+  if (self->scatter_gather) {
+    /* the input buffer stays mapped until end_picture() returns */
+    ret = gst_vk_bitstream_add_slice_segment (vkpic->bitstream,
+        slice->nalu.data, slice->nalu.offset, slice->nalu.size);
+  } else {
+    ret = gst_vk_bitstream_append_slice (vkpic->bitstream,
+        slice->nalu.data + slice->nalu.offset, slice->nalu.size);
+  }
+  if (!ret) {
+    GST_ERROR_OBJECT (self, "Failed to get bitstream storage");
+    return GST_FLOW_ERROR;
+  }
   // GST_MEMDUMP_OBJECT(decoder, "SLICE :", slice->nalu.data + slice->nalu.offset, slice->nalu.size);
-  offset =
-      g_array_index (vkpic->slice_offsets, uint32_t,
-      vkpic->slice_offsets->len - 1) + slice->nalu.size + start_code_size;
-  g_array_append_val (vkpic->slice_offsets, offset);
 
   return GST_FLOW_OK;
 }
@@ -278,14 +404,33 @@ gst_vk_h265_dec_new_picture (GstH265Decoder * decoder, GstVideoCodecFrame * fram
       return GST_FLOW_ERROR;
   }
 
-  vkpic = vk_pic_new (pic);
+  vkpic = vk_pic_new (self, pic);
   gst_h265_picture_set_user_data (picture, vkpic, vk_pic_free);
 
-  frame->output_buffer = gst_buffer_new ();
+  /* nothing downstream when driven directly */
+  if (gst_pad_is_linked (GST_VIDEO_DECODER_SRC_PAD (decoder)))
+    frame->output_buffer = gst_buffer_new ();
 
   return GST_FLOW_OK;
 }
 
+/* The PTS of the frame, or one made up from its number, in clock-rate
+ * ticks. */
+static int64_t
+get_timestamp (GstVkH265Dec * self, GstVideoCodecFrame * frame,
+    GstH265Picture * picture)
+{
+  GstClockTime ts = frame->pts;
+
+  if (!GST_CLOCK_TIME_IS_VALID (ts)
+      && GST_CLOCK_TIME_IS_VALID (frame->duration))
+    ts = picture->system_frame_number * frame->duration;
+  if (!GST_CLOCK_TIME_IS_VALID (ts))
+    return 0;
+
+  return gst_util_uint64_scale_round (ts, self->clock_rate, GST_SECOND);
+}
+
 static GstFlowReturn
 gst_vk_h265_dec_output_picture (GstH265Decoder * decoder,
     GstVideoCodecFrame * frame, GstH265Picture * picture)
@@ -295,14 +440,19 @@ gst_vk_h265_dec_output_picture (GstH265Decoder * decoder,
 
   if (self->client) {
     if (!self->client->DisplayPicture (vkpic->pic,
-            //FIXME: Why divided by 100  ???
-            picture->system_frame_number * frame->duration / 100)) {
+            get_timestamp (self, frame, picture))) {
       gst_h265_picture_unref (picture);
       return GST_FLOW_ERROR;
     }
   }
 
   gst_h265_picture_unref (picture);
+
+  if (!gst_pad_is_linked (GST_VIDEO_DECODER_SRC_PAD (decoder))) {
+    gst_video_decoder_release_frame (GST_VIDEO_DECODER (decoder), frame);
+    return GST_FLOW_OK;
+  }
+
   return gst_video_decoder_finish_frame (GST_VIDEO_DECODER (decoder), frame);
 }
 
@@ -311,13 +461,25 @@ gst_vk_h265_dec_end_picture (GstH265Decoder * decoder, GstH265Picture * picture)
 {
   GstVkH265Dec *self = GST_VK_H265_DEC (decoder);
   VkPic *vkpic = reinterpret_cast<VkPic *>(gst_h265_picture_get_user_data(picture));
-  gsize len;
   GstFlowReturn ret = GST_FLOW_OK;
 
-  vkpic->data.pBitstreamData = g_byte_array_steal (vkpic->bitstream, &len);
-  vkpic->data.nBitstreamDataLen = static_cast<int32_t>(len);
-  vkpic->data.pSliceDataOffsets =
-      static_cast <uint32_t *>(g_array_steal (vkpic->slice_offsets, NULL));
+  if (self->scatter_gather) {
+    vkpic->data.pSliceSegments = reinterpret_cast<const VkParserSliceSegment *>
+        (gst_vk_bitstream_get_segments (vkpic->bitstream));
+    vkpic->data.nBitstreamDataLen =
+        vkpic->bitstream->offsets[vkpic->bitstream->n_slices];
+  } else {
+    gsize padded;
+
+    /* padding might move the data */
+    if (!gst_vk_bitstream_pad (vkpic->bitstream, &padded)) {
+      GST_ERROR_OBJECT (self, "Failed to get bitstream storage");
+      return GST_FLOW_ERROR;
+    }
+    vkpic->data.nBitstreamDataLen = static_cast<uint32_t>(padded);
+    vkpic->data.pBitstreamData = vkpic->bitstream->data;
+  }
+  vkpic->data.pSliceDataOffsets = vkpic->bitstream->offsets;
 
   // FIXME: This flag is set to TRUE unconditionally because VulkanVideoParser.cpp expects it be true
   // during the decode phase. It will be set to True by base class only when it will be added to the dpb
@@ -325,10 +487,15 @@ gst_vk_h265_dec_end_picture (GstH265Decoder * decoder, GstH265Picture * picture)
   vkpic->data.ref_pic_flag = TRUE;
 
   if (self->client) {
+    self->decoding = vkpic;
     if (!self->client->DecodePicture (&vkpic->data))
       ret = GST_FLOW_ERROR;
+    self->decoding = NULL;
   }
 
+  /* client provided memory isn't kept past decoding */
+  gst_vk_bitstream_release_storage (vkpic->bitstream);
+
   return ret;
 }
 
@@ -356,7 +523,7 @@ fill_scaling_list(GstH265ScalingList* src, StdVideoH265ScalingLists* dest) {
 }
 
 static void
-fill_sps(GstH265SPS* sps, VkH265Picture* vkp)
+fill_sps(GstH265SPS* sps, VkH265SPS* vkp)
 {
     if (sps->vui_parameters_present_flag) {
       if (sps->vui_params.hrd_parameters_present_flag) {
@@ -444,7 +611,13 @@ fill_sps(GstH265SPS* sps, VkH265Picture* vkp)
       .general_level_idc = static_cast<StdVideoH265LevelIdc>(sps->profile_tier_level.level_idc),
     };
 
-    fill_scaling_list (&sps->scaling_list, &vkp->scaling_lists_sps);
+    fill_scaling_list (&sps->scaling_list, &vkp->scaling_lists);
+
+    for (guint i = 0; i < STD_VIDEO_H265_SUBLAYERS_LIST_SIZE; i++) {
+      vkp->pic_buf_mgr.max_latency_increase_plus1[i] = sps->max_latency_increase_plus1[i];
+      vkp->pic_buf_mgr.max_dec_pic_buffering_minus1[i] = sps->max_dec_pic_buffering_minus1[i];
+      vkp->pic_buf_mgr.max_num_reorder_pics[i] = sps->max_num_reorder_pics[i];
+    }
 
     vkp->sps = StdVideoH265SequenceParameterSet {
         .flags = {
@@ -513,8 +686,8 @@ fill_sps(GstH265SPS* sps, VkH265Picture* vkp)
         .conf_win_top_offset = sps->conf_win_top_offset,
         .conf_win_bottom_offset = sps->conf_win_bottom_offset,
         .pProfileTierLevel = &vkp->profileTierLevel,
-        .pDecPicBufMgr = &vkp->pic_buf_mgr, // FIXME: Not available in the NVidia parser
-        .pScalingLists = sps->scaling_list_enabled_flag ? &vkp->scaling_lists_sps : nullptr,
+        .pDecPicBufMgr = &vkp->pic_buf_mgr,
+        .pScalingLists = sps->scaling_list_enabled_flag ? &vkp->scaling_lists : nullptr,
         .pShortTermRefPicSet = nullptr, //FIXME
         .pLongTermRefPicsSps = nullptr, //FIXME
         .pSequenceParameterSetVui = &vkp->vui,
@@ -548,10 +721,10 @@ fill_sps(GstH265SPS* sps, VkH265Picture* vkp)
 }
 
 static void
-fill_pps (GstH265PPS * pps, VkH265Picture * vkp)
+fill_pps (GstH265PPS * pps, VkH265PPS * vkp)
 {
 
-  fill_scaling_list(&pps->scaling_list, &vkp->scaling_lists_pps);
+  fill_scaling_list(&pps->scaling_list, &vkp->scaling_lists);
 
   vkp->pps = StdVideoH265PictureParameterSet {
     .flags = {
@@ -621,7 +794,7 @@ fill_pps (GstH265PPS * pps, VkH265Picture * vkp)
     .num_tile_rows_minus1 = pps->num_tile_rows_minus1,
     //.column_width_minus1 = 0,// memcpy above
     //.row_height_minus1 = 0,// memcpy above
-    .pScalingLists =  pps->scaling_list_data_present_flag ? &vkp->scaling_lists_pps : nullptr,
+    .pScalingLists =  pps->scaling_list_data_present_flag ? &vkp->scaling_lists : nullptr,
     .pPredictorPaletteEntries = nullptr,
   };
 
@@ -632,7 +805,7 @@ fill_pps (GstH265PPS * pps, VkH265Picture * vkp)
 }
 
 static void
-fill_vps (GstH265VPS * vps, VkH265Picture * vkp)
+fill_vps (GstH265VPS * vps, VkH265VPS * vkp)
 {
   vkp->vps = StdVideoH265VideoParameterSet {
     .flags = {
@@ -655,30 +828,192 @@ fill_vps (GstH265VPS * vps, VkH265Picture * vkp)
   vkp->vps.pDecPicBufMgr = &vkp->pic_buf_mgr;
 }
 
+static GstVkParamSet *
+convert_vps (GstVkH265Dec * self, GstH265VPS * vps,
+    const GstH265NalUnit * unit)
+{
+  GstVkParamSet *ps = gst_vk_param_set_cache_insert (self->vps_cache,
+      vps->id, sizeof (VkH265VPS), NALU_DATA (unit), NALU_SIZE (unit));
+
+  fill_vps (vps, GST_VK_PARAM_SET_DATA (ps, VkH265VPS));
+  GST_DEBUG_OBJECT (self, "VPS %u generation %u", ps->id, ps->generation);
+
+  return ps;
+}
+
+static GstVkParamSet *
+convert_sps (GstVkH265Dec * self, GstH265SPS * sps,
+    const GstH265NalUnit * unit)
+{
+  GstVkParamSet *ps = gst_vk_param_set_cache_insert (self->sps_cache,
+      sps->id, sizeof (VkH265SPS), NALU_DATA (unit), NALU_SIZE (unit));
+
+  fill_sps (sps, GST_VK_PARAM_SET_DATA (ps, VkH265SPS));
+  GST_DEBUG_OBJECT (self, "SPS %u generation %u", ps->id, ps->generation);
+
+  return ps;
+}
+
+/* The PPS scaling lists might replace those of its SPS, so it's converted
+ * against the SPS, which becomes its parent. */
+static GstVkParamSet *
+convert_pps (GstVkH265Dec * self, GstH265PPS * pps, GstVkParamSet * sps_ps,
+    const GstH265NalUnit * unit)
+{
+  GstVkParamSet *ps = gst_vk_param_set_cache_insert (self->pps_cache,
+      pps->id, sizeof (VkH265PPS), NALU_DATA (unit), NALU_SIZE (unit));
+  VkH265PPS *vkp = GST_VK_PARAM_SET_DATA (ps, VkH265PPS);
+  GstH265SPS *sps = pps->sps;
+
+  gst_vk_param_set_set_parent (ps, sps_ps);
+  fill_pps (pps, vkp);
+
+  vkp->sps = GST_VK_PARAM_SET_DATA (sps_ps, VkH265SPS)->sps;
+  // Following bad/sys/nvcodec/gstnvh265dec.c
+  if (pps->scaling_list_data_present_flag ||
+      (sps->scaling_list_enabled_flag
+          && !sps->scaling_list_data_present_flag)) {
+    vkp->sps.pScalingLists = &vkp->scaling_lists;
+  }
+
+  GST_DEBUG_OBJECT (self, "PPS %u generation %u, on SPS %u generation %u",
+      ps->id, ps->generation, sps_ps->id, sps_ps->generation);
+
+  return ps;
+}
+
+/* Parameter sets are converted as they arrive, in
+ * update_picture_parameters(); these only convert those missed, or a PPS
+ * converted against a previous SPS. */
+static GstVkParamSet *
+get_vps (GstVkH265Dec * self, GstH265VPS * vps)
+{
+  GstVkParamSet *ps = gst_vk_param_set_cache_lookup (self->vps_cache, vps->id);
+
+  return ps ? ps : convert_vps (self, vps, NULL);
+}
+
+static GstVkParamSet *
+get_sps (GstVkH265Dec * self, GstH265SPS * sps)
+{
+  GstVkParamSet *ps = gst_vk_param_set_cache_lookup (self->sps_cache, sps->id);
+
+  return ps ? ps : convert_sps (self, sps, NULL);
+}
+
+static GstVkParamSet *
+get_pps (GstVkH265Dec * self, GstH265PPS * pps, GstVkParamSet * sps_ps)
+{
+  GstVkParamSet *ps = gst_vk_param_set_cache_lookup (self->pps_cache, pps->id);
+
+  return ps && ps->parent == sps_ps ? ps :
+      convert_pps (self, pps, sps_ps, NULL);
+}
+
+static void
+release_dpb_slot (GstH265Picture ** slot)
+{
+  VkPic *vkpic = static_cast<VkPic *>(gst_h265_picture_get_user_data (*slot));
+
+  vkpic->dpb_slot = NULL;
+  *slot = NULL;
+}
+
+/* The RefPics indexes of the pictures, those missing skipped. */
+static void
+fill_ref_pic_set (GstVkH265Dec * self, int8_t set[8],
+    GstH265Picture ** pictures, guint n_pictures)
+{
+  guint i, n = 0;
+
+  for (i = 0; i < n_pictures && n < 8; i++) {
+    VkPic *vkpic;
+
+    if (!pictures[i])
+      continue;
+
+    vkpic = static_cast<VkPic *>(gst_h265_picture_get_user_data (pictures[i]));
+    if (vkpic && vkpic->dpb_slot)
+      set[n++] = vkpic->dpb_slot - self->dpb_slots;
+  }
+}
+
+static void
+fill_ref_pic_list (GstVkH265Dec * self, VkParserSliceInfo * info, guint list,
+    GArray * ref_pic_list)
+{
+  guint i;
+
+  info->num_ref_idx_active[list] = MIN (ref_pic_list->len, 32);
+  for (i = 0; i < (guint) info->num_ref_idx_active[list]; i++) {
+    GstH265Picture *picture =
+        g_array_index (ref_pic_list, GstH265Picture *, i);
+    VkPic *vkpic = picture ?
+        static_cast<VkPic *>(gst_h265_picture_get_user_data (picture)) : NULL;
+
+    if (vkpic && vkpic->dpb_slot)
+      info->RefPicList[list][i] = vkpic->dpb_slot - self->dpb_slots;
+  }
+}
+
+/* The reference picture lists are only built for the slices the client asks
+ * about, from its DecodePicture(), parsing them again. */
+static gboolean
+gst_vk_h265_dec_decode_slice_info (GstVkH265Dec * self,
+    VkParserSliceInfo * info, const VkParserPictureData * data, gint index)
+{
+  GstH265Decoder *decoder = GST_H265_DECODER (self);
+  VkPic *vkpic = self->decoding;
+  const guint8 *slice_data;
+  gsize size;
+  GstH265Slice slice;
+  GArray *ref_pic_list0, *ref_pic_list1;
+  guint32 address = 0;
+  gint i;
+
+  if (!vkpic || data != &vkpic->data || index < 0
+      || static_cast<guint>(index) >= vkpic->bitstream->n_slices)
+    return FALSE;
+
+  /* dependent slice segments have the lists of their independent one */
+  for (i = index; i >= 0; i--) {
+    slice_data = gst_vk_bitstream_get_slice (vkpic->bitstream, i, &size);
+    if (!gst_h265_decoder_reparse_slice (decoder, slice_data, size, &slice))
+      return FALSE;
+    if (i == index)
+      address = slice.header.segment_address;
+    if (!slice.header.dependent_slice_segment_flag)
+      break;
+  }
+
+  if (i < 0 || !gst_h265_decoder_build_ref_pic_lists (decoder, &slice,
+          &ref_pic_list0, &ref_pic_list1))
+    return FALSE;
+
+  *info = VkParserSliceInfo {
+    .slice_type = slice.header.type,
+    .first_mb_in_slice = address,
+  };
+  memset (info->RefPicList, -1, sizeof (info->RefPicList));
+  fill_ref_pic_list (self, info, 0, ref_pic_list0);
+  fill_ref_pic_list (self, info, 1, ref_pic_list1);
+
+  return TRUE;
+}
+
 static GstFlowReturn
 gst_vk_h265_dec_start_picture (GstH265Decoder * decoder, GstH265Picture * picture,
     GstH265Slice * slice, GstH265Dpb * dpb)
 {
   GstVkH265Dec *self = GST_VK_H265_DEC (decoder);
   VkPic *vkpic =  gst_vk_h265_dec_get_decoder_frame_from_picture(decoder, picture);
-  VkH265Picture *vkp = &self->vkp;
   GstH265PPS *pps = slice->header.pps;
   GstH265SPS *sps = pps->sps;
   GstH265VPS *vps = sps->vps;
 
-  if (!self->oob_pic_params
-      || (self->sps_update_count == 0 && self->sps_update_count == 0)) {
-    vkp = &vkpic->vkp;
-    fill_sps (sps, vkp);
-    fill_pps (pps, vkp);
-  }
-  // Following bad/sys/nvcodec/gstnvh265dec.c
-  if (pps->scaling_list_data_present_flag ||
-      (sps->scaling_list_enabled_flag
-          && !sps->scaling_list_data_present_flag)) {
-      fill_scaling_list (&pps->scaling_list, &vkp->scaling_lists_sps);
-      vkp->sps.pScalingLists  = &vkp->scaling_lists_sps;
-    }
+  GstVkParamSet *sps_ps = get_sps (self, sps);
+  vkpic->params = gst_vk_param_snapshot_ref (gst_vk_param_snapshot_update
+      (&self->params, get_vps (self, vps), sps_ps, get_pps (self, pps, sps_ps)));
 
   vkpic->data = VkParserPictureData {
       .PicWidthInMbs = sps->width / 16, // Coded Frame Size
@@ -709,11 +1044,11 @@ gst_vk_h265_dec_start_picture (GstH265Decoder * decoder, GstH265Picture * pictur
 
   VkParserHevcPictureData *h265 = &vkpic->data.CodecSpecific.hevc;
   *h265 = VkParserHevcPictureData {
-      .pStdVps = &vkp->vps,
+      .pStdVps = &GST_VK_PARAM_SET_DATA (vkpic->params->vps, VkH265VPS)->vps,
       .pVpsClientObject = self->vpsclient,
-      .pStdSps = &vkp->sps,
+      .pStdSps = &GST_VK_PARAM_SET_DATA (vkpic->params->pps, VkH265PPS)->sps,
       .pSpsClientObject = self->spsclient,
-      .pStdPps = &vkp->pps,
+      .pStdPps = &GST_VK_PARAM_SET_DATA (vkpic->params->pps, VkH265PPS)->pps,
       .pPpsClientObject = self->ppsclient,
       .pic_parameter_set_id = static_cast<uint8_t>(pps->id), // PPS ID
       .seq_parameter_set_id = static_cast<uint8_t>(sps->id), // SPS ID
@@ -759,78 +1094,48 @@ gst_vk_h265_dec_start_picture (GstH265Decoder * decoder, GstH265Picture * pictur
       // int8_t RefPicSetInterLayer1[8];
   };
 
-  /* reference frames */
-  GArray * dpb_array = gst_h265_dpb_get_pictures_all(dpb);
-  guint i, j, k;
-  guint num_ref_pic = 0;
-  for (i = 0; i < dpb_array->len; i++) {
-    GstH265Picture *other = g_array_index (dpb_array, GstH265Picture *, i);
-    VkPic *other_frame;
-    //gint picture_index = -1;
+  /* reference frames: the DPB slots still referenced, the current picture
+   * taking a free one */
+  {
+    GstH265Picture **free_slot = NULL;
+    guint i;
 
-    if (!other->ref)
-      continue;
+    for (i = 0; i < G_N_ELEMENTS (self->dpb_slots); i++) {
+      GstH265Picture *other = self->dpb_slots[i];
+      VkPic *other_frame;
 
-    if (num_ref_pic >= G_N_ELEMENTS (h265->RefPics)) {
-      GST_ERROR_OBJECT (self, "Too many reference frames");
-      return GST_FLOW_ERROR;
-    }
-
-    other_frame = gst_vk_h265_dec_get_decoder_frame_from_picture (decoder, other);
-
-    h265->RefPics[num_ref_pic] = other_frame->pic;
-    h265->PicOrderCntVal[num_ref_pic] = other->pic_order_cnt;
-    h265->IsLongTerm[num_ref_pic] = other->long_term;
-
-    num_ref_pic++;
-  }
-  g_array_unref (dpb_array);
-    for (i = 0, j = 0; i < num_ref_pic; i++) {
-    GstH265Picture *other = NULL;
-
-    while (!other && j < decoder->NumPocStCurrBefore)
-      other = decoder->RefPicSetStCurrBefore[j++];
-
-    if (other) {
-      for (k = 0; k < num_ref_pic; k++) {
-        if (h265->PicOrderCntVal[k] == other->pic_order_cnt) {
-          h265->RefPicSetStCurrBefore[i] = k;
-          break;
-        }
+      if (other && !other->ref) {
+        release_dpb_slot (&self->dpb_slots[i]);
+        other = NULL;
       }
-    }
-  }
-
-  for (i = 0, j = 0; i < num_ref_pic; i++) {
-    GstH265Picture *other = NULL;
-
-    while (!other && j < decoder->NumPocStCurrAfter)
-      other = decoder->RefPicSetStCurrAfter[j++];
 
-    if (other) {
-      for (k = 0; k < num_ref_pic; k++) {
-        if (h265->PicOrderCntVal[k] == other->pic_order_cnt) {
-          h265->RefPicSetStCurrAfter[i] = k;
-          break;
-        }
+      if (!other) {
+        if (!free_slot)
+          free_slot = &self->dpb_slots[i];
+        continue;
       }
-    }
-  }
 
-  for (i = 0, j = 0; i < num_ref_pic; i++) {
-    GstH265Picture *other = NULL;
+      other_frame =
+          static_cast<VkPic *>(gst_h265_picture_get_user_data (other));
+      h265->RefPics[i] = other_frame->pic;
+      h265->PicOrderCntVal[i] = other->pic_order_cnt;
+      h265->IsLongTerm[i] = other->long_term;
+    }
 
-    while (!other && j < decoder->NumPocLtCurr)
-      other = decoder->RefPicSetLtCurr[j++];
+    fill_ref_pic_set (self, h265->RefPicSetStCurrBefore,
+        decoder->RefPicSetStCurrBefore, decoder->NumPocStCurrBefore);
+    fill_ref_pic_set (self, h265->RefPicSetStCurrAfter,
+        decoder->RefPicSetStCurrAfter, decoder->NumPocStCurrAfter);
+    fill_ref_pic_set (self, h265->RefPicSetLtCurr,
+        decoder->RefPicSetLtCurr, decoder->NumPocLtCurr);
 
-    if (other) {
-      for (k = 0; k < num_ref_pic; k++) {
-        if (h265->PicOrderCntVal[k] == other->pic_order_cnt) {
-          h265->RefPicSetLtCurr[i] = k;
-          break;
-        }
-      }
+    if (!free_slot) {
+      GST_ERROR_OBJECT (self, "Too many reference frames");
+      return GST_FLOW_ERROR;
     }
+
+    *free_slot = picture;
+    vkpic->dpb_slot = free_slot;
   }
 
   return GST_FLOW_OK;
@@ -848,19 +1153,31 @@ gst_vk_h265_dec_unhandled_nalu (GstH265Decoder * decoder, const guint8 * data,
 
 static void
 gst_vk_h265_dec_update_picture_parameters (GstH265Decoder * decoder,
-    GstH265NalUnitType type, const gpointer nalu)
+    GstH265NalUnitType type, const gpointer nalu, const GstH265NalUnit * unit)
 {
   GstVkH265Dec *self = GST_VK_H265_DEC (decoder);
   VkPictureParameters params;
 
+  /* Streams usually repeat their parameter sets before every IRAP: the
+   * client is only told about those which changed, so it doesn't rebuild
+   * its session parameters for nothing. */
   switch (type) {
     case GST_H265_NAL_SPS:{
       GstH265SPS *sps = static_cast < GstH265SPS * >(nalu);
-      fill_sps (sps, &self->vkp);
+      GstVkParamSet *ps;
+
+      if (gst_vk_param_set_cache_lookup_content (self->sps_cache, sps->id,
+              NALU_DATA (unit), NALU_SIZE (unit))) {
+        GST_LOG_OBJECT (self, "SPS %u repeated", sps->id);
+        break;
+      }
+
+      ps = convert_sps (self, sps, unit);
       params = VkPictureParameters {
         .updateType = VK_PICTURE_PARAMETERS_UPDATE_H265_SPS,
-        .pH265Sps = &self->vkp.sps,
+        .pH265Sps = &GST_VK_PARAM_SET_DATA (ps, VkH265SPS)->sps,
         .updateSequenceCount = self->sps_update_count++,
+        .contentGeneration = ps->generation,
       };
       if (self->client) {
         if (!self->client->UpdatePictureParameters (&params, self->spsclient,
@@ -871,11 +1188,26 @@ gst_vk_h265_dec_update_picture_parameters (GstH265Decoder * decoder,
     }
     case GST_H265_NAL_PPS:{
       GstH265PPS *pps = static_cast < GstH265PPS * >(nalu);
-      fill_pps (pps, &self->vkp);
+      GstVkParamSet *sps_ps, *ps;
+
+      if (!pps->sps)
+        break;
+      sps_ps = get_sps (self, pps->sps);
+
+      /* its conversion might change with the SPS */
+      ps = gst_vk_param_set_cache_lookup_content (self->pps_cache, pps->id,
+          NALU_DATA (unit), NALU_SIZE (unit));
+      if (ps && ps->parent == sps_ps) {
+        GST_LOG_OBJECT (self, "PPS %u repeated", pps->id);
+        break;
+      }
+
+      ps = convert_pps (self, pps, sps_ps, unit);
       params = VkPictureParameters {
         .updateType = VK_PICTURE_PARAMETERS_UPDATE_H265_PPS,
-        .pH265Pps = &self->vkp.pps,
+        .pH265Pps = &GST_VK_PARAM_SET_DATA (ps, VkH265PPS)->pps,
         .updateSequenceCount = self->pps_update_count++,
+        .contentGeneration = ps->generation,
       };
       if (self->client) {
         if (!self->client->UpdatePictureParameters (&params, self->ppsclient,
@@ -886,11 +1218,20 @@ gst_vk_h265_dec_update_picture_parameters (GstH265Decoder * decoder,
     }
     case GST_H265_NAL_VPS:{
       GstH265VPS *vps = static_cast < GstH265VPS * >(nalu);
-      fill_vps (vps, &self->vkp);
+      GstVkParamSet *ps;
+
+      if (gst_vk_param_set_cache_lookup_content (self->vps_cache, vps->id,
+              NALU_DATA (unit), NALU_SIZE (unit))) {
+        GST_LOG_OBJECT (self, "VPS %u repeated", vps->id);
+        break;
+      }
+
+      ps = convert_vps (self, vps, unit);
       params = VkPictureParameters {
         .updateType = VK_PICTURE_PARAMETERS_UPDATE_H265_VPS,
-        .pH265Vps = &self->vkp.vps,
+        .pH265Vps = &GST_VK_PARAM_SET_DATA (ps, VkH265VPS)->vps,
         .updateSequenceCount = self->pps_update_count++,
+        .contentGeneration = ps->generation,
       };
       if (self->client) {
         if (!self->client->UpdatePictureParameters (&params, self->vpsclient,
@@ -908,6 +1249,13 @@ static void
 gst_vk_h265_dec_dispose (GObject * object)
 {
   GstVkH265Dec *self = GST_VK_H265_DEC (object);
+  guint i;
+
+  /* pictures might outlive the element */
+  for (i = 0; i < G_N_ELEMENTS (self->dpb_slots); i++) {
+    if (self->dpb_slots[i])
+      release_dpb_slot (&self->dpb_slots[i]);
+  }
 
   if (self->spsclient)
     self->spsclient->Release ();
@@ -916,7 +1264,12 @@ gst_vk_h265_dec_dispose (GObject * object)
   if (self->vpsclient)
     self->vpsclient->Release ();
 
-  g_clear_pointer (&self->refs, g_array_unref);
+  g_clear_pointer (&self->params, gst_vk_param_snapshot_unref);
+  g_clear_pointer (&self->vps_cache, gst_vk_param_set_cache_free);
+  g_clear_pointer (&self->sps_cache, gst_vk_param_set_cache_free);
+  g_clear_pointer (&self->pps_cache, gst_vk_param_set_cache_free);
+  g_clear_pointer (&self->arena, gst_vk_bitstream_arena_unref);
+  g_clear_pointer (&self->pic_pool, gst_vk_pic_pool_unref);
 
   G_OBJECT_CLASS (parent_class)->dispose (object);
 }
@@ -932,8 +1285,64 @@ gst_vk_h265_dec_set_property (GObject * object, guint property_id,
       self->client =
           reinterpret_cast <VkParserVideoDecodeClient *>(g_value_get_pointer (value));
       break;
-    case PROP_OOB_PIC_PARAMS:
-      self->oob_pic_params = g_value_get_boolean (value);
+    case PROP_SCATTER_GATHER_SLICES:
+      self->scatter_gather = g_value_get_boolean (value);
+      break;
+    case PROP_BITSTREAM_OFFSET_ALIGNMENT:
+      self->offset_alignment = g_value_get_uint (value);
+      gst_vk_bitstream_arena_set_alignment (self->arena,
+          self->offset_alignment, self->size_alignment);
+      break;
+    case PROP_BITSTREAM_SIZE_ALIGNMENT:
+      self->size_alignment = g_value_get_uint (value);
+      gst_vk_bitstream_arena_set_alignment (self->arena,
+          self->offset_alignment, self->size_alignment);
+      break;
+    case PROP_CLOCK_RATE:
+      self->clock_rate = g_value_get_uint64 (value);
+      break;
+    case PROP_BITSTREAM_STORAGE:
+      self->storage =
+          reinterpret_cast <VkParserBitstreamStorage *>(g_value_get_pointer (value));
+      if (self->storage) {
+        gst_vk_bitstream_arena_set_storage (self->arena,
+            vk_bitstream_storage_get, vk_bitstream_storage_release,
+            self->storage);
+      }
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_vk_h265_dec_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstVkH265Dec *self = GST_VK_H265_DEC (object);
+  guint64 hits, misses;
+
+  switch (property_id) {
+    case PROP_PIC_POOL_HITS:
+      gst_vk_pic_pool_get_stats (self->pic_pool, &hits, NULL);
+      g_value_set_uint64 (value, hits);
+      break;
+    case PROP_PIC_POOL_MISSES:
+      gst_vk_pic_pool_get_stats (self->pic_pool, NULL, &misses);
+      g_value_set_uint64 (value, misses);
+      break;
+    case PROP_BITSTREAM_ALLOCATIONS:
+      g_value_set_uint64 (value,
+          gst_vk_bitstream_arena_get_allocations (self->arena));
+      break;
+    case PROP_PICTURE_BYTES:
+      g_value_set_uint64 (value, gst_vk_pic_pool_get_size (self->pic_pool));
+      break;
+    case PROP_PARAM_SET_BYTES:
+      g_value_set_uint64 (value, gst_vk_param_set_cache_get_size (self->vps_cache)
+          + gst_vk_param_set_cache_get_size (self->sps_cache)
+          + gst_vk_param_set_cache_get_size (self->pps_cache));
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -962,6 +1371,7 @@ gst_vk_h265_dec_class_init (GstVkH265DecClass * klass)
 
   gobject_class->dispose = gst_vk_h265_dec_dispose;
   gobject_class->set_property = gst_vk_h265_dec_set_property;
+  gobject_class->get_property = gst_vk_h265_dec_get_property;
 
   h265decoder_class->new_sequence = gst_vk_h265_dec_new_sequence;
   h265decoder_class->decode_slice = gst_vk_h265_dec_decode_slice;
@@ -977,10 +1387,71 @@ gst_vk_h265_dec_class_init (GstVkH265DecClass * klass)
       g_param_spec_pointer ("user-data", "user-data", "user-data",
           GParamFlags (G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY)));
 
-  g_object_class_install_property (gobject_class, PROP_OOB_PIC_PARAMS,
-      g_param_spec_boolean ("oob-pic-params", "oob-pic-params",
-          "oop-pic-params", FALSE,
+  g_object_class_install_property (gobject_class, PROP_SCATTER_GATHER_SLICES,
+      g_param_spec_boolean ("scatter-gather-slices", "scatter-gather-slices",
+          "Hand slices as segments of the input instead of copying them",
+          FALSE, GParamFlags (G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_BITSTREAM_OFFSET_ALIGNMENT,
+      g_param_spec_uint ("bitstream-offset-alignment",
+          "bitstream-offset-alignment",
+          "Alignment of the picture bitstream data, a power of two", 1,
+          G_MAXUINT, 1,
+          GParamFlags (G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_BITSTREAM_SIZE_ALIGNMENT,
+      g_param_spec_uint ("bitstream-size-alignment",
+          "bitstream-size-alignment",
+          "Picture bitstream data is zero padded to a multiple of this", 1,
+          G_MAXUINT, 1,
           GParamFlags (G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY)));
+
+  g_object_class_install_property (gobject_class, PROP_BITSTREAM_STORAGE,
+      g_param_spec_pointer ("bitstream-storage", "bitstream-storage",
+          "VkParserBitstreamStorage providing the picture bitstream memory",
+          GParamFlags (G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY)));
+
+  g_object_class_install_property (gobject_class, PROP_CLOCK_RATE,
+      g_param_spec_uint64 ("clock-rate", "clock-rate",
+          "Ticks per second of the timestamps given to DisplayPicture()", 1,
+          G_MAXUINT64, 10000000,
+          GParamFlags (G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY)));
+
+  g_object_class_install_property (gobject_class, PROP_PIC_POOL_HITS,
+      g_param_spec_uint64 ("pic-pool-hits", "pic-pool-hits",
+          "Pictures reused from the pool", 0, G_MAXUINT64, 0,
+          GParamFlags (G_PARAM_READABLE)));
+
+  g_object_class_install_property (gobject_class, PROP_PIC_POOL_MISSES,
+      g_param_spec_uint64 ("pic-pool-misses", "pic-pool-misses",
+          "Pictures allocated because the pool was empty", 0, G_MAXUINT64, 0,
+          GParamFlags (G_PARAM_READABLE)));
+
+  g_object_class_install_property (gobject_class, PROP_BITSTREAM_ALLOCATIONS,
+      g_param_spec_uint64 ("bitstream-allocations", "bitstream-allocations",
+          "Heap allocations done to store picture slice data", 0,
+          G_MAXUINT64, 0,
+          GParamFlags (G_PARAM_READABLE)));
+
+  g_object_class_install_property (gobject_class, PROP_PICTURE_BYTES,
+      g_param_spec_uint64 ("picture-bytes", "picture-bytes",
+          "Memory taken by the picture structures, in use or pooled", 0,
+          G_MAXUINT64, 0,
+          GParamFlags (G_PARAM_READABLE)));
+
+  g_object_class_install_property (gobject_class, PROP_PARAM_SET_BYTES,
+      g_param_spec_uint64 ("param-set-bytes", "param-set-bytes",
+          "Memory taken by the converted parameter sets", 0,
+          G_MAXUINT64, 0,
+          GParamFlags (G_PARAM_READABLE)));
+
+  /* gboolean (VkParserSliceInfo *, const VkParserPictureData *, gint) */
+  g_signal_new_class_handler ("decode-slice-info", G_TYPE_FROM_CLASS (klass),
+      GSignalFlags (G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION),
+      G_CALLBACK (gst_vk_h265_dec_decode_slice_info), NULL, NULL, NULL,
+      G_TYPE_BOOLEAN, 3, G_TYPE_POINTER, G_TYPE_POINTER, G_TYPE_INT);
 }
 
 static void
@@ -988,6 +1459,13 @@ gst_vk_h265_dec_init (GstVkH265Dec * self)
 {
   gst_h265_decoder_set_process_ref_pic_lists (GST_H265_DECODER (self), FALSE);
 
-  self->refs = g_array_sized_new (FALSE, TRUE, sizeof (GstH265Decoder *), 16);
-  g_array_set_clear_func (self->refs, (GDestroyNotify) gst_clear_h265_picture);
+  self->arena = gst_vk_bitstream_arena_new ();
+  self->vps_cache = gst_vk_param_set_cache_new (GST_H265_MAX_VPS_COUNT);
+  self->sps_cache = gst_vk_param_set_cache_new (GST_H265_MAX_SPS_COUNT);
+  self->pps_cache = gst_vk_param_set_cache_new (GST_H265_MAX_PPS_COUNT);
+  self->offset_alignment = 1;
+  self->size_alignment = 1;
+  self->clock_rate = 10000000;
+  self->pic_pool =
+      gst_vk_pic_pool_new (sizeof (VkPic), GST_VK_PIC_POOL_DEFAULT_MAX_FREE);
 }
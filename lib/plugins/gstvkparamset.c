@@ -0,0 +1,313 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "gstvkparamset.h"
+
+#include <string.h>
+
+/* keeps the StdVideo* structures following the header aligned */
+#define HEADER_SIZE \
+    ((sizeof (GstVkParamSet) + sizeof (gint64) - 1) & ~(sizeof (gint64) - 1))
+
+/* of the distinct contents remembered per id */
+#define MAX_CONTENTS 4
+
+typedef struct _Content Content;
+struct _Content
+{
+  guint32 hash;
+  guint32 generation;
+  GBytes *bytes;
+};
+
+typedef struct _CacheEntry CacheEntry;
+struct _CacheEntry
+{
+  GstVkParamSet *set;
+  /* the last generation given */
+  guint32 generation;
+  /* the distinct contents seen, most recent first: contents[0] is the one
+   * set was converted from, if has_content */
+  Content contents[MAX_CONTENTS];
+  gboolean has_content;
+};
+
+struct _GstVkParamSetCache
+{
+  guint max_ids;
+  CacheEntry *entries;
+  /* of the parameter sets in entries */
+  gsize size;
+};
+
+/* FNV-1a */
+static guint32
+hash_content (const guint8 * data, gsize size)
+{
+  guint32 hash = 2166136261u;
+  gsize i;
+
+  for (i = 0; i < size; i++)
+    hash = (hash ^ data[i]) * 16777619u;
+
+  return hash;
+}
+
+static gboolean
+content_equal (const Content * content, guint32 hash, const guint8 * data,
+    gsize size)
+{
+  gsize content_size;
+  gconstpointer content_data;
+
+  if (!content->bytes || content->hash != hash)
+    return FALSE;
+
+  content_data = g_bytes_get_data (content->bytes, &content_size);
+  return content_size == size && memcmp (content_data, data, size) == 0;
+}
+
+GstVkParamSet *
+gst_vk_param_set_ref (GstVkParamSet * ps)
+{
+  g_atomic_int_inc (&ps->ref_count);
+  return ps;
+}
+
+void
+gst_vk_param_set_unref (GstVkParamSet * ps)
+{
+  if (!g_atomic_int_dec_and_test (&ps->ref_count))
+    return;
+
+  if (ps->clear_func)
+    ps->clear_func (gst_vk_param_set_get_data (ps));
+  if (ps->parent)
+    gst_vk_param_set_unref (ps->parent);
+  g_free (ps);
+}
+
+gpointer
+gst_vk_param_set_get_data (GstVkParamSet * ps)
+{
+  return (guint8 *) ps + HEADER_SIZE;
+}
+
+/* Only to be called while filling ps. */
+void
+gst_vk_param_set_set_parent (GstVkParamSet * ps, GstVkParamSet * parent)
+{
+  if (parent)
+    gst_vk_param_set_ref (parent);
+  if (ps->parent)
+    gst_vk_param_set_unref (ps->parent);
+  ps->parent = parent;
+}
+
+/* For what the structures own besides themselves: clear_func gets them
+ * when ps is freed. Only to be called while filling ps. */
+void
+gst_vk_param_set_set_clear_func (GstVkParamSet * ps,
+    GDestroyNotify clear_func)
+{
+  ps->clear_func = clear_func;
+}
+
+GstVkParamSetCache *
+gst_vk_param_set_cache_new (guint max_ids)
+{
+  GstVkParamSetCache *cache = g_new0 (GstVkParamSetCache, 1);
+
+  cache->max_ids = max_ids;
+  cache->entries = g_new0 (CacheEntry, max_ids);
+
+  return cache;
+}
+
+void
+gst_vk_param_set_cache_free (GstVkParamSetCache * cache)
+{
+  guint i, j;
+
+  for (i = 0; i < cache->max_ids; i++) {
+    CacheEntry *entry = &cache->entries[i];
+
+    if (entry->set)
+      gst_vk_param_set_unref (entry->set);
+    for (j = 0; j < MAX_CONTENTS; j++) {
+      if (entry->contents[j].bytes)
+        g_bytes_unref (entry->contents[j].bytes);
+    }
+  }
+  g_free (cache->entries);
+  g_free (cache);
+}
+
+/* The current parameter set with id, or NULL. The cache keeps the
+ * reference. */
+GstVkParamSet *
+gst_vk_param_set_cache_lookup (GstVkParamSetCache * cache, guint id)
+{
+  g_return_val_if_fail (id < cache->max_ids, NULL);
+
+  return cache->entries[id].set;
+}
+
+/* The current parameter set with id if it was converted from these very
+ * bytes, so a repetition of it can be ignored, or NULL. The cache keeps the
+ * reference. */
+GstVkParamSet *
+gst_vk_param_set_cache_lookup_content (GstVkParamSetCache * cache, guint id,
+    const guint8 * data, gsize size)
+{
+  CacheEntry *entry;
+
+  g_return_val_if_fail (id < cache->max_ids, NULL);
+
+  entry = &cache->entries[id];
+  if (!entry->set || !entry->has_content)
+    return NULL;
+
+  return content_equal (&entry->contents[0], hash_content (data, size), data,
+      size) ? entry->set : NULL;
+}
+
+/* Makes data, if any, the current content of entry, returning the
+ * generation it had if it was seen before, or a new one. */
+static guint32
+update_content (CacheEntry * entry, const guint8 * data, gsize size)
+{
+  Content content = { 0, };
+  guint32 hash;
+  guint i;
+
+  entry->has_content = data != NULL;
+  if (!data)
+    return ++entry->generation;
+
+  hash = hash_content (data, size);
+  for (i = 0; i < MAX_CONTENTS; i++) {
+    if (content_equal (&entry->contents[i], hash, data, size))
+      break;
+  }
+
+  if (i < MAX_CONTENTS) {
+    content = entry->contents[i];
+  } else {
+    /* the least recent one is forgotten */
+    i = MAX_CONTENTS - 1;
+    if (entry->contents[i].bytes)
+      g_bytes_unref (entry->contents[i].bytes);
+    content.hash = hash;
+    content.generation = ++entry->generation;
+    content.bytes = g_bytes_new (data, size);
+  }
+
+  memmove (&entry->contents[1], &entry->contents[0], i * sizeof (Content));
+  entry->contents[0] = content;
+
+  return content.generation;
+}
+
+/* A new parameter set with id, to be filled right away. It replaces the
+ * current one, which is still valid for those holding a reference to it.
+ * When converted from content, the size bytes at data, it gets the
+ * generation of the last parameter set converted from the same content, if
+ * still remembered, instead of the next one. The cache keeps the
+ * reference. */
+GstVkParamSet *
+gst_vk_param_set_cache_insert (GstVkParamSetCache * cache, guint id,
+    gsize size, const guint8 * data, gsize data_size)
+{
+  GstVkParamSet *ps;
+  CacheEntry *entry;
+
+  g_return_val_if_fail (id < cache->max_ids, NULL);
+
+  entry = &cache->entries[id];
+
+  ps = (GstVkParamSet *) g_malloc0 (HEADER_SIZE + size);
+  ps->ref_count = 1;
+  ps->id = id;
+  ps->generation = update_content (entry, data, data_size);
+  ps->size = size;
+
+  if (entry->set) {
+    cache->size -= HEADER_SIZE + entry->set->size;
+    gst_vk_param_set_unref (entry->set);
+  }
+  entry->set = ps;
+  cache->size += HEADER_SIZE + size;
+
+  return ps;
+}
+
+/* Bytes taken by the current parameter sets. Replaced ones still used by
+ * some picture aren't accounted. */
+gsize
+gst_vk_param_set_cache_get_size (GstVkParamSetCache * cache)
+{
+  return cache->size;
+}
+
+GstVkParamSnapshot *
+gst_vk_param_snapshot_ref (GstVkParamSnapshot * snapshot)
+{
+  g_atomic_int_inc (&snapshot->ref_count);
+  return snapshot;
+}
+
+void
+gst_vk_param_snapshot_unref (GstVkParamSnapshot * snapshot)
+{
+  if (!g_atomic_int_dec_and_test (&snapshot->ref_count))
+    return;
+
+  if (snapshot->vps)
+    gst_vk_param_set_unref (snapshot->vps);
+  if (snapshot->sps)
+    gst_vk_param_set_unref (snapshot->sps);
+  if (snapshot->pps)
+    gst_vk_param_set_unref (snapshot->pps);
+  g_free (snapshot);
+}
+
+/* Returns *snapshot if it holds these parameter sets, otherwise replaces it
+ * with a new one holding them: pictures keep the one they got, so it's never
+ * modified. *snapshot keeps the reference. */
+GstVkParamSnapshot *
+gst_vk_param_snapshot_update (GstVkParamSnapshot ** snapshot,
+    GstVkParamSet * vps, GstVkParamSet * sps, GstVkParamSet * pps)
+{
+  GstVkParamSnapshot *current = *snapshot;
+
+  if (current && current->vps == vps && current->sps == sps
+      && current->pps == pps)
+    return current;
+
+  current = g_new0 (GstVkParamSnapshot, 1);
+  current->ref_count = 1;
+  current->vps = vps ? gst_vk_param_set_ref (vps) : NULL;
+  current->sps = sps ? gst_vk_param_set_ref (sps) : NULL;
+  current->pps = pps ? gst_vk_param_set_ref (pps) : NULL;
+
+  if (*snapshot)
+    gst_vk_param_snapshot_unref (*snapshot);
+  *snapshot = current;
+
+  return current;
+}
@@ -0,0 +1,105 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstVkParamSetCache GstVkParamSetCache;
+typedef struct _GstVkParamSet GstVkParamSet;
+typedef struct _GstVkParamSnapshot GstVkParamSnapshot;
+
+/* A parameter set converted to its StdVideo* structures, which follow this
+ * header, as a zeroed block of size bytes. Immutable once filled, so
+ * pictures can point at it for as long as they hold a reference. */
+struct _GstVkParamSet
+{
+  guint id;
+  /* of the parameter sets with this id, starting at 1, the same for those
+   * converted from the same content: the client's contentGeneration */
+  guint32 generation;
+  /* the parameter set it was converted against, if any, kept alive as its
+   * structures might be pointed from this one */
+  GstVkParamSet *parent;
+  gsize size;
+
+  /*< private >*/
+  gint ref_count;
+  GDestroyNotify clear_func;
+};
+
+/* The parameter sets a picture is decoded with, any of them NULL if the
+ * codec doesn't have it. Shared by all the pictures using the same ones. */
+struct _GstVkParamSnapshot
+{
+  GstVkParamSet *vps;
+  GstVkParamSet *sps;
+  GstVkParamSet *pps;
+
+  /*< private >*/
+  gint ref_count;
+};
+
+#define GST_VK_PARAM_SET_DATA(ps, type) \
+    ((type *) gst_vk_param_set_get_data (ps))
+
+GstVkParamSet *         gst_vk_param_set_ref            (GstVkParamSet * ps);
+
+void                    gst_vk_param_set_unref          (GstVkParamSet * ps);
+
+gpointer                gst_vk_param_set_get_data       (GstVkParamSet * ps);
+
+void                    gst_vk_param_set_set_parent     (GstVkParamSet * ps,
+                                                         GstVkParamSet * parent);
+
+void                    gst_vk_param_set_set_clear_func (GstVkParamSet * ps,
+                                                         GDestroyNotify clear_func);
+
+/* The current parameter set of each id, replaced when a new one with the
+ * same id is inserted. */
+GstVkParamSetCache *    gst_vk_param_set_cache_new      (guint max_ids);
+
+void                    gst_vk_param_set_cache_free     (GstVkParamSetCache * cache);
+
+GstVkParamSet *         gst_vk_param_set_cache_lookup   (GstVkParamSetCache * cache,
+                                                         guint id);
+
+GstVkParamSet *         gst_vk_param_set_cache_lookup_content (GstVkParamSetCache * cache,
+                                                         guint id,
+                                                         const guint8 * data,
+                                                         gsize size);
+
+GstVkParamSet *         gst_vk_param_set_cache_insert   (GstVkParamSetCache * cache,
+                                                         guint id,
+                                                         gsize size,
+                                                         const guint8 * data,
+                                                         gsize data_size);
+
+gsize                   gst_vk_param_set_cache_get_size (GstVkParamSetCache * cache);
+
+GstVkParamSnapshot *    gst_vk_param_snapshot_ref       (GstVkParamSnapshot * snapshot);
+
+void                    gst_vk_param_snapshot_unref     (GstVkParamSnapshot * snapshot);
+
+GstVkParamSnapshot *    gst_vk_param_snapshot_update    (GstVkParamSnapshot ** snapshot,
+                                                         GstVkParamSet * vps,
+                                                         GstVkParamSet * sps,
+                                                         GstVkParamSet * pps);
+
+G_END_DECLS
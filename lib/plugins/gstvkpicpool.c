@@ -0,0 +1,138 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "gstvkpicpool.h"
+
+struct _GstVkPicPool
+{
+  gint ref_count;
+
+  gsize pic_size;
+  guint max_free;
+
+  GMutex lock;
+  GPtrArray *free;
+  /* acquisitions served from the free list, and allocated */
+  guint64 hits;
+  guint64 misses;
+  /* pictures allocated and not freed yet, acquired or not */
+  guint allocated;
+};
+
+GstVkPicPool *
+gst_vk_pic_pool_new (gsize pic_size, guint max_free)
+{
+  GstVkPicPool *pool = g_new0 (GstVkPicPool, 1);
+
+  pool->ref_count = 1;
+  pool->pic_size = pic_size;
+  pool->max_free = max_free;
+  g_mutex_init (&pool->lock);
+  pool->free = g_ptr_array_sized_new (max_free);
+
+  return pool;
+}
+
+GstVkPicPool *
+gst_vk_pic_pool_ref (GstVkPicPool * pool)
+{
+  g_atomic_int_inc (&pool->ref_count);
+  return pool;
+}
+
+void
+gst_vk_pic_pool_unref (GstVkPicPool * pool)
+{
+  guint i;
+
+  if (!g_atomic_int_dec_and_test (&pool->ref_count))
+    return;
+
+  for (i = 0; i < pool->free->len; i++)
+    g_free (g_ptr_array_index (pool->free, i));
+  g_ptr_array_unref (pool->free);
+  g_mutex_clear (&pool->lock);
+  g_free (pool);
+}
+
+/* Newly allocated pictures are zeroed, recycled ones keep their previous
+ * contents. */
+gpointer
+gst_vk_pic_pool_acquire (GstVkPicPool * pool)
+{
+  gpointer pic;
+
+  g_mutex_lock (&pool->lock);
+  if (pool->free->len > 0) {
+    pic = g_ptr_array_remove_index_fast (pool->free, pool->free->len - 1);
+    pool->hits++;
+  } else {
+    pic = NULL;
+    pool->misses++;
+    pool->allocated++;
+  }
+  g_mutex_unlock (&pool->lock);
+
+  if (!pic)
+    pic = g_malloc0 (pool->pic_size);
+
+  gst_vk_pic_pool_ref (pool);
+
+  return pic;
+}
+
+void
+gst_vk_pic_pool_release (GstVkPicPool * pool, gpointer pic)
+{
+  g_mutex_lock (&pool->lock);
+  if (pool->free->len < pool->max_free) {
+    g_ptr_array_add (pool->free, pic);
+    pic = NULL;
+  } else {
+    pool->allocated--;
+  }
+  g_mutex_unlock (&pool->lock);
+
+  g_free (pic);
+
+  gst_vk_pic_pool_unref (pool);
+}
+
+void
+gst_vk_pic_pool_get_stats (GstVkPicPool * pool, guint64 * hits,
+    guint64 * misses)
+{
+  g_mutex_lock (&pool->lock);
+  if (hits)
+    *hits = pool->hits;
+  if (misses)
+    *misses = pool->misses;
+  g_mutex_unlock (&pool->lock);
+}
+
+/* Bytes taken by the pictures, in use or in the free list. */
+gsize
+gst_vk_pic_pool_get_size (GstVkPicPool * pool)
+{
+  gsize size;
+
+  g_mutex_lock (&pool->lock);
+  size = pool->allocated * pool->pic_size;
+  g_mutex_unlock (&pool->lock);
+
+  return size;
+}
@@ -0,0 +1,50 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstVkPicPool GstVkPicPool;
+
+/* a whole DPB plus the pictures being decoded and output */
+#define GST_VK_PIC_POOL_DEFAULT_MAX_FREE 32
+
+/* Free list of fixed size picture structures, keeping up to max_free of
+ * them. Acquired pictures aren't cleared when reused, the caller resets
+ * what it needs. Each acquired picture keeps a reference to the pool. */
+GstVkPicPool *  gst_vk_pic_pool_new       (gsize pic_size,
+                                           guint max_free);
+
+GstVkPicPool *  gst_vk_pic_pool_ref       (GstVkPicPool * pool);
+
+void            gst_vk_pic_pool_unref     (GstVkPicPool * pool);
+
+gpointer        gst_vk_pic_pool_acquire   (GstVkPicPool * pool);
+
+void            gst_vk_pic_pool_release   (GstVkPicPool * pool,
+                                           gpointer pic);
+
+void            gst_vk_pic_pool_get_stats (GstVkPicPool * pool,
+                                           guint64 * hits,
+                                           guint64 * misses);
+
+gsize           gst_vk_pic_pool_get_size  (GstVkPicPool * pool);
+
+G_END_DECLS
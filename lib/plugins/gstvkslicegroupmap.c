@@ -0,0 +1,328 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "gstvkslicegroupmap.h"
+
+#include <string.h>
+
+/* of the evolving maps kept per PPS */
+#define MAX_CACHED_BYTES (1 << 20)
+
+typedef struct _MapSlot MapSlot;
+struct _MapSlot
+{
+  guint cycle;
+  GBytes *map;
+};
+
+struct _GstVkSliceGroupMaps
+{
+  guint8 map_type;
+  gboolean change_direction_flag;
+  guint change_rate;
+  guint width;
+  guint height;
+  guint size;
+  /* the last slice_group_change_cycle making a different map */
+  guint max_cycle;
+
+  /* the static map in slots[0], or the evolving ones by cycle modulo
+   * n_slots */
+  MapSlot *slots;
+  guint n_slots;
+};
+
+/* 8.2.2.1 */
+static void
+fill_interleaved (guint8 * map, guint size, const GstH264PPS * pps)
+{
+  guint i = 0, group;
+
+  do {
+    for (group = 0; group <= pps->num_slice_groups_minus1 && i < size;
+        group++) {
+      guint run = MIN (pps->run_length_minus1[group] + 1, size - i);
+
+      memset (map + i, group, run);
+      i += run;
+    }
+  } while (i < size);
+}
+
+/* 8.2.2.2 */
+static void
+fill_dispersed (guint8 * map, guint width, guint height, guint n_groups)
+{
+  guint x, y;
+
+  for (y = 0; y < height; y++) {
+    guint group = (y * n_groups / 2) % n_groups;
+
+    for (x = 0; x < width; x++) {
+      map[y * width + x] = group;
+      group = group + 1 == n_groups ? 0 : group + 1;
+    }
+  }
+}
+
+/* 8.2.2.3 */
+static void
+fill_foreground (guint8 * map, guint width, guint size,
+    const GstH264PPS * pps)
+{
+  gint group;
+  guint y;
+
+  memset (map, pps->num_slice_groups_minus1, size);
+
+  for (group = pps->num_slice_groups_minus1 - 1; group >= 0; group--) {
+    guint top_left = MIN (pps->top_left[group], size - 1);
+    guint bottom_right = MIN (pps->bottom_right[group], size - 1);
+    guint x_top_left = top_left % width;
+    guint x_bottom_right = bottom_right % width;
+
+    if (x_bottom_right < x_top_left)
+      continue;
+
+    for (y = top_left / width; y <= bottom_right / width; y++) {
+      memset (map + y * width + x_top_left, group,
+          x_bottom_right - x_top_left + 1);
+    }
+  }
+}
+
+/* Clears the still vacant (set to 1) ones of the n map units walked from p,
+ * step bytes apart, until count reaches units. */
+static void
+clear_vacant (guint8 * p, gssize step, guint n, guint * count, guint units)
+{
+  guint vacant = 0, i;
+
+  for (i = 0; i < n; i++)
+    vacant += p[i * step];
+
+  if (*count + vacant <= units) {
+    /* the ones not vacant are 0 already */
+    if (step == 1 || step == -1) {
+      memset (step < 0 ? p - (n - 1) : p, 0, n);
+    } else {
+      for (i = 0; i < n; i++)
+        p[i * step] = 0;
+    }
+    *count += vacant;
+    return;
+  }
+
+  for (i = 0; *count < units; i++) {
+    *count += p[i * step];
+    p[i * step] = 0;
+  }
+}
+
+/* 8.2.2.4: slice group 0 spirals out of the center, clockwise or not. The
+ * walk goes a side of the box at a time instead of a map unit at a time;
+ * only the sides clamped at the picture edges are walked again. */
+static void
+fill_box_out (guint8 * map, guint width, guint height, gboolean direction,
+    guint units)
+{
+  gint x = (width - direction) / 2, y = (height - direction) / 2;
+  gint left = x, right = x, top = y, bottom = y;
+  gint x_dir = direction - 1, y_dir = direction;
+  guint count = 0;
+
+  memset (map, 1, width * height);
+
+  while (count < units) {
+    if (x_dir != 0) {
+      gint end = x_dir < 0 ? left : right;
+
+      clear_vacant (map + y * width + x, x_dir, ABS (end - x) + 1, &count,
+          units);
+      if (x_dir < 0) {
+        left = MAX (left - 1, 0);
+        x = left;
+        y_dir = 2 * direction - 1;
+      } else {
+        right = MIN (right + 1, (gint) width - 1);
+        x = right;
+        y_dir = 1 - 2 * direction;
+      }
+      x_dir = 0;
+    } else {
+      gint end = y_dir < 0 ? top : bottom;
+
+      clear_vacant (map + y * width + x, y_dir * (gint) width,
+          ABS (end - y) + 1, &count, units);
+      if (y_dir < 0) {
+        top = MAX (top - 1, 0);
+        y = top;
+        x_dir = 1 - 2 * direction;
+      } else {
+        bottom = MIN (bottom + 1, (gint) height - 1);
+        y = bottom;
+        x_dir = 2 * direction - 1;
+      }
+      y_dir = 0;
+    }
+  }
+}
+
+/* 8.2.2.5 */
+static void
+fill_raster (guint8 * map, guint size, gboolean direction, guint upper_left)
+{
+  memset (map, direction, upper_left);
+  memset (map + upper_left, 1 - direction, size - upper_left);
+}
+
+/* 8.2.2.6: the upper left group fills columns top to bottom, so each row
+ * starts with as many of its units as full columns, plus one if the last
+ * partial column reaches it. */
+static void
+fill_wipe (guint8 * map, guint width, guint height, gboolean direction,
+    guint upper_left)
+{
+  guint columns = upper_left / height, rows = upper_left % height, y;
+
+  for (y = 0; y < height; y++) {
+    guint n = columns + (y < rows);
+
+    memset (map + y * width, direction, n);
+    memset (map + y * width + n, 1 - direction, width - n);
+  }
+}
+
+static GBytes *
+new_evolving_map (GstVkSliceGroupMaps * maps, guint cycle)
+{
+  guint8 *map = (guint8 *) g_malloc (maps->size);
+  guint units = MIN (cycle * maps->change_rate, maps->size);
+  guint upper_left = maps->change_direction_flag ? maps->size - units : units;
+
+  switch (maps->map_type) {
+    case 3:
+      fill_box_out (map, maps->width, maps->height,
+          maps->change_direction_flag, units);
+      break;
+    case 4:
+      fill_raster (map, maps->size, maps->change_direction_flag, upper_left);
+      break;
+    case 5:
+      fill_wipe (map, maps->width, maps->height, maps->change_direction_flag,
+          upper_left);
+      break;
+    default:
+      g_assert_not_reached ();
+  }
+
+  return g_bytes_new_take (map, maps->size);
+}
+
+GstVkSliceGroupMaps *
+gst_vk_slice_group_maps_new (const GstH264PPS * pps)
+{
+  GstVkSliceGroupMaps *maps = g_new0 (GstVkSliceGroupMaps, 1);
+  const GstH264SPS *sps = pps->sequence;
+  guint8 *map;
+
+  maps->map_type = pps->slice_group_map_type;
+  maps->change_direction_flag = pps->slice_group_change_direction_flag;
+  maps->change_rate = pps->slice_group_change_rate_minus1 + 1;
+  maps->width = sps->pic_width_in_mbs_minus1 + 1;
+  maps->height = sps->pic_height_in_map_units_minus1 + 1;
+  maps->size = maps->width * maps->height;
+
+  if (pps->num_slice_groups_minus1 > 0 && maps->map_type >= 3
+      && maps->map_type <= 5) {
+    maps->max_cycle = (maps->size + maps->change_rate - 1) / maps->change_rate;
+    maps->n_slots = CLAMP (MAX_CACHED_BYTES / maps->size, 1,
+        maps->max_cycle + 1);
+    maps->slots = g_new0 (MapSlot, maps->n_slots);
+    return maps;
+  }
+
+  map = (guint8 *) g_malloc0 (maps->size);
+
+  if (pps->num_slice_groups_minus1 > 0) {
+    switch (maps->map_type) {
+      case 0:
+        fill_interleaved (map, maps->size, pps);
+        break;
+      case 1:
+        fill_dispersed (map, maps->width, maps->height,
+            pps->num_slice_groups_minus1 + 1);
+        break;
+      case 2:
+        fill_foreground (map, maps->width, maps->size, pps);
+        break;
+      case 6:
+        memcpy (map, pps->slice_group_id,
+            MIN (pps->pic_size_in_map_units_minus1 + 1, maps->size));
+        break;
+      default:
+        break;
+    }
+  }
+
+  maps->n_slots = 1;
+  maps->slots = g_new0 (MapSlot, 1);
+  maps->slots[0].map = g_bytes_new_take (map, maps->size);
+
+  return maps;
+}
+
+void
+gst_vk_slice_group_maps_free (GstVkSliceGroupMaps * maps)
+{
+  guint i;
+
+  for (i = 0; i < maps->n_slots; i++) {
+    if (maps->slots[i].map)
+      g_bytes_unref (maps->slots[i].map);
+  }
+  g_free (maps->slots);
+  g_free (maps);
+}
+
+/* The map for slice_group_change_cycle, which only matters to the
+ * evolving map types. It's kept by maps: pictures using it take a
+ * reference, as an evolving one might be replaced by that of another
+ * cycle. */
+GBytes *
+gst_vk_slice_group_maps_get (GstVkSliceGroupMaps * maps,
+    guint slice_group_change_cycle)
+{
+  guint cycle;
+  MapSlot *slot;
+
+  if (maps->max_cycle == 0)
+    return maps->slots[0].map;
+
+  /* all the cycles from max_cycle on cover the whole picture */
+  cycle = MIN (slice_group_change_cycle, maps->max_cycle);
+  slot = &maps->slots[cycle % maps->n_slots];
+
+  if (!slot->map || slot->cycle != cycle) {
+    if (slot->map)
+      g_bytes_unref (slot->map);
+    slot->map = new_evolving_map (maps, cycle);
+    slot->cycle = cycle;
+  }
+
+  return slot->map;
+}
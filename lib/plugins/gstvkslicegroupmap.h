@@ -0,0 +1,37 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#pragma once
+
+#include <gst/codecparsers/gsth264parser.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstVkSliceGroupMaps GstVkSliceGroupMaps;
+
+/* The map unit to slice group maps of a PPS, as of H.264 8.2.2, one byte
+ * per map unit. Those of the map types 3 to 5 evolve with the
+ * slice_group_change_cycle of each picture, so they're computed on demand
+ * and kept by cycle, within a memory budget; the others once. */
+GstVkSliceGroupMaps *   gst_vk_slice_group_maps_new     (const GstH264PPS * pps);
+
+void                    gst_vk_slice_group_maps_free    (GstVkSliceGroupMaps * maps);
+
+GBytes *                gst_vk_slice_group_maps_get     (GstVkSliceGroupMaps * maps,
+                                                         guint slice_group_change_cycle);
+
+G_END_DECLS
@@ -0,0 +1,236 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "gstvkaccessunitframer.h"
+
+#include <algorithm>
+
+GstVkAccessUnitFramer::GstVkAccessUnitFramer(Codec codec)
+    : m_codec(codec)
+    , m_chunkStart(0)
+    , m_bytesCopied(0)
+{
+    Reset();
+}
+
+void GstVkAccessUnitFramer::Reset()
+{
+    m_carry.clear();
+    m_auStart = m_chunkStart;
+    m_auHasVcl = false;
+    m_nalStarts.clear();
+    m_zeros = 0;
+    m_nalStart = m_chunkStart;
+    m_scOffset = m_chunkStart;
+    m_headerSize = 0;
+    m_inHeader = false;
+}
+
+// Zero bytes, up to 3, right before pos, including the ones ending the
+// previous chunk.
+uint32_t GstVkAccessUnitFramer::ZerosBefore(const uint8_t* chunk, size_t pos) const
+{
+    uint32_t zeros = 0;
+
+    while (zeros < 3 && zeros < pos && chunk[pos - zeros - 1] == 0)
+        zeros++;
+
+    if (zeros == pos)
+        zeros = std::min<uint32_t>(zeros + m_zeros, 3);
+
+    return zeros;
+}
+
+bool GstVkAccessUnitFramer::IsFirstNalOfAccessUnit(Codec codec, const uint8_t* header, bool* auHasVcl)
+{
+    bool first = false;
+
+    if (codec == H264) {
+        uint8_t type = header[0] & 0x1f;
+
+        if (type >= 1 && type <= 5) {
+            // first_mb_in_slice == 0 is coded as a single bit set to 1
+            first = *auHasVcl && (header[1] & 0x80);
+            *auHasVcl = true;
+        } else if ((type >= 6 && type <= 9) || (type >= 14 && type <= 18)) {
+            first = *auHasVcl;
+            *auHasVcl = false;
+        }
+    } else {
+        uint8_t type = (header[0] >> 1) & 0x3f;
+        uint8_t layer = ((header[0] & 0x01) << 5) | (header[1] >> 3);
+
+        // only the base layer delimits access units
+        if (layer > 0)
+            return false;
+
+        if (type <= 31) {
+            // first_slice_segment_in_pic_flag
+            first = *auHasVcl && (header[2] & 0x80);
+            *auHasVcl = true;
+        } else if ((type >= 32 && type <= 35) || type == 39
+            || (type >= 41 && type <= 44) || (type >= 48 && type <= 55)) {
+            first = *auHasVcl;
+            *auHasVcl = false;
+        }
+    }
+
+    return first;
+}
+
+// Outputs the access unit starting at m_auStart, along with its NAL units.
+bool GstVkAccessUnitFramer::Emit(const uint8_t* data, size_t size, bool borrowed, const AccessUnitFunc& func)
+{
+    m_nals.clear();
+
+    for (size_t i = 0; i < m_nalStarts.size(); i++) {
+        uint32_t sc = m_nalStarts[i] - m_auStart;
+        uint32_t end = (i + 1 < m_nalStarts.size()) ? m_nalStarts[i + 1] - m_auStart : size;
+
+        // trailing_zero_8bits and the zero_byte of the next start code
+        while (end > sc + 3 && data[end - 1] == 0)
+            end--;
+
+        m_nals.push_back({ sc, end });
+    }
+    m_nalStarts.clear();
+
+    return func({ data, size, m_auStart, m_nals.data(), m_nals.size(), borrowed });
+}
+
+// Outputs the access unit ending at the stream offset end.
+bool GstVkAccessUnitFramer::EmitUntil(uint64_t end, const uint8_t* chunk, const AccessUnitFunc& func)
+{
+    bool ret;
+
+    if (m_auStart >= m_chunkStart) {
+        ret = Emit(chunk + (m_auStart - m_chunkStart), end - m_auStart, true, func);
+    } else if (end >= m_chunkStart) {
+        size_t size = end - m_chunkStart;
+
+        m_carry.insert(m_carry.end(), chunk, chunk + size);
+        m_bytesCopied += size;
+        ret = Emit(m_carry.data(), m_carry.size(), false, func);
+        m_carry.clear();
+    } else {
+        // the start code of the next access unit began in a previous chunk
+        size_t size = end - m_auStart;
+
+        ret = Emit(m_carry.data(), size, false, func);
+        m_carry.erase(m_carry.begin(), m_carry.begin() + size);
+    }
+
+    m_auStart = end;
+    return ret;
+}
+
+// Reads the NAL unit header, which may span several chunks, and then
+// decides whether the NAL unit begins a new access unit.
+bool GstVkAccessUnitFramer::ReadHeader(const uint8_t* chunk, size_t size, size_t pos, const AccessUnitFunc& func)
+{
+    const uint32_t headerSize = HeaderSize(m_codec);
+    bool ret = true;
+
+    while (m_headerSize < headerSize && pos < size)
+        m_header[m_headerSize++] = chunk[pos++];
+
+    if (m_headerSize < headerSize)
+        return true;
+
+    m_inHeader = false;
+
+    if (IsFirstNalOfAccessUnit(m_codec, m_header, &m_auHasVcl) && m_nalStart > m_auStart)
+        ret = EmitUntil(m_nalStart, chunk, func);
+
+    m_nalStarts.push_back(m_scOffset);
+
+    return ret;
+}
+
+// pos is the offset in chunk of the last byte of a start code.
+bool GstVkAccessUnitFramer::StartCode(const uint8_t* chunk, size_t size, size_t pos, const AccessUnitFunc& func)
+{
+    // a truncated NAL unit, keep it anyway
+    if (m_inHeader)
+        m_nalStarts.push_back(m_scOffset);
+
+    // a leading zero_byte belongs to the start code
+    m_nalStart = m_chunkStart + pos - ZerosBefore(chunk, pos);
+    m_scOffset = m_chunkStart + pos - 2;
+    m_headerSize = 0;
+    m_inHeader = true;
+
+    return ReadHeader(chunk, size, pos + 1, func);
+}
+
+bool GstVkAccessUnitFramer::Push(const uint8_t* data, size_t size, const AccessUnitFunc& func)
+{
+    bool ret = true;
+    size_t pos = 0;
+
+    if (m_inHeader)
+        ret &= ReadHeader(data, size, 0, func);
+
+    // start codes beginning in the previous chunk
+    for (size_t i = 0; i < std::min<size_t>(size, 2); i++) {
+        if (data[i] == 1 && ZerosBefore(data, i) >= 2)
+            ret &= StartCode(data, size, i, func);
+    }
+
+    while (pos + 3 <= size) {
+        pos += gst_codec_nal_find_start_code(data + pos, size - pos);
+        if (pos + 3 > size)
+            break;
+
+        ret &= StartCode(data, size, pos + 2, func);
+        pos += 3;
+    }
+
+    // keep what belongs to the unfinished access unit
+    size_t offset = (m_auStart > m_chunkStart) ? m_auStart - m_chunkStart : 0;
+    m_carry.insert(m_carry.end(), data + offset, data + size);
+    m_bytesCopied += size - offset;
+
+    uint32_t zeros = 0;
+    while (zeros < 3 && zeros < size && data[size - zeros - 1] == 0)
+        zeros++;
+    m_zeros = (zeros == size) ? std::min<uint32_t>(zeros + m_zeros, 3) : zeros;
+
+    m_chunkStart += size;
+
+    return ret;
+}
+
+bool GstVkAccessUnitFramer::Drain(const AccessUnitFunc& func)
+{
+    bool ret = true;
+
+    if (m_inHeader)
+        m_nalStarts.push_back(m_scOffset);
+
+    if (!m_carry.empty())
+        ret = Emit(m_carry.data(), m_carry.size(), false, func);
+
+    m_carry.clear();
+    m_nalStarts.clear();
+    m_auStart = m_chunkStart;
+    m_auHasVcl = false;
+    m_zeros = 0;
+    m_inHeader = false;
+
+    return ret;
+}
@@ -0,0 +1,103 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "gstcodecnal.h"
+
+// Splits an Annex-B byte stream, given in arbitrary chunks, into access
+// units (H.264 7.4.1.2.3 and H.265 7.4.2.4.4), replacing h264parse and
+// h265parse when the decoder is driven directly. Every byte is scanned
+// once, with gst_codec_nal_find_start_code(), and the NAL units found on
+// the way are handed along with their access unit.
+class GstVkAccessUnitFramer {
+public:
+    enum Codec {
+        H264,
+        H265,
+    };
+
+    struct AccessUnit {
+        const uint8_t* data;
+        size_t size;
+        // offset of data in the stream
+        uint64_t offset;
+        // NAL units, with offsets relative to data
+        const GstCodecNal* nals;
+        size_t nalCount;
+        // If true, data points into the chunk given to Push(), otherwise
+        // into the framer's own storage, which is only valid during the call.
+        bool borrowed;
+    };
+
+    // Called for every complete access unit.
+    using AccessUnitFunc = std::function<bool(const AccessUnit&)>;
+
+    explicit GstVkAccessUnitFramer(Codec codec);
+
+    // Returns false if func failed.
+    bool Push(const uint8_t* data, size_t size, const AccessUnitFunc& func);
+    // Outputs the last, unterminated, access unit.
+    bool Drain(const AccessUnitFunc& func);
+    // Drops the access unit being framed, as when seeking. The stream
+    // offsets go on from the bytes pushed so far.
+    void Reset();
+
+    // Bytes copied to keep access units spanning several chunks.
+    uint64_t BytesCopied() const { return m_bytesCopied; }
+
+    // Bytes of the NAL unit header IsFirstNalOfAccessUnit() looks at.
+    static uint32_t HeaderSize(Codec codec) { return (codec == H264) ? 2 : 3; }
+    // Must be called once per NAL unit, in stream order, with auHasVcl
+    // tracking whether the current access unit has a VCL NAL unit already.
+    static bool IsFirstNalOfAccessUnit(Codec codec, const uint8_t* header, bool* auHasVcl);
+
+private:
+    uint32_t ZerosBefore(const uint8_t* chunk, size_t pos) const;
+    bool StartCode(const uint8_t* chunk, size_t size, size_t pos, const AccessUnitFunc& func);
+    bool ReadHeader(const uint8_t* chunk, size_t size, size_t pos, const AccessUnitFunc& func);
+    bool EmitUntil(uint64_t end, const uint8_t* chunk, const AccessUnitFunc& func);
+    bool Emit(const uint8_t* data, size_t size, bool borrowed, const AccessUnitFunc& func);
+
+    Codec m_codec;
+
+    // bytes of the current access unit coming from previous chunks
+    std::vector<uint8_t> m_carry;
+    // stream offsets of the current access unit and of the current chunk
+    uint64_t m_auStart;
+    uint64_t m_chunkStart;
+    bool m_auHasVcl;
+    // stream offsets of the start codes of the current access unit
+    std::vector<uint64_t> m_nalStarts;
+    std::vector<GstCodecNal> m_nals;
+
+    // zero bytes ending the previous chunk, up to 3
+    uint32_t m_zeros;
+    // the NAL unit whose header is being read
+    uint64_t m_nalStart;
+    uint64_t m_scOffset;
+    uint8_t m_header[3];
+    uint32_t m_headerSize;
+    bool m_inHeader;
+
+    uint64_t m_bytesCopied;
+};
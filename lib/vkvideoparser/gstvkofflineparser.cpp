@@ -0,0 +1,449 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "gstvkofflineparser.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+// bytes of stream per segment, at least
+static const size_t minSegmentSize = 256 * 1024;
+// segments per thread, so that uneven ones even out
+static const size_t segmentsPerThread = 8;
+// segments parsed ahead of the one being fed, per thread
+static const size_t windowPerThread = 2;
+
+// Reads the first fields of the RBSP of a NAL unit, enough to tell the
+// ids of a parameter set.
+class GstVkRbspReader {
+public:
+    GstVkRbspReader(const uint8_t* data, size_t size)
+        : m_size(0)
+        , m_bit(0)
+    {
+        uint32_t zeros = 0;
+
+        // without emulation_prevention_three_byte
+        for (size_t i = 0; i < size && m_size < sizeof(m_rbsp); i++) {
+            if (zeros >= 2 && data[i] == 3) {
+                zeros = 0;
+                continue;
+            }
+            zeros = data[i] ? 0 : zeros + 1;
+            m_rbsp[m_size++] = data[i];
+        }
+    }
+
+    bool Skip(uint32_t bits)
+    {
+        m_bit += bits;
+        return m_bit <= m_size * 8;
+    }
+
+    bool ReadUe(uint32_t* value)
+    {
+        uint32_t zeros = 0;
+        uint32_t bit;
+
+        while ((bit = Bit()) == 0) {
+            if (++zeros > 31)
+                return false;
+        }
+        if (bit > 1)
+            return false;
+
+        *value = 0;
+        for (uint32_t i = 0; i < zeros; i++) {
+            bit = Bit();
+            if (bit > 1)
+                return false;
+            *value = (*value << 1) | bit;
+        }
+        *value += (1u << zeros) - 1;
+
+        return true;
+    }
+
+private:
+    // 2 past the end
+    uint32_t Bit()
+    {
+        if (m_bit >= m_size * 8)
+            return 2;
+
+        uint32_t bit = (m_rbsp[m_bit / 8] >> (7 - m_bit % 8)) & 1;
+        m_bit++;
+        return bit;
+    }
+
+    uint8_t m_rbsp[16];
+    size_t m_size;
+    size_t m_bit;
+};
+
+GstVkOfflineParser::GstVkOfflineParser(unsigned threads)
+    : m_threads(threads ? threads : std::max(std::thread::hardware_concurrency(), 1u))
+    , m_data(nullptr)
+    , m_size(0)
+    , m_next(0)
+    , m_fed(0)
+    , m_stop(false)
+{
+}
+
+// Every thread records the start codes beginning in its range, which may
+// end in the next one.
+void GstVkOfflineParser::FindStartCodes(unsigned threads)
+{
+    std::vector<std::vector<uint64_t>> found(threads);
+    std::vector<std::thread> workers;
+    size_t range = (m_size + threads - 1) / threads;
+
+    for (unsigned i = 0; i < threads; i++) {
+        workers.emplace_back([&, i] {
+            size_t begin = std::min(i * range, m_size);
+            size_t limit = std::min(begin + range + 2, m_size);
+            size_t pos = begin;
+
+            while (pos + 3 <= limit) {
+                pos += gst_codec_nal_find_start_code(m_data + pos, limit - pos);
+                if (pos + 3 > limit)
+                    break;
+
+                found[i].push_back(pos);
+                pos += 3;
+            }
+        });
+    }
+
+    for (auto& worker : workers)
+        worker.join();
+
+    m_starts.clear();
+    for (auto& starts : found)
+        m_starts.insert(m_starts.end(), starts.begin(), starts.end());
+}
+
+// As GstVkAccessUnitFramer does, but with every start code known already.
+void GstVkOfflineParser::SplitUnits()
+{
+    const uint32_t headerSize = GstVkAccessUnitFramer::HeaderSize(GstVkAccessUnitFramer::H264);
+    uint64_t auStart = 0;
+    size_t firstNal = 0;
+    bool auHasVcl = false;
+
+    m_nals.clear();
+    m_units.clear();
+
+    for (size_t i = 0; i < m_starts.size(); i++) {
+        uint64_t sc = m_starts[i];
+        uint64_t end = (i + 1 < m_starts.size()) ? m_starts[i + 1] : m_size;
+        // a leading zero_byte belongs to the start code
+        uint64_t nalStart = (sc > 0 && m_data[sc - 1] == 0) ? sc - 1 : sc;
+
+        // a truncated NAL unit is kept anyway
+        if (sc + 3 + headerSize <= m_size
+            && GstVkAccessUnitFramer::IsFirstNalOfAccessUnit(GstVkAccessUnitFramer::H264, m_data + sc + 3, &auHasVcl)
+            && nalStart > auStart) {
+            m_units.push_back({ auStart, nalStart, firstNal, m_nals.size() - firstNal });
+            auStart = nalStart;
+            firstNal = m_nals.size();
+        }
+
+        // trailing_zero_8bits and the zero_byte of the next start code
+        while (end > sc + 3 && m_data[end - 1] == 0)
+            end--;
+
+        m_nals.push_back({ sc, end });
+    }
+
+    if (m_size > auStart)
+        m_units.push_back({ auStart, m_size, firstNal, m_nals.size() - firstNal });
+}
+
+// Cuts segments at access unit boundaries, keeping track of the SPS and
+// PPS the decoder has by then. A PPS is dropped when its SPS changes, since
+// part of it was derived from the former one, so the slices using it are
+// left for the decoder to parse. Any parameter set whose id can't be read
+// stops the cutting.
+void GstVkOfflineParser::SplitSegments(unsigned threads)
+{
+    struct ParamSet {
+        Nal nal;
+        bool valid;
+        uint32_t spsId;
+    };
+    std::vector<ParamSet> sps(GST_H264_MAX_SPS_COUNT, { { 0, 0 }, false, 0 });
+    std::vector<ParamSet> pps(GST_H264_MAX_PPS_COUNT, { { 0, 0 }, false, 0 });
+    size_t target = std::max(m_size / (threads * segmentsPerThread), minSegmentSize);
+    bool tracked = true;
+    Segment* segment = nullptr;
+
+    m_segments.clear();
+
+    for (size_t u = 0; u < m_units.size(); u++) {
+        const Unit& unit = m_units[u];
+
+        if (!segment || (tracked && unit.start - m_units[segment->firstUnit].start >= target)) {
+            m_segments.emplace_back(new Segment { u, 0, {}, nullptr, {}, {}, false });
+            segment = m_segments.back().get();
+
+            for (auto& ps : sps) {
+                if (ps.valid)
+                    segment->seeds.push_back(ps.nal);
+            }
+            for (auto& ps : pps) {
+                if (ps.valid)
+                    segment->seeds.push_back(ps.nal);
+            }
+        }
+        segment->unitCount++;
+
+        for (size_t i = unit.firstNal; i < unit.firstNal + unit.nalCount && tracked; i++) {
+            const Nal& nal = m_nals[i];
+            uint32_t id, spsId;
+
+            if (nal.end <= nal.sc + 3)
+                continue;
+
+            uint8_t type = m_data[nal.sc + 3] & 0x1f;
+            GstVkRbspReader reader(m_data + nal.sc + 4, nal.end - nal.sc - 4);
+
+            if (type == GST_H264_NAL_SPS) {
+                // profile_idc, constraint_set flags and level_idc
+                if (!(reader.Skip(24) && reader.ReadUe(&id) && id < GST_H264_MAX_SPS_COUNT)) {
+                    tracked = false;
+                    break;
+                }
+
+                ParamSet& ps = sps[id];
+                size_t size = nal.end - nal.sc;
+                bool same = ps.valid && ps.nal.end - ps.nal.sc == size
+                    && memcmp(m_data + ps.nal.sc, m_data + nal.sc, size) == 0;
+
+                if (!same) {
+                    for (auto& p : pps) {
+                        if (p.valid && p.spsId == id)
+                            p.valid = false;
+                    }
+                }
+                ps = { nal, true, id };
+            } else if (type == GST_H264_NAL_PPS) {
+                if (!(reader.ReadUe(&id) && id < GST_H264_MAX_PPS_COUNT
+                        && reader.ReadUe(&spsId) && spsId < GST_H264_MAX_SPS_COUNT)) {
+                    tracked = false;
+                    break;
+                }
+
+                pps[id] = { nal, true, spsId };
+            }
+        }
+    }
+}
+
+static void parseParamSet(GstH264NalParser* parser, GstH264NalUnit* nalu)
+{
+    if (nalu->type == GST_H264_NAL_SPS) {
+        GstH264SPS sps;
+
+        if (gst_h264_parse_sps(nalu, &sps) == GST_H264_PARSER_OK) {
+            gst_h264_parser_update_sps(parser, &sps);
+            gst_h264_sps_clear(&sps);
+        }
+    } else if (nalu->type == GST_H264_NAL_PPS) {
+        GstH264PPS pps;
+
+        if (gst_h264_parse_pps(parser, nalu, &pps) == GST_H264_PARSER_OK) {
+            gst_h264_parser_update_pps(parser, &pps);
+            gst_h264_pps_clear(&pps);
+        }
+    }
+}
+
+static bool isSlice(GstH264NalUnitType type)
+{
+    switch (type) {
+    case GST_H264_NAL_SLICE:
+    case GST_H264_NAL_SLICE_DPA:
+    case GST_H264_NAL_SLICE_DPB:
+    case GST_H264_NAL_SLICE_DPC:
+    case GST_H264_NAL_SLICE_IDR:
+    case GST_H264_NAL_SLICE_EXT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Goes through the NAL units as GstH264Decoder does, but only parsing the
+// parameter sets and slice headers, up to the first slice failing in every
+// access unit.
+void GstVkOfflineParser::ParseSegment(Segment& segment)
+{
+    GstH264NalUnit nalu;
+
+    segment.parser = gst_h264_nal_parser_new();
+
+    for (auto& seed : segment.seeds) {
+        if (gst_h264_parser_identify_nalu_unchecked(segment.parser, m_data + seed.sc, 0, seed.end - seed.sc, &nalu) == GST_H264_PARSER_OK)
+            parseParamSet(segment.parser, &nalu);
+    }
+
+    for (size_t u = segment.firstUnit; u < segment.firstUnit + segment.unitCount; u++) {
+        const Unit& unit = m_units[u];
+        bool failed = false;
+
+        segment.unitHeaders.push_back(segment.headers.size());
+
+        for (size_t i = unit.firstNal; i < unit.firstNal + unit.nalCount; i++) {
+            const Nal& nal = m_nals[i];
+
+            if (gst_h264_parser_identify_nalu_unchecked(segment.parser, m_data + unit.start,
+                    nal.sc - unit.start, nal.end - unit.start, &nalu) != GST_H264_PARSER_OK)
+                break;
+
+            if (!isSlice(nalu.type)) {
+                parseParamSet(segment.parser, &nalu);
+                continue;
+            }
+
+            if (failed)
+                continue;
+
+            segment.headers.emplace_back();
+            if (gst_h264_parser_parse_slice_hdr(segment.parser, &nalu, &segment.headers.back(), TRUE, TRUE) != GST_H264_PARSER_OK) {
+                segment.headers.pop_back();
+                failed = true;
+            }
+        }
+    }
+
+    segment.unitHeaders.push_back(segment.headers.size());
+}
+
+// Takes the segments in order, as long as they are close enough to the
+// one being fed.
+void GstVkOfflineParser::Work(size_t window)
+{
+    for (;;) {
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+
+            m_cond.wait(lock, [&] { return m_stop || m_next == m_segments.size() || m_next < m_fed + window; });
+            if (m_stop || m_next == m_segments.size())
+                return;
+            index = m_next++;
+        }
+
+        ParseSegment(*m_segments[index]);
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_segments[index]->parsed = true;
+        m_cond.notify_all();
+    }
+}
+
+// From the calling thread, hands the access units in order, and lets go of
+// every segment once fed, since the headers handed keep only the id of
+// their PPS.
+bool GstVkOfflineParser::Feed(const AccessUnitFunc& func)
+{
+    std::vector<GstCodecNal> nals;
+
+    for (size_t s = 0; s < m_segments.size(); s++) {
+        Segment& segment = *m_segments[s];
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_cond.wait(lock, [&] { return segment.parsed; });
+        }
+
+        for (size_t k = 0; k < segment.unitCount; k++) {
+            const Unit& unit = m_units[segment.firstUnit + k];
+
+            nals.clear();
+            for (size_t i = unit.firstNal; i < unit.firstNal + unit.nalCount; i++)
+                nals.push_back({ static_cast<guint32>(m_nals[i].sc - unit.start), static_cast<guint32>(m_nals[i].end - unit.start) });
+
+            size_t firstHeader = segment.unitHeaders[k];
+            AccessUnit au = {
+                m_data + unit.start,
+                unit.end - unit.start,
+                nals.data(),
+                nals.size(),
+                segment.headers.data() + firstHeader,
+                segment.unitHeaders[k + 1] - firstHeader,
+            };
+
+            if (!func(au))
+                return false;
+        }
+
+        if (segment.parser)
+            gst_h264_nal_parser_free(segment.parser);
+        segment.parser = nullptr;
+        segment.headers = {};
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_fed++;
+        m_cond.notify_all();
+    }
+
+    return true;
+}
+
+bool GstVkOfflineParser::Parse(const uint8_t* data, size_t size, const AccessUnitFunc& func)
+{
+    std::vector<std::thread> workers;
+    bool ret;
+
+    m_data = data;
+    m_size = size;
+    m_next = 0;
+    m_fed = 0;
+    m_stop = false;
+
+    FindStartCodes(m_threads);
+    SplitUnits();
+
+    SplitSegments(m_threads);
+    for (unsigned i = 0; i < std::min<size_t>(m_threads, m_segments.size()); i++)
+        workers.emplace_back(&GstVkOfflineParser::Work, this, m_threads * windowPerThread);
+
+    ret = Feed(func);
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stop = true;
+        m_cond.notify_all();
+    }
+    for (auto& worker : workers)
+        worker.join();
+
+    // those not fed, if func failed
+    for (auto& segment : m_segments) {
+        if (segment->parser)
+            gst_h264_nal_parser_free(segment->parser);
+    }
+    m_segments.clear();
+    m_units.clear();
+    m_nals.clear();
+    m_starts.clear();
+
+    return ret;
+}
@@ -0,0 +1,117 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "gstvkaccessunitframer.h"
+#include "gsth264decoder.h"
+
+// Splits a whole H.264 Annex-B stream into the same access units as
+// GstVkAccessUnitFramer, on several threads, and parses ahead their slice
+// headers, which is most of what's left of parsing once the decoder is
+// driven directly. H.265 isn't supported: without its slice headers parsed
+// ahead, there would be little left to gain.
+//
+// The stream is scanned for start codes in as many ranges as threads, and
+// then cut in segments at access unit boundaries. Every segment gets a
+// parser of its own, seeded with the parameter sets the decoder has at its
+// start, so the segments are parsed concurrently while the access units
+// are handed in order, from the calling thread, to a single decoder. Since
+// that decoder still manages the DPB and calls the client, pictures come
+// out exactly as from a serial parse, and segments need not start at
+// random access points.
+class GstVkOfflineParser {
+public:
+    struct AccessUnit {
+        const uint8_t* data;
+        size_t size;
+        // NAL units, with offsets relative to data
+        const GstCodecNal* nals;
+        size_t nalCount;
+        // headers of the first slices, their PPS only valid during the call
+        const GstH264SliceHdr* headers;
+        size_t headerCount;
+    };
+
+    // Called for every access unit, in stream order. Returns false on
+    // failure.
+    using AccessUnitFunc = std::function<bool(const AccessUnit&)>;
+
+    // No threads means one per CPU.
+    explicit GstVkOfflineParser(unsigned threads);
+
+    // Returns false if func failed.
+    bool Parse(const uint8_t* data, size_t size, const AccessUnitFunc& func);
+
+private:
+    struct Nal {
+        uint64_t sc;
+        uint64_t end;
+    };
+
+    struct Unit {
+        uint64_t start;
+        uint64_t end;
+        size_t firstNal;
+        size_t nalCount;
+    };
+
+    struct Segment {
+        size_t firstUnit;
+        size_t unitCount;
+        // parameter sets to parse first, SPS before PPS
+        std::vector<Nal> seeds;
+
+        GstH264NalParser* parser;
+        std::vector<GstH264SliceHdr> headers;
+        // first header of every unit, and one past the last one
+        std::vector<size_t> unitHeaders;
+        bool parsed;
+    };
+
+    void FindStartCodes(unsigned threads);
+    void SplitUnits();
+    void SplitSegments(unsigned threads);
+    void ParseSegment(Segment& segment);
+    void Work(size_t window);
+    bool Feed(const AccessUnitFunc& func);
+
+    unsigned m_threads;
+
+    const uint8_t* m_data;
+    size_t m_size;
+    // offsets of the start codes, in order
+    std::vector<uint64_t> m_starts;
+    std::vector<Nal> m_nals;
+    std::vector<Unit> m_units;
+    std::vector<std::unique_ptr<Segment>> m_segments;
+
+    // under the lock: next segment to parse and first one not fed yet
+    size_t m_next;
+    size_t m_fed;
+    bool m_stop;
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+};
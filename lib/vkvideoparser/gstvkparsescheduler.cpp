@@ -0,0 +1,271 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "gstvkparsescheduler.h"
+#include "gstvkparseworker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <glib.h>
+
+#ifdef __linux__
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// packets parsed from a stream before letting others run
+static const size_t runBudget = 4;
+
+static std::mutex s_lock;
+static GstVkParseScheduler* s_scheduler = nullptr;
+static unsigned s_threads = 0;
+static bool s_cpuAffinity = false;
+
+// the scheduler running the current thread and its queue
+static thread_local GstVkParseScheduler* t_scheduler = nullptr;
+static thread_local unsigned t_index = 0;
+
+static uint64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+GstVkParseScheduler* GstVkParseScheduler::Acquire()
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+
+    if (!s_scheduler) {
+        unsigned threads = s_threads;
+
+        if (threads == 0)
+            threads = std::max(std::thread::hardware_concurrency(), 1u);
+        s_scheduler = new GstVkParseScheduler(threads, s_cpuAffinity);
+    }
+
+    s_scheduler->m_refCount++;
+    return s_scheduler;
+}
+
+void GstVkParseScheduler::Release(GstVkParseScheduler* scheduler)
+{
+    {
+        std::lock_guard<std::mutex> lock(s_lock);
+
+        if (--scheduler->m_refCount > 0)
+            return;
+        if (s_scheduler == scheduler)
+            s_scheduler = nullptr;
+    }
+
+    // without the lock, since joining the threads takes a while
+    delete scheduler;
+}
+
+bool GstVkParseScheduler::Configure(unsigned threads, bool cpuAffinity)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+
+    if (s_scheduler)
+        return false;
+
+    s_threads = threads;
+    s_cpuAffinity = cpuAffinity;
+    return true;
+}
+
+// a is less urgent than b
+bool GstVkParseScheduler::LessUrgent(const Entry& a, const Entry& b)
+{
+    if (a.priority != b.priority)
+        return a.priority < b.priority;
+    return a.deadline > b.deadline;
+}
+
+GstVkParseScheduler::GstVkParseScheduler(unsigned threads, bool cpuAffinity)
+    : m_queues(threads)
+    , m_refCount(0)
+    , m_next(0)
+    , m_queued(0)
+    , m_sleeping(0)
+    , m_stop(false)
+{
+#ifdef __linux__
+    // the CPUs the process may run on, which needn't be the first ones
+    std::vector<int> cpus;
+
+    if (cpuAffinity) {
+        cpu_set_t allowed;
+
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &allowed))
+                    cpus.push_back(cpu);
+            }
+        } else {
+            g_warning("Failed to get the CPUs allowed: %s", g_strerror(errno));
+        }
+    }
+#endif
+
+    for (unsigned i = 0; i < threads; i++) {
+        m_threads.emplace_back(&GstVkParseScheduler::Run, this, i);
+
+#ifdef __linux__
+        if (cpuAffinity && threads <= cpus.size()) {
+            cpu_set_t set;
+            int ret;
+
+            CPU_ZERO(&set);
+            CPU_SET(cpus[i], &set);
+            ret = pthread_setaffinity_np(m_threads[i].native_handle(), sizeof(set), &set);
+            if (ret != 0)
+                g_warning("Failed to bind parsing thread %u to CPU %d: %s", i, cpus[i], g_strerror(ret));
+        }
+#else
+        (void)cpuAffinity;
+#endif
+    }
+}
+
+// Every stream is gone already.
+GstVkParseScheduler::~GstVkParseScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stop = true;
+        m_cond.notify_all();
+    }
+
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+void GstVkParseScheduler::Schedule(GstVkParseWorker* stream)
+{
+    Entry entry = { stream, stream->Priority(), now() + stream->Latency() };
+    unsigned index;
+
+    // from one of the threads, to its own queue, where it's likely to be
+    // run by the same thread
+    if (t_scheduler == this)
+        index = t_index;
+    else
+        index = m_next++ % m_queues.size();
+
+    Queue& queue = m_queues[index];
+    {
+        std::lock_guard<std::mutex> lock(queue.lock);
+        queue.entries.push_back(entry);
+        std::push_heap(queue.entries.begin(), queue.entries.end(), LessUrgent);
+        m_queued++;
+    }
+
+    // as in GstVkParseWorker, the thread going to sleep counts itself
+    // with the lock held and then checks m_queued
+    if (m_sleeping > 0) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_cond.notify_one();
+    }
+}
+
+bool GstVkParseScheduler::Pop(unsigned index, Entry* entry)
+{
+    Queue& queue = m_queues[index];
+    std::lock_guard<std::mutex> lock(queue.lock);
+
+    if (queue.entries.empty())
+        return false;
+
+    std::pop_heap(queue.entries.begin(), queue.entries.end(), LessUrgent);
+    *entry = queue.entries.back();
+    queue.entries.pop_back();
+    m_queued--;
+
+    return true;
+}
+
+bool GstVkParseScheduler::Peek(unsigned index, Entry* entry)
+{
+    Queue& queue = m_queues[index];
+    std::lock_guard<std::mutex> lock(queue.lock);
+
+    if (queue.entries.empty())
+        return false;
+
+    *entry = queue.entries.front();
+    return true;
+}
+
+// Takes the most urgent stream of all the queues, from its own one on a
+// tie. Every queue is ordered on its own, so the heads of the others are
+// compared before taking one: otherwise priorities and deadlines would
+// only hold among the streams of a thread. They might be taken meanwhile,
+// and then it looks again.
+bool GstVkParseScheduler::Take(unsigned index, Entry* entry)
+{
+    while (m_queued > 0) {
+        Entry best, head;
+        unsigned bestIndex = index;
+        bool found = Peek(index, &best);
+
+        for (size_t i = 1; i < m_queues.size(); i++) {
+            unsigned other = (index + i) % m_queues.size();
+
+            if (Peek(other, &head) && (!found || LessUrgent(best, head))) {
+                best = head;
+                bestIndex = other;
+                found = true;
+            }
+        }
+
+        if (!found)
+            return false;
+        if (Pop(bestIndex, entry))
+            return true;
+    }
+
+    return false;
+}
+
+void GstVkParseScheduler::Run(unsigned index)
+{
+    Entry entry;
+
+    t_scheduler = this;
+    t_index = index;
+
+    for (;;) {
+        if (Take(index, &entry)) {
+            if (entry.stream->RunScheduled(runBudget))
+                Schedule(entry.stream);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_lock);
+
+        m_sleeping++;
+        m_cond.wait(lock, [&] { return m_queued > 0 || m_stop; });
+        m_sleeping--;
+
+        if (m_stop)
+            break;
+    }
+}
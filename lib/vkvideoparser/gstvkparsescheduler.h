@@ -0,0 +1,93 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class GstVkParseWorker;
+
+// Runs the streams of many GstVkParseWorker on a few threads. Every thread
+// has a queue of the streams with packets ready, ordered by priority and
+// then deadline, and takes the most urgent one at the head of any queue,
+// its own on a tie. A stream is in one queue at most and run by one thread
+// at a time, for a few packets before going back to a queue, so its
+// packets are parsed in order while a busy stream doesn't hold a thread.
+//
+// There's one per process, started with the first stream using it and
+// stopped with the last one, which mustn't be released from one of its
+// threads.
+class GstVkParseScheduler {
+public:
+    // Returns a reference to the scheduler, starting it if needed.
+    static GstVkParseScheduler* Acquire();
+    static void Release(GstVkParseScheduler* scheduler);
+    // For the next time it's started. Returns false if running. No
+    // threads means one per CPU. With cpuAffinity, every thread is bound
+    // to a CPU of its own among those the process may run on, as long as
+    // there are enough.
+    static bool Configure(unsigned threads, bool cpuAffinity);
+
+    // Queues stream, which mustn't be queued or running already.
+    void Schedule(GstVkParseWorker* stream);
+
+    unsigned Threads() const { return static_cast<unsigned>(m_queues.size()); }
+
+private:
+    struct Entry {
+        GstVkParseWorker* stream;
+        int priority;
+        // microseconds on the monotonic clock
+        uint64_t deadline;
+    };
+
+    struct Queue {
+        std::mutex lock;
+        // a heap, the most urgent first
+        std::vector<Entry> entries;
+    };
+
+    GstVkParseScheduler(unsigned threads, bool cpuAffinity);
+    ~GstVkParseScheduler();
+
+    static bool LessUrgent(const Entry& a, const Entry& b);
+
+    void Run(unsigned index);
+    bool Peek(unsigned index, Entry* entry);
+    bool Pop(unsigned index, Entry* entry);
+    bool Take(unsigned index, Entry* entry);
+
+    std::vector<Queue> m_queues;
+    std::vector<std::thread> m_threads;
+    // under the process-wide lock
+    int m_refCount;
+    // queue of the next stream scheduled from outside the threads
+    std::atomic<unsigned> m_next;
+    // streams in the queues
+    std::atomic<size_t> m_queued;
+
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    std::atomic<unsigned> m_sleeping;
+    bool m_stop;
+};
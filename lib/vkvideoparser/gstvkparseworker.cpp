@@ -0,0 +1,186 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "gstvkparseworker.h"
+#include "gstvkparsescheduler.h"
+
+#include <algorithm>
+
+GstVkParseWorker::GstVkParseWorker(size_t depth, const ParseFunc& func,
+    bool shared, int priority, uint64_t latency)
+    : m_func(func)
+    , m_slots(std::max<size_t>(depth, 1))
+    , m_scheduler(nullptr)
+    , m_priority(priority)
+    , m_latency(latency)
+    , m_tail(0)
+    , m_head(0)
+    , m_discardUntil(0)
+    , m_failed(false)
+    , m_stop(false)
+    , m_scheduled(false)
+    , m_producerWaiting(false)
+    , m_consumerWaiting(false)
+    , m_bytesCopied(0)
+{
+    if (shared)
+        m_scheduler = GstVkParseScheduler::Acquire();
+    else
+        m_thread = std::thread(&GstVkParseWorker::Run, this);
+}
+
+GstVkParseWorker::~GstVkParseWorker()
+{
+    Flush(true);
+
+    if (m_scheduler) {
+        // RunScheduled() only lets go of the stream with the lock held
+        std::unique_lock<std::mutex> lock(m_lock);
+
+        m_producerWaiting = true;
+        m_cond.wait(lock, [&] { return !m_scheduled; });
+        m_producerWaiting = false;
+        lock.unlock();
+
+        GstVkParseScheduler::Release(m_scheduler);
+        return;
+    }
+
+    m_stop = true;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_cond.notify_all();
+    }
+    m_thread.join();
+}
+
+// The side waiting sets its flag while holding the lock and then checks
+// the indexes, and the other side updates them before checking the flag,
+// so either the waiter sees the update or it is woken up.
+void GstVkParseWorker::WakeUp(std::atomic<bool>& waiting)
+{
+    if (waiting) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_cond.notify_all();
+    }
+}
+
+bool GstVkParseWorker::Push(const uint8_t* data, size_t size, uint64_t pts, bool eos)
+{
+    uint64_t tail = m_tail;
+
+    if (tail - m_head == m_slots.size()) {
+        std::unique_lock<std::mutex> lock(m_lock);
+
+        m_producerWaiting = true;
+        m_cond.wait(lock, [&] { return tail - m_head < m_slots.size(); });
+        m_producerWaiting = false;
+    }
+
+    // the worker is done with this slot
+    Packet& packet = m_slots[tail % m_slots.size()];
+    packet.data.assign(data, data + size);
+    packet.pts = pts;
+    packet.eos = eos;
+    m_bytesCopied += size;
+
+    m_tail = tail + 1;
+
+    // as for WakeUp(), either RunScheduled() sees the new tail before
+    // letting go of the stream, or the stream is scheduled again here
+    if (m_scheduler) {
+        if (!m_scheduled.exchange(true))
+            m_scheduler->Schedule(this);
+    } else {
+        WakeUp(m_consumerWaiting);
+    }
+
+    return !m_failed.exchange(false);
+}
+
+bool GstVkParseWorker::Flush(bool discard)
+{
+    uint64_t tail = m_tail;
+
+    if (discard) {
+        m_discardUntil = tail;
+        if (!m_scheduler)
+            WakeUp(m_consumerWaiting);
+    }
+
+    if (m_head != tail) {
+        std::unique_lock<std::mutex> lock(m_lock);
+
+        m_producerWaiting = true;
+        m_cond.wait(lock, [&] { return m_head == tail; });
+        m_producerWaiting = false;
+    }
+
+    return !m_failed.exchange(false);
+}
+
+void GstVkParseWorker::ParseNext(uint64_t head)
+{
+    // parsed in place: the slot isn't reused until head moves past it
+    if (head >= m_discardUntil && !m_func(m_slots[head % m_slots.size()]))
+        m_failed = true;
+
+    m_head = head + 1;
+    WakeUp(m_producerWaiting);
+}
+
+void GstVkParseWorker::Run()
+{
+    uint64_t head = m_head;
+
+    for (;;) {
+        if (m_tail == head) {
+            std::unique_lock<std::mutex> lock(m_lock);
+
+            m_consumerWaiting = true;
+            m_cond.wait(lock, [&] { return m_tail != head || m_stop; });
+            m_consumerWaiting = false;
+
+            if (m_tail == head)
+                break;
+        }
+
+        ParseNext(head++);
+    }
+}
+
+bool GstVkParseWorker::RunScheduled(size_t budget)
+{
+    uint64_t head = m_head;
+    bool again;
+
+    for (size_t i = 0; i < budget && m_tail != head; i++)
+        ParseNext(head++);
+
+    if (m_tail != head)
+        return true;
+
+    // The destructor may run as soon as the flag is cleared, so nothing
+    // of the stream is touched after releasing the lock.
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    m_scheduled = false;
+    again = m_tail != head && !m_scheduled.exchange(true);
+    m_cond.notify_all();
+
+    return again;
+}
@@ -0,0 +1,108 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class GstVkParseScheduler;
+
+// Parses packets away from the caller, in the order they are pushed,
+// either on a thread of its own or on the threads of a
+// GstVkParseScheduler, shared with other streams. They wait in a bounded
+// single producer, single consumer ring, whose indexes are atomics:
+// Push() only takes the lock to sleep while the ring is full, and the
+// thread of its own while it's empty. Push(), Flush() and the destructor
+// must be called from the same thread.
+class GstVkParseWorker {
+public:
+    struct Packet {
+        // owned, so the caller's memory can go as soon as Push() returns;
+        // the storage of every slot is reused
+        std::vector<uint8_t> data;
+        uint64_t pts;
+        bool eos;
+    };
+
+    // Called for every packet. Returns false on failure.
+    using ParseFunc = std::function<bool(const Packet&)>;
+
+    // If shared, the packets are parsed by the process-wide
+    // GstVkParseScheduler instead, before those of streams with a lower
+    // priority or, with the same one, a later deadline, which is latency
+    // microseconds after the stream has packets ready.
+    GstVkParseWorker(size_t depth, const ParseFunc& func, bool shared = false,
+        int priority = 0, uint64_t latency = 0);
+    // Discards the packets not parsed yet.
+    ~GstVkParseWorker();
+
+    // Copies the packet into the ring, waiting for a free slot. Returns
+    // false if a packet pushed before failed to parse since the last
+    // Push() or Flush() reporting it.
+    bool Push(const uint8_t* data, size_t size, uint64_t pts, bool eos);
+    // Waits until every packet pushed is parsed or, if discard, dropped
+    // unless being parsed already. Returns false as Push() does.
+    bool Flush(bool discard);
+
+    // Bytes copied into the ring.
+    uint64_t BytesCopied() const { return m_bytesCopied; }
+
+    int Priority() const { return m_priority; }
+    uint64_t Latency() const { return m_latency; }
+
+    // Called by the scheduler, on one thread at a time, once the stream
+    // is scheduled. Parses up to budget packets, returning true if there
+    // are more, in which case the stream stays scheduled.
+    bool RunScheduled(size_t budget);
+
+private:
+    void Run();
+    void WakeUp(std::atomic<bool>& waiting);
+    void ParseNext(uint64_t head);
+
+    ParseFunc m_func;
+    std::vector<Packet> m_slots;
+    GstVkParseScheduler* m_scheduler;
+    int m_priority;
+    uint64_t m_latency;
+
+    // counts of packets pushed and of those parsed or dropped, the slot
+    // of a packet being its count modulo the depth
+    std::atomic<uint64_t> m_tail;
+    std::atomic<uint64_t> m_head;
+    // packets before it are dropped instead of parsed
+    std::atomic<uint64_t> m_discardUntil;
+    std::atomic<bool> m_failed;
+    std::atomic<bool> m_stop;
+    // if queued in or run by the scheduler
+    std::atomic<bool> m_scheduled;
+
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    std::atomic<bool> m_producerWaiting;
+    std::atomic<bool> m_consumerWaiting;
+
+    uint64_t m_bytesCopied;
+    std::thread m_thread;
+};
@@ -16,32 +16,209 @@
  */
 
 #include "gstvkvideoparser.h"
+#include "gstvkaccessunitframer.h"
+#include "gsth264decoder.h"
+
+#include <string.h>
 
 enum
 {
   PROP_USER_DATA = 1,
   PROP_CODEC,
-  PROP_OOB_PIC_PARAMS,
 };
 
 
 GST_DEBUG_CATEGORY (gst_vk_video_parser_debug);
 #define GST_CAT_DEFAULT gst_vk_video_parser_debug
 
+/* GstMemory wrapping the data given to ParseByteStream() without copying
+ * it. The data is only valid until ParseByteStream() returns, so every
+ * borrowed memory still alive by then is detached: it gets its own copy of
+ * the bytes it spans. Shares don't keep their parent alive, thus only the
+ * retained region is copied. */
+typedef struct _GstVkBorrowedMemory
+{
+  GstMemory mem;
+
+  guint8 *data;
+  /* owned copy of data, after detaching */
+  guint8 *copy;
+  /* array of borrowed memories where this one is registered, if any */
+  GPtrArray *tracker;
+} GstVkBorrowedMemory;
+
+typedef struct _GstVkBorrowedAllocator
+{
+  GstAllocator parent;
+} GstVkBorrowedAllocator;
+
+typedef struct _GstVkBorrowedAllocatorClass
+{
+  GstAllocatorClass parent_class;
+} GstVkBorrowedAllocatorClass;
+
+GType gst_vk_borrowed_allocator_get_type (void);
+G_DEFINE_TYPE (GstVkBorrowedAllocator, gst_vk_borrowed_allocator,
+    GST_TYPE_ALLOCATOR);
+
+static GstMemory *gst_vk_borrowed_memory_new (GstMemory * parent,
+    GPtrArray * tracker, guint8 * data, gsize size);
+
+static GstMemory *
+gst_vk_borrowed_allocator_alloc (GstAllocator * allocator, gsize size,
+    GstAllocationParams * params)
+{
+  return NULL;
+}
+
+static void
+gst_vk_borrowed_allocator_free (GstAllocator * allocator, GstMemory * mem)
+{
+  GstVkBorrowedMemory *bmem = (GstVkBorrowedMemory *) mem;
+
+  if (bmem->tracker)
+    g_ptr_array_remove_fast (bmem->tracker, bmem);
+  g_free (bmem->copy);
+  g_free (bmem);
+}
+
+static gpointer
+gst_vk_borrowed_memory_map (GstMemory * mem, gsize maxsize, GstMapFlags flags)
+{
+  return ((GstVkBorrowedMemory *) mem)->data;
+}
+
+static void
+gst_vk_borrowed_memory_unmap (GstMemory * mem)
+{
+}
+
+static GstMemory *
+gst_vk_borrowed_memory_share (GstMemory * mem, gssize offset, gssize size)
+{
+  GstVkBorrowedMemory *bmem = (GstVkBorrowedMemory *) mem;
+  GstMemory *parent = NULL;
+
+  if (size == -1)
+    size = mem->size - offset;
+
+  /* once detached, shares have to keep the copy alive */
+  if (!bmem->tracker) {
+    if ((parent = mem->parent) == NULL)
+      parent = mem;
+  }
+
+  return gst_vk_borrowed_memory_new (parent, bmem->tracker,
+      bmem->data + mem->offset + offset, size);
+}
+
+static void
+gst_vk_borrowed_allocator_class_init (GstVkBorrowedAllocatorClass * klass)
+{
+  GstAllocatorClass *allocator_class = GST_ALLOCATOR_CLASS (klass);
+
+  allocator_class->alloc = gst_vk_borrowed_allocator_alloc;
+  allocator_class->free = gst_vk_borrowed_allocator_free;
+}
+
+static void
+gst_vk_borrowed_allocator_init (GstVkBorrowedAllocator * self)
+{
+  GstAllocator *alloc = GST_ALLOCATOR_CAST (self);
+
+  alloc->mem_type = "VkBorrowedMemory";
+  alloc->mem_map = gst_vk_borrowed_memory_map;
+  alloc->mem_unmap = gst_vk_borrowed_memory_unmap;
+  alloc->mem_share = gst_vk_borrowed_memory_share;
+
+  GST_OBJECT_FLAG_SET (self, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
+}
+
+static GstAllocator *
+gst_vk_borrowed_allocator_get (void)
+{
+  static GstAllocator *allocator = NULL;
+
+  if (g_once_init_enter (&allocator)) {
+    GstAllocator *alloc = (GstAllocator *)
+        g_object_new (gst_vk_borrowed_allocator_get_type (), NULL);
+    gst_object_ref_sink (alloc);
+    GST_OBJECT_FLAG_SET (alloc, GST_OBJECT_FLAG_MAY_BE_LEAKED);
+    g_once_init_leave (&allocator, alloc);
+  }
+
+  return allocator;
+}
+
+static GstMemory *
+gst_vk_borrowed_memory_new (GstMemory * parent, GPtrArray * tracker,
+    guint8 * data, gsize size)
+{
+  GstVkBorrowedMemory *bmem = g_new0 (GstVkBorrowedMemory, 1);
+
+  gst_memory_init (GST_MEMORY_CAST (bmem), GST_MEMORY_FLAG_READONLY,
+      gst_vk_borrowed_allocator_get (), parent, size, 0, 0, size);
 
-GstVkVideoParser::GstVkVideoParser (gpointer user_data, VkVideoCodecOperationFlagBitsKHR codec, gboolean oob_pic_params)
+  bmem->data = data;
+  if (tracker) {
+    bmem->tracker = tracker;
+    g_ptr_array_add (tracker, bmem);
+  }
+
+  return GST_MEMORY_CAST (bmem);
+}
+
+GstVkVideoParser::GstVkVideoParser (gpointer user_data, VkVideoCodecOperationFlagBitsKHR codec, gboolean zero_copy, gboolean direct, gboolean scatter_gather, guint offset_alignment, guint size_alignment, gpointer bitstream_storage, guint64 clock_rate, gboolean pipelined)
       :m_user_data(user_data),
       m_codec(codec),
-      m_oob_pic_params(oob_pic_params)
+      m_zero_copy(zero_copy),
+      m_direct(direct),
+      m_scatter_gather(scatter_gather),
+      m_offset_alignment(offset_alignment),
+      m_size_alignment(size_alignment),
+      m_bitstream_storage(bitstream_storage),
+      m_clock_rate(clock_rate),
+      /* the decoder keeps reading borrowed data after it's detached */
+      m_pipelined(pipelined && !zero_copy),
+      m_parser(nullptr),
+      m_bus(nullptr),
+      m_element(nullptr),
+      m_decoder(nullptr),
+      m_sinkpad(nullptr),
+      m_chain(nullptr),
+      m_framer(nullptr),
+      m_bytes_in(0),
+      m_bytes_copied(0)
 {
   GST_DEBUG_CATEGORY_INIT (gst_vk_video_parser_debug, "vkvideoparser", 0, "Vulkan Video Parser");
+
+  if (m_direct) {
+    m_framer = new GstVkAccessUnitFramer (codec == VK_VIDEO_CODEC_OPERATION_DECODE_H265_BIT_EXT ?
+        GstVkAccessUnitFramer::H265 : GstVkAccessUnitFramer::H264);
+  }
+
+  m_borrowed = g_ptr_array_new ();
 }
 
 GstVkVideoParser::~GstVkVideoParser()
 {
   GstMessage *msg;
 
-  gst_harness_teardown (m_parser);
+  if (m_decoder) {
+    gst_element_set_state (m_decoder, GST_STATE_NULL);
+    gst_object_unref (m_sinkpad);
+    gst_object_unref (m_decoder);
+  } else if (m_parser) {
+    gst_harness_teardown (m_parser);
+  }
+
+  delete m_framer;
+
+  g_assert (m_borrowed->len == 0);
+  g_ptr_array_unref (m_borrowed);
+
+  if (!this->m_bus)
+    return;
 
   /* drain bus after bin unref */
   while ((msg = gst_bus_pop (this->m_bus))) {
@@ -52,9 +229,10 @@ GstVkVideoParser::~GstVkVideoParser()
   gst_object_unref (this->m_bus);
 }
 
-void
+GstFlowReturn
 GstVkVideoParser::ProcessMessages ()
 {
+  GstFlowReturn ret = GST_FLOW_OK;
   GstMessage *msg;
 
   while ((msg = gst_bus_pop (this->m_bus))) {
@@ -69,6 +247,7 @@ GstVkVideoParser::ProcessMessages ()
         GST_ERROR("Error: %s - %s", err->message, debug);
         g_clear_error (&err);
         g_free (debug);
+        ret = GST_FLOW_ERROR;
         break;
       }
       case GST_MESSAGE_WARNING:{
@@ -90,33 +269,62 @@ GstVkVideoParser::ProcessMessages ()
 
     gst_message_unref (msg);
   }
+
+  return ret;
 }
 
 bool GstVkVideoParser::Build ()
 {
-  GstElement *bin, *decoder, *parser, *sink;
+  GstElement *decoder;
   const char *parser_name = NULL;
   const char* src_caps_desc = NULL;
-  GstPad *pad;
 
   if (m_codec == VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_EXT) {
     parser_name = "h264parse";
-    src_caps_desc = "video/x-h264,stream-format=byte-stream";
+    src_caps_desc = m_direct ? "video/x-h264,stream-format=byte-stream,alignment=au"
+        : "video/x-h264,stream-format=byte-stream";
     decoder = gst_element_factory_make_full("vkh264parse", "user-data", m_user_data,
-        "oob-pic-params",  m_oob_pic_params, NULL);
+        "scatter-gather-slices", m_scatter_gather,
+        "bitstream-offset-alignment", m_offset_alignment,
+        "bitstream-size-alignment", m_size_alignment,
+        "bitstream-storage", m_bitstream_storage,
+        "clock-rate", m_clock_rate, NULL);
     g_assert (decoder);
-    g_object_set(decoder, "compliance", 3, NULL);
+    g_object_set(decoder, "compliance", 3, "pipelined", m_pipelined, NULL);
   } else if (m_codec == VK_VIDEO_CODEC_OPERATION_DECODE_H265_BIT_EXT) {
     parser_name = "h265parse";
-    src_caps_desc = "video/x-h265,stream-format=byte-stream";
+    src_caps_desc = m_direct ? "video/x-h265,stream-format=byte-stream,alignment=au"
+        : "video/x-h265,stream-format=byte-stream";
     decoder = gst_element_factory_make_full("vkh265parse", "user-data", m_user_data,
-        "oob-pic-params", m_oob_pic_params, NULL);
+        "scatter-gather-slices", m_scatter_gather,
+        "bitstream-offset-alignment", m_offset_alignment,
+        "bitstream-size-alignment", m_size_alignment,
+        "bitstream-storage", m_bitstream_storage,
+        "clock-rate", m_clock_rate, NULL);
     g_assert (decoder);
   }
   else {
     return false;
   }
 
+  /* as documented by ParseByteStream(), whatever the GstVideoDecoder
+   * default is */
+  g_object_set (decoder, "max-errors", 10, NULL);
+
+  m_element = decoder;
+
+  if (m_direct)
+    return BuildDirect (decoder, src_caps_desc);
+
+  return BuildHarness (decoder, parser_name, src_caps_desc);
+}
+
+/* parser ! decoder ! fakesink, fed through a harness */
+bool GstVkVideoParser::BuildHarness (GstElement * decoder, const char * parser_name, const char * src_caps_desc)
+{
+  GstElement *bin, *parser, *sink;
+  GstPad *pad;
+
   parser = gst_element_factory_make (parser_name, NULL);
   sink = gst_element_factory_make ("fakesink", NULL);
   g_object_set (sink, "async", FALSE, "sync", FALSE, NULL);
@@ -126,6 +334,7 @@ bool GstVkVideoParser::Build ()
 
   if (!gst_element_link_many (parser, decoder, sink, NULL)) {
     GST_WARNING("Failed to link element");
+    gst_object_unref (bin);
     return false;
   }
   if ((pad = gst_bin_find_unlinked_pad (GST_BIN (bin), GST_PAD_SINK)) != NULL) {
@@ -150,7 +359,196 @@ bool GstVkVideoParser::Build ()
   return true;
 }
 
+/* The decoder alone: access units, framed by GstVkAccessUnitFramer, are
+ * handed to its chain function, and its source pad is left unlinked. */
+bool GstVkVideoParser::BuildDirect (GstElement * decoder, const char * src_caps_desc)
+{
+  GstCaps *caps;
+  GstSegment segment;
+  gchar *stream_id;
+
+  m_decoder = GST_ELEMENT (gst_object_ref_sink (decoder));
+
+  m_bus = gst_bus_new ();
+  gst_element_set_bus (m_decoder, m_bus);
+
+  if (gst_element_set_state (m_decoder, GST_STATE_PAUSED) == GST_STATE_CHANGE_FAILURE) {
+    GST_WARNING("Failed to start decoder");
+    return false;
+  }
+
+  m_sinkpad = gst_element_get_static_pad (m_decoder, "sink");
+  m_chain = GST_PAD_CHAINFUNC (m_sinkpad);
+  g_assert (m_chain);
+
+  stream_id = g_strdup_printf ("vkvideoparser/%p", this);
+  gst_pad_send_event (m_sinkpad, gst_event_new_stream_start (stream_id));
+  g_free (stream_id);
 
+  caps = gst_caps_from_string (src_caps_desc);
+  if (!gst_pad_send_event (m_sinkpad, gst_event_new_caps (caps))) {
+    GST_WARNING("Decoder refused caps %" GST_PTR_FORMAT, caps);
+    gst_caps_unref (caps);
+    return false;
+  }
+  gst_caps_unref (caps);
+
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_send_event (m_sinkpad, gst_event_new_segment (&segment));
+
+  ProcessMessages ();
+
+  return true;
+}
+
+void GstVkVideoParser::DetachBorrowed ()
+{
+  while (m_borrowed->len > 0) {
+    GstVkBorrowedMemory *bmem = (GstVkBorrowedMemory *)
+        g_ptr_array_steal_index_fast (m_borrowed, m_borrowed->len - 1);
+    GstMemory *mem = GST_MEMORY_CAST (bmem);
+
+    bmem->copy = (guint8 *) g_malloc (mem->size);
+    memcpy (bmem->copy, bmem->data + mem->offset, mem->size);
+    bmem->data = bmem->copy;
+    bmem->tracker = NULL;
+
+    /* the copy only spans the visible region */
+    mem->maxsize = mem->size;
+    mem->offset = 0;
+
+    m_bytes_copied += mem->size;
+  }
+}
+
+guint64 GstVkVideoParser::BytesCopied () const
+{
+  return m_bytes_copied + (m_framer ? m_framer->BytesCopied () : 0);
+}
+
+void GstVkVideoParser::PoolStats (guint64 * pic_pool_hits, guint64 * pic_pool_misses, guint64 * bitstream_allocations) const
+{
+  *pic_pool_hits = *pic_pool_misses = *bitstream_allocations = 0;
+
+  if (!m_element)
+    return;
+
+  g_object_get (m_element, "pic-pool-hits", pic_pool_hits,
+      "pic-pool-misses", pic_pool_misses,
+      "bitstream-allocations", bitstream_allocations, NULL);
+}
+
+void GstVkVideoParser::MemoryStats (guint64 * picture_bytes, guint64 * param_set_bytes) const
+{
+  *picture_bytes = *param_set_bytes = 0;
+
+  if (!m_element)
+    return;
+
+  g_object_get (m_element, "picture-bytes", picture_bytes,
+      "param-set-bytes", param_set_bytes, NULL);
+}
+
+/* Only while the element is in the client's DecodePicture() for
+ * picture_data. */
+bool GstVkVideoParser::DecodeSliceInfo (gpointer slice_info, gconstpointer picture_data, gint slice)
+{
+  gboolean ret = FALSE;
+
+  if (!m_element)
+    return false;
+
+  g_signal_emit_by_name (m_element, "decode-slice-info", slice_info,
+      picture_data, slice, &ret);
+
+  return ret;
+}
+
+/* As parsers do, the PTS of a packet goes to the first access unit starting
+ * in it, if any. */
+GstClockTime GstVkVideoParser::AccessUnitPts (guint64 offset)
+{
+  GstClockTime pts;
+
+  while (m_pts.size () > 1 && m_pts[1].first <= offset)
+    m_pts.pop_front ();
+
+  if (m_pts.empty () || m_pts.front ().first > offset)
+    return GST_CLOCK_TIME_NONE;
+
+  pts = m_pts.front ().second;
+  m_pts.pop_front ();
+  return pts;
+}
+
+GstFlowReturn GstVkVideoParser::PushData (const guint8 * data, gsize size, GstClockTime pts)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  if (!m_framer) {
+    m_bytes_in += size;
+    return PushBytes (data, size, pts);
+  }
+
+  if (GST_CLOCK_TIME_IS_VALID (pts))
+    m_pts.emplace_back (m_bytes_in, pts);
+  m_bytes_in += size;
+
+  m_framer->Push (data, size, [&] (const GstVkAccessUnitFramer::AccessUnit & au) {
+    GstFlowReturn au_ret = PushBytes (au.data, au.size, AccessUnitPts (au.offset), au.nals, au.nalCount);
+    if (ret == GST_FLOW_OK)
+      ret = au_ret;
+    return au_ret == GST_FLOW_OK;
+  });
+
+  return ret;
+}
+
+GstFlowReturn GstVkVideoParser::PushAccessUnit (const guint8 * data, gsize size, const GstCodecNal * nals, guint n_nals,
+    const GstH264SliceHdr * headers, guint n_headers)
+{
+  g_return_val_if_fail (m_decoder, GST_FLOW_ERROR);
+
+  m_bytes_in += size;
+  return PushBytes (data, size, GST_CLOCK_TIME_NONE, nals, n_nals, headers, n_headers);
+}
+
+GstFlowReturn GstVkVideoParser::PushBytes (const guint8 * data, gsize size, GstClockTime pts, const GstCodecNal * nals, guint n_nals,
+    const GstH264SliceHdr * headers, guint n_headers)
+{
+  GstBuffer *buffer;
+  GstFlowReturn ret;
+
+  if (!m_zero_copy) {
+    buffer = gst_buffer_new_memdup (data, size);
+    m_bytes_copied += size;
+  } else {
+    buffer = gst_buffer_new ();
+    gst_buffer_append_memory (buffer, gst_vk_borrowed_memory_new (NULL,
+            m_borrowed, (guint8 *) data, size));
+  }
+
+  GST_BUFFER_PTS (buffer) = pts;
+
+  /* spare the decoder a second scan for start codes */
+  if (n_nals > 0)
+    gst_buffer_add_codec_nal_meta (buffer, nals, n_nals);
+  /* and a second parse of the slice headers */
+  if (n_headers > 0)
+    gst_buffer_add_h264_slice_hdr_meta (buffer, headers, n_headers);
+
+  ret = PushBuffer (buffer);
+
+  if (m_zero_copy) {
+    /* data is not ours after returning */
+    DetachBorrowed ();
+
+    GST_LOG ("%" G_GUINT64_FORMAT " bytes copied out of %" G_GUINT64_FORMAT,
+        m_bytes_copied, m_bytes_in);
+  }
+
+  return ret;
+}
 
 GstFlowReturn GstVkVideoParser::PushBuffer (GstBuffer * buffer)
 {
@@ -158,7 +556,10 @@ GstFlowReturn GstVkVideoParser::PushBuffer (GstBuffer * buffer)
 
   GST_DEBUG("Pushing buffer: %" GST_PTR_FORMAT, buffer);
 
-  ret = gst_harness_push (m_parser, buffer);
+  if (m_decoder)
+    ret = m_chain (m_sinkpad, GST_OBJECT_PARENT (m_sinkpad), buffer);
+  else
+    ret = gst_harness_push (m_parser, buffer);
   if (ret != GST_FLOW_OK && ret != GST_FLOW_EOS) {
     GST_WARNING("Couldn't push buffer: %s",
         gst_flow_get_name (ret));
@@ -174,10 +575,60 @@ GstFlowReturn GstVkVideoParser::Eos ()
 {
   GST_DEBUG("Pushing EOS");
 
-  if (!gst_harness_push_event (m_parser, gst_event_new_eos ()))
+  if (m_decoder) {
+    GstFlowReturn ret = GST_FLOW_OK;
+
+    m_framer->Drain ([&] (const GstVkAccessUnitFramer::AccessUnit & au) {
+      ret = PushBytes (au.data, au.size, AccessUnitPts (au.offset), au.nals, au.nalCount);
+      return ret == GST_FLOW_OK;
+    });
+    if (ret != GST_FLOW_OK)
+      return ret;
+
+    /* with the source pad unlinked the EOS event can't be forwarded, but
+     * the decoder drains its pending pictures before trying */
+    gst_pad_send_event (m_sinkpad, gst_event_new_eos ());
+  } else if (!gst_harness_push_event (m_parser, gst_event_new_eos ())) {
     return GST_FLOW_ERROR;
+  }
 
-  ProcessMessages ();
+  /* the decoder's drain result is lost once the EOS event is forwarded,
+   * but failures of the last pictures, which it might only find out then,
+   * are posted */
+  if (ProcessMessages () != GST_FLOW_OK)
+    return GST_FLOW_ERROR;
 
   return GST_FLOW_EOS;
 }
+
+/* The pictures not output yet are released without being displayed, and
+ * the bytes of the access unit being framed are dropped, with their PTS.
+ * Then a new segment starts. */
+bool GstVkVideoParser::Flush ()
+{
+  GstSegment segment;
+  gboolean ret;
+
+  GST_DEBUG("Flushing");
+
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+
+  if (m_decoder) {
+    m_framer->Reset ();
+    m_pts.clear ();
+
+    /* as with EOS, the flush events go no further than the decoder */
+    gst_pad_send_event (m_sinkpad, gst_event_new_flush_start ());
+    gst_pad_send_event (m_sinkpad, gst_event_new_flush_stop (TRUE));
+    ret = gst_pad_send_event (m_sinkpad, gst_event_new_segment (&segment));
+  } else {
+    ret = gst_harness_push_event (m_parser, gst_event_new_flush_start ())
+        && gst_harness_push_event (m_parser, gst_event_new_flush_stop (TRUE))
+        && gst_harness_push_event (m_parser, gst_event_new_segment (&segment));
+  }
+
+  /* failures of the pictures dropped are of no use after them */
+  ProcessMessages ();
+
+  return ret;
+}
@@ -19,29 +19,82 @@
 
 #include <gst/gst.h>
 #include "gstharness.h"
+#include <deque>
 #define VK_ENABLE_BETA_EXTENSIONS 1
 #include <vulkan/vulkan.h>
 
 G_BEGIN_DECLS
 
+class GstVkAccessUnitFramer;
+typedef struct _GstCodecNal GstCodecNal;
+typedef struct _GstH264SliceHdr GstH264SliceHdr;
+
 class GstVkVideoParser {
 public:
     GstVkVideoParser(gpointer user_data,
                                        VkVideoCodecOperationFlagBitsKHR codec,
-                                       gboolean oob_pic_params);
+                                       gboolean zero_copy = FALSE,
+                                       gboolean direct = FALSE,
+                                       gboolean scatter_gather = FALSE,
+                                       guint offset_alignment = 1,
+                                       guint size_alignment = 1,
+                                       gpointer bitstream_storage = nullptr,
+                                       guint64 clock_rate = 10000000,
+                                       gboolean pipelined = FALSE);
     ~GstVkVideoParser();
 
     bool Build();
+    GstFlowReturn PushData(const guint8 *data, gsize size, GstClockTime pts = GST_CLOCK_TIME_NONE);
+    /* in direct drive, an access unit framed by the caller, with the
+     * headers of its first slices if parsed ahead (H.264) */
+    GstFlowReturn PushAccessUnit(const guint8 *data, gsize size, const GstCodecNal *nals, guint n_nals,
+                                 const GstH264SliceHdr *headers = nullptr, guint n_headers = 0);
     GstFlowReturn PushBuffer(GstBuffer *buffer);
-    void ProcessMessages ();
+    /* GST_FLOW_ERROR if an error was posted */
+    GstFlowReturn ProcessMessages ();
     GstFlowReturn Eos();
+    /* drops what the decoder and the framer hold, as when seeking */
+    bool Flush();
+
+    guint64 BytesIn() const { return m_bytes_in; }
+    guint64 BytesCopied() const;
+    void PoolStats(guint64 *pic_pool_hits, guint64 *pic_pool_misses, guint64 *bitstream_allocations) const;
+    void MemoryStats(guint64 *picture_bytes, guint64 *param_set_bytes) const;
+    bool DecodeSliceInfo(gpointer slice_info, gconstpointer picture_data, gint slice);
 
 private:
+    bool BuildHarness(GstElement *decoder, const char *parser_name, const char *src_caps_desc);
+    bool BuildDirect(GstElement *decoder, const char *src_caps_desc);
+    GstFlowReturn PushBytes(const guint8 *data, gsize size, GstClockTime pts, const GstCodecNal *nals = nullptr, guint n_nals = 0,
+                            const GstH264SliceHdr *headers = nullptr, guint n_headers = 0);
+    GstClockTime AccessUnitPts(guint64 offset);
+    void DetachBorrowed();
+
     void* m_user_data;
     VkVideoCodecOperationFlagBitsKHR m_codec;
-    bool m_oob_pic_params;
+    bool m_zero_copy;
+    bool m_direct;
+    bool m_scatter_gather;
+    guint m_offset_alignment;
+    guint m_size_alignment;
+    gpointer m_bitstream_storage;
+    guint64 m_clock_rate;
+    bool m_pipelined;
     GstHarness* m_parser;
     GstBus* m_bus;
+    /* the vk decoder element, in either mode; not owned */
+    GstElement* m_element;
+    /* direct drive */
+    GstElement* m_decoder;
+    GstPad* m_sinkpad;
+    GstPadChainFunction m_chain;
+    GstVkAccessUnitFramer* m_framer;
+    /* stream offsets where packets with a PTS begin */
+    std::deque<std::pair<guint64, GstClockTime>> m_pts;
+    /* memories still pointing to the caller's data */
+    GPtrArray* m_borrowed;
+    guint64 m_bytes_in;
+    guint64 m_bytes_copied;
 };
 
 G_END_DECLS
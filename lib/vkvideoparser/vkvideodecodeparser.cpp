@@ -17,6 +17,9 @@
 
 #include "vkvideodecodeparser.h"
 #include "gstvkvideoparser.h"
+#include "gstvkparseworker.h"
+#include "gstvkparsescheduler.h"
+#include "gstvkofflineparser.h"
 
 #include <vk_video/vulkan_video_codecs_common.h>
 
@@ -36,27 +39,42 @@ public:
         : m_refCount(1)
         , m_codec(codec)
         , m_parser(nullptr)
+        , m_worker(nullptr)
+        , m_clockRate(10000000)
+        , m_direct(false)
     {
     }
 
     VkResult Initialize(VkParserInitDecodeParameters*) final;
     bool Deinitialize() final;
     bool ParseByteStream(const VkParserBitstreamPacket*, int32_t*) final;
+    // only from the client's DecodePicture()
+    bool DecodeSliceInfo(VkParserSliceInfo*, const VkParserPictureData*, int32_t) final;
 
     // not implemented
     bool DecodePicture(VkParserPictureData*) final { return false; }
-    bool DecodeSliceInfo(VkParserSliceInfo*, const VkParserPictureData*, int32_t) final { return false; }
     bool GetDisplayMasteringInfo(VkParserDisplayMasteringInfo*) final { return false; }
 
     int32_t AddRef() final;
     int32_t Release() final;
 
+    bool GetStats(VkParserStats*);
+    bool Flush(bool discard);
+    bool ParseStream(const uint8_t* data, size_t size, uint32_t numThreads);
+
 private:
     ~GstVkVideoDecoderParser() {}
 
+    bool Parse(const uint8_t* data, size_t size, GstClockTime pts, bool eos);
+
     int m_refCount;
     VkVideoCodecOperationFlagBitsKHR m_codec;
     GstVkVideoParser* m_parser;
+    // parses on a thread of its own, if asynchronous
+    GstVkParseWorker* m_worker;
+    // ticks per second of llPTS
+    uint64_t m_clockRate;
+    bool m_direct;
 };
 
 VkResult GstVkVideoDecoderParser::Initialize(VkParserInitDecodeParameters* params)
@@ -67,6 +85,15 @@ VkResult GstVkVideoDecoderParser::Initialize(VkParserInitDecodeParameters* param
     if (!params->pClient)
         return VK_ERROR_INITIALIZATION_FAILED;
 
+    uint32_t offsetAlignment = params->nBitstreamOffsetAlignment ? params->nBitstreamOffsetAlignment : 1;
+    uint32_t sizeAlignment = params->nBitstreamSizeAlignment ? params->nBitstreamSizeAlignment : 1;
+
+    if ((offsetAlignment & (offsetAlignment - 1)) != 0)
+        return VK_ERROR_INITIALIZATION_FAILED;
+
+    m_clockRate = params->lReferenceClockRate ? params->lReferenceClockRate : 10000000;
+    m_direct = params->bDirectDrive;
+
 
     if (!gst_init_check(NULL, NULL, NULL))
         return VK_ERROR_INITIALIZATION_FAILED;
@@ -75,15 +102,32 @@ VkResult GstVkVideoDecoderParser::Initialize(VkParserInitDecodeParameters* param
   GST_PLUGIN_STATIC_REGISTER(vkparser);
 #endif
 
-    m_parser = new GstVkVideoParser(params->pClient, m_codec, params->bOutOfBandPictureParameters);
+    m_parser = new GstVkVideoParser(params->pClient, m_codec, params->bZeroCopyByteStream, params->bDirectDrive, params->bScatterGatherSlices,
+        offsetAlignment, sizeAlignment, params->pBitstreamStorage, m_clockRate,
+        params->bPipelinedParsing);
     if (!m_parser->Build())
         return VK_ERROR_INITIALIZATION_FAILED;
 
+    if (params->nAsyncQueueDepth > 0 || params->bSharedScheduler) {
+        uint32_t depth = params->nAsyncQueueDepth ? params->nAsyncQueueDepth : 4;
+        auto parse = [this](const GstVkParseWorker::Packet& packet) {
+            return Parse(packet.data.data(), packet.data.size(), packet.pts, packet.eos);
+        };
+
+        m_worker = new GstVkParseWorker(depth, parse, params->bSharedScheduler,
+            params->nSchedulerPriority, params->nSchedulerLatency);
+    }
+
     return VK_SUCCESS;
 }
 
 bool GstVkVideoDecoderParser::Deinitialize()
 {
+    // before the parser it drives
+    if (m_worker) {
+        delete m_worker;
+        m_worker = nullptr;
+    }
     if (m_parser) {
         delete m_parser;
         m_parser  = nullptr;
@@ -91,30 +135,118 @@ bool GstVkVideoDecoderParser::Deinitialize()
     return true;
 }
 
-bool GstVkVideoDecoderParser::ParseByteStream(const VkParserBitstreamPacket* bspacket, int32_t* parsed)
+bool GstVkVideoDecoderParser::DecodeSliceInfo(VkParserSliceInfo* psli, const VkParserPictureData* pd, int32_t iSlice)
 {
-    if (parsed)
-        *parsed = 0;
+    if (!(m_parser && psli && pd))
+        return false;
 
-    if (bspacket->nDataLength) {
-         auto buffer = gst_buffer_new_memdup(bspacket->pByteStream, bspacket->nDataLength);
-        if (!buffer)
-            return false;
+    return m_parser->DecodeSliceInfo(psli, pd, iSlice);
+}
 
-        auto ret = m_parser->PushBuffer(buffer);
+bool GstVkVideoDecoderParser::Parse(const uint8_t* data, size_t size, GstClockTime pts, bool eos)
+{
+    if (size) {
+        auto ret = m_parser->PushData(data, size, pts);
         if (ret != GST_FLOW_OK)
             return false;
     }
 
-    if (bspacket->bEOS) {
+    if (eos) {
         auto ret = m_parser->Eos();
         if (ret != GST_FLOW_EOS)
             return false;
     }
 
+    return true;
+}
+
+bool GstVkVideoDecoderParser::ParseByteStream(const VkParserBitstreamPacket* bspacket, int32_t* parsed)
+{
+    GstClockTime pts = GST_CLOCK_TIME_NONE;
+    bool ret = true;
+
+    if (parsed)
+        *parsed = 0;
+
+    if (!m_parser)
+        return false;
+
+    if (bspacket->nDataLength && bspacket->bPTSValid && bspacket->llPTS >= 0)
+        pts = gst_util_uint64_scale_round(bspacket->llPTS, GST_SECOND, m_clockRate);
+
+    if (!m_worker) {
+        if (!Parse(bspacket->pByteStream, bspacket->nDataLength, pts, bspacket->bEOS))
+            return false;
+    } else {
+        // a failure is only known by the next call
+        if (bspacket->nDataLength || bspacket->bEOS)
+            ret = m_worker->Push(bspacket->pByteStream, bspacket->nDataLength, pts, bspacket->bEOS);
+        // nothing is left behind the end of the stream
+        if (bspacket->bEOS)
+            ret = m_worker->Flush(false) && ret;
+    }
+
     if (parsed)
         *parsed = bspacket->nDataLength;
 
+    return ret;
+}
+
+bool GstVkVideoDecoderParser::Flush(bool discard)
+{
+    bool ret = true;
+
+    if (!m_parser)
+        return false;
+
+    if (m_worker)
+        ret = m_worker->Flush(discard);
+
+    // the worker is idle by now, so the parser is flushed from this thread
+    if (discard && !m_parser->Flush())
+        ret = false;
+
+    return ret;
+}
+
+bool GstVkVideoDecoderParser::ParseStream(const uint8_t* data, size_t size, uint32_t numThreads)
+{
+    // the access units are framed here, instead of by the decoder's parser,
+    // and only H.264 slice headers can be parsed ahead
+    if (!(m_parser && m_direct && m_codec == VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_EXT))
+        return false;
+
+    // whatever was given to ParseByteStream() goes first
+    if (m_worker && !m_worker->Flush(false))
+        return false;
+
+    GstVkOfflineParser offline(numThreads);
+    bool ret = offline.Parse(data, size, [this](const GstVkOfflineParser::AccessUnit& au) {
+        return m_parser->PushAccessUnit(au.data, au.size, au.nals, au.nalCount, au.headers, au.headerCount) == GST_FLOW_OK;
+    });
+
+    if (!ret)
+        return false;
+
+    return m_parser->Eos() == GST_FLOW_EOS;
+}
+
+bool GstVkVideoDecoderParser::GetStats(VkParserStats* stats)
+{
+    if (!m_parser)
+        return false;
+
+    guint64 hits, misses, allocations, picture_bytes, param_set_bytes;
+
+    stats->nBytesIn = m_parser->BytesIn();
+    stats->nBytesCopied = m_parser->BytesCopied() + (m_worker ? m_worker->BytesCopied() : 0);
+    m_parser->PoolStats(&hits, &misses, &allocations);
+    stats->nPicPoolHits = hits;
+    stats->nPicPoolMisses = misses;
+    stats->nBitstreamAllocations = allocations;
+    m_parser->MemoryStats(&picture_bytes, &param_set_bytes);
+    stats->nPictureBytes = picture_bytes;
+    stats->nParamSetBytes = param_set_bytes;
     return true;
 }
 
@@ -149,3 +281,33 @@ bool CreateVulkanVideoDecodeParser(VulkanVideoDecodeParser** parser, VkVideoCode
     *parser = internalParser;
     return true;
 }
+
+bool GetVulkanVideoDecodeParserStats(VulkanVideoDecodeParser* parser, VkParserStats* stats)
+{
+    if (!(parser && stats))
+        return false;
+
+    return static_cast<GstVkVideoDecoderParser*>(parser)->GetStats(stats);
+}
+
+bool FlushVulkanVideoDecodeParser(VulkanVideoDecodeParser* parser, bool discard)
+{
+    if (!parser)
+        return false;
+
+    return static_cast<GstVkVideoDecoderParser*>(parser)->Flush(discard);
+}
+
+bool ConfigureVulkanVideoDecodeParserScheduler(uint32_t numThreads, bool cpuAffinity)
+{
+    return GstVkParseScheduler::Configure(numThreads, cpuAffinity);
+}
+
+bool ParseVulkanVideoDecodeParserStream(VulkanVideoDecodeParser* parser, const uint8_t* data, size_t size,
+                                        uint32_t numThreads)
+{
+    if (!(parser && (data || size == 0)))
+        return false;
+
+    return static_cast<GstVkVideoDecoderParser*>(parser)->ParseStream(data, size, numThreads);
+}
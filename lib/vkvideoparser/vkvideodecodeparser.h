@@ -27,3 +27,40 @@ typedef void (*nvParserLogFuncType)(const char* format, ...);
 bool CreateVulkanVideoDecodeParser(VulkanVideoDecodeParser** ppobj, VkVideoCodecOperationFlagBitsKHR eCompression,
                                    const VkExtensionProperties* pStdExtensionVersion,
                                    nvParserLogFuncType pParserLogFunc, int logLevel);
+
+// Counters of an initialized parser, for benchmarking
+typedef struct VkParserStats {
+    uint64_t nBytesIn; // bytes given to ParseByteStream()
+    uint64_t nBytesCopied; // bytes copied while ingesting them
+    uint64_t nPicPoolHits; // pictures reused from the decoder's pool
+    uint64_t nPicPoolMisses; // pictures allocated, the pool being empty
+    uint64_t nBitstreamAllocations; // allocations storing picture slice data
+    uint64_t nPictureBytes; // memory of the decoder's picture structures
+    uint64_t nParamSetBytes; // memory of the converted parameter sets
+} VkParserStats;
+
+bool GetVulkanVideoDecodeParserStats(VulkanVideoDecodeParser* pobj, VkParserStats* pStats);
+
+// With nAsyncQueueDepth, waits until the packets given to ParseByteStream()
+// are parsed and their callbacks called. Without it, there's nothing to
+// wait for. If discard, as when seeking, the packets not being parsed yet
+// are dropped instead, and so are the bytes of the access unit being
+// framed and the pictures not displayed yet, which are released without
+// DisplayPicture(). The next packet should start at a random access point.
+// Returns false if any of the packets failed, or the flush did.
+bool FlushVulkanVideoDecodeParser(VulkanVideoDecodeParser* pobj, bool discard);
+
+// Sets the threads of the scheduler bSharedScheduler parsers run on, zero
+// for one per CPU, the default, and whether to bind each one to a CPU. It
+// only applies while no parser uses it, returning false otherwise.
+bool ConfigureVulkanVideoDecodeParserScheduler(uint32_t numThreads, bool cpuAffinity);
+
+// Parses a whole H.264 Annex-B stream on numThreads threads, zero for one
+// per CPU, as a single ParseByteStream() with bEOS would, the callbacks
+// being called from the calling thread in the same order. Access units are
+// found and their slice headers parsed ahead concurrently, while the
+// pictures go through a single decoder. Only with bDirectDrive; the
+// pictures get no timestamps. Fails for other codecs, without parsing
+// anything, since H.265 slice headers aren't parsed ahead.
+bool ParseVulkanVideoDecodeParserStream(VulkanVideoDecodeParser* pobj, const uint8_t* pData, size_t nDataLength,
+                                        uint32_t numThreads);
@@ -0,0 +1,383 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <glib.h>
+#include <memory>
+
+#include "utils.h"
+#include "VideoParserClient.h"
+#include "vkvideodecodeparser.h"
+
+// Silent client, so the callbacks don't dominate the measurements. As
+// bitstream storage, it stands for a client handing out mapped Vulkan
+// memory, so there's nothing to upload then.
+class BenchClient : public VkParserVideoDecodeClient, public VkParserBitstreamStorage {
+public:
+    BenchClient(uint32_t alignment, bool storage)
+        : m_dpb(32)
+        , m_storage(storage)
+        , m_alignment(alignment)
+        , m_misaligned(0)
+        , m_decoded(0)
+        , m_displayed(0)
+    {
+    }
+
+    int32_t BeginSequence(const VkParserSequenceInfo* info) final
+    {
+        return std::min(std::max(info->nMinNumDecodeSurfaces, 1), 17);
+    }
+
+    bool AllocPictureBuffer(VkPicIf** pic) final
+    {
+        for (auto& apic : m_dpb) {
+            if (apic.isAvailable()) {
+                apic.AddRef();
+                *pic = &apic;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool DecodePicture(VkParserPictureData* pic) final
+    {
+        if (pic->pBitstreamData && m_alignment > 1) {
+            // the client's own memory isn't aligned by the parser
+            if ((!m_storage && (GPOINTER_TO_SIZE(pic->pBitstreamData) % m_alignment) != 0) || (pic->nBitstreamDataLen % m_alignment) != 0)
+                m_misaligned++;
+        }
+
+        if (m_storage) {
+            m_decoded++;
+            return true;
+        }
+
+        // the copy to GPU visible memory a Vulkan client would do
+        if (m_upload.size() < pic->nBitstreamDataLen)
+            m_upload.resize(pic->nBitstreamDataLen);
+
+        if (pic->pSliceSegments) {
+            for (uint32_t i = 0; i < pic->nNumSlices; i++)
+                memcpy(m_upload.data() + pic->pSliceDataOffsets[i], pic->pSliceSegments[i].pData, pic->pSliceSegments[i].nDataLen);
+        } else {
+            memcpy(m_upload.data(), pic->pBitstreamData, pic->nBitstreamDataLen);
+        }
+
+        m_decoded++;
+        return true;
+    }
+
+    bool UpdatePictureParameters(VkPictureParameters*, VkSharedBaseObj<VkParserVideoRefCountBase>& shared, uint64_t) final
+    {
+        shared = PictureParameterSet::create();
+        return true;
+    }
+
+    bool DisplayPicture(VkPicIf*, int64_t) final
+    {
+        m_displayed++;
+        return true;
+    }
+
+    void UnhandledNALU(const uint8_t*, int32_t) final { }
+
+    uint8_t* GetBitstreamBuffer(VkPicIf*, uint8_t* buffer, size_t, size_t minSize, size_t* size) final
+    {
+        std::vector<uint8_t>* storage = nullptr;
+
+        if (buffer) {
+            for (auto& used : m_usedBuffers) {
+                if (used->data() == buffer) {
+                    storage = used.get();
+                    break;
+                }
+            }
+        } else {
+            if (m_freeBuffers.empty())
+                m_freeBuffers.emplace_back(new std::vector<uint8_t>());
+            m_usedBuffers.push_back(std::move(m_freeBuffers.back()));
+            m_freeBuffers.pop_back();
+            storage = m_usedBuffers.back().get();
+        }
+
+        if (!storage)
+            return nullptr;
+
+        // vector keeps the contents when growing
+        if (storage->size() < minSize)
+            storage->resize(std::max(minSize, storage->size() * 2));
+
+        *size = storage->size();
+        return storage->data();
+    }
+
+    void ReleaseBitstreamBuffer(VkPicIf*, uint8_t* buffer) final
+    {
+        for (auto it = m_usedBuffers.begin(); it != m_usedBuffers.end(); ++it) {
+            if ((*it)->data() == buffer) {
+                m_freeBuffers.push_back(std::move(*it));
+                m_usedBuffers.erase(it);
+                break;
+            }
+        }
+    }
+
+    uint64_t misaligned() const { return m_misaligned; }
+    uint64_t decoded() const { return m_decoded; }
+    uint64_t displayed() const { return m_displayed; }
+
+private:
+    std::vector<Picture> m_dpb;
+    std::vector<uint8_t> m_upload;
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> m_freeBuffers;
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> m_usedBuffers;
+    bool m_storage;
+    uint32_t m_alignment;
+    uint64_t m_misaligned;
+    uint64_t m_decoded;
+    uint64_t m_displayed;
+};
+
+struct BenchOptions {
+    VkVideoCodecOperationFlagBitsKHR codec;
+    gint chunk_size;
+    gint iterations;
+    gboolean zero_copy;
+    gboolean direct;
+    gboolean scatter_gather;
+    gint alignment;
+    gboolean client_storage;
+    gint async_depth;
+    gboolean pipelined;
+    gboolean offline;
+    gint threads;
+};
+
+// Returns the pictures decoded per second in rate.
+static bool run(const BenchOptions& opts, const guint8* data, gsize size, gdouble* rate)
+{
+    VulkanVideoDecodeParser* parser = nullptr;
+    BenchClient client(opts.alignment, opts.client_storage);
+    VkParserInitDecodeParameters params = {
+        .interfaceVersion = NV_VULKAN_VIDEO_PARSER_API_VERSION,
+        .pClient = &client,
+        .bOutOfBandPictureParameters = true,
+        .bZeroCopyByteStream = !!opts.zero_copy,
+        .bDirectDrive = !!opts.direct,
+        .bScatterGatherSlices = !!opts.scatter_gather,
+        .nBitstreamOffsetAlignment = static_cast<uint32_t>(opts.alignment),
+        .nBitstreamSizeAlignment = static_cast<uint32_t>(opts.alignment),
+        .pBitstreamStorage = opts.client_storage ? &client : nullptr,
+        .nAsyncQueueDepth = static_cast<uint32_t>(opts.async_depth),
+        .bPipelinedParsing = !!opts.pipelined,
+    };
+    VkParserStats stats = { };
+    int32_t parsed;
+    gint64 start, elapsed, blocked = 0;
+
+    static const VkExtensionProperties h264StdExtensionVersion = { VK_STD_VULKAN_VIDEO_CODEC_H264_DECODE_EXTENSION_NAME, VK_STD_VULKAN_VIDEO_CODEC_H264_DECODE_SPEC_VERSION };
+    static const VkExtensionProperties h265StdExtensionVersion = { VK_STD_VULKAN_VIDEO_CODEC_H265_DECODE_EXTENSION_NAME, VK_STD_VULKAN_VIDEO_CODEC_H265_DECODE_SPEC_VERSION };
+
+    if (!CreateVulkanVideoDecodeParser(&parser, opts.codec,
+            opts.codec == VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_EXT ? &h264StdExtensionVersion : &h265StdExtensionVersion,
+            (nvParserLogFuncType)printf, 0))
+        return false;
+
+    if (parser->Initialize(&params) != VK_SUCCESS) {
+        parser->Release();
+        return false;
+    }
+
+    // Reuse a single scratch buffer, trashed after every call, so any
+    // reference kept to the caller's memory shows up as corruption.
+    std::vector<guint8> scratch(opts.chunk_size);
+
+    start = g_get_monotonic_time();
+
+    if (opts.offline) {
+        if (!ParseVulkanVideoDecodeParserStream(parser, data, size, opts.threads))
+            ERR("failed to parse stream.");
+        blocked = g_get_monotonic_time() - start;
+    }
+
+    for (gint i = 0; i < opts.iterations && !opts.offline; i++) {
+        for (gsize offset = 0; offset < size; offset += opts.chunk_size) {
+            gsize len = MIN((gsize)opts.chunk_size, size - offset);
+            memcpy(scratch.data(), data + offset, len);
+
+            VkParserBitstreamPacket pkt = {
+                .pByteStream = scratch.data(),
+                .nDataLength = static_cast<int32_t>(len),
+                .bEOS = (i == opts.iterations - 1) && (offset + len == size),
+            };
+
+            gint64 call = g_get_monotonic_time();
+
+            if (!parser->ParseByteStream(&pkt, &parsed)) {
+                ERR("failed to parse bitstream.");
+                break;
+            }
+
+            blocked += g_get_monotonic_time() - call;
+
+            memset(scratch.data(), 0xff, len);
+        }
+    }
+
+    elapsed = g_get_monotonic_time() - start;
+
+    GetVulkanVideoDecodeParserStats(parser, &stats);
+
+    INFO("%s, %s, %s, %s%s: %" G_GUINT64_FORMAT " pictures decoded, %" G_GUINT64_FORMAT " displayed",
+        opts.direct ? "direct" : "harness", opts.zero_copy ? "zero-copy" : "copy",
+        opts.scatter_gather ? "scatter-gather" : "contiguous",
+        opts.pipelined ? "pipelined" : "serial", opts.offline ? ", offline" : "",
+        client.decoded(), client.displayed());
+    INFO("  %.3f s, %.2f MB/s, %.2f pictures/s", elapsed / 1e6,
+        (size * (gdouble)opts.iterations) / elapsed, client.decoded() * 1e6 / elapsed);
+    // time the thread feeding the parser couldn't do anything else
+    INFO("  %.3f s in %s (%s)", blocked / 1e6,
+        opts.offline ? "ParseVulkanVideoDecodeParserStream()" : "ParseByteStream()",
+        opts.async_depth > 0 ? "asynchronous" : "synchronous");
+    INFO("  %" G_GUINT64_FORMAT " bytes in, %" G_GUINT64_FORMAT " bytes copied (%.3f copied per input byte)",
+        stats.nBytesIn, stats.nBytesCopied,
+        stats.nBytesIn ? (gdouble)stats.nBytesCopied / stats.nBytesIn : 0.0);
+    INFO("  %" G_GUINT64_FORMAT " pictures reused, %" G_GUINT64_FORMAT " allocated, %" G_GUINT64_FORMAT " bitstream allocations",
+        stats.nPicPoolHits, stats.nPicPoolMisses, stats.nBitstreamAllocations);
+    INFO("  %.1f KB of picture structures, %.1f KB of parameter sets",
+        stats.nPictureBytes / 1024.0, stats.nParamSetBytes / 1024.0);
+
+    parser->Deinitialize();
+    parser->Release();
+
+    *rate = elapsed ? client.decoded() * 1e6 / elapsed : 0.0;
+
+    if (client.misaligned() > 0) {
+        ERR("%" G_GUINT64_FORMAT " pictures with misaligned bitstream", client.misaligned());
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    GOptionContext* ctx;
+    GError* err = NULL;
+    gchar** filenames = NULL;
+    gchar* codec_str = NULL;
+    gchar* contents = NULL;
+    gsize size;
+    gdouble rate = 0.0, serialRate = 0.0;
+    BenchOptions opts = {
+        .codec = VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_EXT,
+        .chunk_size = BUFSIZ,
+        .iterations = 1,
+        .zero_copy = FALSE,
+        .direct = FALSE,
+        .scatter_gather = FALSE,
+        .alignment = 1,
+        .client_storage = FALSE,
+        .async_depth = 0,
+        .pipelined = FALSE,
+        .offline = FALSE,
+        .threads = 0,
+    };
+    gint ret = EXIT_SUCCESS;
+
+    GOptionEntry entries[] = {
+        { "codec", 'c', 0, G_OPTION_ARG_STRING, &codec_str, "Codec to use ie h265", NULL },
+        { "chunk-size", 's', 0, G_OPTION_ARG_INT, &opts.chunk_size, "Bytes per ParseByteStream() call", NULL },
+        { "iterations", 'n', 0, G_OPTION_ARG_INT, &opts.iterations, "Times to parse the file", NULL },
+        { "zero-copy", 'z', 0, G_OPTION_ARG_NONE, &opts.zero_copy, "Don't copy the input packets", NULL },
+        { "direct", 'd', 0, G_OPTION_ARG_NONE, &opts.direct, "Drive the decoder without a pipeline", NULL },
+        { "scatter-gather", 'g', 0, G_OPTION_ARG_NONE, &opts.scatter_gather, "Get slices as segments of the input", NULL },
+        { "alignment", 'a', 0, G_OPTION_ARG_INT, &opts.alignment, "Bitstream offset and size alignment", NULL },
+        { "client-storage", 'b', 0, G_OPTION_ARG_NONE, &opts.client_storage, "Write slices into client memory", NULL },
+        { "async", 'q', 0, G_OPTION_ARG_INT, &opts.async_depth, "Parse on a worker with a queue of this many packets", NULL },
+        { "pipelined", 'p', 0, G_OPTION_ARG_NONE, &opts.pipelined, "Parse slice headers ahead of decoding", NULL },
+        { "offline", 'o', 0, G_OPTION_ARG_NONE, &opts.offline, "Parse the whole H.264 file at once, on several threads", NULL },
+        { "threads", 't', 0, G_OPTION_ARG_INT, &opts.threads, "Threads of --offline, 0 for one per CPU", NULL },
+        { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &filenames, NULL },
+        { NULL }
+    };
+
+    g_set_prgname(argv[0]);
+
+    ctx = g_option_context_new("BENCH");
+    g_option_context_add_main_entries(ctx, entries, NULL);
+
+    if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+        ERR("Error initializing: %s", err->message);
+        g_option_context_free(ctx);
+        g_clear_error(&err);
+        exit(EXIT_FAILURE);
+    }
+
+    g_option_context_free(ctx);
+
+    if (!(filenames != NULL && *filenames != NULL)) {
+        ERR("Please provide a filename.");
+        exit(EXIT_FAILURE);
+    }
+
+    if (opts.chunk_size <= 0 || opts.iterations <= 0 || opts.alignment <= 0 || opts.async_depth < 0 || (opts.alignment & (opts.alignment - 1)) != 0) {
+        ERR("Invalid chunk size, iterations, alignment or queue depth.");
+        exit(EXIT_FAILURE);
+    }
+
+    if (codec_str && strcmp(codec_str, "h265") == 0)
+        opts.codec = VK_VIDEO_CODEC_OPERATION_DECODE_H265_BIT_EXT;
+    g_free(codec_str);
+
+    if (opts.offline && (!opts.direct || opts.iterations > 1 || opts.threads < 0
+            || opts.codec != VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_EXT)) {
+        ERR("--offline needs H.264, --direct, a single iteration and a valid number of threads.");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!g_file_get_contents(filenames[0], &contents, &size, &err)) {
+        ERR("Unable to read %s: %s", filenames[0], err->message);
+        g_clear_error(&err);
+        g_strfreev(filenames);
+        exit(EXIT_FAILURE);
+    }
+
+    if (opts.offline) {
+        // the serial parse of the same stream, to compare with
+        BenchOptions serial = opts;
+
+        serial.offline = FALSE;
+        if (!run(serial, (const guint8*)contents, size, &serialRate))
+            ret = EXIT_FAILURE;
+    }
+
+    if (ret == EXIT_SUCCESS && !run(opts, (const guint8*)contents, size, &rate))
+        ret = EXIT_FAILURE;
+
+    if (ret == EXIT_SUCCESS && opts.offline) {
+        INFO("offline: %.2f times the pictures/s of the serial parse",
+            serialRate > 0 ? rate / serialRate : 0.0);
+    }
+
+    g_free(contents);
+    g_strfreev(filenames);
+
+    return ret;
+}
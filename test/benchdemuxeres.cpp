@@ -0,0 +1,174 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Opens many demuxers on the same file and reports the CPU the process
+// uses while they sit idle, and then while all their packets are read in
+// turns, as cores busy on average.
+
+#include <gst/gst.h>
+#include <stdlib.h>
+#include <vector>
+
+#ifdef G_OS_WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "utils.h"
+#include "gstdemuxeres.h"
+
+// user and system time of the process, in microseconds
+static gint64
+process_cpu_time (void)
+{
+#ifdef G_OS_WIN32
+  FILETIME creation, end, kernel, user;
+  ULARGE_INTEGER k, u;
+
+  GetProcessTimes (GetCurrentProcess (), &creation, &end, &kernel, &user);
+  k.LowPart = kernel.dwLowDateTime;
+  k.HighPart = kernel.dwHighDateTime;
+  u.LowPart = user.dwLowDateTime;
+  u.HighPart = user.dwHighDateTime;
+
+  return (k.QuadPart + u.QuadPart) / 10;
+#else
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC
+      + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *ctx;
+  GError *err = NULL;
+  gchar **filenames = NULL;
+  gint num_demuxers = 100;
+  gint idle_ms = 1000;
+  std::vector<GstDemuxerES *> demuxers;
+  std::vector<bool> done;
+  gint64 start, cpu, elapsed;
+  gint remaining, packets = 0;
+  gint ret = EXIT_SUCCESS;
+
+  const GOptionEntry entries[] = {
+    {"demuxers", 'n', 0, G_OPTION_ARG_INT, &num_demuxers,
+        "Demuxers open at once", NULL},
+    {"idle", 'i', 0, G_OPTION_ARG_INT, &idle_ms,
+        "Milliseconds to leave them idle", NULL},
+    {G_OPTION_REMAINING, 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME_ARRAY,
+        &filenames, "Media file to demux", NULL},
+    {NULL,},
+  };
+
+  g_set_prgname (argv[0]);
+
+  ctx = g_option_context_new ("- demuxer CPU usage benchmark");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    ERR ("Error initializing: %s", err->message);
+    g_clear_error (&err);
+    g_option_context_free (ctx);
+    exit (EXIT_FAILURE);
+  }
+  g_option_context_free (ctx);
+
+  if (!filenames) {
+    ERR ("Please provide a filename.");
+    exit (EXIT_FAILURE);
+  }
+
+  if (num_demuxers <= 0 || idle_ms < 0) {
+    ERR ("Invalid number of demuxers or idle time.");
+    g_strfreev (filenames);
+    exit (EXIT_FAILURE);
+  }
+
+  for (gint i = 0; i < num_demuxers; i++) {
+    GstDemuxerES *demuxer = gst_demuxer_es_new (filenames[0]);
+
+    if (!demuxer) {
+      ERR ("Unable to open demuxer %d.", i);
+      ret = EXIT_FAILURE;
+      break;
+    }
+    demuxers.push_back (demuxer);
+    done.push_back (false);
+  }
+
+  if (ret == EXIT_SUCCESS) {
+    start = g_get_monotonic_time ();
+    cpu = process_cpu_time ();
+    g_usleep (idle_ms * 1000);
+    elapsed = g_get_monotonic_time () - start;
+    cpu = process_cpu_time () - cpu;
+
+    INFO ("%d demuxers idle: %.3f s of CPU in %.3f s (%.2f cores)",
+        num_demuxers, cpu / 1e6, elapsed / 1e6,
+        elapsed ? (gdouble) cpu / elapsed : 0.0);
+
+    start = g_get_monotonic_time ();
+    cpu = process_cpu_time ();
+
+    for (remaining = num_demuxers; remaining > 0 && ret == EXIT_SUCCESS;) {
+      for (gint i = 0; i < num_demuxers; i++) {
+        GstDemuxerESPacket *pkt;
+        GstDemuxerESResult result;
+
+        if (done[i])
+          continue;
+
+        result = gst_demuxer_es_read_packet (demuxers[i], &pkt);
+        if (result == DEMUXER_ES_RESULT_ERROR) {
+          ERR ("An error occured during the read of frame.");
+          ret = EXIT_FAILURE;
+          break;
+        }
+        if (result > DEMUXER_ES_RESULT_LAST_PACKET)
+          continue;
+
+        gst_demuxer_es_clear_packet (pkt);
+        packets++;
+
+        if (result == DEMUXER_ES_RESULT_LAST_PACKET) {
+          done[i] = true;
+          remaining--;
+        }
+      }
+    }
+
+    elapsed = g_get_monotonic_time () - start;
+    cpu = process_cpu_time () - cpu;
+
+    INFO ("%d demuxers reading: %d packets, %.3f s of CPU in %.3f s "
+        "(%.2f cores, %.1f us of CPU per packet)", num_demuxers, packets,
+        cpu / 1e6, elapsed / 1e6, elapsed ? (gdouble) cpu / elapsed : 0.0,
+        packets ? (gdouble) cpu / packets : 0.0);
+  }
+
+  for (auto demuxer : demuxers)
+    gst_demuxer_es_teardown (demuxer);
+
+  g_strfreev (filenames);
+  return ret;
+}
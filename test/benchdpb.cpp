@@ -0,0 +1,203 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Drives a GstH264Dpb through the reference marking and bumping of a
+// stream where every picture is a reference one carrying memory management
+// control operations, as some broadcast and conferencing encoders do, and
+// reports the time spent per picture.
+
+#include <gst/gst.h>
+
+#include "gsth264decoder.h"
+#include "utils.h"
+
+static const gint maxFrameNum = 256;
+static const gint numLongTerm = 4;
+
+// Pictures in decoding order come in groups of four, the last one in
+// output order first.
+static gint picture_order_count(gint n)
+{
+    static const gint reorder[] = { 3, 0, 1, 2 };
+
+    return 2 * ((n / 4) * 4 + reorder[n % 4]);
+}
+
+static void update_pic_nums(GstH264Dpb* dpb, gint frameNum)
+{
+    GArray* pictures = gst_h264_dpb_get_pictures_all(dpb);
+
+    for (guint i = 0; i < pictures->len; i++) {
+        GstH264Picture* picture = g_array_index(pictures, GstH264Picture*, i);
+
+        if (GST_H264_PICTURE_IS_LONG_TERM_REF(picture)) {
+            picture->long_term_pic_num = picture->long_term_frame_idx;
+        } else if (GST_H264_PICTURE_IS_SHORT_TERM_REF(picture)) {
+            picture->frame_num_wrap = picture->frame_num > frameNum ? picture->frame_num - maxFrameNum : picture->frame_num;
+            picture->pic_num = picture->frame_num_wrap;
+        }
+    }
+
+    g_array_unref(pictures);
+}
+
+static gboolean mmco(GstH264Dpb* dpb, GstH264Picture* picture, guint8 type, guint32 arg)
+{
+    GstH264RefPicMarking marking = {};
+
+    marking.memory_management_control_operation = type;
+    switch (type) {
+    case 1:
+    case 3:
+        marking.difference_of_pic_nums_minus1 = arg;
+        marking.long_term_frame_idx = (picture->frame_num / 4) % numLongTerm;
+        break;
+    case 2:
+        marking.long_term_pic_num = arg;
+        break;
+    case 4:
+        marking.max_long_term_frame_idx_plus1 = arg;
+        break;
+    }
+
+    return gst_h264_dpb_perform_memory_management_control_operation(dpb, &marking, picture);
+}
+
+// Marks picture as 8.2.5.4 does for the current one, with up to four
+// operations.
+static guint mark_references(GstH264Dpb* dpb, GstH264Picture* picture, gint dpbSize)
+{
+    guint failed = 0;
+
+    // the oldest short-term one, to keep room for the current one
+    if (gst_h264_dpb_num_ref_frames(dpb) >= dpbSize) {
+        GstH264Picture* oldest = gst_h264_dpb_get_lowest_frame_num_short_ref(dpb);
+
+        if (oldest) {
+            failed += !mmco(dpb, picture, 1, picture->pic_num - oldest->pic_num - 1);
+            gst_h264_picture_unref(oldest);
+        }
+    }
+
+    // the previous one becomes long-term, replacing the one with its index
+    if (picture->frame_num % 4 == 1)
+        failed += !mmco(dpb, picture, 3, 0);
+
+    if (picture->frame_num % 16 == 9)
+        failed += !mmco(dpb, picture, 2, 0);
+
+    if (picture->frame_num % 32 == 17)
+        failed += !mmco(dpb, picture, 4, numLongTerm / 2);
+
+    return failed;
+}
+
+int main(int argc, char** argv)
+{
+    GOptionContext* ctx;
+    GError* err = NULL;
+    gint numPictures = 200000, dpbSize = GST_H264_DPB_MAX_SIZE;
+    GstH264Dpb* dpb;
+    gint64 start, elapsed;
+    guint failed = 0, output = 0;
+
+    GOptionEntry entries[] = {
+        { "pictures", 'n', 0, G_OPTION_ARG_INT, &numPictures, "Pictures to decode", NULL },
+        { "dpb-size", 's', 0, G_OPTION_ARG_INT, &dpbSize, "Frames in the DPB", NULL },
+        { NULL }
+    };
+
+    ctx = g_option_context_new("- DPB reference marking microbenchmark");
+    g_option_context_add_main_entries(ctx, entries, NULL);
+    g_option_context_add_group(ctx, gst_init_get_option_group());
+
+    if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+        ERR("Error initializing: %s", err->message);
+        g_option_context_free(ctx);
+        g_clear_error(&err);
+        exit(EXIT_FAILURE);
+    }
+
+    g_option_context_free(ctx);
+
+    if (numPictures <= 0 || dpbSize < 4 || dpbSize > GST_H264_DPB_MAX_SIZE) {
+        ERR("Invalid number of pictures or DPB size.");
+        exit(EXIT_FAILURE);
+    }
+
+    // registers the debug category the DPB logs to
+    g_type_ensure(GST_TYPE_H264_DECODER);
+
+    dpb = gst_h264_dpb_new();
+    gst_h264_dpb_set_max_num_frames(dpb, dpbSize);
+    gst_h264_dpb_set_max_num_reorder_frames(dpb, 3);
+
+    start = g_get_monotonic_time();
+
+    for (gint n = 0; n < numPictures; n++) {
+        GstH264Picture* picture = gst_h264_picture_new();
+        GstH264Picture* out;
+
+        picture->frame_num = n % maxFrameNum;
+        picture->pic_num = picture->frame_num;
+        picture->frame_num_wrap = picture->frame_num;
+        picture->pic_order_cnt = picture_order_count(n);
+        picture->top_field_order_cnt = picture->pic_order_cnt;
+        picture->bottom_field_order_cnt = picture->pic_order_cnt;
+        picture->nal_ref_idc = 1;
+        picture->ref_pic = TRUE;
+
+        update_pic_nums(dpb, picture->frame_num);
+        failed += mark_references(dpb, picture, dpbSize);
+        gst_h264_picture_set_reference(picture, GST_H264_PICTURE_REF_SHORT_TERM, FALSE);
+
+        gst_h264_dpb_delete_unused(dpb);
+        while (gst_h264_dpb_needs_bump(dpb, picture, GST_H264_DPB_BUMP_NORMAL_LATENCY)) {
+            out = gst_h264_dpb_bump(dpb, FALSE);
+            if (!out)
+                break;
+            gst_h264_picture_unref(out);
+            output++;
+        }
+
+        gst_h264_dpb_add(dpb, picture);
+    }
+
+    for (GstH264Picture* out; (out = gst_h264_dpb_bump(dpb, TRUE));) {
+        gst_h264_picture_unref(out);
+        output++;
+    }
+
+    elapsed = g_get_monotonic_time() - start;
+
+    gst_h264_dpb_free(dpb);
+
+    INFO("%d pictures, %d frames DPB: %.1f ns per picture", numPictures, dpbSize,
+        elapsed * 1000.0 / numPictures);
+
+    if (failed > 0) {
+        ERR("%u memory management control operations failed", failed);
+        return EXIT_FAILURE;
+    }
+
+    if (output != static_cast<guint>(numPictures)) {
+        ERR("%u pictures output, expected %d", output, numPictures);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,166 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Compares splitting big intra access units in NAL units with the
+// codecparsers, as the decoder base classes used to do, against
+// gst_codec_nal_table_fill(). GST_CODEC_NAL_IMPL=scalar|sse2|sse4.2|avx2|neon
+// forces the start code scanning implementation.
+
+#include <gst/codecparsers/gsth264parser.h>
+#include <vector>
+
+#include "gstcodecnal.h"
+#include "utils.h"
+
+// An IDR access unit, with AUD, SPS, PPS and slices of random data, with
+// emulation prevention bytes where needed.
+static std::vector<guint8> make_access_unit(gsize size, gint slices, GRand* rand)
+{
+    static const guint8 headers[] = {
+        0x00, 0x00, 0x00, 0x01, 0x09, 0x10,
+        0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x33, 0xac, 0x2b, 0x40, 0x3c,
+        0x00, 0x00, 0x00, 0x01, 0x68, 0xee, 0x3c, 0xb0,
+    };
+    std::vector<guint8> au(headers, headers + sizeof(headers));
+
+    au.reserve(size + size / 64);
+
+    for (gint i = 0; i < slices; i++) {
+        static const guint8 slice[] = { 0x00, 0x00, 0x01, 0x65, 0x88 };
+        gsize end = au.size() + size / slices;
+        guint zeros = 0;
+
+        au.insert(au.end(), slice, slice + sizeof(slice));
+
+        while (au.size() < end) {
+            // residual data has plenty of zeros
+            guint8 byte = (g_rand_int_range(rand, 0, 8) == 0) ? 0 : g_rand_int(rand);
+
+            if (zeros >= 2 && byte <= 3) {
+                au.push_back(0x03);
+                zeros = 0;
+            }
+            au.push_back(byte);
+            zeros = byte ? 0 : zeros + 1;
+        }
+        // rbsp_stop_one_bit
+        au.push_back(0x80);
+    }
+
+    return au;
+}
+
+static guint parse_identify(GstH264NalParser* parser, const std::vector<guint8>& au)
+{
+    GstH264NalUnit nalu;
+    GstH264ParserResult pres;
+    guint count = 0;
+
+    pres = gst_h264_parser_identify_nalu(parser, au.data(), 0, au.size(), &nalu);
+    while (pres == GST_H264_PARSER_OK || pres == GST_H264_PARSER_NO_NAL_END) {
+        count++;
+        if (pres == GST_H264_PARSER_NO_NAL_END)
+            break;
+        pres = gst_h264_parser_identify_nalu(parser, au.data(), nalu.offset + nalu.size, au.size(), &nalu);
+    }
+
+    return count;
+}
+
+static guint parse_table(GstH264NalParser* parser, GArray* table, const std::vector<guint8>& au)
+{
+    GstH264NalUnit nalu;
+    guint count = 0;
+    guint n_nals = gst_codec_nal_table_fill(table, au.data(), au.size());
+
+    for (guint i = 0; i < n_nals; i++) {
+        const GstCodecNal* nal = &g_array_index(table, GstCodecNal, i);
+
+        if (gst_h264_parser_identify_nalu_unchecked(parser, au.data(), nal->sc_offset, nal->end, &nalu) == GST_H264_PARSER_OK)
+            count++;
+    }
+
+    return count;
+}
+
+int main(int argc, char** argv)
+{
+    GOptionContext* ctx;
+    GError* err = NULL;
+    gint size_mb = 8, slices = 4, iterations = 20;
+    GstH264NalParser* parser;
+    GArray* table;
+    GRand* rand;
+    gint64 start, identify_time, table_time;
+    guint identify_count = 0, table_count = 0;
+
+    GOptionEntry entries[] = {
+        { "size", 's', 0, G_OPTION_ARG_INT, &size_mb, "Access unit size, in MB", NULL },
+        { "slices", 'l', 0, G_OPTION_ARG_INT, &slices, "Slices per access unit", NULL },
+        { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Times to parse the access unit", NULL },
+        { NULL }
+    };
+
+    ctx = g_option_context_new("- NAL unit splitting microbenchmark");
+    g_option_context_add_main_entries(ctx, entries, NULL);
+
+    if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+        ERR("Error initializing: %s", err->message);
+        g_option_context_free(ctx);
+        g_clear_error(&err);
+        exit(EXIT_FAILURE);
+    }
+
+    g_option_context_free(ctx);
+
+    if (size_mb <= 0 || slices <= 0 || iterations <= 0) {
+        ERR("Invalid size, slices or iterations.");
+        exit(EXIT_FAILURE);
+    }
+
+    rand = g_rand_new_with_seed(0x264);
+    std::vector<guint8> au = make_access_unit((gsize)size_mb << 20, slices, rand);
+    g_rand_free(rand);
+
+    parser = gst_h264_nal_parser_new();
+    table = g_array_new(FALSE, FALSE, sizeof(GstCodecNal));
+
+    start = g_get_monotonic_time();
+    for (gint i = 0; i < iterations; i++)
+        identify_count = parse_identify(parser, au);
+    identify_time = g_get_monotonic_time() - start;
+
+    start = g_get_monotonic_time();
+    for (gint i = 0; i < iterations; i++)
+        table_count = parse_table(parser, table, au);
+    table_time = g_get_monotonic_time() - start;
+
+    INFO("%.2f MB access unit, %u NAL units", au.size() / 1048576.0, table_count);
+    INFO("  identify_nalu: %.2f MB/s", (au.size() * (gdouble)iterations) / identify_time);
+    INFO("  %s table: %.2f MB/s (%.2fx)", gst_codec_nal_get_impl_name(),
+        (au.size() * (gdouble)iterations) / table_time, (gdouble)identify_time / table_time);
+
+    g_array_unref(table);
+    gst_h264_nal_parser_free(parser);
+
+    if (identify_count != table_count) {
+        ERR("NAL unit count mismatch: %u != %u", identify_count, table_count);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
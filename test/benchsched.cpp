@@ -0,0 +1,188 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Feeds from a single thread, as a network thread would, one access unit
+// at a time to each of 1, 2, 4... streams, and reports how many pictures
+// per second get parsed and the time that thread spends in
+// ParseByteStream(), with the streams on the shared scheduler, on a thread
+// each, or parsed by the caller.
+
+#include <memory>
+
+#include "h264writer.h"
+#include "testclient.h"
+
+// Callbacks of a stream aren't called concurrently, but from any thread.
+class StreamClient : public TestClient {
+public:
+    StreamClient()
+        : TestClient(17)
+    {
+    }
+
+    bool DecodePicture(VkParserPictureData*) final
+    {
+        m_decoded++;
+        return true;
+    }
+
+    int decoded() const { return m_decoded; }
+
+private:
+    int m_decoded = 0;
+};
+
+enum Mode {
+    SHARED,
+    DEDICATED,
+    CALLER,
+};
+
+struct BenchOptions {
+    gint maxStreams;
+    gint frames;
+    gint threads;
+    gboolean affinity;
+    Mode mode;
+};
+
+static bool run(const BenchOptions& opts, const std::vector<std::vector<uint8_t>>& aus, int numStreams)
+{
+    std::vector<std::unique_ptr<StreamClient>> clients;
+    std::vector<VulkanVideoDecodeParser*> parsers;
+    gint64 start, elapsed, blocked = 0;
+    int32_t parsed;
+    int decoded = 0;
+    bool ret = true;
+
+    for (int i = 0; i < numStreams; i++) {
+        VulkanVideoDecodeParser* parser;
+
+        clients.emplace_back(new StreamClient());
+
+        VkParserInitDecodeParameters params = {
+            .bOutOfBandPictureParameters = true,
+            .bDirectDrive = true,
+            .nAsyncQueueDepth = opts.mode == CALLER ? 0u : 4u,
+            .bSharedScheduler = opts.mode == SHARED,
+        };
+
+        parser = create_h264_parser(clients.back().get(), params);
+        if (!parser) {
+            ret = false;
+            break;
+        }
+
+        parsers.push_back(parser);
+    }
+
+    start = g_get_monotonic_time();
+
+    for (size_t i = 0; i < aus.size() && ret; i++) {
+        for (auto parser : parsers) {
+            VkParserBitstreamPacket pkt = {
+                .pByteStream = aus[i].data(),
+                .nDataLength = static_cast<int32_t>(aus[i].size()),
+                .bEOS = i == aus.size() - 1,
+            };
+            gint64 call = g_get_monotonic_time();
+
+            if (!parser->ParseByteStream(&pkt, &parsed)) {
+                ERR("failed to parse bitstream.");
+                ret = false;
+                break;
+            }
+
+            blocked += g_get_monotonic_time() - call;
+        }
+    }
+
+    elapsed = g_get_monotonic_time() - start;
+
+    for (auto parser : parsers)
+        destroy_parser(parser);
+
+    for (auto& client : clients)
+        decoded += client->decoded();
+
+    INFO("%4d streams: %.3f s, %.1f pictures/s, %.3f s in ParseByteStream() (%.1f us per call)",
+        numStreams, elapsed / 1e6, decoded * 1e6 / elapsed, blocked / 1e6,
+        static_cast<gdouble>(blocked) / (numStreams * aus.size()));
+
+    if (ret && decoded != numStreams * static_cast<int>(aus.size())) {
+        ERR("%d pictures decoded, expected %d", decoded, numStreams * static_cast<int>(aus.size()));
+        ret = false;
+    }
+
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    gboolean dedicated = FALSE, caller = FALSE;
+    BenchOptions opts = {
+        .maxStreams = 512,
+        .frames = 120,
+        .threads = 0,
+        .affinity = FALSE,
+        .mode = SHARED,
+    };
+    std::vector<std::vector<uint8_t>> aus;
+
+    GOptionEntry entries[] = {
+        { "max-streams", 's', 0, G_OPTION_ARG_INT, &opts.maxStreams, "Streams of the last run", NULL },
+        { "frames", 'n', 0, G_OPTION_ARG_INT, &opts.frames, "Pictures per stream", NULL },
+        { "threads", 't', 0, G_OPTION_ARG_INT, &opts.threads, "Scheduler threads, 0 for one per CPU", NULL },
+        { "affinity", 'a', 0, G_OPTION_ARG_NONE, &opts.affinity, "Bind every scheduler thread to a CPU", NULL },
+        { "dedicated", 'd', 0, G_OPTION_ARG_NONE, &dedicated, "Parse every stream on a thread of its own", NULL },
+        { "caller", 'c', 0, G_OPTION_ARG_NONE, &caller, "Parse on the feeding thread", NULL },
+        { NULL }
+    };
+
+    parse_options(&argc, &argv, "- multi-stream scheduler benchmark", entries);
+
+    if (opts.maxStreams <= 0 || opts.frames <= 0 || opts.threads < 0) {
+        ERR("Invalid number of streams, frames or threads.");
+        exit(EXIT_FAILURE);
+    }
+
+    if (dedicated)
+        opts.mode = DEDICATED;
+    else if (caller)
+        opts.mode = CALLER;
+
+    ConfigureVulkanVideoDecodeParserScheduler(opts.threads, opts.affinity);
+
+    // groups of an IDR and 7 P pictures
+    for (int i = 0; i < opts.frames; i++) {
+        std::vector<uint8_t> au;
+
+        if (i % 8 == 0) {
+            write_sps(au);
+            write_pps(au);
+        }
+        write_slice({ i % 8, i % 8 ? 'P' : 'I' }, i % 8, (i / 8) % 2, au);
+        aus.push_back(std::move(au));
+    }
+
+    for (int streams = 1; streams <= opts.maxStreams; streams *= 2) {
+        if (!run(opts, aus, streams))
+            return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -24,6 +24,19 @@
 static int indent_depth = 0;
 static int indent_size = 4;
 static bool pretty_print = true;
+static FILE *output = NULL;
+
+void
+dump_set_output (FILE * file)
+{
+  output = file;
+}
+
+static FILE *
+out (void)
+{
+  return output ? output : stdout;
+}
 
 static void
 print_indent (void)
@@ -33,23 +46,23 @@ print_indent (void)
   int i, j;
   for (i = 0; i < indent_depth; i++)
     for (j = 0; j < indent_size; j++)
-      putchar (' ');
+      fputc (' ', out ());
 }
 
 static void
 print_newline (void)
 {
   if (pretty_print)
-    printf ("\n");
+    fprintf (out (), "\n");
 }
 
 static void
 print_tag (const char *tag)
 {
   if (tag) {
-    printf ("\"%s\":", tag);
+    fprintf (out (), "\"%s\":", tag);
     if (pretty_print)
-      printf (" ");
+      fprintf (out (), " ");
   }
 }
 
@@ -58,7 +71,7 @@ start_array (const char *tag)
 {
   print_indent ();
   print_tag (tag);
-  printf ("[");
+  fprintf (out (), "[");
   print_newline ();
   ++indent_depth;
 }
@@ -68,7 +81,7 @@ end_array (void)
 {
   --indent_depth;
   print_indent ();
-  printf ("],");
+  fprintf (out (), "],");
   print_newline ();
 }
 
@@ -77,7 +90,7 @@ start_object (const char *tag)
 {
   print_indent ();
   print_tag (tag);
-  printf ("{");
+  fprintf (out (), "{");
   print_newline ();
   ++indent_depth;
 }
@@ -87,7 +100,7 @@ end_object (void)
 {
   --indent_depth;
   print_indent ();
-  printf ("},");
+  fprintf (out (), "},");
   print_newline ();
 }
 
@@ -96,7 +109,7 @@ print_boolean (const char *tag, bool value)
 {
   print_indent ();
   print_tag (tag);
-  printf ("%s,", value ? "true" : "false");
+  fprintf (out (), "%s,", value ? "true" : "false");
   print_newline ();
 }
 
@@ -105,7 +118,7 @@ print_integer (const char *tag, int64_t value)
 {
   print_indent ();
   print_tag (tag);
-  printf ("%" PRId64 ",", value);
+  fprintf (out (), "%" PRId64 ",", value);
   print_newline ();
 }
 
@@ -115,7 +128,7 @@ print_double (const char *tag, double value)
 {
   print_indent ();
   print_tag (tag);
-  printf ("%lg,", value);
+  fprintf (out (), "%lg,", value);
   print_newline ();
 }
 #endif
@@ -125,14 +138,14 @@ print_string (const char *tag, const char *format, ...)
 {
   print_indent ();
   print_tag (tag);
-  printf ("\"");
+  fprintf (out (), "\"");
 
   va_list args;
   va_start (args, format);
-  vfprintf (stdout, format, args);
+  vfprintf (out (), format, args);
   va_end (args);
 
-  printf ("\",");
+  fprintf (out (), "\",");
   print_newline ();
 }
 
@@ -145,7 +158,7 @@ print_hex (const char *tag, const uint8_t * buf, unsigned size)
   print_tag (tag);
 
   for (unsigned i = 0; i < MIN (20, size); i++)
-    printf (" %02x", buf[i]);
+    fprintf (out (), " %02x", buf[i]);
 
   print_newline ();
 }
@@ -17,8 +17,13 @@
 
 #pragma once
 
+#include <cstdio>
+
 #include <VulkanVideoParserIf.h>
 
+// Where the functions below print, stdout if NULL, the default.
+void dump_set_output(FILE*);
+
 void dump_parser_sequence_info(const struct VkParserSequenceInfo*);
 void dump_parser_picture_data(VkVideoCodecOperationFlagBitsKHR codec, struct VkParserPictureData*);
 void dump_picture_parameters(struct VkPictureParameters*);
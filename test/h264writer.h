@@ -0,0 +1,168 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Synthesizes tiny H.264 streams: 32x32 Main profile, POC type 0, CAVLC,
+// with a single slice per picture whose macroblock data is just filler, so
+// only headers are parsed.
+
+#pragma once
+
+#include <glib.h>
+
+#include <cstdint>
+#include <vector>
+
+class BitWriter {
+public:
+    void PutBits(uint32_t value, int n)
+    {
+        while (n-- > 0) {
+            m_byte = (m_byte << 1) | ((value >> n) & 1);
+            if (++m_bits == 8)
+                Flush();
+        }
+    }
+
+    void PutUe(uint32_t value)
+    {
+        int n = g_bit_storage(value + 1);
+
+        PutBits(0, n - 1);
+        PutBits(value + 1, n);
+    }
+
+    void PutSe(int32_t value)
+    {
+        PutUe(value > 0 ? 2 * value - 1 : -2 * value);
+    }
+
+    // rbsp_trailing_bits, and the NAL unit with emulation prevention
+    void FinishNal(uint8_t header, std::vector<uint8_t>& out)
+    {
+        guint zeros = 0;
+
+        PutBits(1, 1);
+        while (m_bits)
+            PutBits(0, 1);
+
+        out.insert(out.end(), { 0x00, 0x00, 0x00, 0x01, header });
+        for (uint8_t byte : m_rbsp) {
+            if (zeros >= 2 && byte <= 3) {
+                out.push_back(0x03);
+                zeros = 0;
+            }
+            out.push_back(byte);
+            zeros = byte ? 0 : zeros + 1;
+        }
+        m_rbsp.clear();
+    }
+
+private:
+    void Flush()
+    {
+        m_rbsp.push_back(m_byte);
+        m_byte = 0;
+        m_bits = 0;
+    }
+
+    std::vector<uint8_t> m_rbsp;
+    uint8_t m_byte = 0;
+    int m_bits = 0;
+};
+
+struct Frame {
+    int display;
+    char type;
+};
+
+static inline void write_sps(std::vector<uint8_t>& out)
+{
+    BitWriter bw;
+
+    bw.PutBits(77, 8); // profile_idc
+    bw.PutBits(0, 8); // constraint flags
+    bw.PutBits(30, 8); // level_idc
+    bw.PutUe(0); // seq_parameter_set_id
+    bw.PutUe(0); // log2_max_frame_num_minus4
+    bw.PutUe(0); // pic_order_cnt_type
+    bw.PutUe(2); // log2_max_pic_order_cnt_lsb_minus4
+    bw.PutUe(2); // max_num_ref_frames
+    bw.PutBits(0, 1); // gaps_in_frame_num_value_allowed_flag
+    bw.PutUe(1); // pic_width_in_mbs_minus1
+    bw.PutUe(1); // pic_height_in_map_units_minus1
+    bw.PutBits(1, 1); // frame_mbs_only_flag
+    bw.PutBits(1, 1); // direct_8x8_inference_flag
+    bw.PutBits(0, 1); // frame_cropping_flag
+    bw.PutBits(0, 1); // vui_parameters_present_flag
+    bw.FinishNal(0x67, out);
+}
+
+static inline void write_pps(std::vector<uint8_t>& out, int picInitQpMinus26 = 0)
+{
+    BitWriter bw;
+
+    bw.PutUe(0); // pic_parameter_set_id
+    bw.PutUe(0); // seq_parameter_set_id
+    bw.PutBits(0, 1); // entropy_coding_mode_flag
+    bw.PutBits(0, 1); // bottom_field_pic_order_in_frame_present_flag
+    bw.PutUe(0); // num_slice_groups_minus1
+    bw.PutUe(0); // num_ref_idx_l0_default_active_minus1
+    bw.PutUe(0); // num_ref_idx_l1_default_active_minus1
+    bw.PutBits(0, 1); // weighted_pred_flag
+    bw.PutBits(0, 2); // weighted_bipred_idc
+    bw.PutSe(picInitQpMinus26); // pic_init_qp_minus26
+    bw.PutSe(0); // pic_init_qs_minus26
+    bw.PutSe(0); // chroma_qp_index_offset
+    bw.PutBits(1, 1); // deblocking_filter_control_present_flag
+    bw.PutBits(0, 1); // constrained_intra_pred_flag
+    bw.PutBits(0, 1); // redundant_pic_cnt_present_flag
+    bw.FinishNal(0x68, out);
+}
+
+// frame.display is the POC, counting from the last IDR
+static inline void write_slice(const Frame& frame, int frameNum, int idrPicId, std::vector<uint8_t>& out)
+{
+    BitWriter bw;
+    bool idr = frame.type == 'I';
+    bool ref = frame.type != 'B';
+
+    bw.PutUe(0); // first_mb_in_slice
+    bw.PutUe(idr ? 7 : frame.type == 'P' ? 5 : 6); // slice_type
+    bw.PutUe(0); // pic_parameter_set_id
+    bw.PutBits(frameNum, 4); // frame_num
+    if (idr)
+        bw.PutUe(idrPicId); // idr_pic_id
+    bw.PutBits(2 * frame.display, 6); // pic_order_cnt_lsb
+    if (frame.type == 'B')
+        bw.PutBits(1, 1); // direct_spatial_mv_pred_flag
+    if (!idr) {
+        bw.PutBits(0, 1); // num_ref_idx_active_override_flag
+        bw.PutBits(0, 1); // ref_pic_list_modification_flag_l0
+        if (frame.type == 'B')
+            bw.PutBits(0, 1); // ref_pic_list_modification_flag_l1
+    }
+    if (idr) {
+        bw.PutBits(0, 1); // no_output_of_prior_pics_flag
+        bw.PutBits(0, 1); // long_term_reference_flag
+    } else if (ref) {
+        bw.PutBits(0, 1); // adaptive_ref_pic_marking_mode_flag
+    }
+    bw.PutSe(0); // slice_qp_delta
+    bw.PutUe(1); // disable_deblocking_filter_idc
+    bw.PutBits(0x5a5a5a5a, 32); // slice_data()
+    bw.FinishNal(idr ? 0x65 : ref ? 0x41 : 0x01, out);
+}
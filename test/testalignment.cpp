@@ -0,0 +1,193 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Parses a sample with nBitstreamOffsetAlignment and
+// nBitstreamSizeAlignment, as minBitstreamBufferOffsetAlignment and
+// minBitstreamBufferSizeAlignment of a device might be, and checks every
+// pBitstreamData is aligned, nBitstreamDataLen is the slices rounded up to a
+// multiple of the size alignment, with zeros in between, and the slices are
+// those without alignment. Also that the parser doesn't initialize with an
+// offset alignment other than a power of two.
+
+#include <cstring>
+#include <vector>
+
+#include "testclient.h"
+
+struct PictureBitstream {
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> offsets;
+};
+
+class AlignmentClient : public TestClient {
+public:
+    // 0 being no alignment
+    AlignmentClient(uint32_t offsetAlignment, uint32_t sizeAlignment)
+        : m_offsetAlignment(std::max(offsetAlignment, 1u))
+        , m_sizeAlignment(std::max(sizeAlignment, 1u))
+    {
+    }
+
+    bool DecodePicture(VkParserPictureData* pic) final
+    {
+        size_t index = m_pictures.size();
+        uint32_t size = pic->pSliceDataOffsets[pic->nNumSlices];
+        uint32_t padded = (size + m_sizeAlignment - 1) / m_sizeAlignment * m_sizeAlignment;
+
+        if (reinterpret_cast<uintptr_t>(pic->pBitstreamData) % m_offsetAlignment != 0) {
+            ERR("picture %zu: bitstream data at %p, not aligned to %u", index, pic->pBitstreamData, m_offsetAlignment);
+            m_errors++;
+        }
+
+        if (pic->nBitstreamDataLen != padded) {
+            ERR("picture %zu: %u bytes of bitstream data for %u of slices, expected %u", index,
+                pic->nBitstreamDataLen, size, padded);
+            m_errors++;
+        } else {
+            for (uint32_t i = size; i < padded; i++) {
+                if (pic->pBitstreamData[i] != 0) {
+                    ERR("picture %zu: padding byte %u is 0x%02x", index, i, pic->pBitstreamData[i]);
+                    m_errors++;
+                    break;
+                }
+            }
+        }
+
+        m_pictures.push_back({ std::vector<uint8_t>(pic->pBitstreamData, pic->pBitstreamData + size),
+            std::vector<uint32_t>(pic->pSliceDataOffsets, pic->pSliceDataOffsets + pic->nNumSlices + 1) });
+
+        return true;
+    }
+
+    const std::vector<PictureBitstream>& pictures() const { return m_pictures; }
+    int errors() const { return m_errors; }
+
+private:
+    uint32_t m_offsetAlignment;
+    uint32_t m_sizeAlignment;
+    std::vector<PictureBitstream> m_pictures;
+    int m_errors = 0;
+};
+
+// The bitstream of every picture of stream, empty on failure.
+static std::vector<PictureBitstream> parse(VkVideoCodecOperationFlagBitsKHR codec, const std::vector<uint8_t>& stream,
+    bool direct, uint32_t offsetAlignment, uint32_t sizeAlignment)
+{
+    VulkanVideoDecodeParser* parser;
+    AlignmentClient client(offsetAlignment, sizeAlignment);
+    VkParserInitDecodeParameters params = {
+        .bOutOfBandPictureParameters = true,
+        .bDirectDrive = direct,
+        .nBitstreamOffsetAlignment = offsetAlignment,
+        .nBitstreamSizeAlignment = sizeAlignment,
+    };
+    bool ret = true;
+
+    parser = create_parser(codec, &client, params);
+    if (!parser) {
+        ERR("failed to create the parser aligning to %u and %u", offsetAlignment, sizeAlignment);
+        return {};
+    }
+
+    if (!parse_packet(parser, stream.data(), stream.size(), true)) {
+        ERR("failed to parse bitstream.");
+        ret = false;
+    }
+
+    destroy_parser(parser);
+
+    if (!ret || client.errors() > 0)
+        return {};
+
+    return client.pictures();
+}
+
+// Whether the parser initializes with the offset alignment.
+static bool initializes(VkVideoCodecOperationFlagBitsKHR codec, uint32_t offsetAlignment)
+{
+    TestClient client;
+    VkParserInitDecodeParameters params = {
+        .bOutOfBandPictureParameters = true,
+        .nBitstreamOffsetAlignment = offsetAlignment,
+    };
+    VulkanVideoDecodeParser* parser = create_parser(codec, &client, params);
+
+    if (!parser)
+        return false;
+
+    destroy_parser(parser);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    VkVideoCodecOperationFlagBitsKHR codec = VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_EXT;
+    gchar* codecName = NULL;
+    gboolean direct = FALSE;
+    bool ret = true;
+
+    GOptionEntry entries[] = {
+        { "codec", 'c', 0, G_OPTION_ARG_STRING, &codecName, "Codec of the sample, h264 or h265", NULL },
+        { "direct", 'd', 0, G_OPTION_ARG_NONE, &direct, "Drive the decoder without a pipeline", NULL },
+        { NULL }
+    };
+
+    parse_options(&argc, &argv, "FILE - BITSTREAM ALIGNMENT TEST", entries);
+
+    if (codecName && strcmp(codecName, "h265") == 0)
+        codec = VK_VIDEO_CODEC_OPERATION_DECODE_H265_BIT_EXT;
+    g_free(codecName);
+
+    if (argc != 2) {
+        ERR("Please provide one filename.");
+        return EXIT_FAILURE;
+    }
+
+    for (uint32_t offsetAlignment : { 3, 48, 257 }) {
+        if (initializes(codec, offsetAlignment)) {
+            ERR("the parser initialized with an offset alignment of %u", offsetAlignment);
+            ret = false;
+        }
+    }
+
+    std::vector<uint8_t> stream = read_file(argv[1]);
+    if (stream.empty())
+        return EXIT_FAILURE;
+
+    std::vector<PictureBitstream> unaligned = parse(codec, stream, direct, 0, 0);
+    std::vector<PictureBitstream> aligned = parse(codec, stream, direct, 256, 64);
+
+    if (unaligned.empty() || aligned.empty())
+        return EXIT_FAILURE;
+
+    if (aligned.size() != unaligned.size()) {
+        ERR("%zu pictures decoded aligned, %zu unaligned", aligned.size(), unaligned.size());
+        ret = false;
+    } else {
+        for (size_t i = 0; i < aligned.size(); i++) {
+            if (aligned[i].data != unaligned[i].data || aligned[i].offsets != unaligned[i].offsets) {
+                ERR("the slices of picture %zu differ when aligned", i);
+                ret = false;
+            }
+        }
+    }
+
+    if (ret)
+        INFO("%zu pictures aligned to 256 and padded to 64", aligned.size());
+
+    return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,315 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Feeds an H.264 stream with B-frames through an asynchronous parser with a
+// short queue, from a buffer trashed after every call, and checks the
+// callbacks come from another thread, in order, and are all done once the
+// packet with bEOS is taken. Then seeks, with and without the queue: the
+// stream is cut in the middle of a group of pictures and of an access
+// unit, the parser flushed discarding, and a new group fed. Nothing from
+// before may be displayed or referenced afterwards.
+
+#include <set>
+#include <string>
+
+#include "h264writer.h"
+#include "testclient.h"
+
+static const uint32_t queueDepth = 2;
+
+class AsyncClient : public TestClient {
+public:
+    AsyncClient()
+        : m_caller(g_thread_self())
+    {
+    }
+
+    int32_t BeginSequence(const VkParserSequenceInfo* info) final
+    {
+        CheckThread();
+        return TestClient::BeginSequence(info);
+    }
+
+    bool DecodePicture(VkParserPictureData*) final
+    {
+        CheckThread();
+        m_decoded++;
+        return true;
+    }
+
+    bool DisplayPicture(VkPicIf*, int64_t timestamp) final
+    {
+        CheckThread();
+        m_timestamps.push_back(timestamp);
+        return true;
+    }
+
+    int decoded() const { return m_decoded; }
+    int wrongThread() const { return m_wrongThread; }
+    const std::vector<int64_t>& timestamps() const { return m_timestamps; }
+
+private:
+    void CheckThread()
+    {
+        if (g_thread_self() == m_caller)
+            m_wrongThread++;
+    }
+
+    GThread* m_caller;
+    std::vector<int64_t> m_timestamps;
+    int m_decoded = 0;
+    int m_wrongThread = 0;
+};
+
+// decode order of I0 P3 B1 B2 P6 B4 B5 ...
+static const Frame frames[] = {
+    { 0, 'I' },
+    { 3, 'P' }, { 1, 'B' }, { 2, 'B' },
+    { 6, 'P' }, { 4, 'B' }, { 5, 'B' },
+    { 9, 'P' }, { 7, 'B' }, { 8, 'B' },
+    { 12, 'P' }, { 10, 'B' }, { 11, 'B' },
+};
+
+// the access unit of frames[i], with the parameter sets first
+static std::vector<uint8_t> make_access_unit(size_t i, int frameNum, int idrPicId)
+{
+    std::vector<uint8_t> au;
+
+    if (i == 0) {
+        write_sps(au);
+        write_pps(au);
+    }
+    write_slice(frames[i], frameNum, idrPicId, au);
+
+    return au;
+}
+
+static bool run(bool direct)
+{
+    const char* mode = direct ? "direct" : "harness";
+    VulkanVideoDecodeParser* parser;
+    AsyncClient client;
+    VkParserInitDecodeParameters params = {
+        .bOutOfBandPictureParameters = true,
+        .bDirectDrive = direct,
+        .nAsyncQueueDepth = queueDepth,
+    };
+    int frameNum = 0;
+    bool ret = true;
+
+    parser = create_h264_parser(&client, params);
+    if (!parser)
+        return false;
+
+    for (size_t i = 0; i < G_N_ELEMENTS(frames); i++) {
+        std::vector<uint8_t> au = make_access_unit(i, frameNum, 0);
+
+        if (!parse_packet(parser, au.data(), au.size(), i == G_N_ELEMENTS(frames) - 1, true, frames[i].display)) {
+            ERR("failed to parse bitstream.");
+            ret = false;
+            break;
+        }
+
+        // the queued copy has to be used
+        std::fill(au.begin(), au.end(), 0xff);
+
+        if (frames[i].type != 'B')
+            frameNum = (frameNum + 1) % 16;
+
+        if (i == G_N_ELEMENTS(frames) / 2 && !FlushVulkanVideoDecodeParser(parser, false)) {
+            ERR("%s: flush failed", mode);
+            ret = false;
+        }
+    }
+
+    // nothing may come after the end of the stream
+    int decoded = client.decoded();
+    size_t displayed = client.timestamps().size();
+
+    destroy_parser(parser);
+
+    if (decoded != static_cast<int>(G_N_ELEMENTS(frames)) || displayed != G_N_ELEMENTS(frames)) {
+        ERR("%s: %d pictures decoded and %zu displayed by the end of the stream, expected %zu",
+            mode, decoded, displayed, G_N_ELEMENTS(frames));
+        ret = false;
+    }
+
+    const std::vector<int64_t>& timestamps = client.timestamps();
+
+    for (size_t i = 0; i < timestamps.size(); i++) {
+        if (timestamps[i] != static_cast<int64_t>(i)) {
+            ERR("%s: picture %zu displayed with timestamp %" G_GINT64_FORMAT ", expected %zu",
+                mode, i, timestamps[i], i);
+            ret = false;
+        }
+    }
+
+    if (client.wrongThread() > 0) {
+        ERR("%s: %d callbacks from the caller's thread", mode, client.wrongThread());
+        ret = false;
+    }
+
+    return ret;
+}
+
+// Tells apart what comes before and after a seek.
+class SeekClient : public TestClient {
+public:
+    bool DecodePicture(VkParserPictureData* pic) final
+    {
+        if (!m_seeked)
+            return true;
+
+        for (const VkParserH264DpbEntry& entry : pic->CodecSpecific.h264.dpb) {
+            if (entry.pPicBuf && m_decoded.count(entry.pPicBuf) == 0)
+                m_staleReferences++;
+        }
+        m_decoded.insert(pic->pCurrPic);
+
+        return true;
+    }
+
+    bool DisplayPicture(VkPicIf*, int64_t timestamp) final
+    {
+        if (m_seeked)
+            m_timestamps.push_back(timestamp);
+        return true;
+    }
+
+    void Seeked() { m_seeked = true; }
+
+    size_t decoded() const { return m_decoded.size(); }
+    int staleReferences() const { return m_staleReferences; }
+    const std::vector<int64_t>& timestamps() const { return m_timestamps; }
+
+private:
+    bool m_seeked = false;
+    // the pictures decoded since the seek, the only ones to reference
+    std::set<VkPicIf*> m_decoded;
+    std::vector<int64_t> m_timestamps;
+    int m_staleReferences = 0;
+};
+
+static bool seek(bool direct, uint32_t depth)
+{
+    // B4, the access unit cut in the middle
+    static const size_t cut = 5;
+    // the timestamps of the pictures fed after the seek start here
+    static const int64_t seekTimestamp = 100;
+    std::string mode = std::string(direct ? "direct" : "harness") + (depth ? ", async" : "");
+    VulkanVideoDecodeParser* parser;
+    SeekClient client;
+    VkParserInitDecodeParameters params = {
+        .bOutOfBandPictureParameters = true,
+        .bDirectDrive = direct,
+        .nAsyncQueueDepth = depth,
+    };
+    int frameNum = 0;
+    bool ret = true;
+
+    parser = create_h264_parser(&client, params);
+    if (!parser)
+        return false;
+
+    for (size_t i = 0; i <= cut && ret; i++) {
+        std::vector<uint8_t> au = make_access_unit(i, frameNum, 0);
+        size_t size = i < cut ? au.size() : au.size() / 2;
+
+        if (!parse_packet(parser, au.data(), size, false, true, frames[i].display)) {
+            ERR("%s: failed to parse bitstream before seeking.", mode.c_str());
+            ret = false;
+        }
+
+        if (frames[i].type != 'B')
+            frameNum = (frameNum + 1) % 16;
+    }
+
+    if (!FlushVulkanVideoDecodeParser(parser, true)) {
+        ERR("%s: flush failed", mode.c_str());
+        ret = false;
+    }
+
+    if (client.PicturesInUse() > 0) {
+        ERR("%s: %zu pictures still held after flushing", mode.c_str(), client.PicturesInUse());
+        ret = false;
+    }
+
+    client.Seeked();
+    frameNum = 0;
+
+    for (size_t i = 0; i < G_N_ELEMENTS(frames) && ret; i++) {
+        std::vector<uint8_t> au = make_access_unit(i, frameNum, 1);
+
+        if (!parse_packet(parser, au.data(), au.size(), i == G_N_ELEMENTS(frames) - 1, true,
+                seekTimestamp + frames[i].display)) {
+            ERR("%s: failed to parse bitstream after seeking.", mode.c_str());
+            ret = false;
+        }
+
+        if (frames[i].type != 'B')
+            frameNum = (frameNum + 1) % 16;
+    }
+
+    destroy_parser(parser);
+
+    if (client.decoded() != G_N_ELEMENTS(frames)) {
+        ERR("%s: %zu pictures decoded after seeking, expected %zu", mode.c_str(), client.decoded(),
+            G_N_ELEMENTS(frames));
+        ret = false;
+    }
+
+    if (client.staleReferences() > 0) {
+        ERR("%s: %d references to pictures from before seeking", mode.c_str(), client.staleReferences());
+        ret = false;
+    }
+
+    const std::vector<int64_t>& timestamps = client.timestamps();
+
+    if (timestamps.size() != G_N_ELEMENTS(frames)) {
+        ERR("%s: %zu pictures displayed after seeking, expected %zu", mode.c_str(), timestamps.size(),
+            G_N_ELEMENTS(frames));
+        ret = false;
+    }
+
+    for (size_t i = 0; i < timestamps.size(); i++) {
+        if (timestamps[i] != seekTimestamp + static_cast<int64_t>(i)) {
+            ERR("%s: picture %zu displayed after seeking with timestamp %" G_GINT64_FORMAT ", expected %" G_GINT64_FORMAT,
+                mode.c_str(), i, timestamps[i], seekTimestamp + static_cast<int64_t>(i));
+            ret = false;
+        }
+    }
+
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    gboolean direct = FALSE;
+
+    GOptionEntry entries[] = {
+        { "direct", 'd', 0, G_OPTION_ARG_NONE, &direct, "Drive the decoder without a pipeline", NULL },
+        { NULL }
+    };
+
+    parse_options(&argc, &argv, "ASYNC TEST", entries);
+
+    bool ret = run(direct);
+    ret = seek(direct, queueDepth) && ret;
+    ret = seek(direct, 0) && ret;
+
+    return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
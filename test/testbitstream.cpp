@@ -0,0 +1,317 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Assembles the same slices as scatter-gather segments and by copying them,
+// and checks the segments gather into the copied data: the slices right
+// after a start code, 3 or 4 bytes long, are borrowed from the input, from
+// their start code on, and the others, at the beginning of the input or
+// after a length prefix, are copied with a start code, however the copies
+// grow meanwhile. Emulation prevention bytes are kept as they are. Also that
+// copied slices stay aligned and are padded with zeros as they grow, even in
+// storage recycled from larger pictures, and that once every picture has
+// been assembled, recycled storage holds them without allocating.
+
+#include <glib.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "gstvkbitstream.h"
+#include "utils.h"
+
+struct Slice {
+    // NAL unit, at offset of the input
+    guint offset;
+    gsize size;
+    bool borrowed;
+};
+
+// a slice NAL unit of size bytes, with emulation prevention bytes
+static std::vector<guint8> make_nal(gsize size, guint8 seed)
+{
+    std::vector<guint8> nalu = { 0x41 };
+
+    while (nalu.size() < size) {
+        if (nalu.size() % 7 == 3)
+            nalu.insert(nalu.end(), { 0x00, 0x00, 0x03 });
+        else
+            nalu.push_back(seed + nalu.size());
+    }
+    nalu.resize(size);
+
+    return nalu;
+}
+
+// Appends nalu to input after prefix, returning the slice.
+static Slice append(std::vector<guint8>& input, std::vector<guint8> prefix, const std::vector<guint8>& nalu,
+    bool borrowed)
+{
+    input.insert(input.end(), prefix.begin(), prefix.end());
+    Slice slice = { static_cast<guint>(input.size()), nalu.size(), borrowed };
+    input.insert(input.end(), nalu.begin(), nalu.end());
+
+    return slice;
+}
+
+static bool check(const char* name, const std::vector<guint8>& input, const std::vector<Slice>& slices)
+{
+    GstVkBitstreamArena* arena = gst_vk_bitstream_arena_new();
+    GstVkBitstream* gathered = gst_vk_bitstream_arena_acquire(arena);
+    GstVkBitstream* copied = gst_vk_bitstream_arena_acquire(arena);
+    const GstVkBitstreamSegment* segments;
+    std::vector<guint8> joined;
+    gsize borrowed = 0;
+    bool ret = true;
+
+    for (const Slice& slice : slices) {
+        if (!gst_vk_bitstream_add_slice_segment(gathered, input.data(), slice.offset, slice.size)
+            || !gst_vk_bitstream_append_slice(copied, input.data() + slice.offset, slice.size)) {
+            ERR("%s: failed to add a slice", name);
+            ret = false;
+            goto beach;
+        }
+    }
+
+    segments = gst_vk_bitstream_get_segments(gathered);
+
+    for (guint i = 0; i < slices.size(); i++) {
+        const Slice& slice = slices[i];
+        const guint8* start = input.data() + slice.offset - 3;
+        bool inInput = segments[i].data >= input.data() && segments[i].data < input.data() + input.size();
+
+        if (segments[i].size != 3 + slice.size) {
+            ERR("%s: segment %u is %zu bytes, expected %zu", name, i, segments[i].size, 3 + slice.size);
+            ret = false;
+            continue;
+        }
+
+        if (slice.borrowed && segments[i].data != start) {
+            ERR("%s: slice %u wasn't borrowed from its start code", name, i);
+            ret = false;
+        } else if (!slice.borrowed && inInput) {
+            ERR("%s: slice %u was borrowed, without a start code before it", name, i);
+            ret = false;
+        } else if (!slice.borrowed) {
+            if (segments[i].data < gathered->data || segments[i].data + segments[i].size > gathered->data + gathered->size) {
+                ERR("%s: copied slice %u isn't in the bitstream data", name, i);
+                ret = false;
+            }
+        } else {
+            borrowed += segments[i].size;
+        }
+
+        if (gathered->offsets[i + 1] - gathered->offsets[i] != segments[i].size) {
+            ERR("%s: offsets of slice %u don't span its segment", name, i);
+            ret = false;
+        }
+
+        joined.insert(joined.end(), segments[i].data, segments[i].data + segments[i].size);
+    }
+
+    if (gathered->size != joined.size() - borrowed) {
+        ERR("%s: %zu bytes copied, expected %zu", name, gathered->size, joined.size() - borrowed);
+        ret = false;
+    }
+
+    if (joined.size() != copied->size || memcmp(joined.data(), copied->data, copied->size) != 0) {
+        ERR("%s: the gathered segments differ from the copied slices", name);
+        ret = false;
+    }
+
+    if (memcmp(gathered->offsets, copied->offsets, (slices.size() + 1) * sizeof(guint32)) != 0) {
+        ERR("%s: the offsets differ from those of the copied slices", name);
+        ret = false;
+    }
+
+beach:
+    gst_vk_bitstream_release(gathered);
+    gst_vk_bitstream_release(copied);
+    gst_vk_bitstream_arena_unref(arena);
+
+    return ret;
+}
+
+// Assembles pictures of growing, then shrinking, numbers of slices, each
+// recycling the storage of the previous one.
+static bool check_alignment(guint offsetAlignment, guint sizeAlignment)
+{
+    GstVkBitstreamArena* arena = gst_vk_bitstream_arena_new();
+    bool ret = true;
+
+    gst_vk_bitstream_arena_set_alignment(arena, offsetAlignment, sizeAlignment);
+
+    for (int slices : { 1, 4, 64, 3, 1 }) {
+        GstVkBitstream* bitstream = gst_vk_bitstream_arena_acquire(arena);
+        gsize padded;
+
+        for (int i = 0; i < slices; i++) {
+            std::vector<guint8> nalu = make_nal(37 + 11 * i, i);
+
+            if (!gst_vk_bitstream_append_slice(bitstream, nalu.data(), nalu.size())) {
+                ERR("failed to add a slice");
+                ret = false;
+            }
+            if (GPOINTER_TO_SIZE(bitstream->data) % offsetAlignment != 0) {
+                ERR("%d slices: data not aligned to %u after slice %d", slices, offsetAlignment, i);
+                ret = false;
+            }
+        }
+
+        if (!gst_vk_bitstream_pad(bitstream, &padded)) {
+            ERR("failed to pad");
+            ret = false;
+        } else if (padded % sizeAlignment != 0 || padded < bitstream->size || padded - bitstream->size >= sizeAlignment) {
+            ERR("%d slices: %zu bytes padded to %zu, not to a multiple of %u", slices, bitstream->size, padded,
+                sizeAlignment);
+            ret = false;
+        } else if (GPOINTER_TO_SIZE(bitstream->data) % offsetAlignment != 0) {
+            ERR("%d slices: data not aligned to %u once padded", slices, offsetAlignment);
+            ret = false;
+        } else {
+            for (gsize i = bitstream->size; i < padded; i++) {
+                if (bitstream->data[i] != 0) {
+                    ERR("%d slices: padding byte %zu is 0x%02x", slices, i, bitstream->data[i]);
+                    ret = false;
+                    break;
+                }
+            }
+        }
+
+        gst_vk_bitstream_release(bitstream);
+    }
+
+    gst_vk_bitstream_arena_unref(arena);
+
+    return ret;
+}
+
+// Assembles the same pictures round after round, several of them being held
+// at a time, as in the DPB, and released out of order, and checks that
+// after the first round no storage is allocated anymore, whichever recycled
+// bitstream each picture gets.
+static bool check_steady_state(void)
+{
+    GstVkBitstreamArena* arena = gst_vk_bitstream_arena_new();
+    std::vector<GstVkBitstream*> held;
+    guint64 allocations = 0;
+    bool ret = true;
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 16; i++) {
+            GstVkBitstream* bitstream = gst_vk_bitstream_arena_acquire(arena);
+
+            // an intra picture first, the largest one, then smaller ones
+            for (int j = 0; j <= i % 3; j++) {
+                std::vector<guint8> nalu = make_nal(i == 0 ? 3000 : 100 + 97 * (i % 5), i + j);
+
+                if (!gst_vk_bitstream_append_slice(bitstream, nalu.data(), nalu.size())) {
+                    ERR("failed to add a slice");
+                    ret = false;
+                }
+            }
+            held.push_back(bitstream);
+
+            if (held.size() > 4) {
+                auto it = held.begin() + (i % 3 == 0 ? 1 : 0);
+
+                gst_vk_bitstream_release(*it);
+                held.erase(it);
+            }
+        }
+
+        guint64 now = gst_vk_bitstream_arena_get_allocations(arena);
+
+        if (round > 0 && now != allocations) {
+            ERR("round %d: %" G_GUINT64_FORMAT " allocations, %" G_GUINT64_FORMAT " after the first one", round, now,
+                allocations);
+            ret = false;
+        }
+        allocations = now;
+    }
+
+    for (GstVkBitstream* bitstream : held)
+        gst_vk_bitstream_release(bitstream);
+    gst_vk_bitstream_arena_unref(arena);
+
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    static const std::vector<guint8> sc3 = { 0x00, 0x00, 0x01 };
+    static const std::vector<guint8> sc4 = { 0x00, 0x00, 0x00, 0x01 };
+    bool ret = true;
+
+    {
+        // byte-stream, as both samples: 4-byte start codes, then 3-byte ones
+        std::vector<guint8> input;
+        std::vector<Slice> slices;
+
+        for (int i = 0; i < 6; i++)
+            slices.push_back(append(input, i < 3 ? sc4 : sc3, make_nal(20 + 13 * i, i), true));
+        ret &= check("byte-stream", input, slices);
+    }
+
+    {
+        // length prefixed, as avc streams: a prefix ending in 0x01 is no
+        // start code, neither are 00 01 nor 00 00 02
+        std::vector<guint8> input;
+        std::vector<Slice> slices;
+
+        slices.push_back(append(input, { 0x00, 0x00, 0x00, 0x01 }, make_nal(1, 0), true));
+        slices.push_back(append(input, { 0x00, 0x00, 0x01, 0x01 }, make_nal(257, 1), false));
+        slices.push_back(append(input, { 0x00, 0x00, 0x00, 0x40 }, make_nal(64, 2), false));
+        slices.push_back(append(input, { 0x00, 0x01 }, make_nal(9, 3), false));
+        slices.push_back(append(input, { 0x00, 0x00, 0x02 }, make_nal(33, 4), false));
+        ret &= check("length-prefixed", input, slices);
+    }
+
+    {
+        // at the beginning of the input, with no room for a start code
+        std::vector<guint8> input;
+        std::vector<Slice> slices;
+
+        slices.push_back(append(input, {}, make_nal(40, 0), false));
+        slices.push_back(append(input, sc3, make_nal(40, 1), true));
+        ret &= check("start", input, slices);
+    }
+
+    {
+        // borrowed and copied slices in turns, the copies being reallocated
+        // several times before being resolved
+        std::vector<guint8> input;
+        std::vector<Slice> slices;
+
+        for (int i = 0; i < 64; i++) {
+            if (i % 2)
+                slices.push_back(append(input, { 0x00, 0x00, 0x12, 0x34 }, make_nal(100 + i * 50, i), false));
+            else
+                slices.push_back(append(input, i % 4 ? sc3 : sc4, make_nal(3 + i, i), true));
+        }
+        ret &= check("mixed", input, slices);
+    }
+
+    ret &= check_alignment(256, 64);
+    ret &= check_alignment(4096, 48);
+    ret &= check_steady_state();
+
+    if (ret)
+        INFO("segments gather into the copied slices, aligned copies are padded with zeros, storage is recycled");
+
+    return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
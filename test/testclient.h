@@ -0,0 +1,186 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// What the tests driving the parser with synthesized streams or samples
+// share: a client that hands out pictures and accepts everything, for them
+// to override the callbacks they check, and helpers to set up the parser,
+// read the samples and parse the command line.
+
+#pragma once
+
+#include <glib.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "utils.h"
+#include "VideoParserClient.h"
+#include "vkvideodecodeparser.h"
+
+class TestClient : public VkParserVideoDecodeClient {
+public:
+    explicit TestClient(size_t numPictures = 32)
+        : m_dpb(numPictures)
+    {
+    }
+
+    int32_t BeginSequence(const VkParserSequenceInfo* info) override
+    {
+        return std::min(std::max(info->nMinNumDecodeSurfaces, 1), 17);
+    }
+
+    bool AllocPictureBuffer(VkPicIf** pic) override
+    {
+        for (auto& apic : m_dpb) {
+            if (apic.isAvailable()) {
+                apic.AddRef();
+                *pic = &apic;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool DecodePicture(VkParserPictureData*) override
+    {
+        return true;
+    }
+
+    bool UpdatePictureParameters(VkPictureParameters*, VkSharedBaseObj<VkParserVideoRefCountBase>& shared, uint64_t) override
+    {
+        shared = PictureParameterSet::create();
+        return true;
+    }
+
+    bool DisplayPicture(VkPicIf*, int64_t) override
+    {
+        return true;
+    }
+
+    void UnhandledNALU(const uint8_t*, int32_t) override { }
+
+    // pictures handed out and not released yet
+    size_t PicturesInUse() const
+    {
+        return std::count_if(m_dpb.begin(), m_dpb.end(), [](const Picture& pic) { return !pic.isAvailable(); });
+    }
+
+protected:
+    // position of pic in the pool, to compare pictures across runs
+    ptrdiff_t Index(VkPicIf* pic) const
+    {
+        return static_cast<Picture*>(pic) - m_dpb.data();
+    }
+
+private:
+    std::vector<Picture> m_dpb;
+};
+
+// An initialized parser of codec calling client, or nullptr. The interface
+// version and the client of params are filled in.
+static inline VulkanVideoDecodeParser* create_parser(VkVideoCodecOperationFlagBitsKHR codec, VkParserVideoDecodeClient* client,
+    VkParserInitDecodeParameters params)
+{
+    static const VkExtensionProperties h264StdExtensionVersion = { VK_STD_VULKAN_VIDEO_CODEC_H264_DECODE_EXTENSION_NAME, VK_STD_VULKAN_VIDEO_CODEC_H264_DECODE_SPEC_VERSION };
+    static const VkExtensionProperties h265StdExtensionVersion = { VK_STD_VULKAN_VIDEO_CODEC_H265_DECODE_EXTENSION_NAME, VK_STD_VULKAN_VIDEO_CODEC_H265_DECODE_SPEC_VERSION };
+    VulkanVideoDecodeParser* parser = nullptr;
+
+    params.interfaceVersion = NV_VULKAN_VIDEO_PARSER_API_VERSION;
+    params.pClient = client;
+
+    if (!CreateVulkanVideoDecodeParser(&parser, codec,
+            codec == VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_EXT ? &h264StdExtensionVersion : &h265StdExtensionVersion,
+            (nvParserLogFuncType)printf, 0))
+        return nullptr;
+
+    if (parser->Initialize(&params) != VK_SUCCESS) {
+        parser->Release();
+        return nullptr;
+    }
+
+    return parser;
+}
+
+static inline VulkanVideoDecodeParser* create_h264_parser(VkParserVideoDecodeClient* client, VkParserInitDecodeParameters params)
+{
+    return create_parser(VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_EXT, client, params);
+}
+
+static inline void destroy_parser(VulkanVideoDecodeParser* parser)
+{
+    parser->Deinitialize();
+    parser->Release();
+}
+
+// Parses size bytes of data as a packet, the last one if eos, with pts if
+// ptsValid. Fails unless all of them are taken.
+static inline bool parse_packet(VulkanVideoDecodeParser* parser, const uint8_t* data, size_t size, bool eos,
+    bool ptsValid = false, int64_t pts = 0)
+{
+    VkParserBitstreamPacket pkt = {
+        .pByteStream = data,
+        .nDataLength = static_cast<int32_t>(size),
+        .bEOS = eos,
+        .bPTSValid = ptsValid,
+        .llPTS = pts,
+    };
+    int32_t parsed;
+
+    return parser->ParseByteStream(&pkt, &parsed) && parsed == pkt.nDataLength;
+}
+
+// The contents of filename, or an empty vector on failure.
+static inline std::vector<uint8_t> read_file(const char* filename)
+{
+    gchar* contents;
+    gsize length;
+    GError* err = NULL;
+
+    if (!g_file_get_contents(filename, &contents, &length, &err)) {
+        ERR("Unable to read %s: %s", filename, err->message);
+        g_clear_error(&err);
+        return {};
+    }
+
+    std::vector<uint8_t> data(contents, contents + length);
+    g_free(contents);
+
+    return data;
+}
+
+// Parses the command line for entries, and exits on failure.
+static inline void parse_options(int* argc, char*** argv, const char* summary, const GOptionEntry* entries)
+{
+    GOptionContext* ctx;
+    GError* err = NULL;
+
+    g_set_prgname((*argv)[0]);
+
+    ctx = g_option_context_new(summary);
+    g_option_context_add_main_entries(ctx, entries, NULL);
+
+    if (!g_option_context_parse(ctx, argc, argv, &err)) {
+        ERR("Error initializing: %s", err->message);
+        g_option_context_free(ctx);
+        g_clear_error(&err);
+        exit(EXIT_FAILURE);
+    }
+
+    g_option_context_free(ctx);
+}
@@ -0,0 +1,398 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Replays fixed-seed random streams through a GstH264Dpb, progressive and
+// with field pairs, bumping with every latency mode: reference and
+// non-reference pictures, sliding window marking or random memory
+// management control operations, MMCO5 included, non-existing frames and
+// repeated POCs. After every picture, the pictures output, the short-term
+// and long-term references, by decoding number, and the number of reference
+// frames are traced, and the trace has to be the expected one, recorded with
+// the DPB as it was before it kept its pictures in slots. With --dump the
+// trace is printed instead.
+
+#include <gst/gst.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gsth264decoder.h"
+#include "utils.h"
+
+static const gint numPictures = 200;
+static const gint maxFrameNum = 16;
+
+struct Replay {
+    guint seed;
+    gboolean interlaced;
+    GstH264DpbBumpMode mode;
+};
+
+static const Replay replays[] = {
+    { 1, FALSE, GST_H264_DPB_BUMP_NORMAL_LATENCY },
+    { 2, FALSE, GST_H264_DPB_BUMP_LOW_LATENCY },
+    { 3, FALSE, GST_H264_DPB_BUMP_VERY_LOW_LATENCY },
+    { 4, TRUE, GST_H264_DPB_BUMP_NORMAL_LATENCY },
+    { 5, TRUE, GST_H264_DPB_BUMP_LOW_LATENCY },
+    { 6, TRUE, GST_H264_DPB_BUMP_VERY_LOW_LATENCY },
+};
+
+// a linear congruential generator, for the streams not to depend on glib's
+class Random {
+public:
+    explicit Random(guint seed)
+        : m_state(seed)
+    {
+    }
+
+    guint operator()(guint n)
+    {
+        m_state = m_state * 1103515245 + 12345;
+        return (m_state >> 8) % n;
+    }
+
+private:
+    guint m_state;
+};
+
+struct Counts {
+    guint mmco5 = 0;
+    guint fieldPairs = 0;
+    guint output = 0;
+};
+
+// A picture by its decoding number, its second field with a quote.
+static std::string name(GstH264Picture* picture)
+{
+    return std::to_string(picture->system_frame_number) + (picture->second_field ? "'" : "");
+}
+
+static void append_pictures(std::string& trace, const char* name, GArray* pictures)
+{
+    trace += name;
+    if (pictures->len == 0)
+        trace += "-";
+    for (guint i = 0; i < pictures->len; i++) {
+        GstH264Picture* picture = g_array_index(pictures, GstH264Picture*, i);
+
+        trace += (i > 0 ? "," : "") + ::name(picture);
+    }
+    g_array_set_size(pictures, 0);
+}
+
+// The references of dpb and how many frames they are.
+static void append_references(std::string& trace, GstH264Dpb* dpb)
+{
+    GArray* pictures = g_array_new(FALSE, FALSE, sizeof(GstH264Picture*));
+
+    g_array_set_clear_func(pictures, reinterpret_cast<GDestroyNotify>(gst_clear_h264_picture));
+
+    trace += " | refs " + std::to_string(gst_h264_dpb_num_ref_frames(dpb));
+    gst_h264_dpb_get_pictures_short_term_ref(dpb, TRUE, TRUE, pictures);
+    append_pictures(trace, " short ", pictures);
+    gst_h264_dpb_get_pictures_long_term_ref(dpb, TRUE, pictures);
+    append_pictures(trace, " long ", pictures);
+
+    g_array_unref(pictures);
+}
+
+static void output(std::string& trace, GstH264Picture* picture, Counts& counts)
+{
+    trace += " out" + name(picture);
+    gst_h264_picture_unref(picture);
+    counts.output++;
+}
+
+static void update_pic_nums(GstH264Dpb* dpb, gint frameNum)
+{
+    GArray* pictures = gst_h264_dpb_get_pictures_all(dpb);
+
+    for (guint i = 0; i < pictures->len; i++) {
+        GstH264Picture* picture = g_array_index(pictures, GstH264Picture*, i);
+
+        if (GST_H264_PICTURE_IS_LONG_TERM_REF(picture)) {
+            picture->long_term_pic_num = picture->long_term_frame_idx;
+        } else if (GST_H264_PICTURE_IS_SHORT_TERM_REF(picture)) {
+            picture->frame_num_wrap = picture->frame_num > frameNum ? picture->frame_num - maxFrameNum : picture->frame_num;
+            picture->pic_num = picture->frame_num_wrap;
+        }
+    }
+
+    g_array_unref(pictures);
+}
+
+// Marks picture with one to three random operations, returning whether it
+// is a reference one after them.
+static bool mark_with_mmcos(GstH264Dpb* dpb, GstH264Picture* picture, Random& random, gint& pocBase, gint n,
+    std::string& trace, Counts& counts)
+{
+    guint ops = 1 + random(3);
+
+    for (guint i = 0; i < ops; i++) {
+        GstH264RefPicMarking marking = {};
+        guint type = 1 + random(6);
+        gboolean done;
+
+        // MMCO5 less often, not to flush the DPB all the time
+        if (type == 5 && random(4))
+            type = 1;
+
+        marking.memory_management_control_operation = type;
+        marking.difference_of_pic_nums_minus1 = random(6);
+        marking.long_term_pic_num = random(4);
+        marking.long_term_frame_idx = random(4);
+        marking.max_long_term_frame_idx_plus1 = random(5);
+        picture->pic_num = picture->frame_num;
+
+        done = gst_h264_dpb_perform_memory_management_control_operation(dpb, &marking, picture);
+        trace += " mmco" + std::to_string(type) + "=" + std::to_string(done);
+
+        if (type == 6)
+            return false;
+
+        if (type == 5) {
+            GstH264Picture* out;
+
+            // as if the picture were an IDR one, once all others are output
+            pocBase = picture->pic_order_cnt = -(n / 8) * 40;
+            while ((out = gst_h264_dpb_bump(dpb, TRUE)))
+                output(trace, out, counts);
+            gst_h264_dpb_clear(dpb);
+            counts.mmco5++;
+            break;
+        }
+    }
+
+    return true;
+}
+
+// Unmarks the short-term references with the lowest frame_num, as the
+// sliding window does, to keep room for picture.
+static void mark_sliding_window(GstH264Dpb* dpb, gint maxNumFrames, Random& random)
+{
+    while (gst_h264_dpb_num_ref_frames(dpb) >= maxNumFrames - 1 + (random(3) == 0)) {
+        GstH264Picture* oldest = gst_h264_dpb_get_lowest_frame_num_short_ref(dpb);
+
+        if (!oldest)
+            break;
+        gst_h264_picture_set_reference(oldest, GST_H264_PICTURE_REF_NONE, TRUE);
+        gst_h264_picture_unref(oldest);
+    }
+}
+
+// The trace of replay, a line per picture.
+static std::vector<std::string> replay(const Replay& replay, Counts& counts)
+{
+    Random random(replay.seed);
+    GstH264Dpb* dpb = gst_h264_dpb_new();
+    gint maxNumFrames = 2 + replay.seed % 5, frameNum = 0, pocBase = 0, lastPoc = 0;
+    std::vector<std::string> trace;
+    std::vector<GstH264Picture*> pictures;
+    GstH264Picture* out;
+
+    gst_h264_dpb_set_max_num_frames(dpb, maxNumFrames);
+    gst_h264_dpb_set_interlaced(dpb, replay.interlaced);
+    gst_h264_dpb_set_max_num_reorder_frames(dpb, random(maxNumFrames + 1));
+
+    for (gint n = 0; n < numPictures; n++) {
+        GstH264Picture* picture = gst_h264_picture_new();
+        bool reference = random(10) < 7;
+        std::string line;
+
+        // the DPB doesn't hold other_field, so the pictures are kept alive
+        // until the end of the replay
+        pictures.push_back(gst_h264_picture_ref(picture));
+
+        // in groups of eight, the even ones in output order first
+        picture->system_frame_number = n;
+        picture->frame_num = frameNum;
+        picture->pic_order_cnt = pocBase + 2 * (n % 8 < 4 ? n % 8 * 2 : (n % 8 - 4) * 2 + 1) + (n / 8) * 40;
+        // now and then that of the previous one, as in broken streams, for
+        // pictures to be output in the order they were added
+        if (n > 0 && random(8) == 0)
+            picture->pic_order_cnt = lastPoc;
+        lastPoc = picture->pic_order_cnt;
+        picture->top_field_order_cnt = picture->pic_order_cnt;
+        picture->bottom_field_order_cnt = picture->pic_order_cnt + 1;
+        picture->ref_pic = reference;
+        picture->nonexisting = random(20) == 0;
+        line = "picture " + std::to_string(n) + " poc " + std::to_string(picture->pic_order_cnt)
+            + (reference ? " ref:" : ":");
+
+        update_pic_nums(dpb, frameNum);
+
+        if (reference) {
+            if (random(2))
+                reference = mark_with_mmcos(dpb, picture, random, pocBase, n, line, counts);
+            else
+                mark_sliding_window(dpb, maxNumFrames, random);
+
+            if (reference)
+                gst_h264_picture_set_reference(picture, GST_H264_PICTURE_REF_SHORT_TERM, FALSE);
+            frameNum = (frameNum + 1) % maxFrameNum;
+        }
+
+        gst_h264_dpb_delete_unused(dpb);
+        while (gst_h264_dpb_needs_bump(dpb, picture, replay.mode)) {
+            out = gst_h264_dpb_bump(dpb, FALSE);
+            if (!out)
+                break;
+            output(line, out, counts);
+        }
+
+        if (GST_H264_PICTURE_IS_REF(picture) || gst_h264_dpb_has_empty_frame_buffer(dpb)) {
+            if (replay.interlaced) {
+                GstH264Picture* second = gst_h264_picture_new();
+
+                picture->field = GST_H264_PICTURE_FIELD_TOP_FIELD;
+                second->field = GST_H264_PICTURE_FIELD_BOTTOM_FIELD;
+                second->system_frame_number = n;
+                second->pic_order_cnt = picture->pic_order_cnt + 1;
+                second->frame_num = picture->frame_num;
+                second->ref = picture->ref;
+                second->ref_pic = picture->ref_pic;
+                second->nonexisting = picture->nonexisting;
+                second->long_term_frame_idx = picture->long_term_frame_idx;
+                second->second_field = TRUE;
+                second->other_field = picture;
+                pictures.push_back(gst_h264_picture_ref(second));
+
+                gst_h264_dpb_add(dpb, picture);
+                gst_h264_dpb_add(dpb, second);
+                counts.fieldPairs++;
+            } else {
+                gst_h264_dpb_add(dpb, picture);
+            }
+        } else {
+            // not needed as reference, output right away
+            line += " direct" + name(picture);
+            counts.output++;
+            gst_h264_dpb_set_last_output(dpb, picture);
+            gst_h264_picture_unref(picture);
+        }
+
+        append_references(line, dpb);
+        trace.push_back(std::move(line));
+    }
+
+    std::string line = "drain:";
+
+    while ((out = gst_h264_dpb_bump(dpb, TRUE)))
+        output(line, out, counts);
+    line += " | size " + std::to_string(gst_h264_dpb_get_size(dpb));
+    trace.push_back(std::move(line));
+
+    gst_h264_dpb_free(dpb);
+    for (GstH264Picture* picture : pictures)
+        gst_h264_picture_unref(picture);
+
+    return trace;
+}
+
+int main(int argc, char** argv)
+{
+    GOptionContext* ctx;
+    GError* err = NULL;
+    gboolean dump = FALSE;
+    std::vector<std::string> trace;
+    Counts counts;
+
+    GOptionEntry entries[] = {
+        { "dump", 'd', 0, G_OPTION_ARG_NONE, &dump, "Print the trace instead of comparing it", NULL },
+        { NULL }
+    };
+
+    ctx = g_option_context_new("[FILE] - DPB REPLAY TEST");
+    g_option_context_add_main_entries(ctx, entries, NULL);
+    g_option_context_add_group(ctx, gst_init_get_option_group());
+
+    if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+        ERR("Error initializing: %s", err->message);
+        g_option_context_free(ctx);
+        g_clear_error(&err);
+        exit(EXIT_FAILURE);
+    }
+
+    g_option_context_free(ctx);
+
+    if (!dump && argc != 2) {
+        ERR("Please provide the expected trace.");
+        return EXIT_FAILURE;
+    }
+
+    // registers the debug category the DPB logs to
+    g_type_ensure(GST_TYPE_H264_DECODER);
+
+    for (const Replay& r : replays) {
+        std::vector<std::string> lines = replay(r, counts);
+
+        trace.push_back("replay " + std::to_string(r.seed) + (r.interlaced ? " interlaced" : " progressive")
+            + " mode " + std::to_string(r.mode));
+        trace.insert(trace.end(), lines.begin(), lines.end());
+    }
+
+    if (dump) {
+        for (const std::string& line : trace)
+            g_print("%s\n", line.c_str());
+        return EXIT_SUCCESS;
+    }
+
+    gchar* contents;
+    if (!g_file_get_contents(argv[1], &contents, NULL, &err)) {
+        ERR("Unable to read %s: %s", argv[1], err->message);
+        g_clear_error(&err);
+        return EXIT_FAILURE;
+    }
+
+    gchar** expected = g_strsplit(contents, "\n", -1);
+    guint numExpected = g_strv_length(expected);
+    bool ret = true;
+
+    // the file ends with a new line
+    if (numExpected > 0 && expected[numExpected - 1][0] == '\0')
+        numExpected--;
+
+    for (guint i = 0; i < trace.size() && i < numExpected; i++) {
+        if (trace[i] != expected[i]) {
+            ERR("line %u differs:\n  expected: %s\n  got:      %s", i + 1, expected[i], trace[i].c_str());
+            ret = false;
+            break;
+        }
+    }
+
+    if (ret && trace.size() != numExpected) {
+        ERR("%zu lines traced, %u expected", trace.size(), numExpected);
+        ret = false;
+    }
+
+    g_strfreev(expected);
+    g_free(contents);
+
+    // the replays have to keep covering these, whatever the seeds
+    if (counts.mmco5 == 0 || counts.fieldPairs == 0) {
+        ERR("%u MMCO5 and %u field pairs replayed", counts.mmco5, counts.fieldPairs);
+        ret = false;
+    }
+
+    if (ret)
+        INFO("%zu replays, %u pictures output, %u MMCO5, %u field pairs, as expected", G_N_ELEMENTS(replays),
+            counts.output, counts.mmco5, counts.fieldPairs);
+
+    return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,196 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Feeds an H.264 stream, one access unit per packet, whose last pictures
+// fail to decode, and checks the packet with bEOS reports it, also with the
+// slice headers parsed ahead of decoding, when the last picture is only
+// decoded by then. The decoder tolerates 10 failures in a row, so 11
+// pictures fail, the last one going over. Then the same parser gets the
+// stream again, and mustn't report the failure again.
+
+#include <climits>
+
+#include "h264writer.h"
+#include "testclient.h"
+
+static const int numFrames = 32;
+// as documented by ParseByteStream()
+static const int maxErrors = 10;
+
+class FailingClient : public TestClient {
+public:
+    // the pictures decoded from now on fail from the index-th one
+    void FailFrom(int index)
+    {
+        m_failFrom = index == INT_MAX ? INT_MAX : m_calls + index;
+    }
+
+    bool DecodePicture(VkParserPictureData*) final
+    {
+        if (m_calls++ >= m_failFrom)
+            return false;
+        m_decoded++;
+        return true;
+    }
+
+    int decoded() const { return m_decoded; }
+
+private:
+    int m_calls = 0;
+    int m_decoded = 0;
+    int m_failFrom = INT_MAX;
+};
+
+// groups of an IDR and 7 P pictures
+static std::vector<uint8_t> make_access_unit(int i)
+{
+    std::vector<uint8_t> au;
+
+    if (i % 8 == 0) {
+        write_sps(au);
+        write_pps(au);
+    }
+    write_slice({ i % 8, i % 8 ? 'P' : 'I' }, i % 8, (i / 8) % 2, au);
+
+    return au;
+}
+
+// What ParseByteStream() returns for every packet of the stream, with
+// the pictures from failFrom on failing.
+static std::vector<bool> parse_stream(VulkanVideoDecodeParser* parser, FailingClient& client, int failFrom)
+{
+    std::vector<bool> results;
+
+    client.FailFrom(failFrom);
+
+    for (int i = 0; i < numFrames; i++) {
+        std::vector<uint8_t> au = make_access_unit(i);
+
+        results.push_back(parse_packet(parser, au.data(), au.size(), i == numFrames - 1));
+    }
+
+    return results;
+}
+
+// The failures the decoder takes to report one, or 0 if it tolerates
+// all those of the stream. Each access unit is only decoded with the next
+// packet, so the failure of the i-th one is reported by the i+1-th.
+static int failures_to_report(void)
+{
+    VulkanVideoDecodeParser* parser;
+    FailingClient client;
+    VkParserInitDecodeParameters params = {
+        .bOutOfBandPictureParameters = true,
+        .bDirectDrive = true,
+    };
+    std::vector<bool> results;
+
+    parser = create_h264_parser(&client, params);
+    if (!parser)
+        return -1;
+
+    results = parse_stream(parser, client, 1);
+    destroy_parser(parser);
+
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results[i])
+            continue;
+        if (i < 2) {
+            ERR("packet %zu failed before any picture did", i);
+            return -1;
+        }
+        return static_cast<int>(i) - 1;
+    }
+
+    return 0;
+}
+
+static bool run(bool pipelined, int failures)
+{
+    const char* mode = pipelined ? "pipelined" : "serial";
+    VulkanVideoDecodeParser* parser;
+    FailingClient client;
+    VkParserInitDecodeParameters params = {
+        .bOutOfBandPictureParameters = true,
+        .bDirectDrive = true,
+        .bPipelinedParsing = pipelined,
+    };
+    std::vector<bool> results;
+    bool ret = true;
+
+    parser = create_h264_parser(&client, params);
+    if (!parser)
+        return false;
+
+    results = parse_stream(parser, client, numFrames - failures);
+
+    for (int i = 0; i < numFrames - 1; i++) {
+        if (!results[i]) {
+            ERR("%s: packet %d failed, before the failure went over the tolerated ones", mode, i);
+            ret = false;
+        }
+    }
+
+    if (results.back()) {
+        ERR("%s: the failure of the last picture wasn't reported", mode);
+        ret = false;
+    }
+
+    // the stream again, after the end of the one failing
+    int decoded = client.decoded();
+
+    results = parse_stream(parser, client, INT_MAX);
+    destroy_parser(parser);
+
+    for (int i = 0; i < numFrames; i++) {
+        if (!results[i]) {
+            ERR("%s: packet %d of the stream after the failure failed", mode, i);
+            ret = false;
+        }
+    }
+
+    if (client.decoded() - decoded != numFrames) {
+        ERR("%s: %d pictures decoded after the failure, expected %d", mode,
+            client.decoded() - decoded, numFrames);
+        ret = false;
+    }
+
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    gboolean pipelined = FALSE;
+    int failures;
+
+    GOptionEntry entries[] = {
+        { "pipelined", 'p', 0, G_OPTION_ARG_NONE, &pipelined, "Parse slice headers ahead of decoding", NULL },
+        { NULL }
+    };
+
+    parse_options(&argc, &argv, "DECODING ERRORS TEST", entries);
+
+    failures = failures_to_report();
+    if (failures < 0)
+        return EXIT_FAILURE;
+    if (failures != maxErrors + 1) {
+        ERR("the decoder reports %d failures in a row, expected %d", failures, maxErrors + 1);
+        return EXIT_FAILURE;
+    }
+
+    return run(pipelined, failures) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -31,7 +31,7 @@
 static VkVideoCodecOperationFlagBitsKHR codec = VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_EXT;
 
 
-static bool parse(FILE* stream, bool quiet)
+static bool parse(FILE* stream, bool quiet, bool direct)
 {
     VulkanVideoDecodeParser* parser = nullptr;
     VideoParserClient client = VideoParserClient(codec, quiet);
@@ -39,6 +39,7 @@ static bool parse(FILE* stream, bool quiet)
         .interfaceVersion = NV_VULKAN_VIDEO_PARSER_API_VERSION,
         .pClient = &client,
         .bOutOfBandPictureParameters = true,
+        .bDirectDrive = direct,
     };
     bool ret;
     unsigned char buf[BUFSIZ + 1];
@@ -93,7 +94,7 @@ static bool parse(FILE* stream, bool quiet)
     return ret;
 }
 
-int process_file (gchar* filename, bool quiet) {
+int process_file (gchar* filename, bool quiet, bool direct) {
     FILE* file;
     DBG ("Processing file %s.\n", filename);
     file = fopen(filename, "r");
@@ -102,7 +103,7 @@ int process_file (gchar* filename, bool quiet) {
         return EXIT_FAILURE;
     }
 
-    if (!parse(file, quiet)) {
+    if (!parse(file, quiet, direct)) {
         fclose(file);
         return EXIT_FAILURE;
     }
@@ -118,11 +119,13 @@ int main(int argc, char** argv)
     gchar **filenames = NULL;
     gchar *codec_str = NULL;
     gboolean quiet = FALSE;
+    gboolean direct = FALSE;
     gint ret = EXIT_SUCCESS;
 
     static GOptionEntry entries[] = {
         { "quiet", 'q', 0, G_OPTION_ARG_NONE, &quiet, "Quiet parser", NULL },
         { "codec", 'c', 0, G_OPTION_ARG_STRING, &codec_str, "Codec to use ie h265", NULL },
+        { "direct", 'd', 0, G_OPTION_ARG_NONE, &direct, "Drive the decoder without a pipeline", NULL },
         {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &filenames, NULL},
         { NULL }
     };
@@ -158,7 +161,7 @@ int main(int argc, char** argv)
 
     int num = g_strv_length (filenames);
     for (int i = 0; i < num; ++i)
-        ret |= process_file (filenames[i], quiet);
+        ret |= process_file (filenames[i], quiet, direct);
 
      g_strfreev (filenames);
 
@@ -0,0 +1,279 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Frames a byte stream pushed in chunks of every size up to 64 and some
+// larger ones, in random chunks, and split in two at every byte, so that
+// start codes, zero_bytes, trailing zeros and NAL unit headers are split
+// everywhere they can be, and checks the access units and their NAL units
+// are those of the whole stream pushed at once. Those have to tile the
+// stream, and their NAL units have to begin with a start code. With no
+// sample, or an H.264 one, synthesized H.264 streams with 3- and 4-byte
+// start codes, trailing zeros, AUDs and SEIs are framed too.
+
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gstvkaccessunitframer.h"
+#include "h264writer.h"
+#include "utils.h"
+
+struct Unit {
+    uint64_t offset;
+    std::vector<uint8_t> data;
+    std::vector<std::pair<uint32_t, uint32_t>> nals;
+
+    bool operator==(const Unit& other) const
+    {
+        return offset == other.offset && data == other.data && nals == other.nals;
+    }
+};
+
+// The access units of stream pushed in chunks of the given sizes, cycled
+// through.
+static std::vector<Unit> frame(GstVkAccessUnitFramer::Codec codec, const std::vector<uint8_t>& stream,
+    const std::vector<size_t>& chunks)
+{
+    GstVkAccessUnitFramer framer(codec);
+    std::vector<Unit> units;
+    auto func = [&units](const GstVkAccessUnitFramer::AccessUnit& au) {
+        Unit unit = { au.offset, std::vector<uint8_t>(au.data, au.data + au.size), {} };
+
+        for (size_t i = 0; i < au.nalCount; i++)
+            unit.nals.emplace_back(au.nals[i].sc_offset, au.nals[i].end);
+        units.push_back(std::move(unit));
+        return true;
+    };
+
+    for (size_t offset = 0, i = 0; offset < stream.size(); i++) {
+        size_t size = std::min(chunks[i % chunks.size()], stream.size() - offset);
+
+        framer.Push(stream.data() + offset, size, func);
+        offset += size;
+    }
+    framer.Drain(func);
+
+    return units;
+}
+
+// Whether the access units tile stream, with NAL units beginning with a
+// start code.
+static bool check_units(const char* name, const std::vector<uint8_t>& stream, const std::vector<Unit>& units)
+{
+    uint64_t offset = 0;
+
+    for (size_t i = 0; i < units.size(); i++) {
+        const Unit& unit = units[i];
+
+        if (unit.offset != offset || unit.offset + unit.data.size() > stream.size()
+            || memcmp(unit.data.data(), stream.data() + offset, unit.data.size()) != 0) {
+            ERR("%s: access unit %zu isn't the stream from offset %" G_GUINT64_FORMAT, name, i, offset);
+            return false;
+        }
+
+        if (unit.nals.empty()) {
+            ERR("%s: access unit %zu has no NAL unit", name, i);
+            return false;
+        }
+
+        for (const auto& nal : unit.nals) {
+            if (nal.second > unit.data.size() || nal.first + 3 > nal.second
+                || memcmp(unit.data.data() + nal.first, "\x00\x00\x01", 3) != 0) {
+                ERR("%s: NAL unit [%u, %u) of access unit %zu doesn't begin with a start code", name, nal.first,
+                    nal.second, i);
+                return false;
+            }
+        }
+
+        offset += unit.data.size();
+    }
+
+    if (offset != stream.size()) {
+        ERR("%s: the access units span %" G_GUINT64_FORMAT " bytes of %zu", name, offset, stream.size());
+        return false;
+    }
+
+    return true;
+}
+
+static bool compare(const char* name, const std::string& how, const std::vector<Unit>& expected,
+    const std::vector<Unit>& units)
+{
+    if (units == expected)
+        return true;
+
+    for (size_t i = 0; i < units.size() && i < expected.size(); i++) {
+        if (!(units[i] == expected[i])) {
+            ERR("%s: pushed %s, access unit %zu differs from the one of the whole stream", name, how.c_str(), i);
+            return false;
+        }
+    }
+
+    ERR("%s: pushed %s, %zu access units, %zu in the whole stream", name, how.c_str(), units.size(), expected.size());
+    return false;
+}
+
+// numUnits is the access units of stream, if known, otherwise 0.
+static bool check(const char* name, GstVkAccessUnitFramer::Codec codec, const std::vector<uint8_t>& stream,
+    size_t numUnits)
+{
+    std::vector<Unit> expected = frame(codec, stream, { stream.size() });
+    std::mt19937 rng(stream.size());
+    std::vector<size_t> sizes;
+
+    if (!check_units(name, stream, expected))
+        return false;
+
+    if (numUnits > 0 && expected.size() != numUnits) {
+        ERR("%s: %zu access units, expected %zu", name, expected.size(), numUnits);
+        return false;
+    }
+
+    for (size_t size = 1; size <= 64; size++)
+        sizes.push_back(size);
+    sizes.insert(sizes.end(), { 100, 188, 1000, 4096 });
+
+    for (size_t size : sizes) {
+        if (!compare(name, "in chunks of " + std::to_string(size), expected, frame(codec, stream, { size })))
+            return false;
+    }
+
+    for (int i = 0; i < 100; i++) {
+        std::vector<size_t> chunks;
+
+        for (int j = 0; j < 32; j++)
+            chunks.push_back(1 + rng() % 300);
+        if (!compare(name, "in random chunks, seed " + std::to_string(stream.size()) + " round " + std::to_string(i),
+                expected, frame(codec, stream, chunks)))
+            return false;
+    }
+
+    for (size_t split = 1; split < stream.size(); split++) {
+        if (!compare(name, "split at " + std::to_string(split), expected,
+                frame(codec, stream, { split, stream.size() - split })))
+            return false;
+    }
+
+    INFO("%s: %zu access units, framed alike however pushed", name, expected.size());
+
+    return true;
+}
+
+// A NAL unit of nal with a 3-byte start code instead of its 4-byte one,
+// and zeros trailing, as trailing_zero_8bits.
+static void append_nal(std::vector<uint8_t>& stream, const std::vector<uint8_t>& nal, bool shortStartCode, int zeros)
+{
+    stream.insert(stream.end(), nal.begin() + (shortStartCode ? 1 : 0), nal.end());
+    stream.insert(stream.end(), zeros, 0x00);
+}
+
+// Groups of an IDR and P pictures, with start codes, trailing zeros, AUDs
+// and SEIs varying from one NAL unit to the next, as variant goes.
+static const int numFrames = 24;
+
+static std::vector<uint8_t> make_stream(int variant)
+{
+    std::vector<uint8_t> stream;
+    int n = 0;
+
+    for (int i = 0; i < numFrames; i++) {
+        std::vector<std::vector<uint8_t>> nals;
+
+        if (variant & 1)
+            nals.push_back({ 0x00, 0x00, 0x00, 0x01, 0x09, 0xf0 }); // AUD
+        if (i % 8 == 0) {
+            nals.emplace_back();
+            write_sps(nals.back());
+            nals.emplace_back();
+            write_pps(nals.back());
+        }
+        if (variant & 2)
+            nals.push_back({ 0x00, 0x00, 0x00, 0x01, 0x06, 0x05, 0x01, 0x00, 0x80 }); // SEI
+        nals.emplace_back();
+        write_slice({ i % 8, i % 8 ? 'P' : 'I' }, i % 8, (i / 8) % 2, nals.back());
+
+        for (const auto& nal : nals) {
+            n++;
+            append_nal(stream, nal, (variant & 4) && n % 3 != 0, (variant & 8) ? n % 5 : 0);
+        }
+    }
+
+    return stream;
+}
+
+int main(int argc, char** argv)
+{
+    GstVkAccessUnitFramer::Codec codec = GstVkAccessUnitFramer::H264;
+    gchar* codecName = NULL;
+    bool ret = true;
+
+    GOptionEntry entries[] = {
+        { "codec", 'c', 0, G_OPTION_ARG_STRING, &codecName, "Codec of the sample, h264 or h265", NULL },
+        { NULL }
+    };
+    GOptionContext* ctx;
+    GError* err = NULL;
+
+    g_set_prgname(argv[0]);
+
+    ctx = g_option_context_new("[FILE] - ACCESS UNIT FRAMER TEST");
+    g_option_context_add_main_entries(ctx, entries, NULL);
+
+    if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+        ERR("Error initializing: %s", err->message);
+        g_option_context_free(ctx);
+        g_clear_error(&err);
+        exit(EXIT_FAILURE);
+    }
+
+    g_option_context_free(ctx);
+
+    if (codecName && strcmp(codecName, "h265") == 0)
+        codec = GstVkAccessUnitFramer::H265;
+    g_free(codecName);
+
+    if (argc > 2) {
+        ERR("Please provide at most one filename.");
+        return EXIT_FAILURE;
+    }
+
+    if (argc == 2) {
+        gchar* contents;
+        gsize length;
+
+        if (!g_file_get_contents(argv[1], &contents, &length, &err)) {
+            ERR("Unable to read %s: %s", argv[1], err->message);
+            g_clear_error(&err);
+            return EXIT_FAILURE;
+        }
+
+        ret &= check(argv[1], codec, std::vector<uint8_t>(contents, contents + length), 0);
+        g_free(contents);
+    }
+
+    if (codec == GstVkAccessUnitFramer::H264) {
+        for (int variant = 0; variant < 16; variant++) {
+            std::string name = "synthesized stream " + std::to_string(variant);
+
+            ret &= check(name.c_str(), codec, make_stream(variant), numFrames);
+        }
+    }
+
+    return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
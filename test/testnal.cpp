@@ -0,0 +1,218 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Compares the start code scanning implementation picked by
+// GST_CODEC_NAL_IMPL=scalar|sse2|sse4.2|avx2|neon, or the default one, with
+// a byte by byte scan: a start code at every position of buffers of every
+// size up to past the widest block, at every alignment up to that of AVX2,
+// partial start codes at their tails, and random buffers dense in start
+// codes and zeros, also split in NAL units by gst_codec_nal_table_fill().
+// Skipped if the host can't run the implementation asked for.
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "gstcodecnal.h"
+#include "utils.h"
+
+// skipped, for meson
+static const int exitSkip = 77;
+
+// the widest block, 64 bytes, and the two bytes it looks past its end
+static const gsize maxBlock = 66;
+static const gsize maxAlignment = 32;
+
+static gsize find_start_code(const guint8* data, gsize size)
+{
+    for (gsize i = 0; i + 3 <= size; i++) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1)
+            return i;
+    }
+
+    return size;
+}
+
+static bool is_supported(const gchar* name)
+{
+    if (strcmp(name, "scalar") == 0)
+        return true;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if (strcmp(name, "sse2") == 0)
+        return __builtin_cpu_supports("sse2");
+    if (strcmp(name, "sse4.2") == 0)
+        return __builtin_cpu_supports("sse4.2");
+    if (strcmp(name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2");
+#elif defined(__GNUC__) && (defined(__aarch64__) || defined(__ARM_NEON))
+    if (strcmp(name, "neon") == 0)
+        return true;
+#endif
+    return false;
+}
+
+// The background of the buffers: no start code, but plenty of zeros and
+// ones, so every partial match is tried.
+static guint8 filler(gsize i)
+{
+    static const guint8 bytes[] = { 0x00, 0x00, 0x02, 0x01, 0x00, 0x03, 0x00, 0x00, 0x00, 0x80, 0x01, 0x00 };
+
+    return bytes[i % sizeof(bytes)];
+}
+
+static bool check_find(const guint8* data, gsize size, const char* what, gsize where)
+{
+    gsize expected = find_start_code(data, size);
+    gsize found = gst_codec_nal_find_start_code(data, size);
+
+    if (found == expected)
+        return true;
+
+    ERR("%s at %zu, in %zu bytes aligned to %zu: found at %zu, expected %zu", what, where, size,
+        GPOINTER_TO_SIZE(data) % maxAlignment, found, expected);
+    return false;
+}
+
+// A single start code at every position, and partial ones at the tail.
+static bool check_positions(void)
+{
+    std::vector<guint8> storage(4 * maxBlock + 2 * maxAlignment);
+    guint8* base = reinterpret_cast<guint8*>((GPOINTER_TO_SIZE(storage.data()) + maxAlignment - 1) / maxAlignment * maxAlignment);
+
+    for (gsize align = 0; align < maxAlignment; align++) {
+        guint8* data = base + align;
+
+        for (gsize size = 0; size <= 2 * maxBlock; size++) {
+            for (gsize i = 0; i < size; i++)
+                data[i] = filler(i);
+
+            if (!check_find(data, size, "no start code", 0))
+                return false;
+
+            for (gsize pos = 0; pos + 3 <= size; pos++) {
+                memcpy(data + pos, "\x00\x00\x01", 3);
+                if (!check_find(data, size, "start code", pos))
+                    return false;
+                // and again later, behind the first one
+                if (pos + 6 <= size) {
+                    memcpy(data + size - 3, "\x00\x00\x01", 3);
+                    if (!check_find(data + pos + 1, size - pos - 1, "second start code", size - 3))
+                        return false;
+                    for (gsize i = size - 3; i < size; i++)
+                        data[i] = filler(i);
+                }
+                for (gsize i = pos; i < pos + 3; i++)
+                    data[i] = filler(i);
+            }
+
+            // cut short at the tail
+            for (gsize cut = 1; cut <= 2 && cut <= size; cut++) {
+                memcpy(data + size - cut, "\x00\x00", cut);
+                if (!check_find(data, size, "partial start code", size - cut))
+                    return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Random buffers, dense in start codes, and their NAL units.
+static bool check_random(void)
+{
+    GRand* rand = g_rand_new_with_seed(0x265);
+    GArray* table = g_array_new(FALSE, FALSE, sizeof(GstCodecNal));
+    bool ret = true;
+
+    for (int round = 0; round < 2000 && ret; round++) {
+        gsize size = g_rand_int_range(rand, 0, round < 1000 ? 300 : 5000);
+        gsize align = g_rand_int_range(rand, 0, maxAlignment);
+        std::vector<guint8> storage(size + align);
+        guint8* data = storage.data() + align;
+        std::vector<GstCodecNal> expected;
+
+        for (gsize i = 0; i < size; i++) {
+            guint r = g_rand_int_range(rand, 0, 16);
+
+            data[i] = r < 8 ? 0x00 : r < 10 ? 0x01 : g_rand_int(rand);
+        }
+
+        for (gsize pos = 0; pos < size && ret; pos++)
+            ret = check_find(data + pos, size - pos, "random buffer", round);
+
+        // as gst_codec_nal_table_fill() documents
+        gsize pos = find_start_code(data, size);
+        while (pos < size) {
+            gsize next = pos + 3 + find_start_code(data + pos + 3, size - pos - 3);
+            GstCodecNal nal = { static_cast<guint32>(pos), static_cast<guint32>(next) };
+
+            while (nal.end > pos + 3 && data[nal.end - 1] == 0)
+                nal.end--;
+            expected.push_back(nal);
+            pos = next;
+        }
+
+        guint n_nals = gst_codec_nal_table_fill(table, data, size);
+
+        if (n_nals != expected.size()) {
+            ERR("random buffer %d: %u NAL units, expected %zu", round, n_nals, expected.size());
+            ret = false;
+            break;
+        }
+
+        for (guint i = 0; i < n_nals; i++) {
+            const GstCodecNal* nal = &g_array_index(table, GstCodecNal, i);
+
+            if (nal->sc_offset != expected[i].sc_offset || nal->end != expected[i].end) {
+                ERR("random buffer %d: NAL unit %u is [%u, %u), expected [%u, %u)", round, i, nal->sc_offset,
+                    nal->end, expected[i].sc_offset, expected[i].end);
+                ret = false;
+                break;
+            }
+        }
+    }
+
+    g_array_unref(table);
+    g_rand_free(rand);
+
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    const gchar* requested = g_getenv("GST_CODEC_NAL_IMPL");
+    const gchar* impl;
+
+    if (requested && !is_supported(requested)) {
+        INFO("%s isn't supported by this host", requested);
+        return exitSkip;
+    }
+
+    impl = gst_codec_nal_get_impl_name();
+    if (requested && strcmp(impl, requested) != 0) {
+        ERR("%s asked for, %s picked", requested, impl);
+        return EXIT_FAILURE;
+    }
+
+    if (!check_positions() || !check_random())
+        return EXIT_FAILURE;
+
+    INFO("%s: start codes found as byte by byte", impl);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,254 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Parses an H.264 stream with B-frames, long GOPs and a PPS changing every
+// few of them, big enough to be cut in several segments, both with
+// ParseByteStream() and ParseVulkanVideoDecodeParserStream(), and checks
+// the callbacks are the same, in the same order. With -c h265 and a
+// sample, checks instead that ParseVulkanVideoDecodeParserStream() fails
+// on it without calling back, and leaves the parser to parse it serially.
+
+#include <cstring>
+
+#include "h264writer.h"
+#include "testclient.h"
+
+static const int numPictures = 65536;
+static const int gopSize = 64;
+
+struct Event {
+    char callback;
+    int32_t poc;
+    int32_t frameNum;
+    int32_t qp;
+    int32_t ref;
+    ptrdiff_t picture;
+
+    bool operator!=(const Event& other) const
+    {
+        return callback != other.callback || poc != other.poc || frameNum != other.frameNum
+            || qp != other.qp || ref != other.ref || picture != other.picture;
+    }
+};
+
+class RecordingClient : public TestClient {
+public:
+    RecordingClient()
+        : TestClient(17)
+    {
+    }
+
+    bool DecodePicture(VkParserPictureData* pd) final
+    {
+        m_events.push_back({ 'D', pd->picture_order_count, pd->CodecSpecific.h264.frame_num,
+            pd->CodecSpecific.h264.pic_init_qp_minus26, pd->ref_pic_flag, Index(pd->pCurrPic) });
+        return true;
+    }
+
+    bool DisplayPicture(VkPicIf* pic, int64_t) final
+    {
+        m_events.push_back({ 'P', 0, 0, 0, 0, Index(pic) });
+        return true;
+    }
+
+    const std::vector<Event>& events() const { return m_events; }
+
+private:
+    std::vector<Event> m_events;
+};
+
+// in decode order, I0 P3 B1 B2 P6 B4 B5 ... up to the next IDR, with the
+// PPS changing every 5 GOPs
+static std::vector<uint8_t> write_stream()
+{
+    std::vector<uint8_t> stream;
+    int frameNum = 0;
+
+    for (int i = 0; i < numPictures; i++) {
+        int gop = i / gopSize;
+        int n = i % gopSize;
+        Frame frame;
+
+        if (n == 0) {
+            frame = { 0, 'I' };
+            frameNum = 0;
+            write_sps(stream);
+            write_pps(stream, (gop / 5) % 4);
+        } else if (n % 3 == 1) {
+            frame = { n + 2, 'P' };
+        } else {
+            frame = { n - 1, 'B' };
+        }
+
+        write_slice(frame, frameNum, gop % 2, stream);
+
+        if (frame.type != 'B')
+            frameNum = (frameNum + 1) % 16;
+    }
+
+    return stream;
+}
+
+static bool parse(const std::vector<uint8_t>& stream, bool offline, bool pipelined, uint32_t threads, RecordingClient* client)
+{
+    VulkanVideoDecodeParser* parser;
+    VkParserInitDecodeParameters params = {
+        .bOutOfBandPictureParameters = true,
+        .bDirectDrive = true,
+        .bPipelinedParsing = pipelined,
+    };
+    bool ret = true;
+
+    parser = create_h264_parser(client, params);
+    if (!parser)
+        return false;
+
+    if (offline) {
+        ret = ParseVulkanVideoDecodeParserStream(parser, stream.data(), stream.size(), threads);
+    } else {
+        for (size_t offset = 0; offset < stream.size() && ret; offset += BUFSIZ) {
+            size_t len = std::min<size_t>(BUFSIZ, stream.size() - offset);
+
+            ret = parse_packet(parser, stream.data() + offset, len, offset + len == stream.size());
+        }
+    }
+
+    destroy_parser(parser);
+
+    return ret;
+}
+
+// H.265 slice headers aren't parsed ahead, so offline parsing refuses it.
+static bool check_h265(const char* filename, uint32_t threads)
+{
+    RecordingClient client;
+    VulkanVideoDecodeParser* parser;
+    VkParserInitDecodeParameters params = {
+        .bOutOfBandPictureParameters = true,
+        .bDirectDrive = true,
+    };
+    bool ret = true;
+
+    std::vector<uint8_t> stream = read_file(filename);
+    if (stream.empty())
+        return false;
+
+    parser = create_parser(VK_VIDEO_CODEC_OPERATION_DECODE_H265_BIT_EXT, &client, params);
+    if (!parser)
+        return false;
+
+    if (ParseVulkanVideoDecodeParserStream(parser, stream.data(), stream.size(), threads)) {
+        ERR("H.265 stream parsed offline");
+        ret = false;
+    } else if (!client.events().empty()) {
+        ERR("%zu callbacks from a failed offline parse", client.events().size());
+        ret = false;
+    }
+
+    for (size_t offset = 0; offset < stream.size() && ret; offset += BUFSIZ) {
+        size_t len = std::min<size_t>(BUFSIZ, stream.size() - offset);
+
+        ret = parse_packet(parser, stream.data() + offset, len, offset + len == stream.size());
+        if (!ret)
+            ERR("failed to parse bitstream after the offline parse failed.");
+    }
+
+    destroy_parser(parser);
+
+    if (ret && client.events().empty()) {
+        ERR("no picture decoded after the offline parse failed");
+        ret = false;
+    }
+
+    if (ret)
+        INFO("H.265 refused offline, %zu callbacks parsed serially", client.events().size());
+
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    gboolean pipelined = FALSE;
+    gint threads = 4;
+    gchar* codecName = NULL;
+    bool h265;
+
+    GOptionEntry entries[] = {
+        { "codec", 'c', 0, G_OPTION_ARG_STRING, &codecName, "h264, synthesized, or h265, with a sample", NULL },
+        { "pipelined", 'p', 0, G_OPTION_ARG_NONE, &pipelined, "Parse slice headers ahead of decoding", NULL },
+        { "threads", 't', 0, G_OPTION_ARG_INT, &threads, "Threads of the offline parse, 0 for one per CPU", NULL },
+        { NULL }
+    };
+
+    parse_options(&argc, &argv, "[FILE] - OFFLINE TEST", entries);
+
+    h265 = codecName && strcmp(codecName, "h265") == 0;
+    g_free(codecName);
+
+    if (threads < 0) {
+        ERR("Invalid number of threads.");
+        exit(EXIT_FAILURE);
+    }
+
+    if (h265) {
+        if (argc != 2) {
+            ERR("Please provide one H.265 filename.");
+            return EXIT_FAILURE;
+        }
+        return check_h265(argv[1], threads) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> stream = write_stream();
+    RecordingClient serial, offline;
+
+    if (!parse(stream, false, pipelined, 0, &serial)) {
+        ERR("failed to parse bitstream.");
+        return EXIT_FAILURE;
+    }
+
+    if (!parse(stream, true, pipelined, threads, &offline)) {
+        ERR("failed to parse stream offline.");
+        return EXIT_FAILURE;
+    }
+
+    const std::vector<Event>& expected = serial.events();
+    const std::vector<Event>& events = offline.events();
+    int decoded = std::count_if(expected.begin(), expected.end(), [](const Event& e) { return e.callback == 'D'; });
+
+    if (decoded != numPictures) {
+        ERR("%d pictures decoded, expected %d", decoded, numPictures);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < std::min(expected.size(), events.size()); i++) {
+        if (events[i] != expected[i]) {
+            ERR("callback %zu: %c of picture %td (POC %d), expected %c of picture %td (POC %d)",
+                i, events[i].callback, events[i].picture, events[i].poc,
+                expected[i].callback, expected[i].picture, expected[i].poc);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (events.size() != expected.size()) {
+        ERR("%zu callbacks, expected %zu", events.size(), expected.size());
+        return EXIT_FAILURE;
+    }
+
+    INFO("%zu callbacks, %zu bytes", events.size(), stream.size());
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,138 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Feeds an H.264 stream repeating its SPS and PPS before every IDR, as
+// broadcast streams do, and checks UpdatePictureParameters() is only called
+// when they change, and that a PPS coming back gets its content generation
+// back.
+
+#include "h264writer.h"
+#include "testclient.h"
+
+static const int numGops = 5;
+// the PPS of the fourth GOP differs, the fifth goes back to the first one
+static const int changedGop = 3;
+// the SPS once, and the PPS of the first, fourth and fifth GOPs
+static const int expectedSpsUpdates = 1;
+static const int expectedPpsUpdates = 3;
+// the fifth GOP's PPS is the first one again
+static const uint32_t expectedPpsGenerations[] = { 1, 2, 1 };
+
+class ParamSetsClient : public TestClient {
+public:
+    bool DecodePicture(VkParserPictureData*) final
+    {
+        m_decoded++;
+        return true;
+    }
+
+    bool UpdatePictureParameters(VkPictureParameters* params, VkSharedBaseObj<VkParserVideoRefCountBase>& shared, uint64_t count) final
+    {
+        if (params->updateType == VK_PICTURE_PARAMETERS_UPDATE_H264_SPS)
+            m_spsUpdates++;
+        else if (params->updateType == VK_PICTURE_PARAMETERS_UPDATE_H264_PPS)
+            m_ppsGenerations.push_back(params->contentGeneration);
+        return TestClient::UpdatePictureParameters(params, shared, count);
+    }
+
+    int decoded() const { return m_decoded; }
+    int spsUpdates() const { return m_spsUpdates; }
+    int ppsUpdates() const { return static_cast<int>(m_ppsGenerations.size()); }
+    const std::vector<uint32_t>& ppsGenerations() const { return m_ppsGenerations; }
+
+private:
+    int m_decoded = 0;
+    int m_spsUpdates = 0;
+    std::vector<uint32_t> m_ppsGenerations;
+};
+
+static bool run(bool direct)
+{
+    static const Frame gop[] = { { 0, 'I' }, { 1, 'P' }, { 2, 'P' } };
+    const char* mode = direct ? "direct" : "harness";
+    VulkanVideoDecodeParser* parser;
+    ParamSetsClient client;
+    VkParserInitDecodeParameters params = {
+        .bOutOfBandPictureParameters = true,
+        .bDirectDrive = direct,
+    };
+    bool ret = true;
+
+    parser = create_h264_parser(&client, params);
+    if (!parser)
+        return false;
+
+    for (int i = 0; i < numGops && ret; i++) {
+        for (size_t j = 0; j < G_N_ELEMENTS(gop); j++) {
+            std::vector<uint8_t> au;
+
+            if (j == 0) {
+                write_sps(au);
+                write_pps(au, i == changedGop ? 1 : 0);
+            }
+            write_slice(gop[j], j, i % 2, au);
+
+            if (!parse_packet(parser, au.data(), au.size(), i == numGops - 1 && j == G_N_ELEMENTS(gop) - 1)) {
+                ERR("failed to parse bitstream.");
+                ret = false;
+                break;
+            }
+        }
+    }
+
+    destroy_parser(parser);
+
+    if (client.decoded() != numGops * static_cast<int>(G_N_ELEMENTS(gop))) {
+        ERR("%s: %d pictures decoded, expected %d", mode, client.decoded(),
+            numGops * static_cast<int>(G_N_ELEMENTS(gop)));
+        ret = false;
+    }
+
+    if (client.spsUpdates() != expectedSpsUpdates) {
+        ERR("%s: %d SPS updates, expected %d", mode, client.spsUpdates(), expectedSpsUpdates);
+        ret = false;
+    }
+
+    if (client.ppsUpdates() != expectedPpsUpdates) {
+        ERR("%s: %d PPS updates, expected %d", mode, client.ppsUpdates(), expectedPpsUpdates);
+        ret = false;
+    } else {
+        for (size_t i = 0; i < G_N_ELEMENTS(expectedPpsGenerations); i++) {
+            if (client.ppsGenerations()[i] != expectedPpsGenerations[i]) {
+                ERR("%s: PPS update %zu with content generation %u, expected %u", mode, i,
+                    client.ppsGenerations()[i], expectedPpsGenerations[i]);
+                ret = false;
+            }
+        }
+    }
+
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    gboolean direct = FALSE;
+
+    GOptionEntry entries[] = {
+        { "direct", 'd', 0, G_OPTION_ARG_NONE, &direct, "Drive the decoder without a pipeline", NULL },
+        { NULL }
+    };
+
+    parse_options(&argc, &argv, "PARAMETER SETS TEST", entries);
+
+    return run(direct) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
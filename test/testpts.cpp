@@ -0,0 +1,129 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Feeds an H.264 stream with B-frames, one access unit per packet, each with
+// its PTS, and checks DisplayPicture() gets them back in display order, also
+// with the slice headers parsed ahead of decoding.
+
+#include "h264writer.h"
+#include "testclient.h"
+
+// 90 kHz, 30 fps
+static const int64_t clockRate = 90000;
+static const int64_t frameTicks = 3000;
+
+static std::vector<uint8_t> make_access_unit(const Frame& frame, int frameNum, bool first)
+{
+    std::vector<uint8_t> au;
+
+    if (first) {
+        write_sps(au);
+        write_pps(au);
+    }
+    write_slice(frame, frameNum, 0, au);
+
+    return au;
+}
+
+class PtsClient : public TestClient {
+public:
+    bool DisplayPicture(VkPicIf*, int64_t timestamp) final
+    {
+        m_timestamps.push_back(timestamp);
+        return true;
+    }
+
+    const std::vector<int64_t>& timestamps() const { return m_timestamps; }
+
+private:
+    std::vector<int64_t> m_timestamps;
+};
+
+static bool run(bool direct, bool pipelined)
+{
+    // decode order of I0 B1 B2 P3 B4 B5 P6 ...
+    static const Frame frames[] = {
+        { 0, 'I' },
+        { 3, 'P' }, { 1, 'B' }, { 2, 'B' },
+        { 6, 'P' }, { 4, 'B' }, { 5, 'B' },
+        { 9, 'P' }, { 7, 'B' }, { 8, 'B' },
+        { 12, 'P' }, { 10, 'B' }, { 11, 'B' },
+        { 15, 'P' }, { 13, 'B' }, { 14, 'B' },
+    };
+    VulkanVideoDecodeParser* parser;
+    PtsClient client;
+    VkParserInitDecodeParameters params = {
+        .lReferenceClockRate = clockRate,
+        .bOutOfBandPictureParameters = true,
+        .bDirectDrive = direct,
+        .bPipelinedParsing = pipelined,
+    };
+    int frameNum = 0;
+    bool ret = true;
+
+    parser = create_h264_parser(&client, params);
+    if (!parser)
+        return false;
+
+    for (size_t i = 0; i < G_N_ELEMENTS(frames); i++) {
+        std::vector<uint8_t> au = make_access_unit(frames[i], frameNum, i == 0);
+
+        if (!parse_packet(parser, au.data(), au.size(), i == G_N_ELEMENTS(frames) - 1, true, frames[i].display * frameTicks)) {
+            ERR("failed to parse bitstream.");
+            ret = false;
+            break;
+        }
+
+        if (frames[i].type != 'B')
+            frameNum = (frameNum + 1) % 16;
+    }
+
+    destroy_parser(parser);
+
+    const std::vector<int64_t>& timestamps = client.timestamps();
+
+    if (timestamps.size() != G_N_ELEMENTS(frames)) {
+        ERR("%s: %zu pictures displayed, expected %zu", direct ? "direct" : "harness",
+            timestamps.size(), G_N_ELEMENTS(frames));
+        return false;
+    }
+
+    for (size_t i = 0; i < timestamps.size(); i++) {
+        if (timestamps[i] != static_cast<int64_t>(i) * frameTicks) {
+            ERR("%s: picture %zu displayed with timestamp %" G_GINT64_FORMAT ", expected %" G_GINT64_FORMAT,
+                direct ? "direct" : "harness", i, timestamps[i], static_cast<int64_t>(i) * frameTicks);
+            ret = false;
+        }
+    }
+
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    gboolean direct = FALSE, pipelined = FALSE;
+
+    GOptionEntry entries[] = {
+        { "direct", 'd', 0, G_OPTION_ARG_NONE, &direct, "Drive the decoder without a pipeline", NULL },
+        { "pipelined", 'p', 0, G_OPTION_ARG_NONE, &pipelined, "Parse slice headers ahead of decoding", NULL },
+        { NULL }
+    };
+
+    parse_options(&argc, &argv, "PTS TEST", entries);
+
+    return run(direct, pipelined) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,189 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Parses an H.265 stream whose pictures reference the previous ones
+// through a sliding-window RPS, as Sample_10.hevc does, and checks where
+// RefPics keeps them: a picture takes a slot none of its references is in,
+// keeps it while referenced, and the RefPicSet entries point at the slots of
+// the pictures before the current one, in decreasing POC order.
+
+#include <cstdarg>
+#include <map>
+
+#include "testclient.h"
+
+// sps_max_dec_pic_buffering_minus1 of Sample_10.hevc: the pictures in the
+// window
+static const int window = 4;
+
+class RefPicsClient : public TestClient {
+public:
+    bool DecodePicture(VkParserPictureData* pic) final
+    {
+        const VkParserHevcPictureData& hevc = pic->CodecSpecific.hevc;
+        int32_t poc = hevc.CurrPicOrderCntVal;
+        std::vector<bool> taken(G_N_ELEMENTS(hevc.RefPics), false);
+        int refs = 0;
+
+        for (size_t i = 0; i < G_N_ELEMENTS(hevc.RefPics); i++) {
+            VkPicIf* ref = hevc.RefPics[i];
+
+            if (!ref)
+                continue;
+
+            taken[i] = true;
+            refs++;
+
+            auto it = m_slots.find(ref);
+            if (it == m_slots.end()) {
+                Error(poc, "RefPics[%zu] is no picture decoded before", i);
+                continue;
+            }
+
+            Slot& slot = it->second;
+            if (slot.index < 0) {
+                if (slot.taken[i])
+                    Error(poc, "picture %d is in RefPics[%zu], taken by one of its references", slot.poc, i);
+                slot.index = i;
+            } else if (slot.index != static_cast<int>(i)) {
+                Error(poc, "picture %d moved from RefPics[%d] to RefPics[%zu]", slot.poc, slot.index, i);
+            }
+
+            if (hevc.PicOrderCntVal[i] != slot.poc)
+                Error(poc, "PicOrderCntVal[%zu] is %d, expected %d", i, hevc.PicOrderCntVal[i], slot.poc);
+        }
+
+        // the window: the previous pictures, up to those the DPB holds
+        int expected = std::min<int32_t>(poc - m_idrPoc, window);
+
+        if (hevc.IdrPicFlag) {
+            m_idrPoc = poc;
+            expected = 0;
+        }
+
+        if (hevc.NumPocStCurrBefore != expected || refs != expected) {
+            Error(poc, "%d references, %d before it, expected %d", refs, hevc.NumPocStCurrBefore, expected);
+        } else {
+            for (int i = 0; i < expected; i++) {
+                int index = hevc.RefPicSetStCurrBefore[i];
+
+                if (index < 0 || index >= static_cast<int>(G_N_ELEMENTS(hevc.RefPics)) || !hevc.RefPics[index]) {
+                    Error(poc, "RefPicSetStCurrBefore[%d] is %d, an empty slot", i, index);
+                    continue;
+                }
+                if (hevc.PicOrderCntVal[index] != poc - 1 - i)
+                    Error(poc, "RefPicSetStCurrBefore[%d] is picture %d, expected %d", i,
+                        hevc.PicOrderCntVal[index], poc - 1 - i);
+            }
+        }
+
+        // a picture from the pool might have been another one before
+        m_slots[pic->pCurrPic] = Slot { poc, -1, taken };
+        m_decoded++;
+
+        return true;
+    }
+
+    int decoded() const { return m_decoded; }
+    int errors() const { return m_errors; }
+
+private:
+    struct Slot {
+        int32_t poc;
+        // in RefPics, once referenced
+        int index;
+        // the slots of the references of the picture
+        std::vector<bool> taken;
+    };
+
+    void Error(int32_t poc, const char* format, ...) G_GNUC_PRINTF(3, 4)
+    {
+        va_list args;
+        gchar* message;
+
+        va_start(args, format);
+        message = g_strdup_vprintf(format, args);
+        va_end(args);
+
+        ERR("picture %d: %s", poc, message);
+        g_free(message);
+        m_errors++;
+    }
+
+    std::map<VkPicIf*, Slot> m_slots;
+    int32_t m_idrPoc = 0;
+    int m_decoded = 0;
+    int m_errors = 0;
+};
+
+static bool run(const char* filename, bool direct)
+{
+    const char* mode = direct ? "direct" : "harness";
+    std::vector<uint8_t> stream = read_file(filename);
+    VulkanVideoDecodeParser* parser;
+    RefPicsClient client;
+    VkParserInitDecodeParameters params = {
+        .bOutOfBandPictureParameters = true,
+        .bDirectDrive = direct,
+    };
+    bool ret = true;
+
+    if (stream.empty())
+        return false;
+
+    parser = create_parser(VK_VIDEO_CODEC_OPERATION_DECODE_H265_BIT_EXT, &client, params);
+    if (!parser)
+        return false;
+
+    if (!parse_packet(parser, stream.data(), stream.size(), true)) {
+        ERR("%s: failed to parse bitstream.", mode);
+        ret = false;
+    }
+
+    destroy_parser(parser);
+
+    if (client.decoded() == 0) {
+        ERR("%s: no picture decoded", mode);
+        ret = false;
+    }
+
+    if (client.errors() > 0) {
+        ERR("%s: %d errors in %d pictures", mode, client.errors(), client.decoded());
+        ret = false;
+    }
+
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    gboolean direct = FALSE;
+
+    GOptionEntry entries[] = {
+        { "direct", 'd', 0, G_OPTION_ARG_NONE, &direct, "Drive the decoder without a pipeline", NULL },
+        { NULL }
+    };
+
+    parse_options(&argc, &argv, "FILE - H.265 REFERENCE PICTURES TEST", entries);
+
+    if (argc != 2) {
+        ERR("Please provide one filename.");
+        return EXIT_FAILURE;
+    }
+
+    return run(argv[1], direct) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
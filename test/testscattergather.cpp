@@ -0,0 +1,225 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Parses a sample with and without bScatterGatherSlices, copying and
+// borrowing the packets, and checks the segments of every picture gather
+// into the pBitstreamData it gets when copying, slice by slice, each one
+// with its start code and emulation prevention bytes. Packets are poisoned
+// and freed as soon as ParseByteStream() returns, so segments still
+// pointing into them when DecodePicture() reads them don't match.
+
+#include <cstring>
+#include <vector>
+
+#include "testclient.h"
+
+// cycled through, so access units and NAL units straddle packets
+static const size_t packetSizes[] = { 1, 2, 5, 17, 188, 1024 };
+
+struct PictureBitstream {
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> offsets;
+};
+
+class BitstreamClient : public TestClient {
+public:
+    explicit BitstreamClient(bool scatterGather)
+        : m_scatterGather(scatterGather)
+    {
+    }
+
+    bool DecodePicture(VkParserPictureData* pic) final
+    {
+        PictureBitstream bitstream;
+        size_t index = m_pictures.size();
+
+        bitstream.offsets.assign(pic->pSliceDataOffsets, pic->pSliceDataOffsets + pic->nNumSlices + 1);
+
+        if (!m_scatterGather) {
+            if (pic->pSliceSegments) {
+                ERR("picture %zu: slice segments without scatter-gather", index);
+                m_errors++;
+            }
+            bitstream.data.assign(pic->pBitstreamData, pic->pBitstreamData + bitstream.offsets.back());
+            m_pictures.push_back(std::move(bitstream));
+            return true;
+        }
+
+        if (pic->pBitstreamData || !pic->pSliceSegments) {
+            ERR("picture %zu: bitstream data instead of slice segments", index);
+            m_errors++;
+            return true;
+        }
+
+        if (pic->nBitstreamDataLen != bitstream.offsets.back()) {
+            ERR("picture %zu: %u bytes of bitstream data, the offsets span %u", index, pic->nBitstreamDataLen,
+                bitstream.offsets.back());
+            m_errors++;
+        }
+
+        for (uint32_t i = 0; i < pic->nNumSlices; i++) {
+            const VkParserSliceSegment& segment = pic->pSliceSegments[i];
+
+            if (segment.nDataLen != bitstream.offsets[i + 1] - bitstream.offsets[i]) {
+                ERR("picture %zu: segment %u is %zu bytes, its offsets span %u", index, i, segment.nDataLen,
+                    bitstream.offsets[i + 1] - bitstream.offsets[i]);
+                m_errors++;
+            }
+            if (segment.nDataLen < 4 || memcmp(segment.pData, "\x00\x00\x01", 3) != 0) {
+                ERR("picture %zu: segment %u doesn't begin with a start code", index, i);
+                m_errors++;
+                continue;
+            }
+            bitstream.data.insert(bitstream.data.end(), segment.pData, segment.pData + segment.nDataLen);
+        }
+
+        m_pictures.push_back(std::move(bitstream));
+
+        return true;
+    }
+
+    const std::vector<PictureBitstream>& pictures() const { return m_pictures; }
+    int errors() const { return m_errors; }
+
+private:
+    bool m_scatterGather;
+    std::vector<PictureBitstream> m_pictures;
+    int m_errors = 0;
+};
+
+// The bitstream of every picture of stream, empty on failure.
+static std::vector<PictureBitstream> parse(VkVideoCodecOperationFlagBitsKHR codec, const std::vector<uint8_t>& stream,
+    bool direct, bool zeroCopy, bool scatterGather)
+{
+    VulkanVideoDecodeParser* parser;
+    BitstreamClient client(scatterGather);
+    VkParserInitDecodeParameters params = {
+        .bOutOfBandPictureParameters = true,
+        .bZeroCopyByteStream = zeroCopy,
+        .bDirectDrive = direct,
+        .bScatterGatherSlices = scatterGather,
+    };
+    bool ret = true;
+
+    parser = create_parser(codec, &client, params);
+    if (!parser) {
+        ERR("failed to create the parser");
+        return {};
+    }
+
+    for (size_t offset = 0, i = 0; ret && offset < stream.size(); i++) {
+        size_t size = std::min(packetSizes[i % G_N_ELEMENTS(packetSizes)], stream.size() - offset);
+        uint8_t* packet = new uint8_t[size];
+
+        memcpy(packet, stream.data() + offset, size);
+        offset += size;
+
+        if (!parse_packet(parser, packet, size, offset == stream.size())) {
+            ERR("failed to parse bitstream.");
+            ret = false;
+        }
+
+        // nothing may read it from now on
+        memset(packet, 0xa5, size);
+        delete[] packet;
+    }
+
+    destroy_parser(parser);
+
+    if (!ret || client.errors() > 0)
+        return {};
+
+    return client.pictures();
+}
+
+// Checks the scatter-gather pictures are the copied ones, which have to
+// hold slices with emulation prevention bytes for the check to be of any
+// use.
+static bool compare(const char* mode, const std::vector<PictureBitstream>& copied,
+    const std::vector<PictureBitstream>& gathered)
+{
+    int emulationPrevention = 0;
+    bool ret = true;
+
+    if (gathered.size() != copied.size()) {
+        ERR("%s: %zu pictures decoded, %zu when copying", mode, gathered.size(), copied.size());
+        return false;
+    }
+
+    for (size_t i = 0; i < copied.size(); i++) {
+        if (gathered[i].offsets != copied[i].offsets) {
+            ERR("%s: the slice offsets of picture %zu differ", mode, i);
+            ret = false;
+        } else if (gathered[i].data != copied[i].data) {
+            ERR("%s: the gathered segments of picture %zu differ from its bitstream data", mode, i);
+            ret = false;
+        }
+
+        for (size_t j = 2; j < copied[i].data.size(); j++) {
+            if (copied[i].data[j] == 0x03 && copied[i].data[j - 1] == 0x00 && copied[i].data[j - 2] == 0x00)
+                emulationPrevention++;
+        }
+    }
+
+    if (emulationPrevention == 0) {
+        ERR("%s: no slice with emulation prevention bytes", mode);
+        ret = false;
+    }
+
+    if (ret)
+        INFO("%s: %zu pictures gathered as copied", mode, copied.size());
+
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    VkVideoCodecOperationFlagBitsKHR codec = VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_EXT;
+    gchar* codecName = NULL;
+    gboolean direct = FALSE;
+    bool ret = true;
+
+    GOptionEntry entries[] = {
+        { "codec", 'c', 0, G_OPTION_ARG_STRING, &codecName, "Codec of the sample, h264 or h265", NULL },
+        { "direct", 'd', 0, G_OPTION_ARG_NONE, &direct, "Drive the decoder without a pipeline", NULL },
+        { NULL }
+    };
+
+    parse_options(&argc, &argv, "FILE - SCATTER-GATHER TEST", entries);
+
+    if (codecName && strcmp(codecName, "h265") == 0)
+        codec = VK_VIDEO_CODEC_OPERATION_DECODE_H265_BIT_EXT;
+    g_free(codecName);
+
+    if (argc != 2) {
+        ERR("Please provide one filename.");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> stream = read_file(argv[1]);
+    if (stream.empty())
+        return EXIT_FAILURE;
+
+    std::vector<PictureBitstream> copied = parse(codec, stream, direct, false, false);
+    if (copied.empty())
+        return EXIT_FAILURE;
+
+    ret &= compare("copy", copied, parse(codec, stream, direct, false, true));
+    ret &= compare("zero-copy", copied, parse(codec, stream, direct, true, true));
+
+    return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
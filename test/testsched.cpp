@@ -0,0 +1,152 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Feeds numbered packets from a single thread to many streams of mixed
+// priorities and latencies on a scheduler with a few threads, and checks
+// every stream parses them in order and on one thread at a time, although
+// the streams move between threads, taken from one another's queues.
+
+#include <cstdlib>
+#include <memory>
+#include <set>
+
+#include "gstvkparsescheduler.h"
+#include "gstvkparseworker.h"
+#include "utils.h"
+
+struct Stream {
+    std::unique_ptr<GstVkParseWorker> worker;
+    uint64_t next = 0;
+    std::atomic<int> running { 0 };
+    std::atomic<int> outOfOrder { 0 };
+    std::atomic<int> overlapping { 0 };
+    std::mutex lock;
+    std::set<std::thread::id> threads;
+};
+
+static bool parse(Stream* stream, const GstVkParseWorker::Packet& pkt)
+{
+    if (stream->running++ > 0)
+        stream->overlapping++;
+
+    if (pkt.pts != stream->next)
+        stream->outOfOrder++;
+    stream->next = pkt.pts + 1;
+
+    {
+        std::lock_guard<std::mutex> lock(stream->lock);
+        stream->threads.insert(std::this_thread::get_id());
+    }
+
+    // long enough for the other threads to look for work meanwhile
+    std::this_thread::yield();
+
+    stream->running--;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    gint threads = 4, numStreams = 32, packets = 200;
+    std::vector<std::unique_ptr<Stream>> streams;
+    const uint8_t data[16] = { 0, };
+    int moved = 0;
+    bool ret = true;
+
+    GOptionEntry entries[] = {
+        { "threads", 't', 0, G_OPTION_ARG_INT, &threads, "Scheduler threads", NULL },
+        { "streams", 's', 0, G_OPTION_ARG_INT, &numStreams, "Streams fed at once", NULL },
+        { "packets", 'n', 0, G_OPTION_ARG_INT, &packets, "Packets per stream", NULL },
+        { NULL }
+    };
+    GOptionContext* ctx;
+    GError* err = NULL;
+
+    g_set_prgname(argv[0]);
+
+    ctx = g_option_context_new("SCHEDULER TEST");
+    g_option_context_add_main_entries(ctx, entries, NULL);
+
+    if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+        ERR("Error initializing: %s", err->message);
+        g_option_context_free(ctx);
+        g_clear_error(&err);
+        exit(EXIT_FAILURE);
+    }
+
+    g_option_context_free(ctx);
+
+    if (threads < 2 || numStreams <= 0 || packets <= 0) {
+        ERR("Invalid number of threads, streams or packets.");
+        exit(EXIT_FAILURE);
+    }
+
+    GstVkParseScheduler::Configure(threads, false);
+
+    for (int i = 0; i < numStreams; i++) {
+        Stream* stream = new Stream();
+
+        streams.emplace_back(stream);
+        stream->worker.reset(new GstVkParseWorker(
+            4, [stream](const GstVkParseWorker::Packet& pkt) { return parse(stream, pkt); },
+            true, i % 3, (i % 4) * 100));
+    }
+
+    for (int i = 0; i < packets && ret; i++) {
+        for (auto& stream : streams) {
+            if (!stream->worker->Push(data, sizeof(data), i, i == packets - 1)) {
+                ERR("failed to parse packet %d", i);
+                ret = false;
+                break;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < streams.size(); i++) {
+        Stream* stream = streams[i].get();
+
+        if (!stream->worker->Flush(false)) {
+            ERR("stream %zu: failed to parse", i);
+            ret = false;
+        }
+        stream->worker.reset();
+
+        if (ret && stream->next != static_cast<uint64_t>(packets)) {
+            ERR("stream %zu: %" G_GUINT64_FORMAT " packets parsed, expected %d", i, stream->next, packets);
+            ret = false;
+        }
+        if (stream->outOfOrder > 0) {
+            ERR("stream %zu: %d packets parsed out of order", i, stream->outOfOrder.load());
+            ret = false;
+        }
+        if (stream->overlapping > 0) {
+            ERR("stream %zu: %d packets parsed while another one was", i, stream->overlapping.load());
+            ret = false;
+        }
+        if (stream->threads.size() > 1)
+            moved++;
+    }
+
+    INFO("%d of %d streams parsed by more than one thread", moved, numStreams);
+
+    if (moved == 0) {
+        ERR("no stream was taken by another thread");
+        ret = false;
+    }
+
+    return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,284 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Compares the slice group maps of every map type with those of the
+// pseudo-code of H.264 8.2.2.1 to 8.2.2.7, transcribed one map unit at a
+// time, for odd and even picture sizes, both change directions and every
+// slice_group_change_cycle up to past the one covering the picture, in
+// both orders, so that evolving maps are also evicted and made again.
+
+#include <glib.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "gstvkslicegroupmap.h"
+#include "utils.h"
+
+// mapUnitToSliceGroupMap of 8.2.2
+static std::vector<guint8> reference_map(const GstH264PPS* pps, guint cycle)
+{
+    const gint PicWidthInMbs = pps->sequence->pic_width_in_mbs_minus1 + 1;
+    const gint PicHeightInMapUnits = pps->sequence->pic_height_in_map_units_minus1 + 1;
+    const gint PicSizeInMapUnits = PicWidthInMbs * PicHeightInMapUnits;
+    const gint num_slice_groups_minus1 = pps->num_slice_groups_minus1;
+    const gint slice_group_change_direction_flag = pps->slice_group_change_direction_flag;
+    const gint SliceGroupChangeRate = pps->slice_group_change_rate_minus1 + 1;
+    // (7-34), (8-14), (8-15)
+    const gint mapUnitsInSliceGroup0 = std::min<gint64>(static_cast<gint64>(cycle) * SliceGroupChangeRate, PicSizeInMapUnits);
+    const gint sizeOfUpperLeftGroup = slice_group_change_direction_flag ? PicSizeInMapUnits - mapUnitsInSliceGroup0 : mapUnitsInSliceGroup0;
+    std::vector<guint8> mapUnitToSliceGroupMap(PicSizeInMapUnits, 0);
+    gint i, j, k, x, y, iGroup;
+
+    if (num_slice_groups_minus1 == 0)
+        return mapUnitToSliceGroupMap;
+
+    switch (pps->slice_group_map_type) {
+    case 0: // 8.2.2.1
+        i = 0;
+        do
+            for (iGroup = 0; iGroup <= num_slice_groups_minus1 && i < PicSizeInMapUnits; i += pps->run_length_minus1[iGroup++] + 1)
+                for (j = 0; j <= static_cast<gint>(pps->run_length_minus1[iGroup]) && i + j < PicSizeInMapUnits; j++)
+                    mapUnitToSliceGroupMap[i + j] = iGroup;
+        while (i < PicSizeInMapUnits);
+        break;
+    case 1: // 8.2.2.2
+        for (i = 0; i < PicSizeInMapUnits; i++)
+            mapUnitToSliceGroupMap[i] = ((i % PicWidthInMbs) + (((i / PicWidthInMbs) * (num_slice_groups_minus1 + 1)) / 2)) % (num_slice_groups_minus1 + 1);
+        break;
+    case 2: // 8.2.2.3
+        for (i = 0; i < PicSizeInMapUnits; i++)
+            mapUnitToSliceGroupMap[i] = num_slice_groups_minus1;
+        for (iGroup = num_slice_groups_minus1 - 1; iGroup >= 0; iGroup--) {
+            gint yTopLeft = pps->top_left[iGroup] / PicWidthInMbs;
+            gint xTopLeft = pps->top_left[iGroup] % PicWidthInMbs;
+            gint yBottomRight = pps->bottom_right[iGroup] / PicWidthInMbs;
+            gint xBottomRight = pps->bottom_right[iGroup] % PicWidthInMbs;
+            for (y = yTopLeft; y <= yBottomRight; y++)
+                for (x = xTopLeft; x <= xBottomRight; x++)
+                    mapUnitToSliceGroupMap[y * PicWidthInMbs + x] = iGroup;
+        }
+        break;
+    case 3: { // 8.2.2.4
+        gint leftBound, topBound, rightBound, bottomBound, xDir, yDir, mapUnitVacant;
+
+        for (k = 0; k < PicSizeInMapUnits; k++)
+            mapUnitToSliceGroupMap[k] = 1;
+        x = (PicWidthInMbs - slice_group_change_direction_flag) / 2;
+        y = (PicHeightInMapUnits - slice_group_change_direction_flag) / 2;
+        leftBound = x, topBound = y;
+        rightBound = x, bottomBound = y;
+        xDir = slice_group_change_direction_flag - 1, yDir = slice_group_change_direction_flag;
+        for (k = 0; k < mapUnitsInSliceGroup0; k += mapUnitVacant) {
+            mapUnitVacant = (mapUnitToSliceGroupMap[y * PicWidthInMbs + x] == 1);
+            if (mapUnitVacant)
+                mapUnitToSliceGroupMap[y * PicWidthInMbs + x] = 0;
+            if (xDir == -1 && x == leftBound) {
+                leftBound = std::max(leftBound - 1, 0);
+                x = leftBound;
+                xDir = 0;
+                yDir = 2 * slice_group_change_direction_flag - 1;
+            } else if (xDir == 1 && x == rightBound) {
+                rightBound = std::min(rightBound + 1, PicWidthInMbs - 1);
+                x = rightBound;
+                xDir = 0;
+                yDir = 1 - 2 * slice_group_change_direction_flag;
+            } else if (yDir == -1 && y == topBound) {
+                topBound = std::max(topBound - 1, 0);
+                y = topBound;
+                xDir = 1 - 2 * slice_group_change_direction_flag;
+                yDir = 0;
+            } else if (yDir == 1 && y == bottomBound) {
+                bottomBound = std::min(bottomBound + 1, PicHeightInMapUnits - 1);
+                y = bottomBound;
+                xDir = 2 * slice_group_change_direction_flag - 1;
+                yDir = 0;
+            } else {
+                x = x + xDir, y = y + yDir;
+            }
+        }
+        break;
+    }
+    case 4: // 8.2.2.5
+        for (k = 0; k < PicSizeInMapUnits; k++)
+            if (k < sizeOfUpperLeftGroup)
+                mapUnitToSliceGroupMap[k] = slice_group_change_direction_flag;
+            else
+                mapUnitToSliceGroupMap[k] = 1 - slice_group_change_direction_flag;
+        break;
+    case 5: // 8.2.2.6
+        k = 0;
+        for (j = 0; j < PicWidthInMbs; j++)
+            for (i = 0; i < PicHeightInMapUnits; i++)
+                if (k++ < sizeOfUpperLeftGroup)
+                    mapUnitToSliceGroupMap[i * PicWidthInMbs + j] = slice_group_change_direction_flag;
+                else
+                    mapUnitToSliceGroupMap[i * PicWidthInMbs + j] = 1 - slice_group_change_direction_flag;
+        break;
+    case 6: // 8.2.2.7
+        for (i = 0; i < PicSizeInMapUnits; i++)
+            mapUnitToSliceGroupMap[i] = pps->slice_group_id[i];
+        break;
+    }
+
+    return mapUnitToSliceGroupMap;
+}
+
+struct Case {
+    GstH264SPS sps;
+    GstH264PPS pps;
+    std::vector<guint8> ids;
+};
+
+static int check(Case& c)
+{
+    const GstH264PPS* pps = &c.pps;
+    const guint size = (c.sps.pic_width_in_mbs_minus1 + 1) * (c.sps.pic_height_in_map_units_minus1 + 1);
+    const guint rate = pps->slice_group_change_rate_minus1 + 1;
+    // past the first cycle covering the whole picture, and then some
+    const guint lastCycle = (size + rate - 1) / rate + 2;
+    GstVkSliceGroupMaps* maps;
+    std::vector<guint> cycles;
+    int errors = 0;
+
+    c.pps.sequence = &c.sps;
+    if (!c.ids.empty())
+        c.pps.slice_group_id = c.ids.data();
+    maps = gst_vk_slice_group_maps_new(pps);
+
+    for (guint cycle = 0; cycle <= lastCycle; cycle++)
+        cycles.push_back(cycle);
+    for (guint cycle = lastCycle + 1; cycle-- > 0;)
+        cycles.push_back(cycle);
+    cycles.push_back(G_MAXUINT);
+
+    for (guint cycle : cycles) {
+        std::vector<guint8> expected = reference_map(pps, cycle);
+        GBytes* map = gst_vk_slice_group_maps_get(maps, cycle);
+        gsize len;
+        const guint8* data = static_cast<const guint8*>(g_bytes_get_data(map, &len));
+
+        if (len != expected.size() || memcmp(data, expected.data(), len) != 0) {
+            ERR("map type %u, %ux%u, direction %u, rate %u, cycle %u: wrong map",
+                pps->slice_group_map_type, c.sps.pic_width_in_mbs_minus1 + 1,
+                c.sps.pic_height_in_map_units_minus1 + 1,
+                pps->slice_group_change_direction_flag, rate, cycle);
+            errors++;
+            break;
+        }
+    }
+
+    gst_vk_slice_group_maps_free(maps);
+
+    return errors;
+}
+
+static Case make_case(guint width, guint height, guint8 mapType, guint numGroups)
+{
+    Case c = {};
+
+    c.sps.pic_width_in_mbs_minus1 = width - 1;
+    c.sps.pic_height_in_map_units_minus1 = height - 1;
+    c.pps.slice_group_map_type = mapType;
+    c.pps.num_slice_groups_minus1 = numGroups - 1;
+    c.pps.pic_size_in_map_units_minus1 = width * height - 1;
+
+    return c;
+}
+
+// sizes below the block of four map units, odd and even ones, and rows or
+// columns only, so the box out spiral hits every edge
+static const guint sizes[][2] = {
+    { 1, 1 }, { 1, 5 }, { 6, 1 }, { 2, 2 }, { 3, 3 }, { 4, 3 }, { 3, 4 },
+    { 5, 5 }, { 6, 6 }, { 7, 4 }, { 4, 7 }, { 11, 9 }, { 22, 18 },
+};
+
+int main(int argc, char** argv)
+{
+    int errors = 0, cases = 0;
+
+    for (const auto& size : sizes) {
+        guint width = size[0], height = size[1], units = width * height;
+
+        // the evolving types, with the rates of one unit, a few, and the
+        // whole picture at once
+        for (guint8 mapType = 3; mapType <= 5; mapType++) {
+            for (guint rate : { 1u, 2u, 3u, 7u, units }) {
+                for (guint direction = 0; direction <= 1; direction++) {
+                    Case c = make_case(width, height, mapType, 2);
+
+                    c.pps.slice_group_change_direction_flag = direction;
+                    c.pps.slice_group_change_rate_minus1 = std::min(rate, units) - 1;
+                    errors += check(c);
+                    cases++;
+                }
+            }
+        }
+
+        for (guint numGroups = 1; numGroups <= 8; numGroups++) {
+            // runs shorter and longer than the picture
+            Case interleaved = make_case(width, height, 0, numGroups);
+            for (guint g = 0; g < numGroups; g++)
+                interleaved.pps.run_length_minus1[g] = (g * 5 + 1) % (units + 2);
+            errors += check(interleaved);
+
+            Case dispersed = make_case(width, height, 1, numGroups);
+            errors += check(dispersed);
+
+            // nested and overlapping rectangles, up to the picture edges
+            Case foreground = make_case(width, height, 2, numGroups);
+            for (guint g = 0; g + 1 < numGroups; g++) {
+                guint left = g % width, top = g % height;
+                guint right = width - 1 - (g / 2) % (width - left);
+                guint bottom = height - 1 - (g / 3) % (height - top);
+
+                foreground.pps.top_left[g] = top * width + left;
+                foreground.pps.bottom_right[g] = bottom * width + right;
+            }
+            errors += check(foreground);
+
+            Case explicitIds = make_case(width, height, 6, numGroups);
+            for (guint i = 0; i < units; i++)
+                explicitIds.ids.push_back((i * 7 + i / width) % numGroups);
+            errors += check(explicitIds);
+
+            cases += 4;
+        }
+    }
+
+    // more cycles than the evolving maps kept at once
+    for (guint8 mapType = 3; mapType <= 5; mapType++) {
+        for (guint direction = 0; direction <= 1; direction++) {
+            Case c = make_case(120, 68, mapType, 2);
+
+            c.pps.slice_group_change_direction_flag = direction;
+            errors += check(c);
+            cases++;
+        }
+    }
+
+    if (errors > 0) {
+        ERR("%d of %d slice group maps wrong", errors, cases);
+        return EXIT_FAILURE;
+    }
+
+    INFO("%d slice group maps", cases);
+
+    return EXIT_SUCCESS;
+}
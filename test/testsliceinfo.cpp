@@ -0,0 +1,167 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Feeds an H.264 stream of I P B groups and checks the reference picture
+// lists DecodeSliceInfo() gives for each picture from DecodePicture(), and
+// that it fails anywhere else.
+
+#include "h264writer.h"
+#include "testclient.h"
+
+static const int numGops = 3;
+
+class SliceInfoClient : public TestClient {
+public:
+    void SetParser(VulkanVideoDecodeParser* parser) { m_parser = parser; }
+
+    // In decoding order, the pictures are I, P and B: the P one refers to
+    // the I one, the B one to both.
+    bool DecodePicture(VkParserPictureData* pd) final
+    {
+        const VkParserH264DpbEntry* dpb = pd->CodecSpecific.h264.dpb;
+        int n = m_decoded++ % 3;
+        VkParserSliceInfo info;
+
+        m_last = *pd;
+
+        if (!m_parser->DecodeSliceInfo(&info, pd, 0)) {
+            ERR("picture %d: no slice info", m_decoded);
+            m_errors++;
+            return true;
+        }
+
+        if (m_parser->DecodeSliceInfo(&info, pd, pd->nNumSlices)) {
+            ERR("picture %d: slice info past the last slice", m_decoded);
+            m_errors++;
+        }
+
+        m_pics[n] = pd->pCurrPic;
+
+        switch (n) {
+        case 0:
+            Check(info.slice_type == 2 && info.num_ref_idx_active[0] == 0
+                && info.num_ref_idx_active[1] == 0);
+            break;
+        case 1:
+            Check(info.slice_type == 0 && info.num_ref_idx_active[0] == 1
+                && info.num_ref_idx_active[1] == 0 && info.RefPicList[0][0] >= 0
+                && dpb[info.RefPicList[0][0]].pPicBuf == m_pics[0]);
+            break;
+        case 2:
+            Check(info.slice_type == 1 && info.num_ref_idx_active[0] == 1
+                && info.num_ref_idx_active[1] == 1 && info.RefPicList[0][0] >= 0
+                && info.RefPicList[1][0] >= 0
+                && dpb[info.RefPicList[0][0]].pPicBuf == m_pics[0]
+                && dpb[info.RefPicList[1][0]].pPicBuf == m_pics[1]);
+            break;
+        }
+
+        return true;
+    }
+
+    int decoded() const { return m_decoded; }
+    int errors() const { return m_errors; }
+    const VkParserPictureData* last() const { return &m_last; }
+
+private:
+    void Check(bool ok)
+    {
+        if (!ok) {
+            ERR("picture %d: unexpected reference picture lists", m_decoded);
+            m_errors++;
+        }
+    }
+
+    VulkanVideoDecodeParser* m_parser = nullptr;
+    VkPicIf* m_pics[3] = {};
+    VkParserPictureData m_last = {};
+    int m_decoded = 0;
+    int m_errors = 0;
+};
+
+static bool run(bool direct)
+{
+    // display order I B P
+    static const Frame gop[] = { { 0, 'I' }, { 2, 'P' }, { 1, 'B' } };
+    const char* mode = direct ? "direct" : "harness";
+    VulkanVideoDecodeParser* parser;
+    SliceInfoClient client;
+    VkParserInitDecodeParameters params = {
+        .bOutOfBandPictureParameters = true,
+        .bDirectDrive = direct,
+    };
+    VkParserSliceInfo info;
+    bool ret = true;
+
+    parser = create_h264_parser(&client, params);
+    if (!parser)
+        return false;
+
+    client.SetParser(parser);
+
+    for (int i = 0; i < numGops && ret; i++) {
+        for (size_t j = 0; j < G_N_ELEMENTS(gop); j++) {
+            std::vector<uint8_t> au;
+
+            if (i == 0 && j == 0) {
+                write_sps(au);
+                write_pps(au);
+            }
+            write_slice(gop[j], j, i % 2, au);
+
+            if (!parse_packet(parser, au.data(), au.size(), i == numGops - 1 && j == G_N_ELEMENTS(gop) - 1)) {
+                ERR("failed to parse bitstream.");
+                ret = false;
+                break;
+            }
+        }
+    }
+
+    if (client.decoded() > 0 && parser->DecodeSliceInfo(&info, client.last(), 0)) {
+        ERR("%s: slice info outside of DecodePicture()", mode);
+        ret = false;
+    }
+
+    destroy_parser(parser);
+
+    if (client.decoded() != numGops * static_cast<int>(G_N_ELEMENTS(gop))) {
+        ERR("%s: %d pictures decoded, expected %d", mode, client.decoded(),
+            numGops * static_cast<int>(G_N_ELEMENTS(gop)));
+        ret = false;
+    }
+
+    if (client.errors() > 0) {
+        ERR("%s: %d errors", mode, client.errors());
+        ret = false;
+    }
+
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    gboolean direct = FALSE;
+
+    GOptionEntry entries[] = {
+        { "direct", 'd', 0, G_OPTION_ARG_NONE, &direct, "Drive the decoder without a pipeline", NULL },
+        { NULL }
+    };
+
+    parse_options(&argc, &argv, "SLICE INFO TEST", entries);
+
+    return run(direct) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,149 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Parses a sample over and over with the same parser, as a stream looping,
+// and checks that after warming up with the first two times, the next ones
+// take every picture from the pool and assemble their slices in recycled
+// storage: nPicPoolMisses and nBitstreamAllocations don't grow while
+// nPicPoolHits does.
+
+#include <cstring>
+#include <vector>
+
+#include "testclient.h"
+
+// the first time, and the switch from the end of the sample back to its
+// beginning
+static const int warmUp = 2;
+static const int measured = 2;
+
+class StatsClient : public TestClient {
+public:
+    bool DecodePicture(VkParserPictureData*) final
+    {
+        m_decoded++;
+        return true;
+    }
+
+    size_t decoded() const { return m_decoded; }
+
+private:
+    size_t m_decoded = 0;
+};
+
+int main(int argc, char** argv)
+{
+    VkVideoCodecOperationFlagBitsKHR codec = VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_EXT;
+    gchar* codecName = NULL;
+    gboolean direct = FALSE;
+    StatsClient client;
+    VulkanVideoDecodeParser* parser;
+    VkParserStats warm = {}, stats = {};
+    size_t decodedWarm = 0;
+    bool ret = true;
+
+    GOptionEntry entries[] = {
+        { "codec", 'c', 0, G_OPTION_ARG_STRING, &codecName, "Codec of the sample, h264 or h265", NULL },
+        { "direct", 'd', 0, G_OPTION_ARG_NONE, &direct, "Drive the decoder without a pipeline", NULL },
+        { NULL }
+    };
+
+    parse_options(&argc, &argv, "FILE - STEADY STATE ALLOCATIONS TEST", entries);
+
+    if (codecName && strcmp(codecName, "h265") == 0)
+        codec = VK_VIDEO_CODEC_OPERATION_DECODE_H265_BIT_EXT;
+    g_free(codecName);
+
+    if (argc != 2) {
+        ERR("Please provide one filename.");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> stream = read_file(argv[1]);
+    if (stream.empty())
+        return EXIT_FAILURE;
+
+    VkParserInitDecodeParameters params = {
+        .bOutOfBandPictureParameters = true,
+        .bDirectDrive = static_cast<bool>(direct),
+    };
+
+    parser = create_parser(codec, &client, params);
+    if (!parser) {
+        ERR("failed to create the parser");
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < warmUp + measured && ret; i++) {
+        // in packets, as read from a file
+        for (size_t offset = 0; offset < stream.size(); offset += 4096) {
+            size_t size = std::min<size_t>(4096, stream.size() - offset);
+            bool eos = i == warmUp + measured - 1 && offset + size == stream.size();
+
+            if (!parse_packet(parser, stream.data() + offset, size, eos)) {
+                ERR("failed to parse bitstream.");
+                ret = false;
+                break;
+            }
+        }
+
+        if (i == warmUp - 1) {
+            if (!GetVulkanVideoDecodeParserStats(parser, &warm)) {
+                ERR("failed to get the parser stats");
+                ret = false;
+            }
+            decodedWarm = client.decoded();
+        }
+    }
+
+    if (ret && !GetVulkanVideoDecodeParserStats(parser, &stats)) {
+        ERR("failed to get the parser stats");
+        ret = false;
+    }
+
+    destroy_parser(parser);
+
+    if (!ret)
+        return EXIT_FAILURE;
+
+    if (client.decoded() <= decodedWarm) {
+        ERR("no picture decoded after warming up");
+        ret = false;
+    }
+
+    if (stats.nPicPoolMisses != warm.nPicPoolMisses) {
+        ERR("%" G_GUINT64_FORMAT " pictures allocated after warming up", stats.nPicPoolMisses - warm.nPicPoolMisses);
+        ret = false;
+    }
+
+    if (stats.nBitstreamAllocations != warm.nBitstreamAllocations) {
+        ERR("%" G_GUINT64_FORMAT " bitstream allocations after warming up",
+            stats.nBitstreamAllocations - warm.nBitstreamAllocations);
+        ret = false;
+    }
+
+    if (stats.nPicPoolHits <= warm.nPicPoolHits) {
+        ERR("no picture reused from the pool after warming up");
+        ret = false;
+    }
+
+    if (ret)
+        INFO("%zu pictures decoded after warming up, %" G_GUINT64_FORMAT " reused from the pool, no allocation",
+            client.decoded() - decodedWarm, stats.nPicPoolHits - warm.nPicPoolHits);
+
+    return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,290 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Parses a sample writing the slices into client memory, handed out barely
+// big enough so it has to grow, and moved when it does, and checks every
+// buffer got is released once, for the picture it was got for: after
+// decoding, when DecodePicture() fails, when the storage itself fails,
+// when discarding with a flush halfway and when destroying the parser
+// halfway. Also that DecodePicture() gets the slices in the buffer of its
+// picture, the same ones it gets without client storage.
+
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "testclient.h"
+
+enum Scenario {
+    DECODE,
+    FAIL_DECODE,
+    FAIL_STORAGE,
+    FLUSH,
+    TEARDOWN,
+};
+
+static const char* scenarioNames[] = { "decode", "failing decode", "failing storage", "flush", "teardown" };
+
+class StorageClient : public TestClient, public VkParserBitstreamStorage {
+public:
+    StorageClient(bool storage, Scenario scenario)
+        : m_storage(storage)
+        , m_scenario(scenario)
+    {
+    }
+
+    ~StorageClient()
+    {
+        for (auto& held : m_held)
+            g_free(held.first);
+    }
+
+    bool DecodePicture(VkParserPictureData* pic) final
+    {
+        size_t index = m_pictures.size();
+        uint32_t size = pic->pSliceDataOffsets[pic->nNumSlices];
+
+        if (m_storage) {
+            auto it = m_held.find(pic->pBitstreamData);
+
+            if (it == m_held.end()) {
+                ERR("picture %zu: bitstream data not in client storage", index);
+                m_errors++;
+                return false;
+            }
+            if (it->second.pic != pic->pCurrPic) {
+                ERR("picture %zu: bitstream data in storage of another picture", index);
+                m_errors++;
+            }
+            if (size > it->second.size) {
+                ERR("picture %zu: %u bytes of slices in %zu of storage", index, size, it->second.size);
+                m_errors++;
+                return false;
+            }
+        }
+
+        m_pictures.emplace_back(pic->pBitstreamData, pic->pBitstreamData + size);
+
+        return !(m_scenario == FAIL_DECODE && index % 3 == 1);
+    }
+
+    uint8_t* GetBitstreamBuffer(VkPicIf* pic, uint8_t* buffer, size_t usedSize, size_t minSize, size_t* size) final
+    {
+        uint8_t* data;
+
+        if (buffer) {
+            auto it = m_held.find(buffer);
+
+            if (it == m_held.end() || it->second.pic != pic) {
+                ERR("growing a buffer not got for the picture");
+                m_errors++;
+                return nullptr;
+            }
+            if (usedSize > it->second.size) {
+                ERR("%zu bytes used of a buffer of %zu", usedSize, it->second.size);
+                m_errors++;
+                return nullptr;
+            }
+        } else if (m_scenario == FAIL_STORAGE && m_got++ % 4 == 2) {
+            return nullptr;
+        }
+
+        // moved, for the parser not to keep using the old one
+        *size = minSize + 16;
+        data = static_cast<uint8_t*>(g_malloc(*size));
+
+        if (buffer) {
+            memcpy(data, buffer, usedSize);
+            memset(buffer, 0xa5, m_held[buffer].size);
+            g_free(buffer);
+            m_held.erase(buffer);
+        }
+
+        m_held[data] = { pic, *size };
+
+        return data;
+    }
+
+    void ReleaseBitstreamBuffer(VkPicIf* pic, uint8_t* buffer) final
+    {
+        auto it = m_held.find(buffer);
+
+        if (it == m_held.end()) {
+            ERR("released a buffer not held");
+            m_errors++;
+            return;
+        }
+        if (it->second.pic != pic) {
+            ERR("released a buffer for another picture");
+            m_errors++;
+        }
+
+        memset(buffer, 0xa5, it->second.size);
+        g_free(buffer);
+        m_held.erase(it);
+        m_released++;
+    }
+
+    size_t held() const { return m_held.size(); }
+    int released() const { return m_released; }
+    int errors() const { return m_errors; }
+    const std::vector<std::vector<uint8_t>>& pictures() const { return m_pictures; }
+
+private:
+    struct Held {
+        VkPicIf* pic;
+        size_t size;
+    };
+
+    bool m_storage;
+    Scenario m_scenario;
+    std::map<uint8_t*, Held> m_held;
+    int m_got = 0;
+    int m_released = 0;
+    int m_errors = 0;
+    std::vector<std::vector<uint8_t>> m_pictures;
+};
+
+// Parses stream in packets of 64 bytes as scenario goes, and returns the
+// slices of every picture decoded, or fills pictures with those of every
+// picture of the whole stream, without storage, if they are empty.
+static bool run(VkVideoCodecOperationFlagBitsKHR codec, const std::vector<uint8_t>& stream, bool direct,
+    Scenario scenario, std::vector<std::vector<uint8_t>>& pictures)
+{
+    bool storage = !pictures.empty();
+    const char* name = storage ? scenarioNames[scenario] : "no storage";
+    StorageClient client(storage, scenario);
+    VulkanVideoDecodeParser* parser;
+    VkParserInitDecodeParameters params = {
+        .bOutOfBandPictureParameters = true,
+        .bDirectDrive = direct,
+        .pBitstreamStorage = storage ? &client : nullptr,
+    };
+    size_t end = stream.size();
+    bool ret = true;
+
+    if (scenario == FLUSH || scenario == TEARDOWN)
+        end /= 2;
+
+    parser = create_parser(codec, &client, params);
+    if (!parser) {
+        ERR("%s: failed to create the parser", name);
+        return false;
+    }
+
+    for (size_t offset = 0; offset < end; offset += 64) {
+        size_t size = std::min<size_t>(64, end - offset);
+
+        // the failures might or might not fail parsing
+        if (!parse_packet(parser, stream.data() + offset, size, offset + size == stream.size())
+            && (scenario == DECODE || scenario == FLUSH || scenario == TEARDOWN)) {
+            ERR("%s: failed to parse bitstream.", name);
+            ret = false;
+            break;
+        }
+    }
+
+    if (scenario == FLUSH) {
+        if (!FlushVulkanVideoDecodeParser(parser, true)) {
+            ERR("%s: failed to flush", name);
+            ret = false;
+        }
+        if (client.held() > 0) {
+            ERR("%s: %zu buffers held after flushing", name, client.held());
+            ret = false;
+        }
+    }
+
+    destroy_parser(parser);
+
+    if (client.held() > 0) {
+        ERR("%s: %zu buffers held after destroying the parser", name, client.held());
+        ret = false;
+    }
+
+    if (client.errors() > 0)
+        ret = false;
+
+    if (!storage) {
+        pictures = client.pictures();
+        return ret && !pictures.empty();
+    }
+
+    if (client.pictures().empty() || client.released() == 0) {
+        ERR("%s: no picture decoded into client storage", name);
+        ret = false;
+    }
+
+    if (scenario == DECODE && client.pictures().size() != pictures.size()) {
+        ERR("%s: %zu pictures decoded, %zu without storage", name, client.pictures().size(), pictures.size());
+        ret = false;
+    }
+
+    // the same pictures up to the first failure, if any
+    size_t compared = scenario == FAIL_DECODE ? 2 : scenario == FAIL_STORAGE ? 0 : client.pictures().size();
+
+    for (size_t i = 0; i < compared && i < client.pictures().size() && i < pictures.size(); i++) {
+        if (client.pictures()[i] != pictures[i]) {
+            ERR("%s: the slices of picture %zu differ from those without storage", name, i);
+            ret = false;
+            break;
+        }
+    }
+
+    if (ret)
+        INFO("%s: %zu pictures decoded, %d buffers released", name, client.pictures().size(), client.released());
+
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    VkVideoCodecOperationFlagBitsKHR codec = VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_EXT;
+    gchar* codecName = NULL;
+    gboolean direct = FALSE;
+    std::vector<std::vector<uint8_t>> pictures;
+    bool ret = true;
+
+    GOptionEntry entries[] = {
+        { "codec", 'c', 0, G_OPTION_ARG_STRING, &codecName, "Codec of the sample, h264 or h265", NULL },
+        { "direct", 'd', 0, G_OPTION_ARG_NONE, &direct, "Drive the decoder without a pipeline", NULL },
+        { NULL }
+    };
+
+    parse_options(&argc, &argv, "FILE - BITSTREAM STORAGE TEST", entries);
+
+    if (codecName && strcmp(codecName, "h265") == 0)
+        codec = VK_VIDEO_CODEC_OPERATION_DECODE_H265_BIT_EXT;
+    g_free(codecName);
+
+    if (argc != 2) {
+        ERR("Please provide one filename.");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> stream = read_file(argv[1]);
+    if (stream.empty())
+        return EXIT_FAILURE;
+
+    if (!run(codec, stream, direct, DECODE, pictures))
+        return EXIT_FAILURE;
+
+    for (Scenario scenario : { DECODE, FAIL_DECODE, FAIL_STORAGE, FLUSH, TEARDOWN })
+        ret &= run(codec, stream, direct, scenario, pictures);
+
+    return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
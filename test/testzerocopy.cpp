@@ -0,0 +1,198 @@
+/* VideoParser
+ * Copyright (C) 2022 Igalia, S.L.
+ *     Author: Víctor Jáquez <vjaquez@igalia.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you
+ * may not use this file except in compliance with the License.  You
+ * may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.  See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Parses a sample with and without bZeroCopyByteStream, in packets of
+// varying sizes which are poisoned and freed as soon as ParseByteStream()
+// returns, and checks both dumps of the callbacks are the same: whatever the
+// parser keeps from a packet has to be copied out before returning.
+
+#include <cstring>
+#include <string>
+
+#include "dump.h"
+#include "testclient.h"
+
+// cycled through, so access units and NAL units straddle packets
+static const size_t packetSizes[] = { 1, 2, 5, 17, 188, 1024 };
+
+// Dumps every callback to a file.
+class DumpClient : public TestClient {
+public:
+    DumpClient(VkVideoCodecOperationFlagBitsKHR codec, FILE* file)
+        : m_codec(codec)
+        , m_file(file)
+    {
+    }
+
+    int32_t BeginSequence(const VkParserSequenceInfo* info) final
+    {
+        fprintf(m_file, "BeginSequence\n");
+        dump_parser_sequence_info(info);
+        return TestClient::BeginSequence(info);
+    }
+
+    bool DecodePicture(VkParserPictureData* pic) final
+    {
+        fprintf(m_file, "DecodePicture %td\n", Index(pic->pCurrPic));
+        dump_parser_picture_data(m_codec, pic);
+        return true;
+    }
+
+    bool UpdatePictureParameters(VkPictureParameters* params, VkSharedBaseObj<VkParserVideoRefCountBase>& shared,
+        uint64_t count) final
+    {
+        fprintf(m_file, "UpdatePictureParameters\n");
+        dump_picture_parameters(params);
+        return TestClient::UpdatePictureParameters(params, shared, count);
+    }
+
+    bool DisplayPicture(VkPicIf* pic, int64_t timestamp) final
+    {
+        fprintf(m_file, "DisplayPicture %td %" G_GINT64_FORMAT "\n", Index(pic), timestamp);
+        return true;
+    }
+
+private:
+    VkVideoCodecOperationFlagBitsKHR m_codec;
+    FILE* m_file;
+};
+
+// The dump of parsing stream, empty on failure.
+static std::string parse(VkVideoCodecOperationFlagBitsKHR codec, const std::vector<uint8_t>& stream, bool direct,
+    bool zeroCopy)
+{
+    const char* mode = zeroCopy ? "zero-copy" : "copy";
+    FILE* file = tmpfile();
+    VulkanVideoDecodeParser* parser;
+    VkParserInitDecodeParameters params = {
+        .bOutOfBandPictureParameters = true,
+        .bZeroCopyByteStream = zeroCopy,
+        .bDirectDrive = direct,
+    };
+    std::string dump;
+    bool ret = true;
+
+    if (!file) {
+        ERR("Unable to create a temporary file.");
+        return {};
+    }
+
+    DumpClient client(codec, file);
+
+    dump_set_output(file);
+
+    parser = create_parser(codec, &client, params);
+    if (!parser) {
+        ERR("%s: failed to create the parser", mode);
+        ret = false;
+    }
+
+    for (size_t offset = 0, i = 0; ret && offset < stream.size(); i++) {
+        size_t size = std::min(packetSizes[i % G_N_ELEMENTS(packetSizes)], stream.size() - offset);
+        uint8_t* packet = new uint8_t[size];
+
+        memcpy(packet, stream.data() + offset, size);
+        offset += size;
+
+        if (!parse_packet(parser, packet, size, offset == stream.size())) {
+            ERR("%s: failed to parse bitstream.", mode);
+            ret = false;
+        }
+
+        // nothing may read it from now on
+        memset(packet, 0xa5, size);
+        delete[] packet;
+    }
+
+    if (parser)
+        destroy_parser(parser);
+
+    dump_set_output(NULL);
+
+    if (ret) {
+        long size;
+
+        fflush(file);
+        size = ftell(file);
+        dump.resize(size);
+        rewind(file);
+        if (size <= 0 || fread(&dump[0], 1, size, file) != static_cast<size_t>(size)) {
+            ERR("%s: failed to read the dump back", mode);
+            dump.clear();
+        }
+    }
+
+    fclose(file);
+
+    return dump;
+}
+
+// 1-based number of the first line where a and b differ
+static size_t first_difference(const std::string& a, const std::string& b)
+{
+    size_t line = 1;
+
+    for (size_t i = 0; i < a.size() && i < b.size() && a[i] == b[i]; i++) {
+        if (a[i] == '\n')
+            line++;
+    }
+
+    return line;
+}
+
+int main(int argc, char** argv)
+{
+    VkVideoCodecOperationFlagBitsKHR codec = VK_VIDEO_CODEC_OPERATION_DECODE_H264_BIT_EXT;
+    gchar* codecName = NULL;
+    gboolean direct = FALSE;
+
+    GOptionEntry entries[] = {
+        { "codec", 'c', 0, G_OPTION_ARG_STRING, &codecName, "Codec of the sample, h264 or h265", NULL },
+        { "direct", 'd', 0, G_OPTION_ARG_NONE, &direct, "Drive the decoder without a pipeline", NULL },
+        { NULL }
+    };
+
+    parse_options(&argc, &argv, "FILE - ZERO-COPY TEST", entries);
+
+    if (codecName && strcmp(codecName, "h265") == 0)
+        codec = VK_VIDEO_CODEC_OPERATION_DECODE_H265_BIT_EXT;
+    g_free(codecName);
+
+    if (argc != 2) {
+        ERR("Please provide one filename.");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> stream = read_file(argv[1]);
+    if (stream.empty())
+        return EXIT_FAILURE;
+
+    std::string copied = parse(codec, stream, direct, false);
+    std::string borrowed = parse(codec, stream, direct, true);
+
+    if (copied.empty() || borrowed.empty())
+        return EXIT_FAILURE;
+
+    if (copied != borrowed) {
+        ERR("the dumps differ from line %zu on", first_difference(copied, borrowed));
+        return EXIT_FAILURE;
+    }
+
+    INFO("%zu bytes of dump match", copied.size());
+
+    return EXIT_SUCCESS;
+}